@@ -0,0 +1,177 @@
+/* -------------------------------------------------------------------------
+ * allocCount.c
+ * Counts calls of malloc, calloc and realloc through the wrappers
+ * created by the GNU linker option --wrap.
+ * -------------------------------------------------------------------------*/
+
+#include <stddef.h>
+#include "allocCount.h"
+
+#ifdef COUNT_ALLOCATIONS
+
+static long count = 0;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* p, size_t size);
+
+void* __wrap_malloc(size_t size) {
+    __sync_fetch_and_add(&count, 1);
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t n, size_t size) {
+    __sync_fetch_and_add(&count, 1);
+    return __real_calloc(n, size);
+}
+
+void* __wrap_realloc(void* p, size_t size) {
+    __sync_fetch_and_add(&count, 1);
+    return __real_realloc(p, size);
+}
+
+long allocationCount(void) {
+    return __sync_fetch_and_add(&count, 0);
+}
+
+#else
+
+long allocationCount(void) {
+    return -1;
+}
+
+#endif // COUNT_ALLOCATIONS
+
+// #define TEST
+#ifdef TEST
+#include <stdio.h>
+#include <stdlib.h>
+#include "arena.h"
+#include "balance.h"
+#include "replay.h"
+#include "windowStats.h"
+
+// Build, with the sources of the modules below and those of recorder.c:
+//     cc -DTEST -DCOUNT_ALLOCATIONS allocCount.c ... -lexpat -lpthread -lm
+//        -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc
+// Every step of the replay target, y = 0.9 y + u, and, if leak is set,
+// one allocation per step that the replay must detect
+typedef struct {
+    double y;
+    double u;
+    int leak;
+    void* leaked;
+} Home;
+
+static int setHomeInput(void* instance, const fmiValueReference* vrs, int n, const double* values) {
+    (void)vrs;
+    if (n != 1) return 0; // error
+    ((Home*)instance)->u = values[0];
+    return 1; // success
+}
+
+static int stepHome(void* instance, double time, double stepSize) {
+    Home* h = (Home*)instance;
+    (void)time;
+    (void)stepSize;
+    h->y = 0.9 * h->y + h->u;
+    if (h->leak) {
+        free(h->leaked);
+        h->leaked = malloc(16);
+    }
+    return 1; // success
+}
+
+static int getHomeOutput(void* instance, const fmiValueReference* vrs, int n, double* values) {
+    (void)vrs;
+    if (n != 1) return 0; // error
+    values[0] = ((Home*)instance)->y;
+    return 1; // success
+}
+
+// allocCount [<homes> [<steps>]]: run the steady-state steps of balance,
+// windowStats, arena and replay for the given homes, and fail if any of
+// them allocates memory after the first step
+int main(int argc, char** argv) {
+    int nHomes = argc > 1 ? atoi(argv[1]) : 1000;
+    int nSteps = argc > 2 ? atoi(argv[2]) : 100;
+    char* names[2] = { "u", "y" };
+    Balancer* b = newBalancer(nHomes, 8, 0.1);
+    WindowStats* w = newWindowStats(nHomes, 96);
+    Arena* arena = newArena(4 * nHomes * sizeof(double) + 64);
+    double* costs = (double*)malloc(nHomes * sizeof(double));
+    Recording* r = newRecordingWithColumns(NULL, names, 2);
+    Home home = { 0, 0, 0, NULL };
+    ReplayTarget target;
+    ReplayResult result;
+    long before = 0, steps, replay, leaky;
+    int i, k, ok;
+
+    if (allocationCount() < 0) {
+        printf("allocations are not counted, build with COUNT_ALLOCATIONS and --wrap\n");
+        return 1;
+    }
+    if (!b || !w || !arena || !costs || !r) return 1;
+
+    // steady-state steps: step cost of each home, rebalance, window
+    // statistics and per-step scratch space from the arena
+    for (k=0; k<nSteps; k++) {
+        double* message;
+        if (k == 1) before = allocationCount();
+        for (i=0; i<nHomes; i++) {
+            costs[i] = 1e-4 * (1 + (i * 7919 + k * 104729) % 13);
+            balancerRecord(b, i, costs[i]);
+        }
+        rebalance(b, 0.05);
+        balancerImbalance(b);
+        addWindowStep(w, costs);
+        arenaReset(arena);
+        message = (double*)arenaAlloc(arena, nHomes * sizeof(double));
+        if (!message) return 1;
+        for (i=0; i<nHomes; i++) message[i] = windowMean(w, i);
+    }
+    steps = allocationCount() - before;
+    printf("%d homes, %d steps: %ld allocations after the first step, imbalance %.3f\n",
+           nHomes, nSteps, steps, b->imbalanceAfter);
+
+    // replay: u is an input, y an output
+    r->causality[0] = enu_input;
+    r->causality[1] = enu_output;
+    r->vrs[0] = 0;
+    r->vrs[1] = 1;
+    reserveRecording(r, nSteps);
+    for (k=0; k<nSteps; k++) {
+        double row[2];
+        row[0] = k % 10;
+        row[1] = 0.9 * home.y + row[0];
+        home.y = row[1];
+        recordStep(r, 60.0 * k, row);
+    }
+    target.instance = &home;
+    target.setReal = setHomeInput;
+    target.doStep = stepHome;
+    target.getReal = getHomeOutput;
+    target.forkSafe = 1;
+    home.y = 0;
+    ok = replayRecording(r, &target, 1e-12, NULL, &result);
+    replay = result.nAllocations;
+    printf("replay: %s, %ld allocations after the first step\n", ok ? "ok" : "failed", replay);
+
+    // a target that allocates in each step must fail the replay
+    home.y = 0;
+    home.leak = 1;
+    ok = ok && !replayRecording(r, &target, 1e-12, NULL, &result);
+    leaky = result.nAllocations;
+    printf("allocating target: %ld allocations detected\n", leaky);
+
+    free(home.leaked);
+    freeRecording(r);
+    free(costs);
+    freeArena(arena);
+    freeWindowStats(w);
+    freeBalancer(b);
+    ok = ok && steps == 0 && replay == 0 && leaky == nSteps - 1;
+    printf("%s\n", ok ? "no allocations in steady-state steps" : "FAILED");
+    return !ok;
+}
+#endif // TEST
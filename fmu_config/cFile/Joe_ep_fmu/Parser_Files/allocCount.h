@@ -0,0 +1,26 @@
+/* -------------------------------------------------------------------------
+ * allocCount.h
+ * Counts calls of malloc, calloc and realloc, to check that steady-state
+ * timesteps do not allocate memory. Counting needs the GNU linker: compile
+ * with COUNT_ALLOCATIONS defined and link with
+ *     -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc
+ * Otherwise, allocationCount returns -1.
+ * Only calls from our code are counted, not those inside the C library,
+ * e.g. qsort, so steady-state code avoids such functions.
+ * The TEST main of allocCount.c checks the steady-state steps of
+ * balance, windowStats, arena and replay.
+ * -------------------------------------------------------------------------*/
+
+#ifndef ALLOC_COUNT_H
+#define ALLOC_COUNT_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Number of allocations since program start, or -1 if not counted
+long allocationCount(void);
+
+#ifdef __cplusplus
+} // closing brace for extern "C"
+#endif
+#endif // ALLOC_COUNT_H
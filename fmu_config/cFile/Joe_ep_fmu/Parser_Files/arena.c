@@ -0,0 +1,44 @@
+/* -------------------------------------------------------------------------
+ * arena.c
+ * Fixed-capacity memory arena.
+ * -------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include "arena.h"
+
+#define ARENA_ALIGNMENT 16
+
+Arena* newArena(size_t capacity) {
+    Arena* a = (Arena*)calloc(1, sizeof(Arena));
+    if (!a) return NULL;
+    a->memory = (char*)malloc(capacity > 0 ? capacity : 1);
+    if (!a->memory) {
+        free(a);
+        return NULL;
+    }
+    a->capacity = capacity;
+    return a;
+}
+
+void freeArena(Arena* a) {
+    if (!a) return;
+    free(a->memory);
+    free(a);
+}
+
+void* arenaAlloc(Arena* a, size_t size) {
+    // align the address, malloc aligns to 8 only on 32-bit Windows
+    size_t address = (size_t)(a->memory + a->used);
+    size_t start = a->used + ((ARENA_ALIGNMENT - address % ARENA_ALIGNMENT) % ARENA_ALIGNMENT);
+    if (start > a->capacity || size > a->capacity - start) {
+        a->nFailed++;
+        return NULL;
+    }
+    a->used = start + size;
+    if (a->used > a->highWater) a->highWater = a->used;
+    return a->memory + start;
+}
+
+void arenaReset(Arena* a) {
+    a->used = 0;
+}
@@ -0,0 +1,39 @@
+/* -------------------------------------------------------------------------
+ * arena.h
+ * Fixed-capacity memory arena. All memory is allocated once; arenaAlloc
+ * hands out pieces of it and arenaReset returns all pieces at once, e.g.
+ * at the end of each timestep. The arena never grows, so steps that use
+ * it do not call malloc.
+ * -------------------------------------------------------------------------*/
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    char* memory;
+    size_t capacity;      // bytes
+    size_t used;          // bytes handed out since the last reset
+    size_t highWater;     // largest value of used so far
+    int nFailed;          // calls of arenaAlloc that found the arena full
+} Arena;
+
+// Returns NULL if no memory is available
+Arena* newArena(size_t capacity);
+void freeArena(Arena* a);
+
+// Returns size bytes aligned to 16, or NULL if the arena is full
+void* arenaAlloc(Arena* a, size_t size);
+
+// Release all memory handed out by arenaAlloc
+void arenaReset(Arena* a);
+
+#ifdef __cplusplus
+} // closing brace for extern "C"
+#endif
+#endif // ARENA_H
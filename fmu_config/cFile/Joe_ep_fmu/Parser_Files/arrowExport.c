@@ -0,0 +1,541 @@
+/* -------------------------------------------------------------------------
+ * arrowExport.c
+ * Writes recordings as Arrow IPC files. The flatbuffers of the Arrow
+ * format (Schema.fbs, Message.fbs, File.fbs) are built by hand, since
+ * only a few tables are needed: the buffer is written front to back,
+ * each table followed by the strings, vectors and tables it refers to.
+ * Flatbuffers are little endian, so the export fails on big endian hosts.
+ * -------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef STANDALONE_XML_PARSER
+#define logThis(n, ...) printf(__VA_ARGS__);printf("\n")
+#else
+#include "GlobalIncludes.h"
+#include "logging.h" // logThis
+#endif // STANDALONE_XML_PARSER
+
+#include "arrowExport.h"
+
+// Constants of the Arrow format
+#define ARROW_MAGIC "ARROW1"
+#define METADATA_V5 4          // MetadataVersion
+#define HEADER_SCHEMA 1        // MessageHeader
+#define HEADER_RECORD_BATCH 3
+#define TYPE_FLOATING_POINT 3  // Type
+#define PRECISION_DOUBLE 2     // Precision
+#define BODY_ALIGNMENT 64      // alignment of buffers in a record batch body
+
+typedef long long int64;
+
+// -------------------------------------------------------------------------
+// Flatbuffer builder
+
+typedef struct {
+    unsigned char* data;
+    size_t size;
+    size_t capacity;
+    int failed;                // 1 if out of memory
+} FlatBuilder;
+
+#define FB_MAX_FIELDS 8
+
+typedef struct {
+    FlatBuilder* b;
+    int nFields;
+    unsigned short offsets[FB_MAX_FIELDS]; // offset of each field in the table, 0 if absent
+    unsigned char content[64];             // the table, starting with the offset to its vtable
+    int size;
+} FlatTable;
+
+// Returns the position of n zero bytes appended to the buffer
+static size_t fbReserve(FlatBuilder* b, size_t n) {
+    size_t position = b->size;
+    if (b->failed) return 0;
+    if (b->size + n > b->capacity) {
+        size_t capacity = b->capacity ? 2 * b->capacity : 1024;
+        unsigned char* data;
+        while (capacity < b->size + n) capacity *= 2;
+        data = (unsigned char*)realloc(b->data, capacity);
+        if (!data) {
+            b->failed = 1;
+            return 0;
+        }
+        b->data = data;
+        b->capacity = capacity;
+    }
+    memset(b->data + position, 0, n);
+    b->size += n;
+    return position;
+}
+
+static void fbPutAt(FlatBuilder* b, size_t position, const void* value, size_t n) {
+    if (!b->failed) memcpy(b->data + position, value, n);
+}
+
+static void fbAlign(FlatBuilder* b, int alignment) {
+    fbReserve(b, (alignment - b->size % alignment) % alignment);
+}
+
+// Set the offset at position to refer to target, which must follow it
+static void fbPatch(FlatBuilder* b, size_t position, size_t target) {
+    unsigned offset = (unsigned)(target - position);
+    fbPutAt(b, position, &offset, 4);
+}
+
+// Start a new buffer with a reference to the root table
+static void fbBegin(FlatBuilder* b) {
+    b->size = 0;
+    b->failed = 0;
+    fbReserve(b, 4);
+}
+
+static void fbBeginTable(FlatTable* t, FlatBuilder* b) {
+    memset(t, 0, sizeof(FlatTable));
+    t->b = b;
+    t->size = 4;
+}
+
+// Returns the offset of the field in the table
+static int fbField(FlatTable* t, int field, const void* value, int size) {
+    t->size = (t->size + size - 1) / size * size;
+    memcpy(t->content + t->size, value, size);
+    t->offsets[field] = (unsigned short)t->size;
+    if (field >= t->nFields) t->nFields = field + 1;
+    t->size += size;
+    return t->offsets[field];
+}
+
+// A field that refers to a string, vector or table written later,
+// see fbPatch. Returns the offset of the field in the table.
+static int fbRefField(FlatTable* t, int field) {
+    unsigned zero = 0;
+    return fbField(t, field, &zero, 4);
+}
+
+// Write the vtable and the table. Returns the position of the table.
+static size_t fbEndTable(FlatTable* t) {
+    FlatBuilder* b = t->b;
+    unsigned short header[2];
+    size_t vtable, table;
+    int toVtable;
+    t->size = (t->size + 3) / 4 * 4;
+    header[0] = (unsigned short)(4 + 2 * t->nFields);
+    header[1] = (unsigned short)t->size;
+    fbAlign(b, 2);
+    vtable = fbReserve(b, header[0]);
+    fbPutAt(b, vtable, header, 4);
+    fbPutAt(b, vtable + 4, t->offsets, 2 * t->nFields);
+    fbAlign(b, 8);
+    table = fbReserve(b, t->size);
+    toVtable = (int)(table - vtable);
+    memcpy(t->content, &toVtable, 4);
+    fbPutAt(b, table, t->content, t->size);
+    return table;
+}
+
+// Returns the position of a vector of count elements. The elements
+// start 4 bytes later, aligned to alignment.
+static size_t fbVector(FlatBuilder* b, int count, int elementSize, int alignment) {
+    size_t position;
+    unsigned n = count;
+    if (alignment < 4) alignment = 4;
+    fbReserve(b, (alignment - (b->size + 4) % alignment) % alignment);
+    position = fbReserve(b, 4 + (size_t)count * elementSize);
+    fbPutAt(b, position, &n, 4);
+    return position;
+}
+
+// Returns the position of the string
+static size_t fbString(FlatBuilder* b, const char* s) {
+    unsigned n = strlen(s);
+    size_t position = fbVector(b, n + 1, 1, 4); // with 0 terminator
+    fbPutAt(b, position, &n, 4);
+    fbPutAt(b, position + 4, s, n);
+    return position;
+}
+
+// -------------------------------------------------------------------------
+// Arrow metadata
+
+typedef struct {
+    char* name;
+    const char* unit;          // NULL if unknown
+    const char* causality;     // NULL for time
+    int valueReference;        // -1 for time
+    Recording* recording;      // NULL for time
+    int column;
+} ArrowColumn;
+
+// Returns the position of a KeyValue table
+static size_t writeKeyValue(FlatBuilder* b, const char* key, const char* value) {
+    FlatTable t;
+    int keyRef, valueRef;
+    size_t table;
+    fbBeginTable(&t, b);
+    keyRef = fbRefField(&t, 0);
+    valueRef = fbRefField(&t, 1);
+    table = fbEndTable(&t);
+    fbPatch(b, table + keyRef, fbString(b, key));
+    fbPatch(b, table + valueRef, fbString(b, value));
+    return table;
+}
+
+// Returns the position of a Field table of type float64
+static size_t writeField(FlatBuilder* b, ArrowColumn* c) {
+    FlatTable t;
+    const char* keys[3];
+    const char* values[3];
+    char vr[16];
+    unsigned char typeType = TYPE_FLOATING_POINT;
+    short precision = PRECISION_DOUBLE;
+    int nameRef, typeRef, childrenRef, metadataRef;
+    int i, n = 0;
+    size_t table, vector;
+    if (c->unit) {
+        keys[n] = "unit";
+        values[n++] = c->unit;
+    }
+    if (c->causality) {
+        keys[n] = "causality";
+        values[n++] = c->causality;
+    }
+    if (c->valueReference >= 0) {
+        sprintf(vr, "%d", c->valueReference);
+        keys[n] = "valueReference";
+        values[n++] = vr;
+    }
+    fbBeginTable(&t, b);
+    nameRef = fbRefField(&t, 0);
+    fbField(&t, 2, &typeType, 1);
+    typeRef = fbRefField(&t, 3);
+    childrenRef = fbRefField(&t, 5);
+    metadataRef = fbRefField(&t, 6);
+    table = fbEndTable(&t);
+    fbPatch(b, table + nameRef, fbString(b, c->name));
+    fbBeginTable(&t, b);
+    fbField(&t, 0, &precision, 2);
+    fbPatch(b, table + typeRef, fbEndTable(&t));
+    fbPatch(b, table + childrenRef, fbVector(b, 0, 4, 4));
+    vector = fbVector(b, n, 4, 4);
+    fbPatch(b, table + metadataRef, vector);
+    for (i=0; i<n; i++)
+        fbPatch(b, vector + 4 + 4 * i, writeKeyValue(b, keys[i], values[i]));
+    return table;
+}
+
+// Returns the position of a Schema table
+static size_t writeSchema(FlatBuilder* b, ArrowColumn* columns, int n) {
+    FlatTable t;
+    int fieldsRef, i;
+    size_t table, vector;
+    fbBeginTable(&t, b);
+    fieldsRef = fbRefField(&t, 1); // endianness 0 is little endian, the default
+    table = fbEndTable(&t);
+    vector = fbVector(b, n, 4, 4);
+    fbPatch(b, table + fieldsRef, vector);
+    for (i=0; i<n; i++)
+        fbPatch(b, vector + 4 + 4 * i, writeField(b, &columns[i]));
+    return table;
+}
+
+// Returns the position of a Message table. Its header is written next
+// and patched by the caller at the returned *headerRef.
+static size_t writeMessage(FlatBuilder* b, unsigned char headerType, int64 bodyLength, size_t* headerRef) {
+    FlatTable t;
+    short version = METADATA_V5;
+    int ref;
+    size_t table;
+    fbBeginTable(&t, b);
+    fbField(&t, 3, &bodyLength, 8);
+    fbField(&t, 0, &version, 2);
+    fbField(&t, 1, &headerType, 1);
+    ref = fbRefField(&t, 2);
+    table = fbEndTable(&t);
+    *headerRef = table + ref;
+    return table;
+}
+
+// -------------------------------------------------------------------------
+// Arrow IPC file
+
+// Position in the file and metadata length of a message, see Block in File.fbs
+typedef struct {
+    int64 offset;
+    int metaDataLength;
+    int padding;
+    int64 bodyLength;
+} Block;
+
+static int64 paddedLength(int64 n, int alignment) {
+    return (n + alignment - 1) / alignment * alignment;
+}
+
+// Write the encapsulated message in b: continuation marker, length,
+// and the flatbuffer padded to 8 bytes. Returns 0 to indicate error.
+static int writeEncapsulated(FILE* file, FlatBuilder* b, int64* position, Block* block) {
+    static const char zeros[8] = {0};
+    int header[2];
+    int pad = (int)(paddedLength(b->size, 8) - b->size);
+    if (b->failed) return 0; // error
+    header[0] = -1;
+    header[1] = (int)b->size + pad;
+    block->offset = *position;
+    block->metaDataLength = 8 + header[1];
+    if (fwrite(header, 4, 2, file) != 2
+            || fwrite(b->data, 1, b->size, file) != b->size
+            || fwrite(zeros, 1, pad, file) != (size_t)pad)
+        return 0; // error
+    *position += block->metaDataLength;
+    return 1; // success
+}
+
+// Write one record batch of steps first to first + n - 1.
+// Returns 0 to indicate error.
+static int writeRecordBatch(FILE* file, FlatBuilder* b, ArrowColumn* columns, int nColumns,
+                            Recording* timeSource, int first, int n, double* scratch,
+                            int64* position, Block* block) {
+    static const char zeros[BODY_ALIGNMENT] = {0};
+    FlatTable t;
+    int64 length = n;
+    int64 columnLength = paddedLength((int64)n * sizeof(double), BODY_ALIGNMENT);
+    int64 bodyLength = nColumns * columnLength;
+    int nodesRef, buffersRef, i, k;
+    size_t message, headerRef, table, nodes, buffers;
+
+    fbBegin(b);
+    message = writeMessage(b, HEADER_RECORD_BATCH, bodyLength, &headerRef);
+    fbPatch(b, 0, message);
+    fbBeginTable(&t, b);
+    fbField(&t, 0, &length, 8);
+    nodesRef = fbRefField(&t, 1);
+    buffersRef = fbRefField(&t, 2);
+    table = fbEndTable(&t);
+    fbPatch(b, headerRef, table);
+    // FieldNode {length, null_count} of each column
+    nodes = fbVector(b, nColumns, 16, 8);
+    fbPatch(b, table + nodesRef, nodes);
+    for (i=0; i<nColumns; i++)
+        fbPutAt(b, nodes + 4 + 16 * i, &length, 8);
+    // Buffer {offset, length} of each column: no validity bitmap, values
+    buffers = fbVector(b, 2 * nColumns, 16, 8);
+    fbPatch(b, table + buffersRef, buffers);
+    for (i=0; i<nColumns; i++) {
+        int64 buffer[4];
+        buffer[0] = i * columnLength;
+        buffer[1] = 0;
+        buffer[2] = i * columnLength;
+        buffer[3] = (int64)n * sizeof(double);
+        fbPutAt(b, buffers + 4 + 32 * i, buffer, 32);
+    }
+    if (!writeEncapsulated(file, b, position, block)) return 0; // error
+    block->bodyLength = bodyLength;
+
+    // body: the values of each column, padded
+    for (i=0; i<nColumns; i++) {
+        ArrowColumn* c = &columns[i];
+        int pad = (int)(columnLength - (int64)n * sizeof(double));
+        for (k=0; k<n; k++)
+            scratch[k] = c->recording
+                ? recordedValue(c->recording, first + k, c->column)
+                : timeSource->time[first + k];
+        if (fwrite(scratch, sizeof(double), n, file) != (size_t)n
+                || fwrite(zeros, 1, pad, file) != (size_t)pad)
+            return 0; // error
+    }
+    *position += bodyLength;
+    return 1; // success
+}
+
+// Returns 0 to indicate error
+static int writeFooter(FILE* file, FlatBuilder* b, ArrowColumn* columns, int nColumns,
+                       Block* blocks, int nBlocks) {
+    FlatTable t;
+    short version = METADATA_V5;
+    int schemaRef, dictionariesRef, batchesRef;
+    size_t table, vector;
+    int size;
+    fbBegin(b);
+    fbBeginTable(&t, b);
+    fbField(&t, 0, &version, 2);
+    schemaRef = fbRefField(&t, 1);
+    dictionariesRef = fbRefField(&t, 2);
+    batchesRef = fbRefField(&t, 3);
+    table = fbEndTable(&t);
+    fbPatch(b, 0, table);
+    fbPatch(b, table + schemaRef, writeSchema(b, columns, nColumns));
+    fbPatch(b, table + dictionariesRef, fbVector(b, 0, sizeof(Block), 8));
+    vector = fbVector(b, nBlocks, sizeof(Block), 8);
+    fbPatch(b, table + batchesRef, vector);
+    fbPutAt(b, vector + 4, blocks, nBlocks * sizeof(Block));
+    if (b->failed) return 0; // error
+    size = (int)b->size;
+    return fwrite(b->data, 1, b->size, file) == b->size
+        && fwrite(&size, 4, 1, file) == 1
+        && fwrite(ARROW_MAGIC, 1, 6, file) == 6;
+}
+
+static int isLittleEndian(void) {
+    int one = 1;
+    return *(char*)&one == 1;
+}
+
+// Returns NULL if no memory is available
+static ArrowColumn* newColumns(ArrowSource* sources, int n, int* nColumns) {
+    ArrowColumn* columns;
+    int i, j, k = 1;
+    *nColumns = 1;
+    for (i=0; i<n; i++)
+        *nColumns += sources[i].recording->nColumns;
+    columns = (ArrowColumn*)calloc(*nColumns, sizeof(ArrowColumn));
+    if (!columns) return NULL;
+    columns[0].name = strdup("time");
+    columns[0].unit = "s";
+    columns[0].valueReference = -1;
+    if (!columns[0].name) {
+        free(columns);
+        return NULL;
+    }
+    for (i=0; i<n; i++) {
+        Recording* r = sources[i].recording;
+        const char* id = sources[i].instanceId;
+        for (j=0; j<r->nColumns; j++, k++) {
+            ArrowColumn* c = &columns[k];
+            ScalarVariable* sv = r->vars[j];
+            c->recording = r;
+            c->column = j;
+            c->causality = enuNames[r->causality[j]];
+            c->valueReference = sv ? (int)r->vrs[j] : -1;
+            if (sv) {
+                c->unit = sources[i].md
+                    ? getString2(sources[i].md, sv->typeSpec, att_unit)
+                    : getString(sv->typeSpec, att_unit);
+            }
+            c->name = (char*)malloc((id ? strlen(id) + 1 : 0) + strlen(r->names[j]) + 1);
+            if (!c->name) {
+                for (k--; k>=0; k--) free(columns[k].name);
+                free(columns);
+                return NULL;
+            }
+            if (id) sprintf(c->name, "%s.%s", id, r->names[j]);
+            else strcpy(c->name, r->names[j]);
+        }
+    }
+    return columns;
+}
+
+int writeArrowFile(const char* path, ArrowSource* sources, int n, int blockSteps) {
+    static const char zeros[8] = {0};
+    FlatBuilder b;
+    ArrowColumn* columns;
+    Block* blocks;
+    Block schemaBlock;
+    double* scratch;
+    FILE* file;
+    int nColumns, nSteps, nBlocks, i, ok;
+    int64 position = 8;
+    int endOfStream[2] = {-1, 0};
+
+    if (!isLittleEndian()) {
+        logThis(ERROR_ERROR, "Arrow export requires a little endian host");
+        return 0; // error
+    }
+    if (n < 1) return 0; // error
+    nSteps = sources[0].recording->nSteps;
+    for (i=1; i<n; i++) {
+        if (sources[i].recording->nSteps != nSteps) {
+            logThis(ERROR_ERROR, "Recording of %s has %d steps, expected %d",
+                    sources[i].instanceId ? sources[i].instanceId : "?",
+                    sources[i].recording->nSteps, nSteps);
+            return 0; // error
+        }
+    }
+    if (blockSteps <= 0 || blockSteps > nSteps) blockSteps = nSteps > 0 ? nSteps : 1;
+    nBlocks = (nSteps + blockSteps - 1) / blockSteps;
+
+    memset(&b, 0, sizeof(FlatBuilder));
+    columns = newColumns(sources, n, &nColumns);
+    blocks = (Block*)calloc(nBlocks > 0 ? nBlocks : 1, sizeof(Block));
+    scratch = (double*)malloc(blockSteps * sizeof(double));
+    file = fopen(path, "wb");
+    ok = columns && blocks && scratch && file;
+    if (!file) {
+        logThis(ERROR_ERROR, "Cannot open file '%s'", path);
+    }
+
+    // magic, schema, record batches, end of stream, footer, magic
+    if (ok) ok = fwrite(ARROW_MAGIC, 1, 6, file) == 6 && fwrite(zeros, 1, 2, file) == 2;
+    if (ok) {
+        size_t message, headerRef;
+        fbBegin(&b);
+        message = writeMessage(&b, HEADER_SCHEMA, 0, &headerRef);
+        fbPatch(&b, 0, message);
+        fbPatch(&b, headerRef, writeSchema(&b, columns, nColumns));
+        ok = writeEncapsulated(file, &b, &position, &schemaBlock);
+    }
+    for (i=0; ok && i<nBlocks; i++) {
+        int first = i * blockSteps;
+        int count = nSteps - first < blockSteps ? nSteps - first : blockSteps;
+        ok = writeRecordBatch(file, &b, columns, nColumns, sources[0].recording,
+                              first, count, scratch, &position, &blocks[i]);
+    }
+    if (ok) ok = fwrite(endOfStream, 4, 2, file) == 2;
+    if (ok) ok = writeFooter(file, &b, columns, nColumns, blocks, nBlocks);
+    if (file && fclose(file)) ok = 0;
+    if (file && !ok) {
+        logThis(ERROR_ERROR, "Cannot write Arrow file '%s'", path);
+    }
+
+    if (columns)
+        for (i=0; i<nColumns; i++) free(columns[i].name);
+    free(columns);
+    free(blocks);
+    free(scratch);
+    free(b.data);
+    return ok;
+}
+
+int writeArrowRecording(Recording* r, ModelDescription* md, const char* path, int blockSteps) {
+    ArrowSource source;
+    source.instanceId = NULL;
+    source.recording = r;
+    source.md = md;
+    return writeArrowFile(path, &source, 1, blockSteps);
+}
+
+// #define TEST
+#ifdef TEST
+// arrowExport <recording.csv> <file.arrow>
+// Converts a recording and, if python with pyarrow is installed, reads
+// the file back with pyarrow and compares it with the recording.
+int main(int argc, char** argv) {
+    char command[2048];
+    Recording* r;
+    int status;
+    if (argc != 3) {
+        printf("usage: arrowExport <recording.csv> <file.arrow>\n");
+        return 1;
+    }
+    r = readRecording(argv[1], NULL);
+    if (!r || !writeArrowRecording(r, NULL, argv[2], 1000)) return 1;
+    freeRecording(r);
+    snprintf(command, sizeof(command),
+        "python3 -c \"import sys, csv, pyarrow.ipc as ipc\n"
+        "t = ipc.open_file(sys.argv[2]).read_all()\n"
+        "rows = list(csv.reader(open(sys.argv[1])))\n"
+        "assert t.column_names == rows[0], 'names differ'\n"
+        "assert t.num_rows == len(rows) - 1, 'row count differs'\n"
+        "same = lambda x, y: x == y or x != x and y != y\n"
+        "for j, name in enumerate(rows[0]):\n"
+        "    column = t.column(name).to_pylist()\n"
+        "    assert all(same(x, float(row[j])) for x, row in zip(column, rows[1:])), name\n"
+        "print('pyarrow reads', t.num_rows, 'rows of', t.num_columns, 'columns')\" %s %s",
+        argv[1], argv[2]);
+    status = system(command);
+    if (status) printf("check with pyarrow failed or pyarrow is not installed\n");
+    return status != 0;
+}
+#endif // TEST
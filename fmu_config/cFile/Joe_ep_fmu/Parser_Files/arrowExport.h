@@ -0,0 +1,40 @@
+/* -------------------------------------------------------------------------
+ * arrowExport.h
+ * Export of recordings as Apache Arrow IPC files (the Arrow "file" format,
+ * also known as Feather V2), so that analysis tools can memory-map the
+ * results instead of parsing text. The file has a float64 column "time"
+ * and one float64 column per recorded variable and instance, named
+ * "<instance id>.<variable name>". Each field carries its "unit",
+ * "causality" and "valueReference" as field metadata. Steps are written
+ * in record batches of blockSteps rows.
+ * -------------------------------------------------------------------------*/
+
+#ifndef ARROW_EXPORT_H
+#define ARROW_EXPORT_H
+
+#include "recorder.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The recording of one instance
+typedef struct {
+    const char* instanceId;   // prefix of the column names, NULL for none
+    Recording* recording;
+    ModelDescription* md;     // NULL, or used to find the unit of declared types
+} ArrowSource;
+
+// Write the recordings of n instances into one Arrow IPC file. All
+// recordings must have the same number of steps; the time column is
+// taken from the first. blockSteps <= 0 writes one record batch.
+// Returns 1 to indicate success and 0 for error.
+int writeArrowFile(const char* path, ArrowSource* sources, int n, int blockSteps);
+
+// Same as writeArrowFile for the recording of one instance
+int writeArrowRecording(Recording* r, ModelDescription* md, const char* path, int blockSteps);
+
+#ifdef __cplusplus
+} // closing brace for extern "C"
+#endif
+#endif // ARROW_EXPORT_H
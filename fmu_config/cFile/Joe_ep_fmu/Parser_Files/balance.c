@@ -0,0 +1,156 @@
+/* -------------------------------------------------------------------------
+ * balance.c
+ * Assignment of homes to workers based on a moving average of
+ * their step cost.
+ * -------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "balance.h"
+
+typedef struct HomeCost {
+    double cost;
+    int home;
+} HomeCost;
+
+// order by decreasing cost, ties by home index to make the result deterministic
+static int costsBefore(const HomeCost* x, const HomeCost* y) {
+    if (x->cost != y->cost) return x->cost > y->cost;
+    return x->home < y->home;
+}
+
+// Move order[i] down the heap of the first n elements, whose root is
+// the element that sorts last
+static void siftDown(HomeCost* order, int i, int n) {
+    HomeCost x = order[i];
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= n) break;
+        if (child + 1 < n && costsBefore(&order[child], &order[child+1])) child++;
+        if (!costsBefore(&x, &order[child])) break;
+        order[i] = order[child];
+        i = child;
+    }
+    order[i] = x;
+}
+
+// Heap sort in place. Unlike qsort, which may allocate a temporary
+// buffer, e.g. glibc before 2.37 for arrays over 1 KB, it never
+// allocates memory.
+static void sortHomeCosts(HomeCost* order, int n) {
+    int i;
+    for (i=n/2-1; i>=0; i--) siftDown(order, i, n);
+    for (i=n-1; i>0; i--) {
+        HomeCost last = order[0];
+        order[0] = order[i];
+        order[i] = last;
+        siftDown(order, 0, i);
+    }
+}
+
+Balancer* newBalancer(int nHomes, int nWorkers, double alpha) {
+    int i;
+    Balancer* b = (Balancer*)calloc(1, sizeof(Balancer));
+    if (!b) return NULL;
+    b->nHomes = nHomes;
+    b->nWorkers = nWorkers > 0 ? nWorkers : 1;
+    b->alpha = alpha > 0 && alpha <= 1 ? alpha : 0.1;
+    b->cost = (double*)malloc((nHomes > 0 ? nHomes : 1) * sizeof(double));
+    b->worker = (int*)malloc((nHomes > 0 ? nHomes : 1) * sizeof(int));
+    b->load = (double*)malloc(b->nWorkers * sizeof(double));
+    b->next = (int*)malloc((nHomes > 0 ? nHomes : 1) * sizeof(int));
+    b->order = (HomeCost*)malloc((nHomes > 0 ? nHomes : 1) * sizeof(HomeCost));
+    if (!b->cost || !b->worker || !b->load || !b->next || !b->order) {
+        freeBalancer(b);
+        return NULL;
+    }
+    for (i=0; i<nHomes; i++) {
+        b->cost[i] = -1;
+        b->worker[i] = i % b->nWorkers;
+    }
+    b->imbalanceBefore = b->imbalanceAfter = 1;
+    return b;
+}
+
+void freeBalancer(Balancer* b) {
+    if (!b) return;
+    free(b->cost);
+    free(b->worker);
+    free(b->load);
+    free(b->next);
+    free(b->order);
+    free(b);
+}
+
+void balancerRecord(Balancer* b, int home, double stepTime) {
+    if (b->cost[home] < 0) b->cost[home] = stepTime;
+    else b->cost[home] += b->alpha * (stepTime - b->cost[home]);
+}
+
+// homes without a measurement count with the mean cost of the others
+static double meanKnownCost(Balancer* b) {
+    double sum = 0;
+    int i, n = 0;
+    for (i=0; i<b->nHomes; i++) {
+        if (b->cost[i] >= 0) {
+            sum += b->cost[i];
+            n++;
+        }
+    }
+    return n ? sum / n : 1;
+}
+
+static double imbalanceOf(Balancer* b, const int* worker, double* load, double unknownCost) {
+    double max = 0, sum = 0;
+    int i;
+    memset(load, 0, b->nWorkers * sizeof(double));
+    for (i=0; i<b->nHomes; i++)
+        load[worker[i]] += b->cost[i] >= 0 ? b->cost[i] : unknownCost;
+    for (i=0; i<b->nWorkers; i++) {
+        sum += load[i];
+        if (load[i] > max) max = load[i];
+    }
+    return sum > 0 ? max * b->nWorkers / sum : 1;
+}
+
+double balancerImbalance(Balancer* b) {
+    return imbalanceOf(b, b->worker, b->load, meanKnownCost(b));
+}
+
+int rebalance(Balancer* b, double minGain) {
+    double unknownCost = meanKnownCost(b);
+    double* load = b->load;
+    int* worker = b->next;
+    HomeCost* order = b->order;
+    int i, w;
+    b->imbalanceBefore = imbalanceOf(b, b->worker, load, unknownCost);
+
+    // longest processing time first: give the next most expensive home
+    // to the least loaded worker, preferring the worker it already has
+    for (i=0; i<b->nHomes; i++) {
+        order[i].cost = b->cost[i] >= 0 ? b->cost[i] : unknownCost;
+        order[i].home = i;
+    }
+    sortHomeCosts(order, b->nHomes);
+    memset(load, 0, b->nWorkers * sizeof(double));
+    for (i=0; i<b->nHomes; i++) {
+        int home = order[i].home;
+        int best = b->worker[home];
+        for (w=0; w<b->nWorkers; w++)
+            if (load[w] < load[best]) best = w;
+        worker[home] = best;
+        load[best] += order[i].cost;
+    }
+
+    b->imbalanceAfter = imbalanceOf(b, worker, load, unknownCost);
+    b->nMigrated = 0;
+    if (b->imbalanceBefore - b->imbalanceAfter > minGain) {
+        for (i=0; i<b->nHomes; i++) {
+            if (worker[i] != b->worker[i]) b->nMigrated++;
+            b->worker[i] = worker[i];
+        }
+    } else {
+        b->imbalanceAfter = b->imbalanceBefore;
+    }
+    return b->nMigrated;
+}
@@ -0,0 +1,53 @@
+/* -------------------------------------------------------------------------
+ * balance.h
+ * Assignment of homes to worker threads or processes. Tracks a moving
+ * average of the step cost of each home and, between timesteps,
+ * reassigns homes so that the most loaded worker finishes as early as
+ * possible (longest processing time first).
+ * -------------------------------------------------------------------------*/
+
+#ifndef BALANCE_H
+#define BALANCE_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    int nHomes;
+    int nWorkers;
+    double alpha;            // weight of a new sample in the moving average, 0 < alpha <= 1
+    double* cost;            // moving average of the step cost of each home, negative if unknown
+    int* worker;             // worker of each home
+    // statistics of the last rebalance
+    double imbalanceBefore;  // max worker load / mean worker load before
+    double imbalanceAfter;   // and after the rebalance
+    int nMigrated;           // homes that changed their worker
+    // scratch space of rebalance, allocated once
+    double* load;            // load of each worker
+    int* next;               // new worker of each home
+    struct HomeCost* order;  // homes by decreasing cost
+} Balancer;
+
+// Initially, homes are assigned round robin.
+// Returns NULL if no memory is available.
+Balancer* newBalancer(int nHomes, int nWorkers, double alpha);
+void freeBalancer(Balancer* b);
+
+// Add a measured step time of the given home to its moving average
+void balancerRecord(Balancer* b, int home, double stepTime);
+
+// Returns max worker load / mean worker load of the current assignment,
+// 1 for perfect balance. Does not allocate memory.
+double balancerImbalance(Balancer* b);
+
+// Compute a new assignment. It is applied only if it reduces the
+// imbalance by more than minGain, e.g. 0.05, to avoid moving homes
+// for little benefit. Call between timesteps only.
+// Does not allocate memory.
+// Returns the number of homes that changed their worker.
+int rebalance(Balancer* b, double minGain);
+
+#ifdef __cplusplus
+} // closing brace for extern "C"
+#endif
+#endif // BALANCE_H
@@ -0,0 +1,337 @@
+/* -------------------------------------------------------------------------
+ * barrier.c
+ * Combining-tree barrier with spin-then-sleep waiting.
+ * -------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#define atomicLoad(p) InterlockedCompareExchange((volatile LONG*)(p), 0, 0)
+#define atomicStore(p, v) InterlockedExchange((volatile LONG*)(p), (v))
+#define atomicIncrement(p) InterlockedIncrement((volatile LONG*)(p))
+#define atomicDecrement(p) InterlockedDecrement((volatile LONG*)(p))
+#define cpuRelax() YieldProcessor()
+#else
+#include <unistd.h>
+#include <sched.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+// sequentially consistent: a releaser stores the generation, then reads
+// the sleepers, a waiter counts itself as sleeper, then reads the generation
+#define atomicLoad(p) __atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define atomicStore(p, v) __atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+#define atomicIncrement(p) __atomic_add_fetch((p), 1, __ATOMIC_SEQ_CST)
+#define atomicDecrement(p) __atomic_sub_fetch((p), 1, __ATOMIC_SEQ_CST)
+#if defined(__x86_64__) || defined(__i386__)
+#define cpuRelax() __builtin_ia32_pause()
+#elif defined(__aarch64__)
+#define cpuRelax() __asm__ __volatile__("yield")
+#else
+#define cpuRelax() ((void)0)
+#endif
+#endif
+
+#include "barrier.h"
+
+#define CACHE_LINE 64
+#define DEFAULT_FAN_IN 8
+#define MIN_FAN_IN 4
+#define MAX_FAN_IN 16
+#define FLAT_LIMIT 16
+#define DEFAULT_SPIN_COUNT 4000
+
+// Arrivals and waiting are on separate cache lines, so that arrivals do
+// not disturb the threads that poll the generation
+struct BarrierNode {
+    volatile int count;          // arrivals in the current timestep
+    int expected;                // participants or children of this node
+    int parent;                  // index of the parent, -1 for the root
+    char padding1[CACHE_LINE - 3 * sizeof(int)];
+    volatile int generation;     // incremented when the node is released
+    volatile int sleepers;       // threads asleep on the generation
+    char padding2[CACHE_LINE - 2 * sizeof(int)];
+};
+
+static int onlineCpus(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    return (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+}
+
+#ifndef _WIN32
+// Number of CPUs in a list like "0-3,8-11" of sysfs, 0 if unreadable
+static int countCpuList(const char* path) {
+    char list[256];
+    char* p = list;
+    int n = 0;
+    FILE* file = fopen(path, "r");
+    if (!file) return 0;
+    if (!fgets(list, sizeof(list), file)) list[0] = '\0';
+    fclose(file);
+    while (*p >= '0' && *p <= '9') {
+        int from = (int)strtol(p, &p, 10), to = from;
+        if (*p == '-') to = (int)strtol(p + 1, &p, 10);
+        n += to - from + 1;
+        if (*p != ',') break;
+        p++;
+    }
+    return n;
+}
+#endif
+
+// CPUs that share the level 2 cache of the first CPU, 0 if unknown
+static int cpusSharingCache(void) {
+#ifdef _WIN32
+    SYSTEM_LOGICAL_PROCESSOR_INFORMATION info[256];
+    DWORD size = sizeof(info), i;
+    if (!GetLogicalProcessorInformation(info, &size)) return 0;
+    for (i=0; i<size / sizeof(info[0]); i++) {
+        ULONG_PTR mask = info[i].ProcessorMask;
+        int n = 0;
+        if (info[i].Relationship != RelationCache || info[i].Cache.Level != 2 || !(mask & 1)) continue;
+        for (; mask; mask >>= 1) n += (int)(mask & 1);
+        return n;
+    }
+    return 0;
+#else
+    char path[128];
+    int index;
+    for (index=0; index<8; index++) {
+        FILE* file;
+        int level = 0;
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/level", index);
+        file = fopen(path, "r");
+        if (!file) return 0;
+        if (fscanf(file, "%d", &level) != 1) level = 0;
+        fclose(file);
+        if (level != 2) continue;
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu0/cache/index%d/shared_cpu_list", index);
+        return countCpuList(path);
+    }
+    return 0;
+#endif
+}
+
+int barrierFanIn(void) {
+    int n = cpusSharingCache();
+    if (n <= 0) return DEFAULT_FAN_IN;
+    if (n < MIN_FAN_IN) return MIN_FAN_IN;
+    if (n > MAX_FAN_IN) return MAX_FAN_IN;
+    return n;
+}
+
+TreeBarrier* newTreeBarrier(int nParticipants, int fanIn) {
+    TreeBarrier* b = (TreeBarrier*)calloc(1, sizeof(TreeBarrier));
+    int nNodes = 0, cpus = onlineCpus(), width, first, i;
+    if (!b) return NULL;
+    if (nParticipants < 1) nParticipants = 1;
+    // at most as many threads arrive at once as there are CPUs; if few
+    // do, one node, a central counter, beats the extra levels
+    if (fanIn <= 1) fanIn = nParticipants <= FLAT_LIMIT || cpus <= FLAT_LIMIT ? nParticipants : barrierFanIn();
+    if (fanIn < 2) fanIn = 2;
+    b->nParticipants = nParticipants;
+    b->fanIn = fanIn;
+    // with more participants than CPUs, a spinning waiter takes the CPU
+    // from one that has yet to arrive
+    b->spinCount = cpus > 1 && nParticipants <= cpus ? DEFAULT_SPIN_COUNT : 0;
+    for (width = nParticipants; ; width = (width + fanIn - 1) / fanIn) {
+        nNodes += (width + fanIn - 1) / fanIn;
+        if (width <= fanIn) break;
+    }
+    b->nNodes = nNodes;
+    b->memory = calloc(1, nNodes * sizeof(BarrierNode) + CACHE_LINE);
+    if (!b->memory) {
+        free(b);
+        return NULL;
+    }
+    b->nodes = (BarrierNode*)(((size_t)b->memory + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE);
+    // level by level: width entries (participants or nodes) below, grouped by fanIn
+    first = 0;
+    for (width = nParticipants; ; width = (width + fanIn - 1) / fanIn) {
+        int n = (width + fanIn - 1) / fanIn;
+        for (i=0; i<n; i++) {
+            BarrierNode* node = &b->nodes[first + i];
+            node->expected = i < n - 1 ? fanIn : width - (n - 1) * fanIn;
+            node->parent = n == 1 ? -1 : first + n + i / fanIn;
+        }
+        first += n;
+        if (n == 1) break;
+    }
+    return b;
+}
+
+void freeTreeBarrier(TreeBarrier* b) {
+    if (!b) return;
+    free(b->memory);
+    free(b);
+}
+
+static void sleepOn(volatile int* word, int old) {
+#if defined(_WIN32)
+    WaitOnAddress(word, &old, sizeof(int), INFINITE);
+#elif defined(__linux__)
+    syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, old, NULL, NULL, 0);
+#else
+    (void)word;
+    (void)old;
+    sched_yield();
+#endif
+}
+
+static void wakeAll(volatile int* word) {
+#if defined(_WIN32)
+    WakeByAddressAll((PVOID)word);
+#elif defined(__linux__)
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#else
+    (void)word;
+#endif
+}
+
+// Wait until the generation of the node is no longer old
+static void waitRelease(TreeBarrier* b, BarrierNode* node, int old) {
+    int i;
+    for (i=0; i<b->spinCount; i++) {
+        if (atomicLoad(&node->generation) != old) return;
+        cpuRelax();
+    }
+    while (atomicLoad(&node->generation) == old) {
+        atomicIncrement(&node->sleepers);
+        if (atomicLoad(&node->generation) == old) sleepOn(&node->generation, old);
+        atomicDecrement(&node->sleepers);
+    }
+}
+
+// Returns 1 if the caller completed the root
+static int arrive(TreeBarrier* b, int index) {
+    BarrierNode* node = &b->nodes[index];
+    int generation = atomicLoad(&node->generation);
+    int last;
+    if (atomicIncrement(&node->count) < node->expected) {
+        waitRelease(b, node, generation);
+        return 0;
+    }
+    // the last to arrive goes up; nobody arrives here again before the
+    // node is released below
+    node->count = 0;
+    last = node->parent < 0 ? 1 : arrive(b, node->parent);
+    atomicStore(&node->generation, generation + 1);
+    if (atomicLoad(&node->sleepers) > 0) wakeAll(&node->generation);
+    return last;
+}
+
+int barrierWait(TreeBarrier* b, int participant) {
+    return arrive(b, participant / b->fanIn);
+}
+
+// #define TEST
+#ifdef TEST
+#include <stdio.h>
+#include "thread_support.h"
+
+// Baseline: one counter under a mutex, all waiters on one condition variable
+typedef struct {
+    Mutex lock;
+    CondVar changed;
+    int count;
+    int generation;
+    int n;
+} SimpleBarrier;
+
+static void simpleWait(SimpleBarrier* s) {
+    int generation;
+    mutexLock(&s->lock);
+    generation = s->generation;
+    if (++s->count == s->n) {
+        s->count = 0;
+        s->generation++;
+        condBroadcast(&s->changed);
+    } else {
+        while (generation == s->generation) condWait(&s->changed, &s->lock);
+    }
+    mutexUnlock(&s->lock);
+}
+
+typedef struct {
+    TreeBarrier* tree;
+    SimpleBarrier* simple;
+    int participant;
+    int rounds;
+    int* serials;
+    double start;                // participant 0: after the first timestep
+    double end;                  // and after the last
+} Participant;
+
+static void runParticipant(void* arg) {
+    Participant* p = (Participant*)arg;
+    int r;
+    for (r=0; r<p->rounds; r++) {
+        if (p->tree) {
+            if (barrierWait(p->tree, p->participant)) (*p->serials)++;
+        } else {
+            simpleWait(p->simple);
+        }
+        if (r == 0) p->start = wallClock();
+    }
+    p->end = wallClock();
+}
+
+// Mean time per timestep of n threads, of the simple barrier for fanIn
+// < 0, else of the tree barrier with fanIn
+static double measure(int n, int rounds, int fanIn) {
+    Thread* threads = (Thread*)malloc(n * sizeof(Thread));
+    Participant* p = (Participant*)malloc(n * sizeof(Participant));
+    SimpleBarrier simple;
+    TreeBarrier* b = fanIn >= 0 ? newTreeBarrier(n, fanIn) : NULL;
+    int serials = 0, i;
+    double t;
+    mutexInit(&simple.lock);
+    condInit(&simple.changed);
+    simple.count = simple.generation = 0;
+    simple.n = n;
+    for (i=0; i<n; i++) {
+        p[i].tree = b;
+        p[i].simple = &simple;
+        p[i].participant = i;
+        p[i].rounds = rounds;
+        p[i].serials = &serials;
+    }
+    for (i=0; i<n; i++) threadCreate(&threads[i], runParticipant, &p[i]);
+    for (i=0; i<n; i++) threadJoin(threads[i]);
+    if (b && serials != rounds) printf("expected %d serial returns, got %d\n", rounds, serials);
+    freeTreeBarrier(b);
+    mutexDestroy(&simple.lock);
+    condDestroy(&simple.changed);
+    t = (p[0].end - p[0].start) / (rounds - 1);
+    free(threads);
+    free(p);
+    return t;
+}
+
+// barrier [<max participants>]: time per timestep of the simple barrier,
+// of one node for all (flat), of the tree with barrierFanIn, and of the
+// default of newTreeBarrier, for 2, 4, ... participants. Run it on the
+// machines of the fleet: the default should be the fastest or near it.
+int main(int argc, char** argv) {
+    int max = argc > 1 ? atoi(argv[1]) : 4096, n;
+    printf("%d cpus, %d share a level 2 cache, fan-in %d\n", onlineCpus(), cpusSharingCache(), barrierFanIn());
+    printf("participants  mutex/condvar       flat       tree    default  us per timestep\n");
+    for (n=2; n<=max; n*=2) {
+        int rounds = n <= 256 ? 2000 : 200;
+        printf("%12d %14.1f %10.1f %10.1f %10.1f\n", n, 1e6 * measure(n, rounds, -1),
+               1e6 * measure(n, rounds, n), 1e6 * measure(n, rounds, barrierFanIn()),
+               1e6 * measure(n, rounds, 0));
+    }
+    return 0;
+}
+#endif // TEST
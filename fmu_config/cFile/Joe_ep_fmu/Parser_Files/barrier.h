@@ -0,0 +1,55 @@
+/* -------------------------------------------------------------------------
+ * barrier.h
+ * Timestep barrier for lockstep mode with thousands of participants,
+ * e.g. one per home. A combining tree: participants arrive at a leaf
+ * node shared with fanIn - 1 others, the last one to arrive at a node
+ * goes on to its parent, and the last one at the root ends the timestep.
+ * Release runs down the same paths, so each node counter and each wake
+ * is shared by at most fanIn threads instead of all of them.
+ * Waiting threads spin for a while, then sleep on the generation word of
+ * their node: futex on Linux, WaitOnAddress on Windows (link
+ * Synchronization.lib), sched_yield elsewhere.
+ * By default fanIn follows the topology, see barrierFanIn, but with up
+ * to 16 participants or CPUs, all participants share one node, a central
+ * counter, which is faster when few threads arrive at the same time.
+ * Waiters spin only if every participant has a CPU of its own.
+ * Give threads that share a core or cache neighbouring participant
+ * numbers, so that they share leaf nodes.
+ * -------------------------------------------------------------------------*/
+
+#ifndef BARRIER_H
+#define BARRIER_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct BarrierNode BarrierNode;
+
+typedef struct {
+    int nParticipants;
+    int fanIn;
+    int spinCount;          // polls before a waiting thread sleeps, 0 on a single CPU
+    int nNodes;
+    BarrierNode* nodes;     // leaves first, root last, each on its own cache line
+    void* memory;
+} TreeBarrier;
+
+// The CPUs that share the level 2 cache of the first CPU, i.e. threads
+// of a core and cores of a cluster, between 4 and 16; 8 if unknown.
+int barrierFanIn(void);
+
+// fanIn <= 1 selects one node for up to 16 participants or CPUs,
+// barrierFanIn for more. Returns NULL if no memory is available.
+TreeBarrier* newTreeBarrier(int nParticipants, int fanIn);
+void freeTreeBarrier(TreeBarrier* b);
+
+// Wait until all participants arrived. Each participant passes its own
+// number, 0 to nParticipants-1, in every timestep.
+// Returns 1 in exactly one participant per timestep, the last to arrive,
+// e.g. to aggregate the timestep, and 0 in all others.
+int barrierWait(TreeBarrier* b, int participant);
+
+#ifdef __cplusplus
+} // closing brace for extern "C"
+#endif
+#endif // BARRIER_H
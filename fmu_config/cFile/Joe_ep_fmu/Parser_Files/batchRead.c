@@ -0,0 +1,550 @@
+/* -------------------------------------------------------------------------
+ * batchRead.c
+ * Reads many small files with many reads in flight, using io_uring on
+ * Linux and blocking reads with readahead hints elsewhere.
+ * The io_uring backend uses the kernel interface directly, so that no
+ * library is needed.
+ * -------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef STANDALONE_XML_PARSER
+#define logThis(n, ...) printf(__VA_ARGS__);printf("\n")
+#else
+#include "GlobalIncludes.h"
+#include "logging.h" // logThis
+#endif // STANDALONE_XML_PARSER
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+#if defined(__linux__) && !defined(NO_IO_URING)
+#define HAVE_IO_URING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+#include "thread_support.h" // wallClock
+#include "batchRead.h"
+
+const char* readBackendNames[SIZEOF_READ_BACKEND] = {
+    "blocking", "io_uring"
+};
+
+void initBatchReader(BatchReader* reader, ReadBackend backend, int queueDepth) {
+    memset(reader, 0, sizeof(BatchReader));
+    reader->backend = backend;
+    reader->queueDepth = queueDepth > 0 ? queueDepth : 32;
+    reader->used = backend;
+}
+
+// Report the file as done, read or failed
+static void fileDone(BatchReader* reader, int file) {
+    if (reader->fileDone) reader->fileDone(file, reader->fileDoneArg);
+}
+
+void freeFileBatch(FileRead* files, int n) {
+    int i;
+    for (i=0; i<n; i++) {
+        free(files[i].data);
+        files[i].data = NULL;
+    }
+}
+
+static void readFailed(FileRead* file, int error) {
+    free(file->data);
+    file->data = NULL;
+    file->size = 0;
+    file->error = error;
+    logThis(ERROR_ERROR, "Cannot read file '%s': %s", file->path, strerror(error));
+}
+
+// Start reading the given file into the page cache, without waiting
+static void readAheadHint(const char* path) {
+#if !defined(_WIN32) && defined(POSIX_FADV_WILLNEED)
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    close(fd);
+#endif
+}
+
+// Returns 1 to indicate success and 0 for error
+static int readWholeFile(FileRead* file) {
+    long n = 0;
+    FILE* f = fopen(file->path, "rb");
+    if (!f) {
+        readFailed(file, errno);
+        return 0; // error
+    }
+    if (fseek(f, 0, SEEK_END) || (file->size = ftell(f)) < 0 || fseek(f, 0, SEEK_SET)) {
+        readFailed(file, errno);
+        fclose(f);
+        return 0; // error
+    }
+    file->data = (char*)malloc(file->size + 1);
+    if (!file->data) {
+        readFailed(file, ENOMEM);
+        fclose(f);
+        return 0; // error
+    }
+    while (n < file->size) {
+        size_t m = fread(file->data + n, 1, file->size - n, f);
+        if (m == 0) break;
+        n += m;
+    }
+    if (ferror(f)) {
+        readFailed(file, EIO);
+        fclose(f);
+        return 0; // error
+    }
+    fclose(f);
+    file->size = n; // the file may have shrunk since ftell
+    file->data[n] = 0;
+    return 1; // success
+}
+
+// Read one file after the other. While file i is read, the files up to
+// i + queueDepth are read ahead by the kernel.
+static int readBlocking(BatchReader* reader, FileRead* files, int n) {
+    int i, nRead = 0;
+    for (i=0; i<n && i<reader->queueDepth; i++)
+        readAheadHint(files[i].path);
+    for (i=0; i<n; i++) {
+        if (i + reader->queueDepth < n)
+            readAheadHint(files[i + reader->queueDepth].path);
+        nRead += readWholeFile(&files[i]);
+        fileDone(reader, i);
+    }
+    return nRead;
+}
+
+#ifdef HAVE_IO_URING
+
+typedef struct {
+    int fd;
+    unsigned entries;
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned* sqMask;
+    unsigned* sqArray;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+    struct io_uring_sqe* sqes;
+    struct io_uring_cqe* cqes;
+    void* sqRing;
+    size_t sqRingSize;
+    void* cqRing;
+    size_t cqRingSize;
+    size_t sqesSize;
+} Ring;
+
+// A read in flight
+typedef struct {
+    int file;             // index into files
+    int fd;
+    long offset;          // bytes read so far
+    int cancelled;        // an IORING_OP_ASYNC_CANCEL for the read is queued
+} Slot;
+
+// user_data of a cancel request, no slot has this index
+#define CANCEL_REQUEST 0xffffffffu
+#define DRAIN_RETRIES 3
+
+static void closeRing(Ring* ring) {
+    if (ring->sqes) munmap(ring->sqes, ring->sqesSize);
+    if (ring->cqRing) munmap(ring->cqRing, ring->cqRingSize);
+    if (ring->sqRing) munmap(ring->sqRing, ring->sqRingSize);
+    if (ring->fd >= 0) close(ring->fd);
+}
+
+// Returns 1 if the kernel supports the operations used here. The probe,
+// like IORING_OP_READ, exists from Linux 5.6 on, so it fails on the
+// kernels 5.1 to 5.5, which have io_uring but no reads without iovecs.
+static int ringSupportsReads(Ring* ring) {
+    struct io_uring_probe* probe;
+    int ok;
+    probe = (struct io_uring_probe*)calloc(1, sizeof(struct io_uring_probe)
+                                              + 256 * sizeof(struct io_uring_probe_op));
+    if (!probe) return 0; // error
+    ok = syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PROBE, probe, 256) >= 0
+      && probe->last_op >= IORING_OP_READ
+      && (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED)
+      && (probe->ops[IORING_OP_ASYNC_CANCEL].flags & IO_URING_OP_SUPPORTED);
+    free(probe);
+    return ok;
+}
+
+// Returns 1 to indicate success and 0 if io_uring is not available,
+// e.g. on kernels before 5.6 or if blocked by a seccomp filter.
+static int openRing(Ring* ring, unsigned entries) {
+    struct io_uring_params p;
+    char* sq;
+    char* cq;
+    memset(ring, 0, sizeof(Ring));
+    memset(&p, 0, sizeof(p));
+    ring->fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (ring->fd < 0) return 0; // error
+    ring->entries = p.sq_entries;
+    ring->sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqRing = mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    ring->cqRing = mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    ring->sqes = (struct io_uring_sqe*)mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqRing == MAP_FAILED) ring->sqRing = NULL;
+    if (ring->cqRing == MAP_FAILED) ring->cqRing = NULL;
+    if (ring->sqes == MAP_FAILED) ring->sqes = NULL;
+    if (!ring->sqRing || !ring->cqRing || !ring->sqes) {
+        closeRing(ring);
+        return 0; // error
+    }
+    sq = (char*)ring->sqRing;
+    cq = (char*)ring->cqRing;
+    ring->sqHead = (unsigned*)(sq + p.sq_off.head);
+    ring->sqTail = (unsigned*)(sq + p.sq_off.tail);
+    ring->sqMask = (unsigned*)(sq + p.sq_off.ring_mask);
+    ring->sqArray = (unsigned*)(sq + p.sq_off.array);
+    ring->cqHead = (unsigned*)(cq + p.cq_off.head);
+    ring->cqTail = (unsigned*)(cq + p.cq_off.tail);
+    ring->cqMask = (unsigned*)(cq + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+    if (!ringSupportsReads(ring)) {
+        closeRing(ring);
+        return 0; // error
+    }
+    return 1; // success
+}
+
+// Queue a read of the rest of the file of the given slot.
+// The kernel sees it with the next io_uring_enter.
+static void queueRead(Ring* ring, Slot* slots, int slot, FileRead* files) {
+    Slot* s = &slots[slot];
+    unsigned tail = *ring->sqTail;
+    unsigned index = tail & *ring->sqMask;
+    struct io_uring_sqe* sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = s->fd;
+    sqe->off = s->offset;
+    sqe->addr = (unsigned long)(files[s->file].data + s->offset);
+    sqe->len = files[s->file].size - s->offset;
+    sqe->user_data = slot;
+    ring->sqArray[index] = index;
+    __atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+}
+
+// Queue a cancel of the read of the given slot
+static void queueCancel(Ring* ring, int slot) {
+    unsigned tail = *ring->sqTail;
+    unsigned index = tail & *ring->sqMask;
+    struct io_uring_sqe* sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = slot;     // user_data of the read to cancel
+    sqe->user_data = CANCEL_REQUEST;
+    ring->sqArray[index] = index;
+    __atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+}
+
+// After a failed io_uring_enter: cancel the reads in flight and wait for
+// their completions, so that the kernel no longer writes into the data of
+// the files. The files of these reads fail with the given error.
+// Returns 0 if the ring keeps failing; the data of the files still in
+// flight then stays allocated, as the kernel may write into it.
+static int drainRing(BatchReader* reader, Ring* ring, Slot* slots, int depth,
+                     FileRead* files, int inFlight, int error) {
+    int i, failures = 0;
+    while (inFlight > 0) {
+        unsigned head, tail, pending;
+        for (i=0; i<depth; i++) {
+            unsigned used = *ring->sqTail - __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE);
+            if (slots[i].fd < 0 || slots[i].cancelled) continue;
+            if (used >= ring->entries) break; // the rest in the next round
+            queueCancel(ring, i);
+            slots[i].cancelled = 1;
+        }
+        // also submits reads queued before the failure; they are cancelled too
+        pending = *ring->sqTail - __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE);
+        if (syscall(__NR_io_uring_enter, ring->fd, pending, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0
+                && errno != EINTR && ++failures > DRAIN_RETRIES) {
+            logThis(ERROR_ERROR, "Cannot cancel %d reads: %s", inFlight, strerror(errno));
+            for (i=0; i<depth; i++) {
+                if (slots[i].fd < 0) continue;
+                close(slots[i].fd);
+                slots[i].fd = -1;
+                files[slots[i].file].data = NULL; // leaked to the kernel
+                readFailed(&files[slots[i].file], error);
+                fileDone(reader, slots[i].file);
+            }
+            return 0; // error
+        }
+        head = *ring->cqHead;
+        tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            struct io_uring_cqe* cqe = &ring->cqes[head & *ring->cqMask];
+            Slot* s;
+            if (cqe->user_data == CANCEL_REQUEST) continue;
+            s = &slots[cqe->user_data];
+            close(s->fd);
+            s->fd = -1;
+            readFailed(&files[s->file], error);
+            fileDone(reader, s->file);
+            inFlight--;
+        }
+        __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+    }
+    return 1; // success
+}
+
+// Returns -1 if the file is done, either read or failed.
+// Otherwise, returns the open file descriptor.
+static int openForRead(FileRead* file) {
+    struct stat st;
+    int fd = open(file->path, O_RDONLY);
+    if (fd < 0) {
+        readFailed(file, errno);
+        return -1;
+    }
+    if (fstat(fd, &st)) {
+        readFailed(file, errno);
+        close(fd);
+        return -1;
+    }
+    file->size = st.st_size;
+    file->data = (char*)malloc(file->size + 1);
+    if (!file->data) {
+        readFailed(file, ENOMEM);
+        close(fd);
+        return -1;
+    }
+    if (file->size == 0) {
+        file->data[0] = 0;
+        close(fd);
+        return -1;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    return fd;
+}
+
+// Returns -1 if io_uring is not available, otherwise the number of files read.
+static int readUring(BatchReader* reader, FileRead* files, int n) {
+    Ring ring;
+    Slot* slots;
+    int* freeSlots;
+    int nFree, next = 0, inFlight = 0, queued = 0, nRead = 0, error = 0;
+    int depth = reader->queueDepth;
+    if (!openRing(&ring, depth)) return -1; // not available
+    if (depth > (int)ring.entries) depth = ring.entries;
+    slots = (Slot*)malloc(depth * sizeof(Slot));
+    freeSlots = (int*)malloc(depth * sizeof(int));
+    if (!slots || !freeSlots) {
+        free(slots);
+        free(freeSlots);
+        closeRing(&ring);
+        return -1; // error
+    }
+    for (nFree=0; nFree<depth; nFree++) {
+        freeSlots[nFree] = depth - 1 - nFree;
+        slots[nFree].fd = -1;
+    }
+
+    while (next < n || inFlight > 0) {
+        unsigned head, tail;
+        int ret;
+        // keep depth files in flight
+        while (nFree > 0 && next < n) {
+            int slot, fd = openForRead(&files[next]);
+            if (fd < 0) {
+                if (files[next].data) nRead++;
+                fileDone(reader, next++);
+                continue;
+            }
+            slot = freeSlots[--nFree];
+            slots[slot].file = next++;
+            slots[slot].fd = fd;
+            slots[slot].offset = 0;
+            slots[slot].cancelled = 0;
+            queueRead(&ring, slots, slot, files);
+            inFlight++;
+            queued++;
+        }
+        if (inFlight == 0) continue;
+        ret = syscall(__NR_io_uring_enter, ring.fd, queued, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (ret < 0) {
+            error = errno;
+            if (error == EINTR) continue;
+            logThis(ERROR_ERROR, "io_uring_enter failed: %s", strerror(error));
+            drainRing(reader, &ring, slots, depth, files, inFlight, error);
+            break;
+        }
+        queued -= ret < queued ? ret : queued;
+        // reap completions
+        head = *ring.cqHead;
+        tail = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            struct io_uring_cqe* cqe = &ring.cqes[head & *ring.cqMask];
+            int slot = (int)cqe->user_data;
+            Slot* s = &slots[slot];
+            FileRead* file = &files[s->file];
+            if (cqe->res > 0 && s->offset + cqe->res < file->size) {
+                // short read, read the rest
+                s->offset += cqe->res;
+                queueRead(&ring, slots, slot, files);
+                queued++;
+                continue;
+            }
+            if (cqe->res < 0) {
+                readFailed(file, -cqe->res);
+            } else {
+                // the file may have shrunk since fstat
+                file->size = s->offset + cqe->res;
+                file->data[file->size] = 0;
+                nRead++;
+            }
+            close(s->fd);
+            s->fd = -1;
+            freeSlots[nFree++] = slot;
+            inFlight--;
+            fileDone(reader, s->file);
+        }
+        __atomic_store_n(ring.cqHead, head, __ATOMIC_RELEASE);
+    }
+
+    // no read is in flight any more, see drainRing; files not yet opened
+    // fail with the error of io_uring_enter
+    for (; next < n; next++) {
+        files[next].error = error;
+        fileDone(reader, next);
+    }
+    closeRing(&ring);
+    free(slots);
+    free(freeSlots);
+    return nRead;
+}
+
+#endif // HAVE_IO_URING
+
+int readFileBatch(BatchReader* reader, FileRead* files, int n) {
+    int i, nRead = -1;
+    double start = wallClock();
+    for (i=0; i<n; i++) {
+        files[i].data = NULL;
+        files[i].size = 0;
+        files[i].error = 0;
+    }
+    reader->used = read_blocking;
+#ifdef HAVE_IO_URING
+    if (reader->backend == read_uring) {
+        nRead = readUring(reader, files, n);
+        if (nRead >= 0) {
+            reader->used = read_uring;
+        } else {
+            logThis(ERROR_WARNING, "io_uring not available, using blocking reads");
+        }
+    }
+#endif
+    if (nRead < 0) nRead = readBlocking(reader, files, n);
+    reader->nFailed = n - nRead;
+    reader->bytes = 0;
+    for (i=0; i<n; i++)
+        reader->bytes += files[i].size;
+    reader->seconds = wallClock() - start;
+    return nRead;
+}
+
+// #define TEST
+#ifdef TEST
+#define POOL_THREADS 16
+
+// Baseline: a pool of threads, each reading one whole file after the
+// other with blocking reads
+typedef struct {
+    FileRead* files;
+    int n;
+    int next;                    // next file to read
+    int nRead;
+    Mutex lock;
+} ReadPool;
+
+static void runPoolThread(void* arg) {
+    ReadPool* pool = (ReadPool*)arg;
+    for (;;) {
+        int i, ok;
+        mutexLock(&pool->lock);
+        i = pool->next++;
+        mutexUnlock(&pool->lock);
+        if (i >= pool->n) return;
+        ok = readWholeFile(&pool->files[i]);
+        mutexLock(&pool->lock);
+        pool->nRead += ok;
+        mutexUnlock(&pool->lock);
+    }
+}
+
+// Returns the number of files read
+static int readPooled(FileRead* files, int n, int nThreads) {
+    Thread threads[POOL_THREADS];
+    ReadPool pool;
+    int i;
+    for (i=0; i<n; i++) {
+        files[i].data = NULL;
+        files[i].size = 0;
+        files[i].error = 0;
+    }
+    pool.files = files;
+    pool.n = n;
+    pool.next = pool.nRead = 0;
+    mutexInit(&pool.lock);
+    for (i=0; i<nThreads; i++) threadCreate(&threads[i], runPoolThread, &pool);
+    for (i=0; i<nThreads; i++) threadJoin(threads[i]);
+    mutexDestroy(&pool.lock);
+    return pool.nRead;
+}
+
+// Compare the backends and a pool of threads with blocking reads, e.g. on
+// a cold page cache after
+//     sync; echo 3 > /proc/sys/vm/drop_caches
+int main(int argc, char** argv) {
+    BatchReader reader;
+    FileRead* files;
+    int b, n = argc - 1, nRead;
+    double start;
+    long bytes;
+    if (n < 1) {
+        printf("usage: batchRead <file>...\n");
+        return 1;
+    }
+    files = (FileRead*)calloc(n, sizeof(FileRead));
+    for (b=0; b<n; b++)
+        files[b].path = argv[b+1];
+    for (b=0; b<SIZEOF_READ_BACKEND; b++) {
+        initBatchReader(&reader, (ReadBackend)b, 64);
+        readFileBatch(&reader, files, n);
+        printf("%-8s %d files, %d failed, %ld bytes in %.3f ms\n", readBackendNames[reader.used],
+               n, reader.nFailed, reader.bytes, 1000 * reader.seconds);
+        freeFileBatch(files, n);
+    }
+    start = wallClock();
+    nRead = readPooled(files, n, POOL_THREADS);
+    start = wallClock() - start;
+    for (b=0, bytes=0; b<n; b++) bytes += files[b].size;
+    printf("pool(%d) %d files, %d failed, %ld bytes in %.3f ms\n", POOL_THREADS,
+           n, n - nRead, bytes, 1000 * start);
+    freeFileBatch(files, n);
+    free(files);
+    return 0;
+}
+#endif // TEST
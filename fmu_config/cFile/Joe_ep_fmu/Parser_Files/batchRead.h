@@ -0,0 +1,60 @@
+/* -------------------------------------------------------------------------
+ * batchRead.h
+ * Reads the contents of many small files, e.g. the modelDescription.xml
+ * of each home, with many reads in flight. On Linux, reads are submitted
+ * in batches through io_uring. Elsewhere, or if the kernel does not
+ * support the io_uring reads (Linux 5.6), files are read with blocking
+ * reads, with a readahead hint for the next files of the batch where
+ * available. Each file can be handed on as soon as it is read, e.g. to
+ * parse it while the rest of the batch is still being read.
+ * -------------------------------------------------------------------------*/
+
+#ifndef BATCH_READ_H
+#define BATCH_READ_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    read_blocking,           // one blocking read after the other, with readahead hints
+    read_uring,              // batched reads through io_uring
+    SIZEOF_READ_BACKEND
+} ReadBackend;
+
+// One file to read
+typedef struct {
+    const char* path;
+    char* data;              // NULL or the file contents, 0-terminated, the receiver must free it
+    long size;               // bytes in data, without the terminating 0
+    int error;               // 0, or the errno of the failed open or read
+} FileRead;
+
+typedef struct {
+    ReadBackend backend;     // requested backend
+    int queueDepth;          // max number of files open and read at once
+    // NULL, or called in the reading thread as soon as a file is read or
+    // has failed, once for each file, with its index in the batch
+    void (*fileDone)(int file, void* arg);
+    void* fileDoneArg;
+    // statistics of the last batch
+    ReadBackend used;        // backend that read the batch
+    int nFailed;             // files that could not be read
+    long bytes;              // bytes read
+    double seconds;          // wall clock time of the batch
+} BatchReader;
+
+extern const char* readBackendNames[SIZEOF_READ_BACKEND];
+
+void initBatchReader(BatchReader* reader, ReadBackend backend, int queueDepth);
+
+// Reads all n files. Files that cannot be read get data NULL and an error.
+// Returns the number of files read.
+int readFileBatch(BatchReader* reader, FileRead* files, int n);
+
+// Frees the data of all n files
+void freeFileBatch(FileRead* files, int n);
+
+#ifdef __cplusplus
+} // closing brace for extern "C"
+#endif
+#endif // BATCH_READ_H
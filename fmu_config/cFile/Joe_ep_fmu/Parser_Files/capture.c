@@ -0,0 +1,567 @@
+/* -------------------------------------------------------------------------
+ * capture.c
+ * Capture of socket bridge frames into a compact binary file, and paced
+ * replay of a capture from concurrent connections.
+ * -------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef STANDALONE_XML_PARSER
+#define logThis(n, ...) printf(__VA_ARGS__);printf("\n")
+#else
+#include "GlobalIncludes.h"
+#include "logging.h" // logThis
+#endif // STANDALONE_XML_PARSER
+
+#ifdef _WIN32
+#include <winsock2.h>
+#pragma comment(lib, "ws2_32.lib")
+typedef SOCKET CaptureSocket;
+#define closeSocket closesocket
+#define INVALID_CAPTURE_SOCKET INVALID_SOCKET
+#else
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+typedef int CaptureSocket;
+#define closeSocket close
+#define INVALID_CAPTURE_SOCKET (-1)
+#endif
+
+// A server that is gone must make send fail, not raise SIGPIPE
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SEND_FLAGS 0
+#endif
+
+#include "capture.h"
+#include "trace.h"
+
+#define CAPTURE_MAGIC 0x50414342 // "BCAP"
+#define CAPTURE_VERSION 1
+
+// -------------------------------------------------------------------------
+// Writing
+
+Capture* openCapture(const char* path) {
+    Capture* c = (Capture*)calloc(1, sizeof(Capture));
+    int header[2];
+    if (!c) return NULL;
+    c->file = fopen(path, "wb");
+    if (!c->file) {
+        logThis(ERROR_ERROR, "Cannot open file '%s'", path);
+        free(c);
+        return NULL;
+    }
+    header[0] = CAPTURE_MAGIC;
+    header[1] = CAPTURE_VERSION;
+    if (fwrite(header, sizeof(header), 1, c->file) != 1) {
+        logThis(ERROR_ERROR, "Cannot write file '%s'", path);
+        fclose(c->file);
+        free(c);
+        return NULL;
+    }
+    c->nBytes = sizeof(header);
+    mutexInit(&c->lock);
+    c->start = wallClock();
+    return c;
+}
+
+// Writes v as unsigned LEB128 to out. Returns the number of bytes.
+static int putVarint(unsigned char* out, unsigned long long v) {
+    int n = 0;
+    while (v >= 0x80) {
+        out[n++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    out[n++] = (unsigned char)v;
+    return n;
+}
+
+int captureFrame(Capture* c, int connection, int direction, const void* data, int size) {
+    unsigned char header[30];
+    long long micros;
+    int n, ok;
+    mutexLock(&c->lock);
+    if (c->failed) {
+        mutexUnlock(&c->lock);
+        return 0; // error
+    }
+    micros = (long long)((wallClock() - c->start) * 1e6);
+    if (micros < c->lastMicros) micros = c->lastMicros;
+    n = putVarint(header, micros - c->lastMicros);
+    n += putVarint(header + n, 2 * (unsigned long long)connection + direction);
+    n += putVarint(header + n, size);
+    ok = fwrite(header, 1, n, c->file) == (size_t)n
+      && fwrite(data, 1, size, c->file) == (size_t)size;
+    if (ok) {
+        c->lastMicros = micros;
+        c->nFrames++;
+        c->nBytes += n + size;
+    } else {
+        logThis(ERROR_ERROR, "Cannot write capture, later frames are dropped");
+        c->failed = 1;
+    }
+    mutexUnlock(&c->lock);
+    return ok;
+}
+
+int closeCapture(Capture* c) {
+    int ok;
+    if (!c) return 1;
+    ok = fclose(c->file) == 0 && !c->failed;
+    logThis(ERROR_INFO, "Captured %ld frames in %lld bytes", c->nFrames, c->nBytes);
+    mutexDestroy(&c->lock);
+    free(c);
+    return ok;
+}
+
+// -------------------------------------------------------------------------
+// Reading
+
+// Reads an unsigned LEB128 varint at *p, before end.
+// Returns 0 to indicate error, e.g. a truncated file.
+static int getVarint(const unsigned char** p, const unsigned char* end, unsigned long long* v) {
+    int shift = 0;
+    *v = 0;
+    while (*p < end && shift < 64) {
+        unsigned char b = *(*p)++;
+        *v |= (unsigned long long)(b & 0x7F) << shift;
+        if (!(b & 0x80)) return 1; // success
+        shift += 7;
+    }
+    return 0; // error
+}
+
+CaptureFile* readCapture(const char* path) {
+    CaptureFile* f = (CaptureFile*)calloc(1, sizeof(CaptureFile));
+    const unsigned char* p;
+    const unsigned char* end;
+    long size;
+    int capacity = 0;
+    long long micros = 0, first = 0;
+    FILE* file;
+    if (!f) return NULL;
+    file = fopen(path, "rb");
+    if (!file) {
+        logThis(ERROR_ERROR, "Cannot open file '%s'", path);
+        free(f);
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    f->data = size > 0 ? (unsigned char*)malloc(size) : NULL;
+    if (!f->data || fread(f->data, 1, size, file) != (size_t)size
+            || size < 8 || ((int*)f->data)[0] != CAPTURE_MAGIC || ((int*)f->data)[1] != CAPTURE_VERSION) {
+        logThis(ERROR_ERROR, "File '%s' is not a capture", path);
+        fclose(file);
+        freeCapture(f);
+        return NULL;
+    }
+    fclose(file);
+    p = f->data + 8;
+    end = f->data + size;
+    while (p < end) {
+        unsigned long long delta, channel, n;
+        CapturedFrame* frame;
+        if (!getVarint(&p, end, &delta) || !getVarint(&p, end, &channel)
+                || !getVarint(&p, end, &n) || n > (unsigned long long)(end - p)
+                || channel / 2 >= 0x7FFFFFFF) {
+            logThis(ERROR_ERROR, "Capture '%s' is truncated after %d frames", path, f->nFrames);
+            freeCapture(f);
+            return NULL;
+        }
+        if (f->nFrames == capacity) {
+            CapturedFrame* frames;
+            capacity = capacity ? 2 * capacity : 1024;
+            frames = (CapturedFrame*)realloc(f->frames, capacity * sizeof(CapturedFrame));
+            if (!frames) {
+                freeCapture(f);
+                return NULL;
+            }
+            f->frames = frames;
+        }
+        micros += delta;
+        // the server may wait long for its first connection after
+        // openCapture; the replay starts with the first frame
+        if (f->nFrames == 0) first = micros;
+        frame = &f->frames[f->nFrames++];
+        frame->micros = micros - first;
+        frame->connection = (int)(channel / 2);
+        frame->direction = (int)(channel % 2);
+        frame->size = (int)n;
+        frame->offset = p - f->data;
+        if (frame->connection >= f->nConnections) f->nConnections = frame->connection + 1;
+        p += n;
+    }
+    return f;
+}
+
+void freeCapture(CaptureFile* f) {
+    if (!f) return;
+    free(f->frames);
+    free(f->data);
+    free(f);
+}
+
+// -------------------------------------------------------------------------
+// Replay
+
+// Returns 0 to indicate error
+static int sendAll(CaptureSocket s, const void* buffer, int size) {
+    const char* p = (const char*)buffer;
+    while (size > 0) {
+        int n = send(s, p, size, SEND_FLAGS);
+        if (n <= 0) return 0; // error
+        p += n;
+        size -= n;
+    }
+    return 1; // success
+}
+
+// Returns 0 to indicate error, e.g. connection closed
+static int receiveAll(CaptureSocket s, void* buffer, int size) {
+    char* p = (char*)buffer;
+    while (size > 0) {
+        int n = recv(s, p, size, 0);
+        if (n <= 0) return 0; // error
+        p += n;
+        size -= n;
+    }
+    return 1; // success
+}
+
+static void sleepUntil(double time) {
+    double d = time - wallClock();
+    if (d <= 0) return;
+#ifdef _WIN32
+    Sleep((DWORD)(d * 1000));
+#else
+    {
+        struct timespec t;
+        t.tv_sec = (time_t)d;
+        t.tv_nsec = (long)((d - t.tv_sec) * 1e9);
+        nanosleep(&t, NULL);
+    }
+#endif
+}
+
+typedef struct {
+    CaptureFile* f;
+    int connection;
+    const char* ip;
+    int port;
+    double speedup;
+    double start;           // wallClock of the start of the replay
+    int nFrames;            // of this connection
+    int* frames;            // indexes into f->frames
+    double* latencies;      // of each down frame
+    unsigned char* buffer;  // for a down frame
+    long nSent;
+    long nReceived;
+    long nMismatches;
+    long long nBytes;
+    double end;             // wallClock after the last frame
+    int ok;
+} ReplayConnection;
+
+static void replayConnection(void* arg) {
+    ReplayConnection* r = (ReplayConnection*)arg;
+    struct sockaddr_in address;
+    CaptureSocket s = socket(AF_INET, SOCK_STREAM, 0);
+    double lastSent = 0;
+    int on = 1, i;
+    r->ok = 0;
+    r->end = wallClock();
+    if (s == INVALID_CAPTURE_SOCKET) return;
+    if (traceSampled(0)) {
+        char name[64];
+        sprintf(name, "replay connection %d", r->connection);
+        traceThreadName(name);
+    }
+#ifdef SO_NOSIGPIPE
+    setsockopt(s, SOL_SOCKET, SO_NOSIGPIPE, (const char*)&on, sizeof(on));
+#endif
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = inet_addr(r->ip);
+    address.sin_port = htons((unsigned short)r->port);
+    if (connect(s, (struct sockaddr*)&address, sizeof(address))) {
+        logThis(ERROR_ERROR, "Replay of connection %d cannot connect to %s:%d", r->connection, r->ip, r->port);
+        closeSocket(s);
+        return;
+    }
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(on));
+    for (i=0; i<r->nFrames; i++) {
+        CapturedFrame* frame = &r->f->frames[r->frames[i]];
+        const unsigned char* data = r->f->data + frame->offset;
+        if (frame->direction == CAPTURE_UP) {
+            if (r->speedup > 0) sleepUntil(r->start + frame->micros * 1e-6 / r->speedup);
+            if (!sendAll(s, data, frame->size)) break;
+            lastSent = wallClock();
+            r->nSent++;
+        } else {
+            if (!receiveAll(s, r->buffer, frame->size)) break;
+            r->latencies[r->nReceived] = wallClock() - lastSent;
+            if (traceSampled(r->nReceived))
+                traceEvent("replay round trip", r->nReceived, lastSent, lastSent + r->latencies[r->nReceived]);
+            r->nReceived++;
+            if (memcmp(r->buffer, data, frame->size)) r->nMismatches++;
+        }
+        r->nBytes += frame->size;
+    }
+    r->end = wallClock();
+    closeSocket(s);
+    if (i < r->nFrames) {
+        logThis(ERROR_ERROR, "Replay of connection %d lost the server after %d of %d frames",
+                r->connection, i, r->nFrames);
+        return;
+    }
+    r->ok = 1;
+}
+
+static int compareDoubles(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+int replayCapture(CaptureFile* f, const char* ip, int port, double speedup, CaptureReplayResult* result) {
+    ReplayConnection* rs = (ReplayConnection*)calloc(f->nConnections + 1, sizeof(ReplayConnection));
+    Thread* threads = (Thread*)calloc(f->nConnections + 1, sizeof(Thread));
+    int* indexes = (int*)malloc((f->nFrames + 1) * sizeof(int));
+    double* latencies = (double*)malloc((f->nFrames + 1) * sizeof(double));
+    int* started = (int*)calloc(f->nConnections + 1, sizeof(int));
+    int maxSize = 1, ok = 1, i, k;
+    double start, end;
+    long nLatencies = 0;
+    memset(result, 0, sizeof(CaptureReplayResult));
+#ifdef _WIN32
+    {
+        WSADATA wsa;
+        if (WSAStartup(MAKEWORD(2, 2), &wsa)) ok = 0;
+    }
+#endif
+    if (!ok || !rs || !threads || !indexes || !latencies || !started) {
+        free(rs);
+        free(threads);
+        free(indexes);
+        free(latencies);
+        free(started);
+        return 0; // error
+    }
+    // frames of each connection, in capture order, with the latencies
+    // of each connection at the same positions
+    for (i=0; i<f->nFrames; i++) {
+        rs[f->frames[i].connection].nFrames++;
+        if (f->frames[i].size > maxSize) maxSize = f->frames[i].size;
+    }
+    for (i=0, k=0; i<f->nConnections; i++) {
+        rs[i].frames = indexes + k;
+        rs[i].latencies = latencies + k;
+        k += rs[i].nFrames;
+        rs[i].nFrames = 0;
+    }
+    for (i=0; i<f->nFrames; i++) {
+        ReplayConnection* r = &rs[f->frames[i].connection];
+        r->frames[r->nFrames++] = i;
+    }
+    start = wallClock();
+    for (i=0; i<f->nConnections; i++) {
+        ReplayConnection* r = &rs[i];
+        if (!r->nFrames) continue;
+        r->f = f;
+        r->connection = i;
+        r->ip = ip;
+        r->port = port;
+        r->speedup = speedup;
+        r->start = start;
+        r->buffer = (unsigned char*)malloc(maxSize);
+        if (!r->buffer || !threadCreate(&threads[i], replayConnection, r)) {
+            ok = 0;
+            break;
+        }
+        started[i] = 1;
+    }
+    end = start;
+    for (i=0; i<f->nConnections; i++) {
+        ReplayConnection* r = &rs[i];
+        if (started[i]) {
+            threadJoin(threads[i]);
+            if (!r->ok) ok = 0;
+            if (r->end > end) end = r->end;
+            result->nSent += r->nSent;
+            result->nReceived += r->nReceived;
+            result->nMismatches += r->nMismatches;
+            result->nBytes += r->nBytes;
+            // compact the latencies
+            memmove(latencies + nLatencies, r->latencies, r->nReceived * sizeof(double));
+            nLatencies += r->nReceived;
+        }
+        free(r->buffer);
+    }
+    result->seconds = end - start;
+    if (result->seconds > 0) result->framesPerSecond = (result->nSent + result->nReceived) / result->seconds;
+    if (nLatencies > 0) {
+        double sum = 0;
+        qsort(latencies, nLatencies, sizeof(double), compareDoubles);
+        for (i=0; i<nLatencies; i++) sum += latencies[i];
+        result->meanLatency = sum / nLatencies;
+        result->medianLatency = latencies[nLatencies / 2];
+        result->p99Latency = latencies[(long)(0.99 * (nLatencies - 1))];
+        result->maxLatency = latencies[nLatencies - 1];
+    }
+    logThis(ERROR_INFO, "Replayed %ld frames on %d connections in %.3f s: %.0f frames/s, "
+            "latency mean %.1f us, median %.1f us, p99 %.1f us, max %.1f us, %ld mismatches",
+            result->nSent + result->nReceived, f->nConnections, result->seconds, result->framesPerSecond,
+            1e6 * result->meanLatency, 1e6 * result->medianLatency, 1e6 * result->p99Latency,
+            1e6 * result->maxLatency, result->nMismatches);
+    free(rs);
+    free(threads);
+    free(indexes);
+    free(latencies);
+    free(started);
+    return ok;
+}
+
+// #define TEST
+#ifdef TEST
+#ifndef _WIN32
+#include <math.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include "shard.h"
+
+#define N_WORKERS 16
+#define N_HOMES 3000
+#define N_UP 2
+#define N_DOWN 2
+
+static double homeEnergy(int home, int step) {
+    return 3.6e3 * (1.5 + sin(0.37 * home + 0.11 * step));
+}
+
+// A worker process: connect, retrying until the coordinator listens,
+// then exchange the sums over its homes for each step
+static int runWorker(int port, int shard, int nSteps) {
+    ShardWorker* w = NULL;
+    ExactSum up[N_UP];
+    double down[N_DOWN];
+    int first, count, step, k, tries;
+    shardRange(N_HOMES, N_WORKERS, shard, &first, &count);
+    for (tries=0; !w && tries<200; tries++) {
+        w = shardWorkerOpen("127.0.0.1", port, shard, N_UP, N_DOWN);
+        if (!w) usleep(20000);
+    }
+    if (!w) return 1;
+    for (step=0; step<nSteps; step++) {
+        exactSumInit(&up[0]);
+        exactSumInit(&up[1]);
+        for (k=first; k<first+count; k++) {
+            exactSumAdd(&up[0], homeEnergy(k, step));
+            exactSumAdd(&up[1], 1);
+        }
+        if (!shardWorkerExchange(w, step, up, down)) break;
+    }
+    shardWorkerClose(w);
+    return step < nSteps;
+}
+
+// The steps of a coordinator: answer each step with its total and number
+typedef struct {
+    Coordinator* c;
+    int port;
+    int nSteps;
+    int ok;
+} Server;
+
+static void runSteps(Server* s) {
+    double up[N_UP], down[N_DOWN];
+    int step;
+    coordinatorSetTimeout(s->c, 10);
+    for (step=0; s->ok && step<s->nSteps; step++) {
+        s->ok = coordinatorGather(s->c, step, up);
+        down[0] = up[0];
+        down[1] = step;
+        s->ok = s->ok && coordinatorScatter(s->c, step, down);
+    }
+}
+
+static void runServer(void* arg) {
+    Server* s = (Server*)arg;
+    s->c = coordinatorOpen(s->port, N_WORKERS, N_UP, N_DOWN);
+    s->ok = s->c != NULL;
+    if (s->ok) runSteps(s);
+    coordinatorClose(s->c);
+}
+
+// capture [<capture file> [<port> [<steps>]]]: capture 16 worker
+// processes with a coordinator, then replay the capture against a new
+// coordinator, as fast as possible and at the captured pace
+int main(int argc, char** argv) {
+    const char* path = argc > 1 ? argv[1] : "shard.bcap";
+    int port = argc > 2 ? atoi(argv[2]) : 47951;
+    int nSteps = argc > 3 ? atoi(argv[3]) : 300;
+    double speedups[] = { 0, 1 };
+    pid_t pids[N_WORKERS];
+    CaptureReplayResult result;
+    CaptureFile* f;
+    Capture* capture;
+    Server server;
+    Thread thread;
+    int i, status, failed = 0;
+    capture = openCapture(path);
+    if (!capture) return 1;
+    fflush(stdout);
+    for (i=0; i<N_WORKERS; i++) {
+        pids[i] = fork();
+        if (pids[i] == 0) _exit(runWorker(port, i, nSteps));
+    }
+    server.port = port;
+    server.nSteps = nSteps;
+    server.c = coordinatorOpenCaptured(port, N_WORKERS, N_UP, N_DOWN, capture);
+    server.ok = server.c != NULL;
+    if (server.ok) runSteps(&server);
+    coordinatorClose(server.c);
+    for (i=0; i<N_WORKERS; i++) {
+        if (!server.ok) kill(pids[i], SIGKILL);
+        if (waitpid(pids[i], &status, 0) != pids[i] || !WIFEXITED(status) || WEXITSTATUS(status)) server.ok = 0;
+    }
+    if (!closeCapture(capture) || !server.ok) {
+        printf("capture failed\n");
+        return 1;
+    }
+    f = readCapture(path);
+    if (!f) return 1;
+    // a hello, then a step and its answer per step from each worker
+    if (f->nConnections != N_WORKERS || f->nFrames != N_WORKERS * (1 + 2 * nSteps) || f->frames[0].micros) {
+        printf("expected %d frames of %d connections from 0 us, got %d of %d from %lld us\n",
+               N_WORKERS * (1 + 2 * nSteps), N_WORKERS, f->nFrames, f->nConnections, f->frames[0].micros);
+        failed = 1;
+    }
+    printf("captured %d frames in %.3f s\n", f->nFrames, f->frames[f->nFrames - 1].micros * 1e-6);
+    for (i=0; !failed && i<2; i++) {
+        server.port = port + 1 + i;
+        server.ok = 1;
+        threadCreate(&thread, runServer, &server);
+        usleep(200000); // until the coordinator listens
+        if (!replayCapture(f, "127.0.0.1", server.port, speedups[i], &result) || result.nMismatches) failed = 1;
+        threadJoin(thread);
+        if (!server.ok) failed = 1;
+        printf("speedup %g: %.3f s, %.0f frames/s, latency median %.1f us, p99 %.1f us, %ld mismatches\n",
+               speedups[i], result.seconds, result.framesPerSecond, 1e6 * result.medianLatency,
+               1e6 * result.p99Latency, result.nMismatches);
+    }
+    freeCapture(f);
+    printf("%s\n", failed ? "failed" : "ok");
+    return failed;
+}
+#endif // _WIN32
+#endif // TEST
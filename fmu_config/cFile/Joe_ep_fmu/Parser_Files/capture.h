@@ -0,0 +1,95 @@
+/* -------------------------------------------------------------------------
+ * capture.h
+ * Capture and replay of the traffic of a socket bridge, e.g. the shard
+ * coordinator, for load tests of the server without the EnergyPlus fleet.
+ * The server records each frame it receives (up) or sends (down) on a
+ * connection, with the time since the capture was opened. A replay client
+ * opens one connection per captured connection, all running concurrently,
+ * sends the up frames at their original pace, counted from the first
+ * frame, or faster, and waits for each down frame, measuring the latency
+ * from the last frame sent. If tracing is on (see trace.h), each of these
+ * round trips is recorded as a trace event, with the number of the down
+ * frame of its connection as id.
+ * The replay knows nothing about the protocol: the server must answer
+ * with frames of the captured sizes, in the captured order.
+ * Capture file: the magic "BCAP" and a version, both 4 byte integers,
+ * then for each frame, as unsigned LEB128 varints, the microseconds since
+ * the previous frame, connection * 2 + direction and the size, followed
+ * by the bytes of the frame. Frames are stored as sent, in host byte
+ * order for the shard protocol.
+ * -------------------------------------------------------------------------*/
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdio.h>
+#include "thread_support.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CAPTURE_UP 0        // received by the server
+#define CAPTURE_DOWN 1      // sent by the server
+
+typedef struct {
+    FILE* file;
+    Mutex lock;             // frames of several connections may be captured concurrently
+    double start;           // wallClock when opened
+    long long lastMicros;   // time of the last frame
+    long nFrames;
+    long long nBytes;       // written to the file
+    int failed;             // set after a write error, further frames are dropped
+} Capture;
+
+// Returns NULL to indicate failure
+Capture* openCapture(const char* path);
+
+// Append one frame. Returns 1 to indicate success and 0 for error.
+int captureFrame(Capture* c, int connection, int direction, const void* data, int size);
+
+// Returns 1 if all frames were written
+int closeCapture(Capture* c);
+
+typedef struct {
+    long long micros;       // since the first frame
+    int connection;
+    int direction;          // CAPTURE_UP or CAPTURE_DOWN
+    int size;
+    size_t offset;          // of the bytes in data
+} CapturedFrame;
+
+typedef struct {
+    int nFrames;
+    CapturedFrame* frames;
+    int nConnections;       // largest connection number + 1
+    unsigned char* data;
+} CaptureFile;
+
+// Returns NULL to indicate failure
+CaptureFile* readCapture(const char* path);
+void freeCapture(CaptureFile* f);
+
+typedef struct {
+    long nSent;             // up frames
+    long nReceived;         // down frames
+    long nMismatches;       // down frames that differ from the captured ones
+    long long nBytes;       // sent and received
+    double seconds;         // from the first connect to the last frame
+    double framesPerSecond; // sent and received
+    double meanLatency;     // seconds from the last up frame to a down frame
+    double medianLatency;
+    double p99Latency;
+    double maxLatency;
+} CaptureReplayResult;
+
+// Replay f against the server at ip:port. speedup 1 keeps the captured
+// pace, 10 sends ten times faster, and 0 sends each up frame as soon as
+// the down frames before it arrived.
+// Returns 1 if all frames were exchanged and 0 for error.
+int replayCapture(CaptureFile* f, const char* ip, int port, double speedup, CaptureReplayResult* result);
+
+#ifdef __cplusplus
+} // closing brace for extern "C"
+#endif
+#endif // CAPTURE_H
@@ -0,0 +1,274 @@
+/* -------------------------------------------------------------------------
+ * catalog.c
+ * Federation-wide variable catalog with shared schemas and columns.
+ * -------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef STANDALONE_XML_PARSER
+#define logThis(n, ...) printf(__VA_ARGS__);printf("\n")
+#else
+#include "GlobalIncludes.h"
+#include "logging.h" // logThis
+#endif // STANDALONE_XML_PARSER
+
+#include "catalog.h"
+
+#define SLOT(kind, column) (((kind) << 24) + (column) + 1)
+#define SLOT_KIND(slot) (((slot) - 1) >> 24)
+#define SLOT_COLUMN(slot) (((slot) - 1) & 0xFFFFFF)
+
+// Returns the kind of a cataloged variable, or -1 for aliases and strings
+static int variableKind(ScalarVariable* sv) {
+    if (getAlias(sv) != enu_noAlias) return -1;
+    switch (sv->typeSpec->type) {
+        case elm_Real: return kind_real;
+        case elm_Integer:
+        case elm_Enumeration: return kind_integer;
+        case elm_Boolean: return kind_boolean;
+        default: return -1;
+    }
+}
+
+static unsigned int hashString(unsigned int h, const char* s) {
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static unsigned int hashWord(unsigned int h, unsigned int w) {
+    int i;
+    for (i=0; i<4; i++) {
+        h ^= (w >> 8 * i) & 0xFF;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static unsigned int interfaceHash(ModelDescription* md) {
+    unsigned int h = 2166136261u;
+    int i;
+    if (!md->modelVariables) return h;
+    for (i=0; md->modelVariables[i]; i++) {
+        ScalarVariable* sv = md->modelVariables[i];
+        int kind = variableKind(sv);
+        if (kind < 0) continue;
+        h = hashString(h, getName(sv));
+        h = hashWord(h, getValueReference(sv));
+        h = hashWord(h, kind);
+        h = hashWord(h, getCausality(sv));
+    }
+    return h;
+}
+
+// Returns 1 if both models have the same cataloged variables in the same order
+static int sameInterface(ModelDescription* a, ModelDescription* b) {
+    int i = 0, j = 0;
+    for (;;) {
+        ScalarVariable* x = NULL;
+        ScalarVariable* y = NULL;
+        while (a->modelVariables && (x = a->modelVariables[i]) && variableKind(x) < 0) i++;
+        while (b->modelVariables && (y = b->modelVariables[j]) && variableKind(y) < 0) j++;
+        if (!x || !y) return x == y;
+        if (variableKind(x) != variableKind(y)
+                || getValueReference(x) != getValueReference(y)
+                || getCausality(x) != getCausality(y)
+                || strcmp(getName(x), getName(y))) return 0;
+        i++;
+        j++;
+    }
+}
+
+static unsigned int nameHash(const char* name, int kind) {
+    return hashWord(hashString(2166136261u, name), kind);
+}
+
+static int findSlot(Catalog* c, const char* name, int kind) {
+    int i = nameHash(name, kind) & (c->nSlots - 1);
+    while (c->slots[i]) {
+        int slot = c->slots[i];
+        if (SLOT_KIND(slot) == kind && !strcmp(c->columns[kind][SLOT_COLUMN(slot)].name, name)) break;
+        i = (i + 1) & (c->nSlots - 1);
+    }
+    return i;
+}
+
+// Doubles the name table when it gets half full.
+// Returns 1 to indicate success and 0 if no memory is available.
+static int growSlots(Catalog* c) {
+    int* old = c->slots;
+    int nOld = c->nSlots, i;
+    c->nSlots = nOld ? 2 * nOld : 256;
+    c->slots = (int*)calloc(c->nSlots, sizeof(int));
+    if (!c->slots) {
+        c->slots = old;
+        c->nSlots = nOld;
+        return 0; // error
+    }
+    for (i=0; i<nOld; i++) {
+        int slot = old[i];
+        if (slot) {
+            int kind = SLOT_KIND(slot);
+            c->slots[findSlot(c, c->columns[kind][SLOT_COLUMN(slot)].name, kind)] = slot;
+        }
+    }
+    free(old);
+    return 1; // success
+}
+
+// Returns the column of a variable, appending a new one for a new name,
+// or -1 if no memory is available
+static int internColumn(Catalog* c, ScalarVariable* sv, int kind, int* capacity) {
+    const char* name = getName(sv);
+    int i, n;
+    if (2 * (c->nColumns[0] + c->nColumns[1] + c->nColumns[2] + 1) > c->nSlots && !growSlots(c)) return -1;
+    i = findSlot(c, name, kind);
+    if (c->slots[i]) return SLOT_COLUMN(c->slots[i]);
+    n = c->nColumns[kind];
+    if (n == capacity[kind]) {
+        int size = capacity[kind] ? 2 * capacity[kind] : 64;
+        CatalogColumn* columns = (CatalogColumn*)realloc(c->columns[kind], size * sizeof(CatalogColumn));
+        if (!columns) return -1;
+        c->columns[kind] = columns;
+        capacity[kind] = size;
+    }
+    c->columns[kind][n].name = strdup(name);
+    if (!c->columns[kind][n].name) return -1;
+    c->columns[kind][n].causality = getCausality(sv);
+    c->columns[kind][n].nHomes = 0;
+    c->nColumns[kind] = n + 1;
+    c->slots[i] = SLOT(kind, n);
+    return n;
+}
+
+// Fills a new schema from md. Returns 1 to indicate success and 0 for error.
+static int addSchema(Catalog* c, CatalogSchema* s, ModelDescription* md, int* capacity) {
+    int i, kind;
+    if (md->modelVariables) {
+        for (i=0; md->modelVariables[i]; i++) {
+            kind = variableKind(md->modelVariables[i]);
+            if (kind >= 0) s->nVariables[kind]++;
+        }
+    }
+    for (kind=0; kind<SIZEOF_KIND; kind++) {
+        // at least one element, so that NULL means no memory
+        s->vrs[kind] = (fmiValueReference*)malloc((s->nVariables[kind] + 1) * sizeof(fmiValueReference));
+        s->columns[kind] = (int*)malloc((s->nVariables[kind] + 1) * sizeof(int));
+        if (!s->vrs[kind] || !s->columns[kind]) return 0; // error
+        s->nVariables[kind] = 0;
+    }
+    if (!md->modelVariables) return 1; // success
+    for (i=0; md->modelVariables[i]; i++) {
+        ScalarVariable* sv = md->modelVariables[i];
+        int column, n;
+        kind = variableKind(sv);
+        if (kind < 0) continue;
+        column = internColumn(c, sv, kind, capacity);
+        if (column < 0) return 0; // error
+        n = s->nVariables[kind]++;
+        s->vrs[kind][n] = getValueReference(sv);
+        s->columns[kind][n] = column;
+    }
+    return 1; // success
+}
+
+Catalog* newCatalog(ModelDescription** mds, int nHomes) {
+    Catalog* c = (Catalog*)calloc(1, sizeof(Catalog));
+    ModelDescription** schemaModels = NULL;   // first home of each schema
+    int capacity[SIZEOF_KIND] = { 0 };
+    int home, i, kind;
+    size_t n;
+    if (!c) return NULL;
+    c->nHomes = nHomes;
+    c->homeSchema = (int*)malloc((nHomes + 1) * sizeof(int));
+    c->schemas = (CatalogSchema*)calloc(nHomes + 1, sizeof(CatalogSchema));
+    schemaModels = (ModelDescription**)malloc((nHomes + 1) * sizeof(ModelDescription*));
+    if (!c->homeSchema || !c->schemas || !schemaModels || !growSlots(c)) goto error;
+    for (home=0; home<nHomes; home++) {
+        unsigned int hash = interfaceHash(mds[home]);
+        CatalogSchema* s;
+        for (i=0; i<c->nSchemas; i++) {
+            if (c->schemas[i].hash == hash && sameInterface(schemaModels[i], mds[home])) break;
+        }
+        if (i == c->nSchemas) {
+            s = &c->schemas[c->nSchemas++];
+            s->hash = hash;
+            schemaModels[i] = mds[home];
+            if (!addSchema(c, s, mds[home], capacity)) goto error;
+        }
+        c->schemas[i].nHomes++;
+        c->homeSchema[home] = i;
+    }
+    for (i=0; i<c->nSchemas; i++) {
+        CatalogSchema* s = &c->schemas[i];
+        int j;
+        for (kind=0; kind<SIZEOF_KIND; kind++) {
+            for (j=0; j<s->nVariables[kind]; j++) c->columns[kind][s->columns[kind][j]].nHomes += s->nHomes;
+        }
+    }
+    // at least one element, so that NULL means no memory
+    n = (size_t)nHomes;
+    c->reals = (double*)calloc(n * c->nColumns[kind_real] + 1, sizeof(double));
+    c->integers = (int*)calloc(n * c->nColumns[kind_integer] + 1, sizeof(int));
+    c->booleans = (char*)calloc(n * c->nColumns[kind_boolean] + 1, sizeof(char));
+    if (!c->reals || !c->integers || !c->booleans) goto error;
+    free(schemaModels);
+    logThis(ERROR_INFO, "Catalog of %d homes: %d schemas, %d real, %d integer and %d boolean columns",
+            nHomes, c->nSchemas, c->nColumns[kind_real], c->nColumns[kind_integer], c->nColumns[kind_boolean]);
+    return c;
+
+error:
+    logThis(ERROR_ERROR, "Out of memory building the catalog of %d homes", nHomes);
+    free(schemaModels);
+    freeCatalog(c);
+    return NULL;
+}
+
+void freeCatalog(Catalog* c) {
+    int i, kind;
+    if (!c) return;
+    for (i=0; i<c->nSchemas; i++) {
+        for (kind=0; kind<SIZEOF_KIND; kind++) {
+            free(c->schemas[i].vrs[kind]);
+            free(c->schemas[i].columns[kind]);
+        }
+    }
+    for (kind=0; kind<SIZEOF_KIND; kind++) {
+        for (i=0; i<c->nColumns[kind]; i++) free(c->columns[kind][i].name);
+        free(c->columns[kind]);
+    }
+    free(c->schemas);
+    free(c->homeSchema);
+    free(c->reals);
+    free(c->integers);
+    free(c->booleans);
+    free(c->slots);
+    free(c);
+}
+
+int catalogFind(Catalog* c, const char* name, VariableKind kind) {
+    int slot = c->slots[findSlot(c, name, kind)];
+    return slot ? SLOT_COLUMN(slot) : -1;
+}
+
+void catalogStoreReals(Catalog* c, int home, const double* values) {
+    CatalogSchema* s = catalogSchema(c, home);
+    double* reals = c->reals + home;
+    int i;
+    for (i=0; i<s->nVariables[kind_real]; i++) {
+        reals[(size_t)s->columns[kind_real][i] * c->nHomes] = values[i];
+    }
+}
+
+void catalogLoadReals(Catalog* c, int home, double* values) {
+    CatalogSchema* s = catalogSchema(c, home);
+    const double* reals = c->reals + home;
+    int i;
+    for (i=0; i<s->nVariables[kind_real]; i++) {
+        values[i] = reals[(size_t)s->columns[kind_real][i] * c->nHomes];
+    }
+}
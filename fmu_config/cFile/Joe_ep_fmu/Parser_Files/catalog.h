@@ -0,0 +1,85 @@
+/* -------------------------------------------------------------------------
+ * catalog.h
+ * Federation-wide catalog of the variables of all homes. Each variable
+ * name of a kind (real, integer, boolean) gets one column, and each
+ * column holds the values of all homes contiguously, so that e.g.
+ * epSendNetEnergy of all homes is one array of nHomes doubles:
+ *     int col = catalogFind(c, "epSendNetEnergy", kind_real);
+ *     double* netEnergy = catalogRealColumn(c, col);
+ * Homes with identical interfaces (same variables, value references and
+ * causalities in the same order) share one schema, which maps the value
+ * references of a home to columns, for the exchange with the FMU.
+ * Alias variables and strings are not cataloged.
+ * -------------------------------------------------------------------------*/
+
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include "xml_parser.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    kind_real,         // Real
+    kind_integer,      // Integer and Enumeration
+    kind_boolean,      // Boolean, stored as char like fmiBoolean
+    SIZEOF_KIND
+} VariableKind;
+
+typedef struct {
+    char* name;
+    Enu causality;     // of the first home that has the variable
+    int nHomes;        // homes that have the variable
+} CatalogColumn;
+
+typedef struct {
+    unsigned int hash;
+    int nHomes;                            // homes with this schema
+    int nVariables[SIZEOF_KIND];
+    fmiValueReference* vrs[SIZEOF_KIND];   // of the variables of a kind, in model order
+    int* columns[SIZEOF_KIND];             // column of each of these variables
+} CatalogSchema;
+
+typedef struct {
+    int nHomes;
+    int nSchemas;
+    CatalogSchema* schemas;
+    int* homeSchema;                       // schema of each home
+    int nColumns[SIZEOF_KIND];
+    CatalogColumn* columns[SIZEOF_KIND];
+    double* reals;                         // values [column][home]
+    int* integers;
+    char* booleans;
+    int nSlots;                            // name table, open addressing
+    int* slots;                            // kind * 2^24 + column + 1, 0 if empty
+} Catalog;
+
+// Build the catalog of nHomes loaded model descriptions. All values are 0.
+// Returns NULL if no memory is available.
+Catalog* newCatalog(ModelDescription** mds, int nHomes);
+void freeCatalog(Catalog* c);
+
+// Returns the column of the named variable of the given kind, or -1
+int catalogFind(Catalog* c, const char* name, VariableKind kind);
+
+// Values of one column for all homes, nHomes contiguous values. The
+// entries of homes without the variable stay 0.
+#define catalogRealColumn(c, column)    ((c)->reals + (size_t)(column) * (c)->nHomes)
+#define catalogIntegerColumn(c, column) ((c)->integers + (size_t)(column) * (c)->nHomes)
+#define catalogBooleanColumn(c, column) ((c)->booleans + (size_t)(column) * (c)->nHomes)
+
+// The schema of a home: variables of a kind, value references and columns
+#define catalogSchema(c, home) (&(c)->schemas[(c)->homeSchema[home]])
+
+// Copy the real values of one home, in the order of the value references
+// of its schema, e.g. from fmiGetReal, into the columns, or back.
+// Do not allocate memory.
+void catalogStoreReals(Catalog* c, int home, const double* values);
+void catalogLoadReals(Catalog* c, int home, double* values);
+
+#ifdef __cplusplus
+} // closing brace for extern "C"
+#endif
+#endif // CATALOG_H
@@ -0,0 +1,311 @@
+/* -------------------------------------------------------------------------
+ * controller.c
+ * Hot-reloadable controller plugins over the columns of the catalog.
+ * -------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef STANDALONE_XML_PARSER
+#define logThis(n, ...) printf(__VA_ARGS__);printf("\n")
+#else
+#include "GlobalIncludes.h"
+#include "logging.h" // logThis
+#endif // STANDALONE_XML_PARSER
+
+#ifdef _WIN32
+#include <windows.h>
+#define atomicIncrement(p) InterlockedIncrement(p)
+#define atomicExchange(p, v) InterlockedExchangePointer((PVOID volatile*)(p), (v))
+#else
+#define atomicIncrement(p) __sync_add_and_fetch((p), 1)
+#define atomicExchange(p, v) __atomic_exchange_n((p), (v), __ATOMIC_ACQ_REL)
+#endif
+
+#include "controller.h"
+#include "sharedLib.h"
+#include "thread_support.h" // wallClock
+#include "trace.h"
+
+static int findColumn(const ControllerView* view, const char* name) {
+    int i;
+    for (i=0; i<view->nColumns; i++) {
+        if (!strcmp(view->names[i], name)) return i;
+    }
+    return -1;
+}
+
+ControllerHost* newControllerHost(Catalog* catalog, const char* copyDir) {
+    ControllerHost* h = (ControllerHost*)calloc(1, sizeof(ControllerHost));
+    int n = catalog->nColumns[kind_real], i;
+    if (!h) return NULL;
+    h->catalog = catalog;
+    h->copyDir = strdup(copyDir);
+    // at least one element, so that NULL means no memory
+    h->view.names = (const char**)malloc((n + 1) * sizeof(const char*));
+    h->view.columns = (double**)malloc((n + 1) * sizeof(double*));
+    if (!h->copyDir || !h->view.names || !h->view.columns) {
+        freeControllerHost(h);
+        return NULL;
+    }
+    h->view.abiVersion = CONTROLLER_ABI_VERSION;
+    h->view.nHomes = catalog->nHomes;
+    h->view.nColumns = n;
+    for (i=0; i<n; i++) {
+        h->view.names[i] = catalog->columns[kind_real][i].name;
+        h->view.columns[i] = catalogRealColumn(catalog, i);
+    }
+    h->view.findColumn = findColumn;
+    return h;
+}
+
+int addControllerColumn(ControllerHost* h, const char* name, double* values) {
+    int n = h->view.nColumns;
+    const char** names;
+    double** columns;
+    if (h->nCopies) {
+        logThis(ERROR_ERROR, "Cannot add column '%s' after loading a controller", name);
+        return 0; // error
+    }
+    names = (const char**)realloc((void*)h->view.names, (n + 1) * sizeof(const char*));
+    if (!names) return 0; // error
+    h->view.names = names;
+    columns = (double**)realloc(h->view.columns, (n + 1) * sizeof(double*));
+    if (!columns) return 0; // error
+    h->view.columns = columns;
+    names[n] = name;
+    columns[n] = values;
+    h->view.nColumns = n + 1;
+    return 1; // success
+}
+
+// Stop the plugin, unload and delete its copy
+static void unloadPlugin(ControllerPlugin* p) {
+    if (!p) return;
+    if (p->stop) p->stop(p->state);
+    closeSharedLib(p->dllHandle);
+    removeSharedLibCopy(p->copyPath);
+    free(p->path);
+    free(p);
+}
+
+void freeControllerHost(ControllerHost* h) {
+    if (!h) return;
+    unloadPlugin(h->active);
+    unloadPlugin(h->pending);
+    free((void*)h->view.names);
+    free(h->view.columns);
+    free(h->copyDir);
+    free(h);
+}
+
+// Load the copy of the plugin and resolve its functions.
+// Returns 1 to indicate success and 0 for error.
+static int openPlugin(ControllerPlugin* p, fControllerAbi* abi, fControllerStart* start) {
+    p->dllHandle = openSharedLib(p->copyPath);
+    if (!p->dllHandle) {
+        logThis(ERROR_ERROR, "Cannot load controller '%s'", p->path);
+        return 0; // error
+    }
+    *abi = (fControllerAbi)sharedLibSymbol(p->dllHandle, "controllerAbi");
+    p->step = (fControllerStep)sharedLibSymbol(p->dllHandle, "controllerStep");
+    *start = (fControllerStart)sharedLibSymbol(p->dllHandle, "controllerStart");
+    p->stop = (fControllerStop)sharedLibSymbol(p->dllHandle, "controllerStop");
+    if (!*abi || !p->step) {
+        logThis(ERROR_ERROR, "Controller '%s' does not export controllerAbi and controllerStep", p->path);
+        p->stop = NULL;
+        return 0; // error
+    }
+    if ((*abi)() != CONTROLLER_ABI_VERSION) {
+        logThis(ERROR_ERROR, "Controller '%s' has ABI version %d, expected %d",
+                p->path, (*abi)(), CONTROLLER_ABI_VERSION);
+        p->stop = NULL;
+        return 0; // error
+    }
+    return 1; // success
+}
+
+int loadController(ControllerHost* h, const char* path) {
+    ControllerPlugin* p = (ControllerPlugin*)calloc(1, sizeof(ControllerPlugin));
+    ControllerPlugin* old;
+    ControllerView view;
+    fControllerAbi abi;
+    fControllerStart start;
+    // from now on, no column may be added, see addControllerColumn
+    atomicIncrement(&h->nCopies);
+    if (!p) return 0; // error
+    p->path = strdup(path);
+    if (!p->path) {
+        unloadPlugin(p);
+        return 0; // error
+    }
+    p->copyPath = copySharedLib(path, h->copyDir, "controller", SHARED_LIB_SUFFIX);
+    if (!p->copyPath) {
+        logThis(ERROR_ERROR, "Cannot copy controller '%s'", path);
+        unloadPlugin(p);
+        return 0; // error
+    }
+    if (!openPlugin(p, &abi, &start)) {
+        unloadPlugin(p);
+        return 0; // error
+    }
+    // a view of its own: the old controller may be running on h->view,
+    // so copy only what runController does not change
+    memset(&view, 0, sizeof(ControllerView));
+    view.abiVersion = CONTROLLER_ABI_VERSION;
+    view.nHomes = h->view.nHomes;
+    view.nColumns = h->view.nColumns;
+    view.names = h->view.names;
+    view.columns = h->view.columns;
+    view.findColumn = findColumn;
+    if (start) {
+        // NULL means the plugin failed to start, see controller.h
+        p->state = start(&view);
+        if (!p->state) {
+            logThis(ERROR_ERROR, "Controller '%s' failed to start, controllerStart returned NULL", path);
+            p->stop = NULL;
+            unloadPlugin(p);
+            return 0; // error
+        }
+    }
+    old = (ControllerPlugin*)atomicExchange(&h->pending, p);
+    if (old) {
+        logThis(ERROR_WARNING, "Controller '%s' replaced before it ran", old->path);
+        unloadPlugin(old);
+    }
+    logThis(ERROR_INFO, "Loaded controller '%s', active from the next timestep", path);
+    return 1; // success
+}
+
+int runController(ControllerHost* h, double time, double stepSize) {
+    ControllerPlugin* p = (ControllerPlugin*)atomicExchange(&h->pending, NULL);
+    double start;
+    int status;
+    if (p) {
+        ControllerPlugin* old = h->active;
+        if (old) {
+            logThis(ERROR_INFO, "Controller '%s' replaced at time %g after %ld steps, "
+                    "%.1f us mean, %.1f us max per step", old->path, time, old->nSteps,
+                    old->nSteps ? 1e6 * old->stepSeconds / old->nSteps : 0.0, 1e6 * old->maxStepSeconds);
+        }
+        h->active = p;
+        h->nSwaps++;
+        unloadPlugin(old);
+    }
+    p = h->active;
+    if (!p) return 1; // success
+    h->view.time = time;
+    h->view.stepSize = stepSize;
+    h->view.state = p->state;
+    start = wallClock();
+    status = p->step(&h->view);
+    h->lastStepSeconds = wallClock() - start;
+    if (traceSampled(h->nRuns)) traceEvent("controller", h->nRuns, start, start + h->lastStepSeconds);
+    h->nRuns++;
+    p->nSteps++;
+    p->stepSeconds += h->lastStepSeconds;
+    if (h->lastStepSeconds > p->maxStepSeconds) p->maxStepSeconds = h->lastStepSeconds;
+    if (status) {
+        logThis(ERROR_ERROR, "Controller '%s' failed at time %g with status %d", p->path, time, status);
+        return 0; // error
+    }
+    return 1; // success
+}
+
+// #define TEST
+#ifdef TEST
+#include "barrier.h"
+
+#define TEST_HOMES 300
+#define TEST_THREADS 8
+#define TEST_STEPS 2000
+#define TEST_RELOADS 30
+
+typedef struct {
+    ControllerHost* host;
+    TreeBarrier* barrier;
+    double* zoneTemp;
+    double* startHeating;
+    double* version;
+    double stepVersion[TEST_STEPS];   // of home 0, by the thread that ran the controller
+    volatile int failed;
+} Harness;
+
+static Harness harness;
+
+// The homes of one thread: set the zone temperatures, wait until the
+// controller ran, then check that all homes got the decision of the same
+// plugin
+static void runHomes(void* arg) {
+    int thread = (int)(long)arg;
+    int k, i;
+    for (k=0; k<TEST_STEPS; k++) {
+        for (i=thread; i<TEST_HOMES; i+=TEST_THREADS)
+            harness.zoneTemp[i] = (i + k) % 2 ? 18 : 22;
+        if (barrierWait(harness.barrier, thread)) {
+            if (!runController(harness.host, 60.0 * k, 60)) harness.failed = 1;
+            harness.stepVersion[k] = harness.version[0];
+        }
+        barrierWait(harness.barrier, thread);
+        for (i=thread; i<TEST_HOMES; i+=TEST_THREADS) {
+            if (harness.version[i] != harness.stepVersion[k]
+                    || harness.startHeating[i] != ((i + k) % 2 ? 1 : 0))
+                harness.failed = 1;
+        }
+    }
+}
+
+// controller <modelDescription.xml> <plugin1> <plugin2> [<badPlugin>]:
+// TEST_THREADS threads step TEST_HOMES homes of the model description
+// through a barrier while the main thread loads the two builds of
+// controllerPlugin.c TEST_RELOADS times in turn. Each timestep must run
+// entirely on one plugin.
+int main(int argc, char** argv) {
+    ModelDescription* md;
+    ModelDescription* mds[TEST_HOMES];
+    double version[TEST_HOMES];
+    Thread threads[TEST_THREADS];
+    Catalog* catalog;
+    int i, k, nChanges = 0;
+    if (argc < 4) {
+        printf("usage: controller <modelDescription.xml> <plugin1> <plugin2> [<badPlugin>]\n");
+        return 1;
+    }
+    md = parse(argv[1]);
+    if (!md) return 1;
+    for (i=0; i<TEST_HOMES; i++) mds[i] = md;
+    catalog = newCatalog(mds, TEST_HOMES);
+    if (!catalog) return 1;
+    memset(&harness, 0, sizeof(Harness));
+    memset(version, 0, sizeof(version));
+    harness.host = newControllerHost(catalog, ".");
+    harness.barrier = newTreeBarrier(TEST_THREADS, barrierFanIn());
+    if (!harness.host || !harness.barrier) return 1;
+    harness.zoneTemp = catalogRealColumn(catalog, catalogFind(catalog, "epSendZoneMeanAirTemp", kind_real));
+    harness.startHeating = catalogRealColumn(catalog, catalogFind(catalog, "epGetStartHeating", kind_real));
+    harness.version = version;
+    for (i=0; i<TEST_HOMES; i++)
+        catalogRealColumn(catalog, catalogFind(catalog, "epSendHeatingSetpoint", kind_real))[i] = 20;
+    if (!addControllerColumn(harness.host, "controllerVersion", version)) return 1;
+    if (argc > 4 && loadController(harness.host, argv[4])) harness.failed = 1;
+    if (!loadController(harness.host, argv[2])) return 1;
+    for (i=0; i<TEST_THREADS; i++) threadCreate(&threads[i], runHomes, (void*)(long)i);
+    for (i=0; i<TEST_RELOADS; i++) {
+        double until = wallClock() + 0.001;
+        while (wallClock() < until);
+        if (!loadController(harness.host, argv[3 - i % 2])) harness.failed = 1;
+    }
+    for (i=0; i<TEST_THREADS; i++) threadJoin(threads[i]);
+    for (k=1; k<TEST_STEPS; k++) nChanges += harness.stepVersion[k] != harness.stepVersion[k-1];
+    printf("%d steps, %d swaps, %d changes of the plugin, last step %.1f us\n",
+           TEST_STEPS, harness.host->nSwaps, nChanges, 1e6 * harness.host->lastStepSeconds);
+    if (harness.stepVersion[0] == 0 || nChanges > harness.host->nSwaps - 1) harness.failed = 1;
+    printf("%s\n", harness.failed ? "failed" : "ok");
+    freeControllerHost(harness.host);
+    freeTreeBarrier(harness.barrier);
+    freeCatalog(catalog);
+    freeElement(md);
+    return harness.failed;
+}
+#endif // TEST
@@ -0,0 +1,115 @@
+/* -------------------------------------------------------------------------
+ * controller.h
+ * Controller plugins: the control logic that computes e.g.
+ * epGetStartHeating and epGetStartCooling of all homes, in a shared
+ * library that can be replaced while the federation runs, without
+ * restarting the FMUs.
+ * A plugin sees the real columns of the catalog (see catalog.h), each
+ * an array of the values of all homes, and exports with C linkage:
+ *     int controllerAbi(void);                  // CONTROLLER_ABI_VERSION
+ *     int controllerStep(ControllerView* view); // 0 if ok
+ *     void* controllerStart(ControllerView* view); // optional
+ *     void controllerStop(void* state);            // optional
+ * controllerStart returns the state of the plugin, passed in view->state
+ * to each step and finally to controllerStop. It must not return NULL,
+ * which means that the plugin failed to start: the plugin is then not
+ * loaded. A plugin without state returns any other pointer, e.g. to a
+ * static variable. Without controllerStart, view->state is NULL.
+ * controllerStart runs in the loading thread, while the old controller
+ * may still run, so it must not access the values of the columns. A
+ * plugin looks up its columns by name in controllerStart, with
+ * view->findColumn, so that it does not link against the host.
+ * controllerPlugin.c is an example.
+ * loadController loads a new plugin in any thread; the next
+ * runController, called by the one thread that completes the timestep
+ * barrier while all homes wait, swaps it in atomically, so each timestep
+ * runs entirely with either the old or the new controller. If tracing is
+ * on (see trace.h), each step of a plugin is recorded as a trace event.
+ * -------------------------------------------------------------------------*/
+
+#ifndef CONTROLLER_H
+#define CONTROLLER_H
+
+#include "catalog.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CONTROLLER_ABI_VERSION 1
+
+typedef struct ControllerView ControllerView;
+
+struct ControllerView {
+    int abiVersion;         // CONTROLLER_ABI_VERSION of the host
+    int nHomes;
+    double time;            // start of the timestep
+    double stepSize;
+    int nColumns;
+    const char** names;     // of the real columns of the catalog, then of the added ones
+    double** columns;       // nHomes values each, read and written in place
+    void* state;            // returned by controllerStart, NULL without controllerStart
+    // the index of the named column, or -1
+    int (*findColumn)(const ControllerView* view, const char* name);
+};
+
+typedef int   (*fControllerAbi)  (void);
+typedef int   (*fControllerStep) (ControllerView* view);
+typedef void* (*fControllerStart)(ControllerView* view);
+typedef void  (*fControllerStop) (void* state);
+
+typedef struct {
+    char* path;             // as given to loadController
+    char* copyPath;         // private copy of the library, deleted on unload
+    void* dllHandle;
+    fControllerStep step;
+    fControllerStop stop;
+    void* state;
+    long nSteps;            // steps run by this plugin
+    double stepSeconds;     // total wall time of these steps
+    double maxStepSeconds;
+} ControllerPlugin;
+
+typedef struct {
+    Catalog* catalog;
+    ControllerView view;
+    ControllerPlugin* active;          // NULL before the first swap
+    ControllerPlugin* volatile pending; // loaded, swapped in by the next runController
+    char* copyDir;
+    volatile long nCopies;             // loadController calls, columns can be added before the first
+    int nSwaps;
+    int nRuns;                         // steps run by any plugin, the trace id of the next
+    double lastStepSeconds;            // of the last runController
+} ControllerHost;
+
+// The host keeps the catalog, but does not own it. Copies of plugin
+// libraries are made in copyDir. Returns NULL if no memory is available.
+ControllerHost* newControllerHost(Catalog* catalog, const char* copyDir);
+void freeControllerHost(ControllerHost* h);
+
+// Add values computed by the host, e.g. the voltage at each home from
+// the power flow, nHomes values, as a column of the view after the real
+// columns of the catalog. The host keeps name and values up to date.
+// Call before the first loadController.
+// Returns 1 to indicate success and 0 for error.
+int addControllerColumn(ControllerHost* h, const char* name, double* values);
+
+// Load the plugin at path and start it; it replaces the active plugin at
+// the next runController. A plugin loaded before and not yet swapped in
+// is discarded. The library is loaded from a private copy, so that it can
+// be rebuilt at path while loaded, and loading the same path again loads
+// the new build. Returns 1 to indicate success and 0 for error, e.g. a
+// missing function or another ABI version; the active plugin stays then.
+int loadController(ControllerHost* h, const char* path);
+
+// Swap in a pending plugin, then run one step of the active one over the
+// catalog. Call only while no home reads or writes the catalog, e.g. in
+// the thread for which barrierWait returned 1.
+// Returns 1 to indicate success and 0 if the step failed. Without any
+// plugin, does nothing and returns 1.
+int runController(ControllerHost* h, double time, double stepSize);
+
+#ifdef __cplusplus
+} // closing brace for extern "C"
+#endif
+#endif // CONTROLLER_H
@@ -0,0 +1,89 @@
+/* -------------------------------------------------------------------------
+ * controllerPlugin.c
+ * An example controller plugin, for the tests of controller.c: a home
+ * starts heating while its zone is below the heating set point. If the
+ * host added a column controllerVersion, the plugin writes its
+ * PLUGIN_VERSION there for each home, so that a test can tell which
+ * plugin ran a timestep. Built with PLUGIN_FEEDER, it copies the column
+ * feederVoltage of feederStep.c to epGetStartHeating instead, for the
+ * tests of feederStep.c.
+ * Build, e.g. on Linux:
+ *     gcc -shared -fPIC -DPLUGIN_VERSION=1 -o plugin1.so controllerPlugin.c
+ *     gcc -shared -fPIC -DPLUGIN_VERSION=2 -o plugin2.so controllerPlugin.c
+ *     gcc -shared -fPIC -DPLUGIN_ABI=0 -o badPlugin.so controllerPlugin.c
+ *     gcc -shared -fPIC -DPLUGIN_FEEDER -o feederPlugin.so controllerPlugin.c
+ * the third with another ABI version, which loadController must reject.
+ * -------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+
+#include "controller.h"
+
+#ifdef _WIN32
+#define DLL_EXPORT __declspec(dllexport)
+#else
+#define DLL_EXPORT
+#endif
+
+#ifndef PLUGIN_VERSION
+#define PLUGIN_VERSION 1
+#endif
+
+#ifndef PLUGIN_ABI
+#define PLUGIN_ABI CONTROLLER_ABI_VERSION
+#endif
+
+typedef struct {
+    int zoneTemp;
+    int heatingSetpoint;
+    int startHeating;
+    int feederVoltage;     // with PLUGIN_FEEDER
+    int version;           // -1 if the host did not add the column
+} Plugin;
+
+DLL_EXPORT int controllerAbi(void) {
+    return PLUGIN_ABI;
+}
+
+DLL_EXPORT void* controllerStart(ControllerView* view) {
+    Plugin* p = (Plugin*)malloc(sizeof(Plugin));
+    if (!p) return NULL;
+    p->zoneTemp = view->findColumn(view, "epSendZoneMeanAirTemp");
+    p->heatingSetpoint = view->findColumn(view, "epSendHeatingSetpoint");
+    p->startHeating = view->findColumn(view, "epGetStartHeating");
+    p->version = view->findColumn(view, "controllerVersion");
+#ifdef PLUGIN_FEEDER
+    p->feederVoltage = view->findColumn(view, "feederVoltage");
+#else
+    p->feederVoltage = 0;
+#endif
+    if (p->zoneTemp < 0 || p->heatingSetpoint < 0 || p->startHeating < 0 || p->feederVoltage < 0) {
+        free(p);
+        return NULL;
+    }
+    return p;
+}
+
+DLL_EXPORT int controllerStep(ControllerView* view) {
+    Plugin* p = (Plugin*)view->state;
+    double* startHeating = view->columns[p->startHeating];
+    int i;
+#ifdef PLUGIN_FEEDER
+    const double* feederVoltage = view->columns[p->feederVoltage];
+    for (i=0; i<view->nHomes; i++) startHeating[i] = feederVoltage[i];
+#else
+    const double* zoneTemp = view->columns[p->zoneTemp];
+    const double* heatingSetpoint = view->columns[p->heatingSetpoint];
+    for (i=0; i<view->nHomes; i++)
+        startHeating[i] = zoneTemp[i] < heatingSetpoint[i] ? 1 : 0;
+#endif
+    if (p->version >= 0) {
+        double* version = view->columns[p->version];
+        for (i=0; i<view->nHomes; i++) version[i] = PLUGIN_VERSION;
+    }
+    return 0;
+}
+
+DLL_EXPORT void controllerStop(void* state) {
+    free(state);
+}
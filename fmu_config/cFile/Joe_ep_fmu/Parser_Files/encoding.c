@@ -0,0 +1,540 @@
+/* -------------------------------------------------------------------------
+ * encoding.c
+ * Compact encoding of step vectors for exchange and recording.
+ * -------------------------------------------------------------------------*/
+
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef STANDALONE_XML_PARSER
+#define logThis(n, ...) printf(__VA_ARGS__);printf("\n")
+#else
+#include "GlobalIncludes.h"
+#include "logging.h" // logThis
+#endif // STANDALONE_XML_PARSER
+
+#include "encoding.h"
+
+#define INT16_NAN 32767
+#define UINT8_NAN 255
+#define ENCODED_RECORDING_MAGIC "SGER"
+
+static const char* encodingNames[] = { "float64", "float32", "int16", "uint8" };
+static const int encodingSizes[] = { 8, 4, 2, 1 };
+
+// -------------------------------------------------------------------------
+// Defaults from the model description
+
+// Returns 1 if the attribute of the variable or its declared type is a number
+static int getLimit(ModelDescription* md, ScalarVariable* sv, Att a, double* value) {
+    const char* s = getString2(md, sv->typeSpec, a);
+    return s && sscanf(s, "%lf", value) == 1;
+}
+
+static void setDefaultEncoding(ModelDescription* md, ScalarVariable* sv, ChannelEncoding* c) {
+    double min, max, nominal;
+    int hasRange;
+    c->type = enc_float64;
+    c->scale = 1;
+    c->offset = 0;
+    if (!sv) return;
+    hasRange = getLimit(md, sv, att_min, &min) && getLimit(md, sv, att_max, &max) && max >= min;
+    switch (sv->typeSpec->type) {
+        case elm_Boolean:
+            c->type = enc_uint8;
+            break;
+        case elm_Integer:
+        case elm_Enumeration:
+            if (hasRange && max - min <= 254) {
+                c->type = enc_uint8;
+                c->offset = min;
+            } else if (hasRange && max - min <= 65533) {
+                c->type = enc_int16;
+                c->offset = min + 32767;
+            }
+            break;
+        case elm_Real:
+            if (hasRange && max > min) {
+                c->type = enc_int16;
+                c->scale = (max - min) / 65532;
+                c->offset = (max + min) / 2;
+            } else if (getLimit(md, sv, att_nominal, &nominal)) {
+                c->type = enc_float32;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static void updateSize(StepEncoding* e) {
+    int i;
+    e->size = 0;
+    for (i=0; i<e->nChannels; i++) e->size += encodingSizes[e->channels[i].type];
+}
+
+StepEncoding* newStepEncoding(ModelDescription* md, ScalarVariable** vars, int n) {
+    int i;
+    StepEncoding* e = (StepEncoding*)calloc(1, sizeof(StepEncoding));
+    if (!e) return NULL;
+    e->nChannels = n;
+    e->channels = (ChannelEncoding*)calloc(n > 0 ? n : 1, sizeof(ChannelEncoding));
+    if (!e->channels) {
+        free(e);
+        return NULL;
+    }
+    for (i=0; i<n; i++) setDefaultEncoding(md, vars ? vars[i] : NULL, &e->channels[i]);
+    updateSize(e);
+    return e;
+}
+
+void freeStepEncoding(StepEncoding* e) {
+    if (!e) return;
+    free(e->channels);
+    free(e);
+}
+
+// -------------------------------------------------------------------------
+// Configuration
+
+// Returns 0 to indicate error
+static int parseSpec(const char* spec, ChannelEncoding* c) {
+    int t;
+    for (t=enc_float64; t<=enc_uint8; t++) {
+        size_t n = strlen(encodingNames[t]);
+        if (strncmp(spec, encodingNames[t], n)) continue;
+        c->type = (EncodingType)t;
+        c->scale = 1;
+        c->offset = 0;
+        spec += n;
+        if (*spec == '\0') return 1; // success
+        if (*spec != ':' || (t != enc_int16 && t != enc_uint8)) return 0; // error
+        if (sscanf(spec + 1, "%lf", &c->scale) != 1 || c->scale <= 0) return 0; // error
+        spec = strchr(spec + 1, ':');
+        if (spec && sscanf(spec + 1, "%lf", &c->offset) != 1) return 0; // error
+        return 1; // success
+    }
+    return 0; // error
+}
+
+int setChannelEncoding(StepEncoding* e, int channel, const char* spec) {
+    ChannelEncoding c;
+    if (channel < 0 || channel >= e->nChannels || !parseSpec(spec, &c)) {
+        logThis(ERROR_ERROR, "Illegal encoding '%s'", spec);
+        return 0; // error
+    }
+    e->channels[channel] = c;
+    updateSize(e);
+    return 1; // success
+}
+
+// Remove leading and trailing white space
+static char* trim(char* s) {
+    char* end;
+    while (isspace((unsigned char)*s)) s++;
+    end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1])) end--;
+    *end = '\0';
+    return s;
+}
+
+int readEncodingConfig(StepEncoding* e, char** names, const char* path) {
+    char line[256];
+    int lineNumber = 0;
+    int i;
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        logThis(ERROR_ERROR, "Cannot open file '%s'", path);
+        return 0; // error
+    }
+    while (fgets(line, sizeof(line), file)) {
+        char* name;
+        char* spec;
+        char* eq;
+        lineNumber++;
+        name = trim(line);
+        if (!*name || *name == '#') continue;
+        eq = strchr(name, '=');
+        if (!eq) {
+            logThis(ERROR_ERROR, "Missing '=' at line %d of file '%s'", lineNumber, path);
+            fclose(file);
+            return 0; // error
+        }
+        *eq = '\0';
+        name = trim(name);
+        spec = trim(eq + 1);
+        for (i=0; i<e->nChannels; i++) {
+            if (strcmp(names[i], name)) continue;
+            if (!setChannelEncoding(e, i, spec)) {
+                logThis(ERROR_ERROR, "at line %d of file '%s'", lineNumber, path);
+                fclose(file);
+                return 0; // error
+            }
+        }
+    }
+    fclose(file);
+    return 1; // success
+}
+
+// -------------------------------------------------------------------------
+// Encoding and decoding, little endian
+
+static void putUInt16(unsigned char* p, unsigned int v) {
+    p[0] = (unsigned char)(v & 0xff);
+    p[1] = (unsigned char)((v >> 8) & 0xff);
+}
+
+static unsigned int getUInt16(const unsigned char* p) {
+    return p[0] | (p[1] << 8);
+}
+
+static void putUInt32(unsigned char* p, unsigned long v) {
+    putUInt16(p, (unsigned int)(v & 0xffff));
+    putUInt16(p + 2, (unsigned int)((v >> 16) & 0xffff));
+}
+
+static unsigned long getUInt32(const unsigned char* p) {
+    return getUInt16(p) | ((unsigned long)getUInt16(p + 2) << 16);
+}
+
+static void putFloat64(unsigned char* p, double d) {
+    unsigned char b[8];
+    int i;
+    unsigned int one = 1;
+    memcpy(b, &d, 8);
+    if (*(unsigned char*)&one) memcpy(p, b, 8);
+    else for (i=0; i<8; i++) p[i] = b[7-i];
+}
+
+static double getFloat64(const unsigned char* p) {
+    unsigned char b[8];
+    double d;
+    int i;
+    unsigned int one = 1;
+    if (*(unsigned char*)&one) memcpy(b, p, 8);
+    else for (i=0; i<8; i++) b[i] = p[7-i];
+    memcpy(&d, b, 8);
+    return d;
+}
+
+static double notANumber(void) {
+    double zero = 0;
+    return zero / zero;
+}
+
+// Returns code, clamped to min..max
+static long quantize(const ChannelEncoding* c, double value, long min, long max) {
+    double code = floor((value - c->offset) / c->scale + 0.5);
+    if (code < min) return min;
+    if (code > max) return max;
+    return (long)code;
+}
+
+void encodeStep(const StepEncoding* e, const double* values, unsigned char* out) {
+    int i;
+    for (i=0; i<e->nChannels; i++) {
+        const ChannelEncoding* c = &e->channels[i];
+        double v = values[i];
+        switch (c->type) {
+            case enc_float64:
+                putFloat64(out, v);
+                break;
+            case enc_float32: {
+                float f = (float)v;
+                unsigned int bits;
+                memcpy(&bits, &f, 4);
+                putUInt32(out, bits);
+                break;
+            }
+            case enc_int16:
+                putUInt16(out, (unsigned int)(v != v ? INT16_NAN : quantize(c, v, -32767, 32766)) & 0xffff);
+                break;
+            case enc_uint8:
+                *out = (unsigned char)(v != v ? UINT8_NAN : quantize(c, v, 0, 254));
+                break;
+        }
+        out += encodingSizes[c->type];
+    }
+}
+
+void decodeStep(const StepEncoding* e, const unsigned char* in, double* values) {
+    int i;
+    for (i=0; i<e->nChannels; i++) {
+        const ChannelEncoding* c = &e->channels[i];
+        switch (c->type) {
+            case enc_float64:
+                values[i] = getFloat64(in);
+                break;
+            case enc_float32: {
+                unsigned int bits = (unsigned int)getUInt32(in);
+                float f;
+                memcpy(&f, &bits, 4);
+                values[i] = f;
+                break;
+            }
+            case enc_int16: {
+                long code = (long)getUInt16(in);
+                if (code >= 32768) code -= 65536;
+                values[i] = code == INT16_NAN ? notANumber() : c->offset + c->scale * code;
+                break;
+            }
+            case enc_uint8:
+                values[i] = *in == UINT8_NAN ? notANumber() : c->offset + c->scale * *in;
+                break;
+        }
+        in += encodingSizes[c->type];
+    }
+}
+
+// -------------------------------------------------------------------------
+// Error bounds
+
+double encodingErrorBound(const ChannelEncoding* c, double value) {
+    switch (c->type) {
+        case enc_float32: return fabs(value) * ldexp(1.0, -24) + 1e-45;
+        case enc_int16:
+        case enc_uint8: return c->scale / 2 * (1 + 1e-9) + 1e-12 * fabs(value);
+        default: return 0;
+    }
+}
+
+int checkEncodingError(const StepEncoding* e, Recording* r, double* maxError) {
+    unsigned char* buffer = (unsigned char*)malloc(e->size + 1);
+    double* decoded = (double*)malloc((e->nChannels + 1) * sizeof(double));
+    int nExceeded = 0;
+    int i, k;
+    if (!buffer || !decoded || e->nChannels != r->nColumns) {
+        free(buffer);
+        free(decoded);
+        return -1; // error
+    }
+    if (maxError) for (i=0; i<e->nChannels; i++) maxError[i] = 0;
+    for (k=0; k<r->nSteps; k++) {
+        const double* values = &recordedValue(r, k, 0);
+        encodeStep(e, values, buffer);
+        decodeStep(e, buffer, decoded);
+        for (i=0; i<e->nChannels; i++) {
+            double error;
+            if (values[i] != values[i]) {
+                if (decoded[i] == decoded[i]) nExceeded++; // NaN must stay NaN
+                continue;
+            }
+            error = fabs(decoded[i] - values[i]);
+            if (maxError && error > maxError[i]) maxError[i] = error;
+            if (error > encodingErrorBound(&e->channels[i], values[i])) nExceeded++;
+        }
+    }
+    free(buffer);
+    free(decoded);
+    return nExceeded;
+}
+
+// -------------------------------------------------------------------------
+// Encoded recordings:
+// "SGER", nColumns, nSteps, for each column: name length, name, type,
+// scale, offset, then for each step: time as float64 and the encoded row.
+
+int writeEncodedRecording(Recording* r, const StepEncoding* e, const char* path) {
+    unsigned char header[24];
+    unsigned char* row;
+    int i, k, ok = 1;
+    FILE* file;
+    if (e->nChannels != r->nColumns) return 0; // error
+    file = fopen(path, "wb");
+    if (!file) {
+        logThis(ERROR_ERROR, "Cannot open file '%s'", path);
+        return 0; // error
+    }
+    row = (unsigned char*)malloc(8 + e->size);
+    if (!row) {
+        fclose(file);
+        return 0; // error
+    }
+    memcpy(header, ENCODED_RECORDING_MAGIC, 4);
+    putUInt32(header + 4, r->nColumns);
+    putUInt32(header + 8, r->nSteps);
+    ok = fwrite(header, 1, 12, file) == 12;
+    for (i=0; ok && i<r->nColumns; i++) {
+        int n = (int)strlen(r->names[i]);
+        putUInt16(header, n);
+        header[2] = (unsigned char)e->channels[i].type;
+        putFloat64(header + 3, e->channels[i].scale);
+        putFloat64(header + 11, e->channels[i].offset);
+        ok = fwrite(header, 1, 19, file) == 19
+          && fwrite(r->names[i], 1, n, file) == (size_t)n;
+    }
+    for (k=0; ok && k<r->nSteps; k++) {
+        putFloat64(row, r->time[k]);
+        encodeStep(e, &recordedValue(r, k, 0), row + 8);
+        ok = fwrite(row, 1, 8 + e->size, file) == (size_t)(8 + e->size);
+    }
+    free(row);
+    if (fclose(file)) ok = 0;
+    if (!ok) {
+        logThis(ERROR_ERROR, "Cannot write file '%s'", path);
+    }
+    return ok;
+}
+
+Recording* readEncodedRecording(const char* path, ModelDescription* md) {
+    unsigned char header[24];
+    unsigned char* row = NULL;
+    double* values = NULL;
+    char** names = NULL;
+    StepEncoding* e = NULL;
+    Recording* r = NULL;
+    int nColumns = 0, nSteps, i, k;
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        logThis(ERROR_ERROR, "Cannot open file '%s'", path);
+        return NULL;
+    }
+    if (fread(header, 1, 12, file) != 12 || memcmp(header, ENCODED_RECORDING_MAGIC, 4)) goto error;
+    nColumns = (int)getUInt32(header + 4);
+    nSteps = (int)getUInt32(header + 8);
+    names = (char**)calloc(nColumns > 0 ? nColumns : 1, sizeof(char*));
+    e = newStepEncoding(NULL, NULL, nColumns);
+    if (!names || !e) goto error;
+    for (i=0; i<nColumns; i++) {
+        int n;
+        if (fread(header, 1, 19, file) != 19 || header[2] > enc_uint8) goto error;
+        n = (int)getUInt16(header);
+        e->channels[i].type = (EncodingType)header[2];
+        e->channels[i].scale = getFloat64(header + 3);
+        e->channels[i].offset = getFloat64(header + 11);
+        names[i] = (char*)malloc(n + 1);
+        if (!names[i] || fread(names[i], 1, n, file) != (size_t)n) goto error;
+        names[i][n] = '\0';
+    }
+    updateSize(e);
+    r = newRecordingWithColumns(md, names, nColumns);
+    row = (unsigned char*)malloc(8 + e->size);
+    values = (double*)malloc((nColumns > 0 ? nColumns : 1) * sizeof(double));
+    if (!r || !row || !values) goto error;
+    for (k=0; k<nSteps; k++) {
+        if (fread(row, 1, 8 + e->size, file) != (size_t)(8 + e->size)) goto error;
+        decodeStep(e, row + 8, values);
+        if (!recordStep(r, getFloat64(row), values)) goto error;
+    }
+    goto done;
+error:
+    logThis(ERROR_ERROR, "Cannot read encoded recording '%s'", path);
+    freeRecording(r);
+    r = NULL;
+done:
+    if (names) for (i=0; i<nColumns; i++) free(names[i]);
+    free(names);
+    freeStepEncoding(e);
+    free(row);
+    free(values);
+    fclose(file);
+    return r;
+}
+
+// #define TEST
+#ifdef TEST
+
+static char* joeNames[] = {
+    "epSendNetEnergy", "epSendZoneMeanAirTemp", "epSendOutdoorAirTemp", "epSendZoneHumidity",
+    "epSendDayofWeek", "epSendEnergyPurchased", "epSendEnergySurplus", "epSendSolarRadiation",
+    "epSendHeatingSetpoint", "epSendCoolingSetpoint", "epGetStartHeating", "epGetStartCooling"
+};
+
+// The configuration for Joe_ep_fmu from encoding.h
+static const char* joeConfig =
+    "# Joe_ep_fmu\n"
+    "epSendNetEnergy = float32\n"
+    "epSendZoneMeanAirTemp = int16:0.01\n"
+    "epSendOutdoorAirTemp = int16:0.01\n"
+    "epSendZoneHumidity = int16:0.01\n"
+    "epSendDayofWeek = uint8\n"
+    "epSendEnergyPurchased = float32\n"
+    "epSendEnergySurplus = float32\n"
+    "epSendSolarRadiation = float32\n"
+    "epSendHeatingSetpoint = int16:0.01\n"
+    "epSendCoolingSetpoint = int16:0.01\n"
+    "epGetStartHeating = uint8\n"
+    "epGetStartCooling = uint8\n";
+
+// One day of 60 s steps of a home, with a NaN in the zone temperature
+static void joeStep(int k, double* row) {
+    double day = 2 * 3.14159265358979 * (k % 1440) / 1440.0;
+    double sun = sin(day - 1.57) > 0 ? 800 * sin(day - 1.57) : 0;
+    row[1] = k == 100 ? notANumber() : 21 + 1.5 * sin(day);
+    row[2] = 5 + 8 * sin(day - 2) + 0.123456789 * (k % 3);
+    row[3] = 45 + 20 * cos(day);
+    row[4] = 1 + (k / 1440) % 7;
+    row[5] = 60 * (900 + 400 * cos(3 * day) + (k % 17));
+    row[6] = 60 * 1.4 * sun;
+    row[7] = sun;
+    row[0] = row[5] - row[6];
+    row[8] = 20 + 0.5 * ((k / 180) % 3);
+    row[9] = row[8] + 4;
+    row[10] = row[1] < row[8];
+    row[11] = row[1] > row[9];
+}
+
+// encoding [<modelDescription.xml>]: a week of one home of Joe_ep_fmu,
+// with the defaults from the model description, if given, and with the
+// configuration for Joe_ep_fmu. Checks the error bounds and that an
+// encoded recording reads back as encoded.
+int main(int argc, char** argv) {
+    const char* configPath = "joeEncoding.txt";
+    const char* path = "joeRecording.sger";
+    int nSteps = 7 * 1440, failed = 0, i, k;
+    double row[12], decoded[12], maxError[12];
+    unsigned char buffer[8 * 12];
+    ModelDescription* md = argc > 1 ? parse(argv[1]) : NULL;
+    Recording* r = newRecordingWithColumns(md, joeNames, 12);
+    Recording* back;
+    StepEncoding* e;
+    FILE* file;
+    if (!r) return 1;
+    for (k=0; k<nSteps; k++) {
+        joeStep(k, row);
+        if (!recordStep(r, 60.0 * k, row)) return 1;
+    }
+    e = newStepEncoding(md, r->vars, r->nColumns);
+    file = fopen(configPath, "w");
+    if (!e || !file) return 1;
+    fputs(joeConfig, file);
+    fclose(file);
+    printf("defaults: %d bytes per step\n", e->size);
+    if (!readEncodingConfig(e, joeNames, configPath)) return 1;
+    printf("configured: %d bytes per step\n", e->size);
+    if (e->size != 29) failed = 1;
+    if (checkEncodingError(e, r, maxError)) failed = 1;
+    for (i=0; i<r->nColumns; i++)
+        printf("  %-22s %-7s max error %g\n", joeNames[i], encodingNames[e->channels[i].type], maxError[i]);
+    if (!writeEncodedRecording(r, e, path)) return 1;
+    back = readEncodedRecording(path, md);
+    if (!back || back->nSteps != nSteps) return 1;
+    for (k=0; k<nSteps; k++) {
+        encodeStep(e, &recordedValue(r, k, 0), buffer);
+        decodeStep(e, buffer, decoded);
+        if (back->time[k] != r->time[k]) failed = 1;
+        for (i=0; i<r->nColumns; i++) {
+            double v = recordedValue(back, k, i);
+            if (v != decoded[i] && (v == v || decoded[i] == decoded[i])) failed = 1;
+        }
+    }
+    if (recordedValue(back, 100, 1) == recordedValue(back, 100, 1)) failed = 1; // NaN must stay NaN
+    file = fopen(path, "rb");
+    if (file) {
+        fseek(file, 0, SEEK_END);
+        printf("%d steps: %ld bytes encoded, %d as float64\n", nSteps, ftell(file), nSteps * (8 + 8 * 12));
+        fclose(file);
+    }
+    printf("%s\n", failed ? "failed" : "ok");
+    freeRecording(r);
+    freeRecording(back);
+    freeStepEncoding(e);
+    if (md) freeElement(md);
+    remove(configPath);
+    remove(path);
+    return failed;
+}
+#endif // TEST
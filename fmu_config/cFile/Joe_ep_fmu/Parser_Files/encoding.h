@@ -0,0 +1,105 @@
+/* -------------------------------------------------------------------------
+ * encoding.h
+ * Compact encoding of step vectors, i.e. the Real values of a set of
+ * variables at one communication step, for exchange and recording.
+ * Each channel (variable) is encoded as
+ * - float64: 8 bytes, exact
+ * - float32: 4 bytes, relative error at most 2^-24
+ * - int16:   2 bytes, value = offset + scale * code, error at most scale/2
+ * - uint8:   1 byte,  value = offset + scale * code, error at most scale/2
+ * Values outside the range of int16 or uint8 are clamped. The largest code
+ * (32767 for int16, 255 for uint8) is reserved for NaN. Encoded vectors
+ * are little endian on every platform.
+ * Defaults are derived from the model description: Boolean variables and
+ * Integer variables with min and max in 0..254 use uint8, Real variables
+ * with min and max use int16 over that range, and Real variables with only
+ * a nominal value use float32. All other variables use float64.
+ * A configuration file overrides the defaults, with lines such as
+ *     epSendHeatingSetpoint = int16:0.1
+ * where int16 and uint8 take an optional scale (default 1) and offset
+ * (default 0), e.g. int16:0.1:20.
+ * The model description of Joe_ep_fmu gives no min, max or nominal, so all
+ * its variables default to float64, 96 bytes per step, and its recordings
+ * only shrink with a configuration. This one needs 29 bytes per step:
+ *     epSendNetEnergy = float32
+ *     epSendZoneMeanAirTemp = int16:0.01
+ *     epSendOutdoorAirTemp = int16:0.01
+ *     epSendZoneHumidity = int16:0.01
+ *     epSendDayofWeek = uint8
+ *     epSendEnergyPurchased = float32
+ *     epSendEnergySurplus = float32
+ *     epSendSolarRadiation = float32
+ *     epSendHeatingSetpoint = int16:0.01
+ *     epSendCoolingSetpoint = int16:0.01
+ *     epGetStartHeating = uint8
+ *     epGetStartCooling = uint8
+ * Temperatures and set points in degC and the relative humidity in % then
+ * keep an error of at most 0.005, within +-327; energies and radiation
+ * keep 24 bits.
+ * -------------------------------------------------------------------------*/
+
+#ifndef encoding_h
+#define encoding_h
+
+#include "xml_parser.h"
+#include "recorder.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    enc_float64,
+    enc_float32,
+    enc_int16,
+    enc_uint8
+} EncodingType;
+
+typedef struct {
+    EncodingType type;
+    double scale;          // for int16 and uint8
+    double offset;         // for int16 and uint8
+} ChannelEncoding;
+
+typedef struct {
+    int nChannels;
+    ChannelEncoding* channels;
+    int size;              // bytes of one encoded step vector
+} StepEncoding;
+
+// Default encoding for each of the n variables.
+// Returns NULL if no memory is available.
+StepEncoding* newStepEncoding(ModelDescription* md, ScalarVariable** vars, int n);
+void freeStepEncoding(StepEncoding* e);
+
+// Set the encoding of one channel from a spec such as "int16:0.1".
+// Returns 1 to indicate success and 0 for error.
+int setChannelEncoding(StepEncoding* e, int channel, const char* spec);
+
+// Apply the overrides of a configuration file. names holds the variable
+// name of each channel; lines for other variables are ignored.
+// Returns 1 to indicate success and 0 for error.
+int readEncodingConfig(StepEncoding* e, char** names, const char* path);
+
+// Encode nChannels values into e->size bytes, and back
+void encodeStep(const StepEncoding* e, const double* values, unsigned char* out);
+void decodeStep(const StepEncoding* e, const unsigned char* in, double* values);
+
+// Largest error of encoding the given value in channel c,
+// unless the value is clamped to the range of the channel
+double encodingErrorBound(const ChannelEncoding* c, double value);
+
+// Encode and decode all values of r. Stores the largest error of each
+// channel in maxError, if not NULL.
+// Returns the number of values whose error exceeds the bound.
+int checkEncodingError(const StepEncoding* e, Recording* r, double* maxError);
+
+// Store a recording with each row encoded by e, and read it back.
+// Return 1 or a recording to indicate success, 0 or NULL for error.
+int writeEncodedRecording(Recording* r, const StepEncoding* e, const char* path);
+Recording* readEncodedRecording(const char* path, ModelDescription* md);
+
+#ifdef __cplusplus
+} // closing brace for extern "C"
+#endif
+#endif // encoding_h
@@ -0,0 +1,184 @@
+/* -------------------------------------------------------------------------
+ * exactSum.c
+ * Order-independent exact summation of doubles in a long fixed-point
+ * accumulator.
+ * -------------------------------------------------------------------------*/
+
+#include <string.h>
+#include <math.h>
+#include "exactSum.h"
+
+#define LIMB_BITS 32
+#define LIMB_MASK 0xffffffffLL
+// a limb takes less than 2^32 per addition, so 2^30 additions cannot
+// overflow it before the carries are propagated
+#define MAX_PENDING (1 << 30)
+
+void exactSumInit(ExactSum* s) {
+    memset(s, 0, sizeof(ExactSum));
+}
+
+// Propagate the carries, so that all limbs but the last are in
+// [0, 2^32) and the last holds the sign. This form is unique.
+static void normalize(ExactSum* s) {
+    long long carry = 0;
+    int i;
+    for (i=0; i<EXACT_SUM_LIMBS-1; i++) {
+        long long v = s->limb[i] + carry;
+        long long low = v & LIMB_MASK;
+        s->limb[i] = low;
+        carry = (v - low) / (LIMB_MASK + 1);
+    }
+    s->limb[EXACT_SUM_LIMBS-1] += carry;
+    s->nPending = 0;
+}
+
+void exactSumAdd(ExactSum* s, double x) {
+    unsigned long long bits, mantissa, low, high;
+    long long sign;
+    int exponent, position, i, shift;
+    memcpy(&bits, &x, sizeof(bits));
+    exponent = (int)((bits >> 52) & 0x7ff);
+    mantissa = bits & 0xfffffffffffffULL;
+    if (exponent == 0x7ff) {
+        s->special = 1;
+        s->specialSum += x;
+        return;
+    }
+    if (exponent == 0) {
+        if (!mantissa) return;
+        exponent = 1; // subnormal
+    } else {
+        mantissa |= 1ULL << 52;
+    }
+    // x = mantissa * 2^(position - 1074)
+    position = exponent - 1;
+    i = position / LIMB_BITS;
+    shift = position % LIMB_BITS;
+    low = (mantissa & LIMB_MASK) << shift;
+    high = (mantissa >> LIMB_BITS) << shift;
+    // negate without a branch, the signs of the homes are unpredictable
+    sign = -(long long)(bits >> 63);
+    s->limb[i] += ((long long)(low & LIMB_MASK) ^ sign) - sign;
+    s->limb[i+1] += ((long long)((low >> LIMB_BITS) + (high & LIMB_MASK)) ^ sign) - sign;
+    s->limb[i+2] += ((long long)(high >> LIMB_BITS) ^ sign) - sign;
+    // limb i+1 took up to 2^33, counted as two additions
+    s->nPending += 2;
+    if (s->nPending >= MAX_PENDING) normalize(s);
+}
+
+void exactSumAddArray(ExactSum* s, const double* x, int n) {
+    int k;
+    for (k=0; k<n; k++) exactSumAdd(s, x[k]);
+}
+
+void exactSumNormalize(ExactSum* s) {
+    normalize(s);
+}
+
+void exactSumMerge(ExactSum* dst, ExactSum* src) {
+    int i;
+    normalize(dst);
+    normalize(src);
+    for (i=0; i<EXACT_SUM_LIMBS; i++) dst->limb[i] += src->limb[i];
+    dst->nPending = 2;
+    if (src->special) {
+        dst->special = 1;
+        dst->specialSum += src->specialSum;
+    }
+}
+
+double exactSumValue(ExactSum* s) {
+    unsigned long long magnitude[EXACT_SUM_LIMBS];
+    unsigned long long top;
+    int negative, i, k, shift, sticky = 0;
+    if (s->special) return s->specialSum;
+    normalize(s);
+    negative = s->limb[EXACT_SUM_LIMBS-1] < 0;
+    // magnitude in limbs of 32 bits, two's complement negated if negative
+    {
+        long long carry = negative ? 1 : 0;
+        for (i=0; i<EXACT_SUM_LIMBS; i++) {
+            long long v = negative ? (~s->limb[i] & LIMB_MASK) + carry : s->limb[i];
+            magnitude[i] = (unsigned long long)(v & LIMB_MASK);
+            carry = negative ? v >> LIMB_BITS : 0;
+        }
+        if (!negative) magnitude[EXACT_SUM_LIMBS-1] = (unsigned long long)s->limb[EXACT_SUM_LIMBS-1];
+    }
+    for (k=EXACT_SUM_LIMBS-1; k>=0 && !magnitude[k]; k--) ;
+    if (k < 0) return 0;
+    // the 64 most significant bits, with the bits below them as a sticky bit,
+    // are rounded once by the conversion to double
+    top = (magnitude[k] << LIMB_BITS) | (k >= 1 ? magnitude[k-1] : 0);
+    for (shift=0; !(top >> 63); shift++) top <<= 1;
+    if (k >= 2) {
+        if (shift) top |= magnitude[k-2] >> (LIMB_BITS - shift);
+        sticky = (magnitude[k-2] & ((1ULL << (LIMB_BITS - shift)) - 1)) != 0;
+    }
+    for (i=k-3; i>=0 && !sticky; i--) sticky = magnitude[i] != 0;
+    if (sticky) top |= 1;
+    return ldexp(negative ? -(double)top : (double)top, LIMB_BITS * (k - 1) - shift - 1074);
+}
+
+double exactSumOf(const double* x, int n) {
+    ExactSum s;
+    exactSumInit(&s);
+    exactSumAddArray(&s, x, n);
+    return exactSumValue(&s);
+}
+
+// #define TEST
+#ifdef TEST
+#include <stdio.h>
+#include <stdlib.h>
+#include "thread_support.h"
+
+// Sums n values split into nParts contiguous parts, merged in reverse
+// order, as by threads that finish in any order
+static double partitioned(const double* x, int n, int nParts, int exact) {
+    ExactSum parts[64];
+    double naive[64], sum = 0;
+    int p, k;
+    for (p=0; p<nParts; p++) {
+        int first = (int)((long long)n * p / nParts), last = (int)((long long)n * (p+1) / nParts);
+        exactSumInit(&parts[p]);
+        naive[p] = 0;
+        for (k=first; k<last; k++) {
+            if (exact) exactSumAdd(&parts[p], x[k]);
+            else naive[p] += x[k];
+        }
+    }
+    for (p=nParts-1; p>0; p--) {
+        if (exact) exactSumMerge(&parts[0], &parts[p]);
+        else sum += naive[p];
+    }
+    return exact ? exactSumValue(&parts[0]) : sum + naive[0];
+}
+
+// Feeder totals of net energies in J, e.g. 10000 homes
+int main(int argc, char** argv) {
+    int n = argc > 1 ? atoi(argv[1]) : 10000;
+    int rounds = 1000, r, p;
+    double* x = (double*)malloc(n * sizeof(double));
+    double t, naive = 0, exact = 0;
+    int k;
+    srand(1);
+    for (k=0; k<n; k++) x[k] = (rand() / (double)RAND_MAX - 0.4) * 3.6e6 * pow(10, rand() % 5 - 2);
+    for (p=1; p<=64; p*=2)
+        printf("%2d parts: naive %.17g exact %.17g\n", p, partitioned(x, n, p, 0), partitioned(x, n, p, 1));
+    t = wallClock();
+    for (r=0; r<rounds; r++) {
+        double s = 0;
+        for (k=0; k<n; k++) s += x[k];
+        naive += s;
+    }
+    t = wallClock() - t;
+    printf("naive %.2f ns per value\n", 1e9 * t / ((double)rounds * n));
+    t = wallClock();
+    for (r=0; r<rounds; r++) exact += exactSumOf(x, n);
+    t = wallClock() - t;
+    printf("exact %.2f ns per value (%g %g)\n", 1e9 * t / ((double)rounds * n), naive, exact);
+    free(x);
+    return 0;
+}
+#endif // TEST
@@ -0,0 +1,54 @@
+/* -------------------------------------------------------------------------
+ * exactSum.h
+ * Exact summation of doubles, e.g. of epSendNetEnergy over the homes of
+ * a feeder. An ExactSum holds the exact sum of all values added, as a
+ * fixed-point number that spans the whole range of double, so the
+ * result does not depend on the order of the additions: sums computed
+ * by 8 or 32 threads, each over its own homes, and merged in whatever
+ * order the threads finish, are bitwise identical. The final value is
+ * the exact sum rounded once to nearest (faithfully for subnormals).
+ * Adding a value touches three words and costs a few ns.
+ * Used for the sums the shards send to the coordinator (see shard.h) and
+ * for the net energy of the metrics page (see metricsPage.h). The power
+ * flow adds the loads of the homes at each bus as plain doubles, in the
+ * order of the homes, in one thread: the same feeder file gives the same
+ * loads, but these are not rounded only once.
+ * -------------------------------------------------------------------------*/
+
+#ifndef EXACT_SUM_H
+#define EXACT_SUM_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 32 bits per limb from 2^-1074 up to beyond 2^1024
+#define EXACT_SUM_LIMBS 68
+
+typedef struct {
+    long long limb[EXACT_SUM_LIMBS]; // limb i holds multiples of 2^(32 i - 1074), carries pending
+    int nPending;                    // additions since the carries were propagated
+    int special;                     // 1 if an infinity or NaN was added
+    double specialSum;               // sum of the infinities and NaNs
+} ExactSum;
+
+void exactSumInit(ExactSum* s);
+void exactSumAdd(ExactSum* s, double x);
+void exactSumAddArray(ExactSum* s, const double* x, int n);
+
+// Add the exact sum of src to dst, e.g. the partial sum of one thread
+void exactSumMerge(ExactSum* dst, ExactSum* src);
+
+// Bring s into its unique form, the same for the same exact sum, e.g.
+// before its bytes are sent to another node that merges it
+void exactSumNormalize(ExactSum* s);
+
+// The sum, rounded to the nearest double
+double exactSumValue(ExactSum* s);
+
+// Sum of n values, independent of their order
+double exactSumOf(const double* x, int n);
+
+#ifdef __cplusplus
+} // closing brace for extern "C"
+#endif
+#endif // EXACT_SUM_H
@@ -0,0 +1,160 @@
+/* -------------------------------------------------------------------------
+ * feederStep.c
+ * Power flow of the feeder, solved every timestep before the controller.
+ * -------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef STANDALONE_XML_PARSER
+#define logThis(n, ...) printf(__VA_ARGS__);printf("\n")
+#else
+#include "GlobalIncludes.h"
+#include "logging.h" // logThis
+#endif // STANDALONE_XML_PARSER
+
+#include "feederStep.h"
+#include "thread_support.h" // wallClock
+#include "trace.h"
+
+FeederStep* newFeederStep(Feeder* feeder, ControllerHost* host, const char* energyName) {
+    Catalog* c = host->catalog;
+    int column = catalogFind(c, energyName, kind_real);
+    FeederStep* s;
+    int nColumns = host->view.nColumns, i;
+    if (column < 0) {
+        logThis(ERROR_ERROR, "Feeder: no real variable '%s' in the catalog", energyName);
+        return NULL;
+    }
+    if (feeder->nHomes > c->nHomes) {
+        logThis(ERROR_ERROR, "Feeder has %d homes, the catalog %d", feeder->nHomes, c->nHomes);
+        return NULL;
+    }
+    s = (FeederStep*)calloc(1, sizeof(FeederStep));
+    if (!s) return NULL;
+    s->feeder = feeder;
+    s->host = host;
+    s->energy = catalogRealColumn(c, column);
+    // at least one element, so that NULL means no memory
+    s->power = (double*)calloc(c->nHomes + 1, sizeof(double));
+    s->voltage = (double*)malloc((c->nHomes + 1) * sizeof(double));
+    s->loading = (double*)calloc(c->nHomes + 1, sizeof(double));
+    if (!s->power || !s->voltage || !s->loading
+            || !addControllerColumn(host, "feederVoltage", s->voltage)
+            || !addControllerColumn(host, "feederLoading", s->loading)) {
+        // no column may point into the freed arrays
+        host->view.nColumns = nColumns;
+        freeFeederStep(s);
+        return NULL;
+    }
+    for (i=0; i<c->nHomes; i++) s->voltage[i] = 1;
+    return s;
+}
+
+void freeFeederStep(FeederStep* s) {
+    if (!s) return;
+    free(s->power);
+    free(s->voltage);
+    free(s->loading);
+    free(s);
+}
+
+int runFeederStep(FeederStep* s, double time, double stepSize) {
+    Feeder* f = s->feeder;
+    int step = s->nSteps++;
+    int traced = traceSampled(step);
+    double start = traced ? wallClock() : 0;
+    int i;
+    for (i=0; i<f->nHomes; i++) s->power[i] = s->energy[i] / stepSize;
+    if (solveFeeder(f, s->power)) {
+        feederHomeVoltages(f, s->voltage);
+        feederHomeLoadings(f, s->loading);
+        if (traced) traceEvent("power flow", step, start, wallClock());
+    } else {
+        s->nFailed++;
+        logThis(ERROR_WARNING, "Power flow failed at time %g, the controller sees the previous voltages", time);
+    }
+    return runController(s->host, time, stepSize);
+}
+
+// #define TEST
+#ifdef TEST
+#include <math.h>
+
+#define TEST_HOMES 300
+#define TEST_STEPS 96
+
+// feederStep <modelDescription.xml> <feederPlugin> [<file>]: TEST_HOMES
+// homes, 8 behind each transformer, on a feeder written to file. The
+// plugin is controllerPlugin.c built with PLUGIN_FEEDER, which copies
+// feederVoltage to epGetStartHeating. Each step, the controller must see
+// the voltages of the power flow of that step, and after a NaN energy
+// those of the step before.
+int main(int argc, char** argv) {
+    const char* path = argc > 3 ? argv[3] : "feeder300.txt";
+    ModelDescription* md;
+    ModelDescription* mds[TEST_HOMES];
+    double expected[TEST_HOMES];
+    double* energy;
+    double* startHeating;
+    Catalog* catalog;
+    ControllerHost* host;
+    FeederStep* s;
+    Feeder* f;
+    double nan = 0;
+    int failed = 0, i, k;
+    FILE* file;
+    if (argc < 3) {
+        printf("usage: feederStep <modelDescription.xml> <feederPlugin> [<file>]\n");
+        return 1;
+    }
+    file = fopen(path, "w");
+    if (!file) return 1;
+    fprintf(file, "source 7200\n");
+    for (i=0; i<TEST_HOMES; i++) {
+        int t = i / 8;
+        if (i % 8 == 0) {
+            // ten transformers along each main from the source
+            if (t % 10) fprintf(file, "bus M%d M%d 0.05 0.08\n", t, t - 1);
+            else fprintf(file, "bus M%d source 0.05 0.08\n", t);
+            fprintf(file, "bus T%d M%d 0.6 1.2 50\n", t, t);
+        }
+        fprintf(file, "bus S%d T%d 0.002 0.001\nhome %d S%d 0.95\n", i, t, i, i);
+    }
+    fclose(file);
+    md = parse(argv[1]);
+    f = readFeeder(path);
+    if (!md || !f) return 1;
+    for (i=0; i<TEST_HOMES; i++) mds[i] = md;
+    catalog = newCatalog(mds, TEST_HOMES);
+    host = catalog ? newControllerHost(catalog, ".") : NULL;
+    s = host ? newFeederStep(f, host, "epSendNetEnergy") : NULL;
+    if (!s || !loadController(host, argv[2])) return 1;
+    energy = catalogRealColumn(catalog, catalogFind(catalog, "epSendNetEnergy", kind_real));
+    startHeating = catalogRealColumn(catalog, catalogFind(catalog, "epGetStartHeating", kind_real));
+    for (k=0; k<TEST_STEPS; k++) {
+        for (i=0; i<TEST_HOMES; i++)
+            energy[i] = 60 * (2000 + 1500 * sin(0.1 * k + i) - (i % 7 ? 0 : 3000));
+        if (k == TEST_STEPS / 2) {
+            // the power flow fails, the columns keep the previous voltages
+            energy[17] = nan / nan;
+            feederHomeVoltages(f, expected);
+        }
+        if (!runFeederStep(s, 60.0 * k, 60)) failed = 1;
+        if (k != TEST_STEPS / 2) feederHomeVoltages(f, expected);
+        for (i=0; i<TEST_HOMES; i++)
+            if (startHeating[i] != expected[i] || !(expected[i] > 0.9 && expected[i] < 1.1)) failed = 1;
+    }
+    printf("%d steps, %d failed, min voltage %.4f pu, max loading %.3f\n",
+           s->nSteps, s->nFailed, f->minVoltage, f->maxLoading);
+    if (s->nSteps != TEST_STEPS || s->nFailed != 1) failed = 1;
+    printf("%s\n", failed ? "failed" : "ok");
+    freeFeederStep(s);
+    freeControllerHost(host);
+    freeCatalog(catalog);
+    freeFeeder(f);
+    freeElement(md);
+    remove(path);
+    return failed;
+}
+#endif // TEST
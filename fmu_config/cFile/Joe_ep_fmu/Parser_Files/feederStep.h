@@ -0,0 +1,53 @@
+/* -------------------------------------------------------------------------
+ * feederStep.h
+ * Couples the power flow of a feeder (see powerFlow.h) to the controller
+ * (see controller.h) once per timestep: the net energy of each home in
+ * the step, a real column of the catalog such as epSendNetEnergy, is
+ * turned into power and the feeder is solved; the voltage at each home
+ * and the loading of its transformer then appear to the controller
+ * plugins as the columns "feederVoltage" and "feederLoading", before the
+ * controller runs for the same step.
+ * Home i of the feeder file is home i of the catalog. If tracing is on
+ * (see trace.h), each power flow is recorded as a trace event with the
+ * step as id.
+ * -------------------------------------------------------------------------*/
+
+#ifndef FEEDER_STEP_H
+#define FEEDER_STEP_H
+
+#include "powerFlow.h"
+#include "controller.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    Feeder* feeder;
+    ControllerHost* host;
+    const double* energy;   // catalog column, J per step, positive if the home consumes
+    double* power;          // W, of the last step
+    double* voltage;        // per unit, column "feederVoltage", 1 for homes not on the feeder
+    double* loading;        // column "feederLoading", 0 for homes not on the feeder
+    int nSteps;
+    int nFailed;            // steps in which the power flow failed
+} FeederStep;
+
+// Add the columns to the view of host, so call it before the first
+// loadController. The step keeps feeder and host, but does not own them.
+// Returns NULL to indicate failure, e.g. no real column energyName in the
+// catalog, or more homes on the feeder than in the catalog.
+FeederStep* newFeederStep(Feeder* feeder, ControllerHost* host, const char* energyName);
+void freeFeederStep(FeederStep* s);
+
+// Solve the feeder for the energies of the step that ends now, update the
+// columns, then runController. If the power flow fails, the columns keep
+// the values of the previous step. Call like runController, while no home
+// reads or writes the catalog.
+// Returns 1 to indicate success and 0 if the controller failed.
+int runFeederStep(FeederStep* s, double time, double stepSize);
+
+#ifdef __cplusplus
+} // closing brace for extern "C"
+#endif
+#endif // FEEDER_STEP_H
@@ -0,0 +1,438 @@
+/* -------------------------------------------------------------------------
+ * fmuImport.c
+ * Loading of FMI 1.0 co-simulation FMUs into a resolved function table.
+ * -------------------------------------------------------------------------*/
+
+#ifdef __linux__
+#define _GNU_SOURCE // dlmopen
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#ifdef STANDALONE_XML_PARSER
+#define logThis(n, ...) printf(__VA_ARGS__);printf("\n")
+#else
+#include "GlobalIncludes.h"
+#include "logging.h" // logThis
+#endif // STANDALONE_XML_PARSER
+
+#ifndef _WIN32
+#include <dlfcn.h>
+#include <unistd.h>
+#endif
+
+#include "fmuImport.h"
+#include "sharedLib.h"
+
+#define SYMBOL_SIZE 256
+#define MESSAGE_SIZE 1024
+
+#if defined(_WIN64)
+#define FMU_PLATFORM "win64"
+#define FMU_SUFFIX ".dll"
+#elif defined(_WIN32)
+#define FMU_PLATFORM "win32"
+#define FMU_SUFFIX ".dll"
+#elif defined(__APPLE__)
+#define FMU_PLATFORM "darwin64"
+#define FMU_SUFFIX ".dylib"
+#elif defined(__x86_64__) || defined(__aarch64__)
+#define FMU_PLATFORM "linux64"
+#define FMU_SUFFIX ".so"
+#else
+#define FMU_PLATFORM "linux32"
+#define FMU_SUFFIX ".so"
+#endif
+
+int fmuBinaryPath(const char* fmuDir, ModelDescription* md, char* path, int size) {
+    const char* id = getModelIdentifier(md);
+    if (!id) return 0; // error
+    return snprintf(path, size, "%s/binaries/" FMU_PLATFORM "/%s" FMU_SUFFIX, fmuDir, id) < size;
+}
+
+// Address of modelIdentifier_functionName in the library. If a required
+// function is missing, sets *s to 0.
+static void* getAdr(int* s, FMU* fmu, const char* functionName, int required) {
+    char name[SYMBOL_SIZE];
+    void* fp;
+    snprintf(name, sizeof(name), "%s_%s", getModelIdentifier(fmu->modelDescription), functionName);
+    fp = sharedLibSymbol(fmu->dllHandle, name);
+    if (!fp && required) {
+        logThis(ERROR_ERROR, "Function %s not found in the FMU library", name);
+        *s = 0;
+    }
+    return fp;
+}
+
+// Resolve all functions of the loaded library.
+// Returns 1 to indicate success and 0 for error.
+static int resolveFunctions(FMU* fmu, const char* dllPath) {
+    int s = 1;
+    fmu->getTypesPlatform         = (fGetTypesPlatform)        getAdr(&s, fmu, "fmiGetTypesPlatform", 1);
+    fmu->getVersion               = (fGetVersion)              getAdr(&s, fmu, "fmiGetVersion", 1);
+    fmu->setDebugLogging          = (fSetDebugLogging)         getAdr(&s, fmu, "fmiSetDebugLogging", 1);
+    fmu->setReal                  = (fSetReal)                 getAdr(&s, fmu, "fmiSetReal", 1);
+    fmu->setInteger               = (fSetInteger)              getAdr(&s, fmu, "fmiSetInteger", 1);
+    fmu->setBoolean               = (fSetBoolean)              getAdr(&s, fmu, "fmiSetBoolean", 1);
+    fmu->setString                = (fSetString)               getAdr(&s, fmu, "fmiSetString", 1);
+    fmu->getReal                  = (fGetReal)                 getAdr(&s, fmu, "fmiGetReal", 1);
+    fmu->getInteger               = (fGetInteger)              getAdr(&s, fmu, "fmiGetInteger", 1);
+    fmu->getBoolean               = (fGetBoolean)              getAdr(&s, fmu, "fmiGetBoolean", 1);
+    fmu->getString                = (fGetString)               getAdr(&s, fmu, "fmiGetString", 1);
+    fmu->instantiateSlave         = (fInstantiateSlave)        getAdr(&s, fmu, "fmiInstantiateSlave", 1);
+    fmu->initializeSlave          = (fInitializeSlave)         getAdr(&s, fmu, "fmiInitializeSlave", 1);
+    fmu->terminateSlave           = (fTerminateSlave)          getAdr(&s, fmu, "fmiTerminateSlave", 1);
+    fmu->resetSlave               = (fResetSlave)              getAdr(&s, fmu, "fmiResetSlave", 1);
+    fmu->freeSlaveInstance        = (fFreeSlaveInstance)       getAdr(&s, fmu, "fmiFreeSlaveInstance", 1);
+    fmu->doStep                   = (fDoStep)                  getAdr(&s, fmu, "fmiDoStep", 1);
+    fmu->setRealInputDerivatives  = (fSetRealInputDerivatives) getAdr(&s, fmu, "fmiSetRealInputDerivatives", 0);
+    fmu->getRealOutputDerivatives = (fGetRealOutputDerivatives)getAdr(&s, fmu, "fmiGetRealOutputDerivatives", 0);
+    fmu->cancelStep               = (fCancelStep)              getAdr(&s, fmu, "fmiCancelStep", 0);
+    fmu->getStatus                = (fGetStatus)               getAdr(&s, fmu, "fmiGetStatus", 0);
+    fmu->getRealStatus            = (fGetRealStatus)           getAdr(&s, fmu, "fmiGetRealStatus", 0);
+    fmu->getIntegerStatus         = (fGetIntegerStatus)        getAdr(&s, fmu, "fmiGetIntegerStatus", 0);
+    fmu->getBooleanStatus         = (fGetBooleanStatus)        getAdr(&s, fmu, "fmiGetBooleanStatus", 0);
+    fmu->getStringStatus          = (fGetStringStatus)         getAdr(&s, fmu, "fmiGetStringStatus", 0);
+    if (s && strcmp(fmu->getVersion(), "1.0")) {
+        logThis(ERROR_ERROR, "'%s' implements FMI %s, expected 1.0", dllPath, fmu->getVersion());
+        s = 0;
+    }
+    if (!s) {
+        unloadFmu(fmu);
+        return 0; // error
+    }
+    return 1; // success
+}
+
+int loadFmu(FMU* fmu, const char* dllPath, ModelDescription* md) {
+    memset(fmu, 0, sizeof(FMU));
+    fmu->modelDescription = md;
+    if (!getModelIdentifier(md)) {
+        logThis(ERROR_ERROR, "Model description of '%s' has no model identifier", dllPath);
+        return 0; // error
+    }
+    fmu->dllHandle = openSharedLib(dllPath);
+    if (!fmu->dllHandle) return 0; // error
+    return resolveFunctions(fmu, dllPath);
+}
+
+int fmuOncePerProcess(ModelDescription* md) {
+    ValueStatus vs;
+    char once;
+    if (!md->cosimulation || !md->cosimulation->capabilities) return 0;
+    once = getBoolean(md->cosimulation->capabilities, att_canBeInstantiatedOnlyOncePerProcess, &vs);
+    return vs == valueDefined && once;
+}
+
+int loadFmuIsolated(FMU* fmu, const char* dllPath, ModelDescription* md, const char* copyDir) {
+    memset(fmu, 0, sizeof(FMU));
+    fmu->modelDescription = md;
+    if (!getModelIdentifier(md)) {
+        logThis(ERROR_ERROR, "Model description of '%s' has no model identifier", dllPath);
+        return 0; // error
+    }
+#if defined(__linux__) && defined(LM_ID_NEWLM)
+    fmu->dllHandle = dlmopen(LM_ID_NEWLM, dllPath, RTLD_NOW | RTLD_LOCAL);
+    if (fmu->dllHandle) return resolveFunctions(fmu, dllPath);
+    // out of linker namespaces: fall back to a copy
+#endif
+    fmu->copyPath = copySharedLib(dllPath, copyDir, getModelIdentifier(md), FMU_SUFFIX);
+    if (!fmu->copyPath) return 0; // error
+    fmu->dllHandle = openSharedLib(fmu->copyPath);
+    if (!fmu->dllHandle) {
+        removeSharedLibCopy(fmu->copyPath);
+        fmu->copyPath = NULL;
+        return 0; // error
+    }
+    return resolveFunctions(fmu, fmu->copyPath);
+}
+
+void unloadFmu(FMU* fmu) {
+    closeSharedLib(fmu->dllHandle);
+    fmu->dllHandle = NULL;
+    removeSharedLibCopy(fmu->copyPath);
+    fmu->copyPath = NULL;
+}
+
+void fmuLogger(fmiComponent c, fmiString instanceName, fmiStatus status,
+               fmiString category, fmiString message, ...) {
+    char text[MESSAGE_SIZE];
+    va_list args;
+    (void)c;
+    va_start(args, message);
+    vsnprintf(text, sizeof(text), message, args);
+    va_end(args);
+    switch (status) {
+        case fmiOK:
+        case fmiPending:
+            logThis(ERROR_INFO, "%s %s: %s", instanceName, category, text);
+            break;
+        case fmiWarning:
+        case fmiDiscard:
+            logThis(ERROR_WARNING, "%s %s: %s", instanceName, category, text);
+            break;
+        default:
+            logThis(ERROR_ERROR, "%s %s: %s", instanceName, category, text);
+            break;
+    }
+}
+
+fmiComponent instantiateFmuSlave(FMU* fmu, const char* instanceName, const char* fmuLocation, int loggingOn) {
+    fmiCallbackFunctions callbacks;
+    const char* guid = getString(fmu->modelDescription, att_guid);
+    fmiComponent c;
+    callbacks.logger = fmuLogger;
+    callbacks.allocateMemory = calloc;
+    callbacks.freeMemory = free;
+    callbacks.stepFinished = NULL;
+    c = fmu->instantiateSlave(instanceName, guid, fmuLocation, "application/x-fmu-sharedlibrary",
+                              0, fmiFalse, fmiFalse, callbacks, loggingOn ? fmiTrue : fmiFalse);
+    if (!c) {
+        logThis(ERROR_ERROR, "Could not instantiate slave %s", instanceName);
+    }
+    return c;
+}
+
+static int slaveSetReal(void* instance, const fmiValueReference* vrs, int n, const double* values) {
+    FmuSlave* s = (FmuSlave*)instance;
+    return s->fmu->setReal(s->c, vrs, n, values) <= fmiWarning;
+}
+
+static int slaveDoStep(void* instance, double time, double stepSize) {
+    FmuSlave* s = (FmuSlave*)instance;
+    return s->fmu->doStep(s->c, time, stepSize, fmiTrue) <= fmiWarning;
+}
+
+static int slaveGetReal(void* instance, const fmiValueReference* vrs, int n, double* values) {
+    FmuSlave* s = (FmuSlave*)instance;
+    return s->fmu->getReal(s->c, vrs, n, values) <= fmiWarning;
+}
+
+void initFmuReplayTarget(ReplayTarget* target, FmuSlave* slave) {
+    target->instance = slave;
+    target->setReal = slaveSetReal;
+    target->doStep = slaveDoStep;
+    target->getReal = slaveGetReal;
+    target->forkSafe = 0;
+}
+
+// #define TEST
+#ifdef TEST
+#include "thread_support.h" // wallClock
+
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <signal.h>
+
+#define HARNESS_STEPS 2000
+
+static fmiValueReference harnessInputs[3] = { 2, 9, 10 };
+static fmiValueReference harnessOutputs[2] = { 11, 12 };
+
+// kB of the first line of file that starts with key, e.g. VmRSS: of
+// /proc/self/status, or -1 if not available
+static long procKb(const char* file, const char* key) {
+    char line[256];
+    long kb = -1;
+    FILE* f = fopen(file, "r");
+    if (!f) return -1;
+    while (kb < 0 && fgets(line, sizeof(line), f)) {
+        if (!strncmp(line, key, strlen(key))) kb = atol(line + strlen(key));
+    }
+    fclose(f);
+    return kb;
+}
+
+static void stepHome(FMU* fmu, fmiComponent c, double* values, double* decisions) {
+    fmu->setReal(c, harnessInputs, 3, values);
+    fmu->doStep(c, 0, 60, fmiTrue);
+    fmu->getReal(c, harnessOutputs, 2, decisions);
+}
+
+// nHomes isolated instances in this process: memory per home, as the
+// growth of the resident set, and time per home step
+static int runIsolated(const char* dllPath, ModelDescription* md, int nHomes, const char* copyDir) {
+    FMU* fmus = (FMU*)calloc(nHomes, sizeof(FMU));
+    fmiComponent* cs = (fmiComponent*)calloc(nHomes, sizeof(fmiComponent));
+    double values[3] = { 18, 20, 24 }, decisions[2], start;
+    long before = procKb("/proc/self/status", "VmRSS:");
+    int i, k, n = 0;
+    if (!fmus || !cs) return 0; // error
+    for (n=0; n<nHomes; n++) {
+        if (!loadFmuIsolated(&fmus[n], dllPath, md, copyDir)) break;
+        cs[n] = instantiateFmuSlave(&fmus[n], "home", "", 0);
+        if (!cs[n]) {
+            unloadFmu(&fmus[n]);
+            break;
+        }
+    }
+    if (n == nHomes) {
+        for (k=0; k<10; k++)
+            for (i=0; i<n; i++) stepHome(&fmus[i], cs[i], values, decisions);
+        printf("isolated:         %6ld kB per home (resident set)\n",
+               (procKb("/proc/self/status", "VmRSS:") - before) / nHomes);
+        start = wallClock();
+        for (k=0; k<HARNESS_STEPS; k++)
+            for (i=0; i<n; i++) stepHome(&fmus[i], cs[i], values, decisions);
+        printf("isolated:         %6.2f us per home step\n", 1e6 * (wallClock() - start) / ((double)HARNESS_STEPS * n));
+    } else {
+        printf("isolated: only %d of %d homes instantiated\n", n, nHomes);
+    }
+    for (i=0; i<n; i++) {
+        fmus[i].freeSlaveInstance(cs[i]);
+        unloadFmu(&fmus[i]);
+    }
+    free(fmus);
+    free(cs);
+    return n == nHomes;
+}
+
+// A home process: step on each message of the parent, answer the decisions
+static void serveHome(const char* dllPath, ModelDescription* md, int in, int out) {
+    double values[3], decisions[2];
+    FMU fmu;
+    fmiComponent c;
+    if (!loadFmu(&fmu, dllPath, md)) _exit(1);
+    c = instantiateFmuSlave(&fmu, "home", "", 0);
+    if (!c) _exit(1);
+    while (read(in, values, sizeof(values)) == sizeof(values)) {
+        stepHome(&fmu, c, values, decisions);
+        if (write(out, decisions, sizeof(decisions)) != sizeof(decisions)) break;
+    }
+    _exit(0);
+}
+
+// One process per home, stepped over pipes: memory per home, as the
+// proportional set size of the processes, and time per home step
+static int runProcessPerHome(const char* dllPath, ModelDescription* md, int nHomes) {
+    int* toHome = (int*)malloc(2 * nHomes * sizeof(int));
+    int* fromHome = (int*)malloc(2 * nHomes * sizeof(int));
+    pid_t* pids = (pid_t*)malloc(nHomes * sizeof(pid_t));
+    double values[3] = { 18, 20, 24 }, decisions[2], start;
+    char path[64];
+    long pss = 0;
+    int i, k, ok = 1, n;
+    if (!toHome || !fromHome || !pids) return 0; // error
+    fflush(stdout);
+    for (n=0; n<nHomes; n++) {
+        if (pipe(&toHome[2*n]) || pipe(&fromHome[2*n])) break;
+        pids[n] = fork();
+        if (pids[n] == 0) serveHome(dllPath, md, toHome[2*n], fromHome[2*n+1]);
+        if (pids[n] < 0) break;
+    }
+    ok = n == nHomes;
+    for (k=0; ok && k<10; k++)
+        for (i=0; ok && i<n; i++)
+            ok = write(toHome[2*i+1], values, sizeof(values)) == sizeof(values)
+              && read(fromHome[2*i], decisions, sizeof(decisions)) == sizeof(decisions);
+    if (ok) {
+        for (i=0; i<n; i++) {
+            snprintf(path, sizeof(path), "/proc/%d/smaps_rollup", (int)pids[i]);
+            pss += procKb(path, "Pss:");
+        }
+        printf("process per home: %6ld kB per home (proportional set)\n", pss / nHomes);
+        start = wallClock();
+        // all homes step in parallel, like the processes of a fleet
+        for (k=0; ok && k<HARNESS_STEPS; k++) {
+            for (i=0; ok && i<n; i++)
+                ok = write(toHome[2*i+1], values, sizeof(values)) == sizeof(values);
+            for (i=0; ok && i<n; i++)
+                ok = read(fromHome[2*i], decisions, sizeof(decisions)) == sizeof(decisions);
+        }
+        printf("process per home: %6.2f us per home step\n", 1e6 * (wallClock() - start) / ((double)HARNESS_STEPS * n));
+    }
+    for (i=0; i<n; i++) {
+        close(toHome[2*i]);
+        close(toHome[2*i+1]);
+        close(fromHome[2*i]);
+        close(fromHome[2*i+1]);
+        kill(pids[i], SIGKILL);
+        waitpid(pids[i], NULL, 0);
+    }
+    free(toHome);
+    free(fromHome);
+    free(pids);
+    return ok;
+}
+#endif // _WIN32
+
+// fmuImport <modelDescription.xml> <stub library> [<stub without fmiDoStep>
+//           [<homes> [<copyDir>]]]:
+// the libraries built from stubFmu.c, with modelDescription.xml of
+// Joe_ep_fmu.fmu. Loads, instantiates and steps the stub, checks its
+// decisions, and measures a set/step/get round through the table.
+// With a number of homes, compares memory and time per home step of
+// isolated instances in one process, see loadFmuIsolated, with one
+// process per home.
+int main(int argc, char** argv) {
+    fmiValueReference inputs[4] = { 2, 3, 9, 10 };   // zone, outdoor, heating and cooling setpoint
+    fmiValueReference outputs[2] = { 11, 12 };       // start heating and cooling
+    fmiValueReference unknown = 99;
+    double values[4] = { 18, 5, 20, 24 };
+    double decisions[2];
+    int rounds = 10000000, k, failed = 0;
+    ReplayTarget target;
+    FmuSlave slave;
+    FMU fmu;
+    ModelDescription* md;
+    double start;
+    if (argc < 3) {
+        printf("usage: fmuImport <modelDescription.xml> <stub library> [<stub without fmiDoStep> "
+               "[<homes> [<copyDir>]]]\n");
+        return 1;
+    }
+    md = parse(argv[1]);
+    if (!md) return 1;
+    if (argc > 3 && loadFmu(&fmu, argv[3], md)) {
+        printf("loaded a library without fmiDoStep\n");
+        failed = 1;
+        unloadFmu(&fmu);
+    }
+    if (!loadFmu(&fmu, argv[2], md)) {
+        freeElement(md);
+        return 1;
+    }
+    slave.fmu = &fmu;
+    slave.c = instantiateFmuSlave(&fmu, "home0", "file:///tmp/Joe_ep_fmu", 0);
+    if (!slave.c || fmu.initializeSlave(slave.c, 0, fmiFalse, 0) > fmiWarning) {
+        unloadFmu(&fmu);
+        freeElement(md);
+        return 1;
+    }
+    initFmuReplayTarget(&target, &slave);
+    // 18 degrees with setpoints 20 to 24: heat, then 26: cool
+    target.setReal(target.instance, inputs, 4, values);
+    target.doStep(target.instance, 0, 60);
+    target.getReal(target.instance, outputs, 2, decisions);
+    if (decisions[0] != 1 || decisions[1] != 0) failed = 1;
+    values[0] = 26;
+    target.setReal(target.instance, inputs, 4, values);
+    target.doStep(target.instance, 60, 60);
+    target.getReal(target.instance, outputs, 2, decisions);
+    if (decisions[0] != 0 || decisions[1] != 1) failed = 1;
+    if (target.setReal(target.instance, &unknown, 1, values)) failed = 1;
+    start = wallClock();
+    for (k=0; k<rounds; k++) {
+        values[0] = 15 + k % 15;
+        target.setReal(target.instance, inputs, 4, values);
+        target.doStep(target.instance, k * 60.0, 60);
+        target.getReal(target.instance, outputs, 2, decisions);
+    }
+    printf("%.1f ns per set/step/get\n", 1e9 * (wallClock() - start) / rounds);
+    fmu.terminateSlave(slave.c);
+    fmu.freeSlaveInstance(slave.c);
+    unloadFmu(&fmu);
+#ifndef _WIN32
+    if (argc > 4 && atoi(argv[4]) > 0) {
+        int nHomes = atoi(argv[4]);
+        if (!runIsolated(argv[2], md, nHomes, argc > 5 ? argv[5] : "/tmp")) failed = 1;
+        if (!runProcessPerHome(argv[2], md, nHomes)) failed = 1;
+    }
+#endif
+    freeElement(md);
+    printf("%s\n", failed ? "failed" : "ok");
+    return failed;
+}
+#endif // TEST
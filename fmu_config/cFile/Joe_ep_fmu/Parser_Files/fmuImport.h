@@ -0,0 +1,165 @@
+/* -------------------------------------------------------------------------
+ * fmuImport.h
+ * Loads the shared library of an FMI 1.0 co-simulation FMU and resolves
+ * its functions once, at load time, into a function table. FMI 1.0
+ * prefixes each exported function with the model identifier of the
+ * model description, e.g. Joe_ep_fmu_fmiDoStep. After loading, each call
+ * is one indirect call through the table, without any lookup.
+ * FMUs that can be instantiated only once per process, like Joe_ep_fmu,
+ * can still run many instances in one process if each instance loads
+ * the library isolated, with its own globals, see loadFmuIsolated.
+ * Uses dlopen/dlsym, or LoadLibrary/GetProcAddress on Windows.
+ * -------------------------------------------------------------------------*/
+
+#ifndef fmuImport_h
+#define fmuImport_h
+
+#include <stddef.h>
+#include "xml_parser.h"
+#include "replay.h" // ReplayTarget
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Types of fmiPlatformTypes.h and fmiFunctions.h of FMI 1.0 co-simulation,
+// unless these headers were included before
+#ifndef fmiPlatformTypes_h
+typedef void*        fmiComponent;
+typedef double       fmiReal;
+typedef int          fmiInteger;
+typedef char         fmiBoolean;
+typedef const char*  fmiString;
+#define fmiTrue  1
+#define fmiFalse 0
+#endif
+
+#ifndef fmiFunctions_h
+typedef enum { fmiOK, fmiWarning, fmiDiscard, fmiError, fmiFatal, fmiPending } fmiStatus;
+typedef enum { fmiDoStepStatus, fmiPendingStatus, fmiLastSuccessfulTime } fmiStatusKind;
+
+typedef void  (*fmiCallbackLogger)        (fmiComponent c, fmiString instanceName, fmiStatus status,
+                                           fmiString category, fmiString message, ...);
+typedef void* (*fmiCallbackAllocateMemory)(size_t nobj, size_t size);
+typedef void  (*fmiCallbackFreeMemory)    (void* obj);
+typedef void  (*fmiStepFinished)          (fmiComponent c, fmiStatus status);
+
+typedef struct {
+    fmiCallbackLogger         logger;
+    fmiCallbackAllocateMemory allocateMemory;
+    fmiCallbackFreeMemory     freeMemory;
+    fmiStepFinished           stepFinished;
+} fmiCallbackFunctions;
+#endif
+
+typedef const char*  (*fGetTypesPlatform)       (void);
+typedef const char*  (*fGetVersion)             (void);
+typedef fmiStatus    (*fSetDebugLogging)        (fmiComponent c, fmiBoolean loggingOn);
+typedef fmiStatus    (*fSetReal)                (fmiComponent c, const fmiValueReference vr[], size_t nvr, const fmiReal value[]);
+typedef fmiStatus    (*fSetInteger)             (fmiComponent c, const fmiValueReference vr[], size_t nvr, const fmiInteger value[]);
+typedef fmiStatus    (*fSetBoolean)             (fmiComponent c, const fmiValueReference vr[], size_t nvr, const fmiBoolean value[]);
+typedef fmiStatus    (*fSetString)              (fmiComponent c, const fmiValueReference vr[], size_t nvr, const fmiString value[]);
+typedef fmiStatus    (*fGetReal)                (fmiComponent c, const fmiValueReference vr[], size_t nvr, fmiReal value[]);
+typedef fmiStatus    (*fGetInteger)             (fmiComponent c, const fmiValueReference vr[], size_t nvr, fmiInteger value[]);
+typedef fmiStatus    (*fGetBoolean)             (fmiComponent c, const fmiValueReference vr[], size_t nvr, fmiBoolean value[]);
+typedef fmiStatus    (*fGetString)              (fmiComponent c, const fmiValueReference vr[], size_t nvr, fmiString value[]);
+typedef fmiComponent (*fInstantiateSlave)       (fmiString instanceName, fmiString fmuGUID, fmiString fmuLocation,
+                                                 fmiString mimeType, fmiReal timeout, fmiBoolean visible, fmiBoolean interactive,
+                                                 fmiCallbackFunctions functions, fmiBoolean loggingOn);
+typedef fmiStatus    (*fInitializeSlave)        (fmiComponent c, fmiReal tStart, fmiBoolean StopTimeDefined, fmiReal tStop);
+typedef fmiStatus    (*fTerminateSlave)         (fmiComponent c);
+typedef fmiStatus    (*fResetSlave)             (fmiComponent c);
+typedef void         (*fFreeSlaveInstance)      (fmiComponent c);
+typedef fmiStatus    (*fSetRealInputDerivatives)(fmiComponent c, const fmiValueReference vr[], size_t nvr,
+                                                 const fmiInteger order[], const fmiReal value[]);
+typedef fmiStatus    (*fGetRealOutputDerivatives)(fmiComponent c, const fmiValueReference vr[], size_t nvr,
+                                                 const fmiInteger order[], fmiReal value[]);
+typedef fmiStatus    (*fCancelStep)             (fmiComponent c);
+typedef fmiStatus    (*fDoStep)                 (fmiComponent c, fmiReal currentCommunicationPoint,
+                                                 fmiReal communicationStepSize, fmiBoolean newStep);
+typedef fmiStatus    (*fGetStatus)              (fmiComponent c, const fmiStatusKind s, fmiStatus* value);
+typedef fmiStatus    (*fGetRealStatus)          (fmiComponent c, const fmiStatusKind s, fmiReal* value);
+typedef fmiStatus    (*fGetIntegerStatus)       (fmiComponent c, const fmiStatusKind s, fmiInteger* value);
+typedef fmiStatus    (*fGetBooleanStatus)       (fmiComponent c, const fmiStatusKind s, fmiBoolean* value);
+typedef fmiStatus    (*fGetStringStatus)        (fmiComponent c, const fmiStatusKind s, fmiString* value);
+
+typedef struct {
+    ModelDescription* modelDescription;
+    void* dllHandle;
+    char* copyPath;              // NULL or private copy of the library, deleted by unloadFmu
+    fGetTypesPlatform getTypesPlatform;
+    fGetVersion getVersion;
+    fSetDebugLogging setDebugLogging;
+    fSetReal setReal;
+    fSetInteger setInteger;
+    fSetBoolean setBoolean;
+    fSetString setString;
+    fGetReal getReal;
+    fGetInteger getInteger;
+    fGetBoolean getBoolean;
+    fGetString getString;
+    fInstantiateSlave instantiateSlave;
+    fInitializeSlave initializeSlave;
+    fTerminateSlave terminateSlave;
+    fResetSlave resetSlave;
+    fFreeSlaveInstance freeSlaveInstance;
+    // optional, NULL if the FMU does not export them
+    fSetRealInputDerivatives setRealInputDerivatives;
+    fGetRealOutputDerivatives getRealOutputDerivatives;
+    fCancelStep cancelStep;
+    fGetStatus getStatus;
+    fGetRealStatus getRealStatus;
+    fGetIntegerStatus getIntegerStatus;
+    fGetBooleanStatus getBooleanStatus;
+    fGetStringStatus getStringStatus;
+    fDoStep doStep;
+} FMU;
+
+// Path of the shared library of the FMU extracted to fmuDir for the
+// running platform, e.g. fmuDir/binaries/linux64/Joe_ep_fmu.so.
+// Returns 1 to indicate success and 0 if the path does not fit.
+int fmuBinaryPath(const char* fmuDir, ModelDescription* md, char* path, int size);
+
+// Load the library and resolve all functions of the model identifier of
+// md. The FMU keeps md, but does not own it.
+// Returns 1 to indicate success and 0 for error, e.g. a missing function.
+int loadFmu(FMU* fmu, const char* dllPath, ModelDescription* md);
+
+// Returns 1 if the Capabilities of md say canBeInstantiatedOnlyOncePerProcess
+int fmuOncePerProcess(ModelDescription* md);
+
+// Like loadFmu, but the FMU gets its own instance of the library and its
+// globals, for one instance of an FMU that can be instantiated only once
+// per process. On Linux, the library is loaded into a new linker
+// namespace with dlmopen. glibc supports only 15 such namespaces; later
+// instances, and all instances on other systems, load a private copy of
+// the library file made in copyDir, which unloadFmu deletes.
+int loadFmuIsolated(FMU* fmu, const char* dllPath, ModelDescription* md, const char* copyDir);
+
+void unloadFmu(FMU* fmu);
+
+// Logger that forwards the messages of an FMU to logThis
+void fmuLogger(fmiComponent c, fmiString instanceName, fmiStatus status,
+               fmiString category, fmiString message, ...);
+
+// Instantiate a slave with the GUID of the model description and
+// callbacks fmuLogger, calloc and free. fmuLocation is the URI of the
+// extracted FMU, e.g. file:///tmp/Joe_ep_fmu. Returns NULL on error.
+fmiComponent instantiateFmuSlave(FMU* fmu, const char* instanceName, const char* fmuLocation, int loggingOn);
+
+// A slave of a loaded FMU as the target of replayRecording.
+// The slave must outlive the target.
+typedef struct {
+    FMU* fmu;
+    fmiComponent c;
+} FmuSlave;
+
+// The target is not forkSafe, so runWhatIf refuses it: an FMU may keep
+// sockets, threads or processes, like Joe_ep_fmu, that a forked child
+// would share or lose.
+void initFmuReplayTarget(ReplayTarget* target, FmuSlave* slave);
+
+#ifdef __cplusplus
+} // closing brace for extern "C"
+#endif
+#endif // fmuImport_h
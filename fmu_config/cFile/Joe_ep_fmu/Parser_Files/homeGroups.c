@@ -0,0 +1,280 @@
+/* -------------------------------------------------------------------------
+ * homeGroups.c
+ * cgroup v2 groups of home processes: limits and per-step accounting.
+ * -------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef STANDALONE_XML_PARSER
+#define logThis(n, ...) printf(__VA_ARGS__);printf("\n")
+#else
+#include "GlobalIncludes.h"
+#include "logging.h" // logThis
+#endif // STANDALONE_XML_PARSER
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+#include "homeGroups.h"
+
+#ifndef __linux__
+
+int enableHomeGroupControllers(const char* parent) {
+    logThis(ERROR_ERROR, "cgroups are available on Linux only");
+    return -1; // error
+}
+
+int createHomeGroup(HomeGroup* g, const char* parent, const char* name, const HomeGroupLimits* limits) {
+    logThis(ERROR_ERROR, "cgroups are available on Linux only");
+    return 0; // error
+}
+
+int attachToHomeGroup(HomeGroup* g, int pid) {
+    return 0; // error
+}
+
+int sampleHomeGroup(HomeGroup* g, HomeUsage* usage) {
+    return 0; // error
+}
+
+int sampleHomeGroups(HomeGroup* groups, int n, Balancer* b, HomeUsage* usage) {
+    int i;
+    if (usage)
+        for (i=0; i<n; i++) usage[i].stepCpuSeconds = -1;
+    return 0;
+}
+
+int removeHomeGroup(HomeGroup* g) {
+    return 0; // error
+}
+
+#else
+
+// Write text to the control file dir/file.
+// Returns 1 to indicate success and 0 for error.
+static int writeControl(const char* dir, const char* file, const char* text) {
+    char path[HOME_GROUP_PATH_SIZE + 32];
+    int fd, ok;
+    snprintf(path, sizeof(path), "%s/%s", dir, file);
+    fd = open(path, O_WRONLY);
+    if (fd < 0) return 0; // error
+    ok = write(fd, text, strlen(text)) == (ssize_t)strlen(text);
+    close(fd);
+    return ok;
+}
+
+// Read an open control file from the start into buffer, 0-terminated.
+// Returns the number of bytes read, or -1 on error.
+static int readControl(int fd, char* buffer, int size) {
+    ssize_t n = pread(fd, buffer, size - 1, 0);
+    if (n < 0) return -1; // error
+    buffer[n] = '\0';
+    return (int)n;
+}
+
+static int openControl(const char* dir, const char* file) {
+    char path[HOME_GROUP_PATH_SIZE + 32];
+    snprintf(path, sizeof(path), "%s/%s", dir, file);
+    return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+// Value of the line "key value" in text, or -1
+static long long statValue(const char* text, const char* key) {
+    size_t n = strlen(key);
+    const char* p = text;
+    while ((p = strstr(p, key)) != NULL) {
+        if ((p == text || p[-1] == '\n') && p[n] == ' ') return atoll(p + n + 1);
+        p += n;
+    }
+    return -1;
+}
+
+int enableHomeGroupControllers(const char* parent) {
+    char available[256];
+    int fd, n = 0;
+    if (mkdir(parent, 0755) && errno != EEXIST) {
+        logThis(ERROR_ERROR, "Cannot create cgroup '%s': %s", parent, strerror(errno));
+        return -1; // error
+    }
+    fd = openControl(parent, "cgroup.controllers");
+    if (fd < 0 || readControl(fd, available, sizeof(available)) < 0) {
+        logThis(ERROR_ERROR, "'%s' is not a cgroup v2 group", parent);
+        if (fd >= 0) close(fd);
+        return -1; // error
+    }
+    close(fd);
+    // controllers can only be enabled for children if the parent holds no
+    // processes itself, so home processes go into the child groups only
+    if (strstr(available, "cpu") && writeControl(parent, "cgroup.subtree_control", "+cpu")) n++;
+    else {
+        logThis(ERROR_WARNING, "cpu controller not available for children of '%s'", parent);
+    }
+    if (strstr(available, "memory") && writeControl(parent, "cgroup.subtree_control", "+memory")) n++;
+    else {
+        logThis(ERROR_WARNING, "memory controller not available for children of '%s'", parent);
+    }
+    return n;
+}
+
+int createHomeGroup(HomeGroup* g, const char* parent, const char* name, const HomeGroupLimits* limits) {
+    char value[32];
+    memset(g, 0, sizeof(HomeGroup));
+    g->cpuStat = g->memoryStat = -1;
+    if (snprintf(g->path, sizeof(g->path), "%s/%s", parent, name) >= (int)sizeof(g->path)) {
+        logThis(ERROR_ERROR, "cgroup path '%s/%s' is too long", parent, name);
+        return 0; // error
+    }
+    if (mkdir(g->path, 0755) && errno != EEXIST) {
+        logThis(ERROR_ERROR, "Cannot create cgroup '%s': %s", g->path, strerror(errno));
+        return 0; // error
+    }
+    if (limits && limits->cpuWeight > 0) {
+        snprintf(value, sizeof(value), "%d", limits->cpuWeight);
+        if (!writeControl(g->path, "cpu.weight", value)) {
+            logThis(ERROR_WARNING, "Cannot set cpu.weight of cgroup '%s'", g->path);
+        }
+    }
+    if (limits && limits->memoryHigh > 0) {
+        snprintf(value, sizeof(value), "%lld", limits->memoryHigh);
+        if (!writeControl(g->path, "memory.high", value)) {
+            logThis(ERROR_WARNING, "Cannot set memory.high of cgroup '%s'", g->path);
+        }
+    }
+    if (limits && limits->memoryMax > 0) {
+        snprintf(value, sizeof(value), "%lld", limits->memoryMax);
+        if (!writeControl(g->path, "memory.max", value)) {
+            logThis(ERROR_WARNING, "Cannot set memory.max of cgroup '%s'", g->path);
+        }
+    }
+    g->cpuStat = openControl(g->path, "cpu.stat");
+    g->memoryStat = openControl(g->path, "memory.stat");
+    if (g->cpuStat < 0) {
+        logThis(ERROR_ERROR, "Cannot open cpu.stat of cgroup '%s'", g->path);
+        removeHomeGroup(g);
+        return 0; // error
+    }
+    return 1; // success
+}
+
+int attachToHomeGroup(HomeGroup* g, int pid) {
+    char value[32];
+    snprintf(value, sizeof(value), "%d", pid);
+    if (!writeControl(g->path, "cgroup.procs", value)) {
+        logThis(ERROR_ERROR, "Cannot move process %d to cgroup '%s': %s", pid, g->path, strerror(errno));
+        return 0; // error
+    }
+    return 1; // success
+}
+
+// Add resident memory and page faults of process pid from /proc
+static void addProcessUsage(int pid, HomeUsage* usage) {
+    char path[64];
+    char text[1024];
+    const char* p;
+    unsigned long minflt, majflt;
+    long rss;
+    int fd, n;
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return; // exited
+    n = readControl(fd, text, sizeof(text));
+    close(fd);
+    // the command name may contain spaces, fields follow the last ')'
+    if (n <= 0 || !(p = strrchr(text, ')'))) return;
+    if (sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %lu %*u %lu %*u %*u %*u %*d %*d %*d %*d %*d %*d %*u %*u %ld",
+               &minflt, &majflt, &rss) != 3)
+        return;
+    usage->pageFaults += minflt + majflt;
+    usage->majorFaults += majflt;
+    usage->rss += rss * sysconf(_SC_PAGESIZE);
+}
+
+// Memory and page faults summed over the processes of the group
+static int sampleProcesses(HomeGroup* g, HomeUsage* usage) {
+    char text[4096];
+    char* p;
+    int fd = openControl(g->path, "cgroup.procs");
+    if (fd < 0) return 0; // error
+    usage->rss = usage->pageFaults = usage->majorFaults = 0;
+    if (readControl(fd, text, sizeof(text)) < 0) {
+        close(fd);
+        return 0; // error
+    }
+    close(fd);
+    for (p = text; *p; ) {
+        char* end;
+        long pid = strtol(p, &end, 10);
+        if (end == p) break;
+        addProcessUsage((int)pid, usage);
+        p = end;
+        while (*p == '\n') p++;
+    }
+    return 1; // success
+}
+
+int sampleHomeGroup(HomeGroup* g, HomeUsage* usage) {
+    char text[4096];
+    long long usec;
+    if (readControl(g->cpuStat, text, sizeof(text)) < 0) return 0; // error
+    usec = statValue(text, "usage_usec");
+    if (usec < 0) return 0; // error
+    usage->cpuSeconds = usec * 1e-6;
+    if (g->memoryStat >= 0) {
+        long long anon, mapped;
+        if (readControl(g->memoryStat, text, sizeof(text)) < 0) return 0; // error
+        anon = statValue(text, "anon");
+        mapped = statValue(text, "file_mapped");
+        if (anon < 0) return 0; // error
+        usage->rss = anon + (mapped > 0 ? mapped : 0);
+        usage->pageFaults = statValue(text, "pgfault");
+        usage->majorFaults = statValue(text, "pgmajfault");
+    } else {
+        if (!sampleProcesses(g, usage)) return 0; // error
+        // a process that left the group takes its faults along
+        if (usage->pageFaults + g->lostFaults < g->last.pageFaults)
+            g->lostFaults = g->last.pageFaults - usage->pageFaults;
+        if (usage->majorFaults + g->lostMajorFaults < g->last.majorFaults)
+            g->lostMajorFaults = g->last.majorFaults - usage->majorFaults;
+        usage->pageFaults += g->lostFaults;
+        usage->majorFaults += g->lostMajorFaults;
+    }
+    usage->stepCpuSeconds = usage->cpuSeconds - g->last.cpuSeconds;
+    usage->stepPageFaults = usage->pageFaults - g->last.pageFaults;
+    usage->stepMajorFaults = usage->majorFaults - g->last.majorFaults;
+    g->last = *usage;
+    return 1; // success
+}
+
+int sampleHomeGroups(HomeGroup* groups, int n, Balancer* b, HomeUsage* usage) {
+    HomeUsage sample;
+    int i, nSampled = 0;
+    for (i=0; i<n; i++) {
+        if (!sampleHomeGroup(&groups[i], &sample)) {
+            if (usage) usage[i].stepCpuSeconds = -1;
+            continue;
+        }
+        if (b) balancerRecord(b, i, sample.stepCpuSeconds);
+        if (usage) usage[i] = sample;
+        nSampled++;
+    }
+    return nSampled;
+}
+
+int removeHomeGroup(HomeGroup* g) {
+    if (g->cpuStat >= 0) close(g->cpuStat);
+    if (g->memoryStat >= 0) close(g->memoryStat);
+    g->cpuStat = g->memoryStat = -1;
+    if (rmdir(g->path)) {
+        logThis(ERROR_ERROR, "Cannot remove cgroup '%s': %s", g->path, strerror(errno));
+        return 0; // error
+    }
+    return 1; // success
+}
+
+#endif // __linux__
@@ -0,0 +1,93 @@
+/* -------------------------------------------------------------------------
+ * homeGroups.h
+ * Resource budgets and accounting of home processes with cgroup v2.
+ * Each home, or group of homes, runs in its own cgroup below a parent
+ * group of the worker pool, with a CPU weight and a memory limit, so
+ * that one runaway EnergyPlus instance cannot starve the others.
+ * Sampling a group once per step reads its CPU time, resident memory
+ * and page faults. sampleHomeGroups passes the CPU time used in the
+ * step, a measure of the step cost of the home, to balancerRecord, and
+ * the samples of all homes go to publishMetrics.
+ * Resident memory is the anonymous memory and the mapped files of the
+ * group, from memory.stat; memory.current would also count the page
+ * cache and kernel memory charged to the group.
+ * If the memory controller is not enabled for the parent, memory and
+ * page faults are summed over the processes currently in the group,
+ * from /proc; the faults of processes that left the group are kept in
+ * the totals.
+ * Linux only: on other systems, createHomeGroup fails.
+ * -------------------------------------------------------------------------*/
+
+#ifndef HOME_GROUPS_H
+#define HOME_GROUPS_H
+
+#include "balance.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HOME_GROUP_PATH_SIZE 256
+
+typedef struct {
+    int cpuWeight;          // 1 to 10000, 100 is the default of cgroup v2, 0 to keep the default
+    long long memoryMax;    // in bytes, 0 for no limit
+    long long memoryHigh;   // in bytes, reclaim and throttle above, 0 for no limit
+} HomeGroupLimits;
+
+typedef struct {
+    double cpuSeconds;      // user and system time of all processes, since creation
+    long long rss;          // resident memory in bytes, anonymous and mapped files
+    long long pageFaults;   // minor and major page faults, since creation
+    long long majorFaults;  // page faults that needed I/O, since creation
+    // change since the previous sample, stepCpuSeconds is -1 if the
+    // home could not be sampled
+    double stepCpuSeconds;
+    long long stepPageFaults;
+    long long stepMajorFaults;
+} HomeUsage;
+
+typedef struct {
+    char path[HOME_GROUP_PATH_SIZE]; // directory of the group
+    int cpuStat;            // open files of the group, read at each sample
+    int memoryStat;         // -1 without memory controller
+    HomeUsage last;         // previous sample
+    long long lostFaults;   // without memory controller: faults of processes
+    long long lostMajorFaults; // that left the group, kept in the totals
+} HomeGroup;
+
+// Enable the cpu and memory controllers for the children of the parent
+// group, e.g. /sys/fs/cgroup/ucef. Creates the parent if needed.
+// Returns the number of controllers enabled, 0 to 2, or -1 on error.
+int enableHomeGroupControllers(const char* parent);
+
+// Create the group parent/name with the given limits. A limit that
+// cannot be set is logged but does not fail the call.
+// Returns 1 to indicate success and 0 for error.
+int createHomeGroup(HomeGroup* g, const char* parent, const char* name, const HomeGroupLimits* limits);
+
+// Move process pid into the group, e.g. a home process right after fork.
+// Returns 1 to indicate success and 0 for error.
+int attachToHomeGroup(HomeGroup* g, int pid);
+
+// Read the current usage of the group into usage, including the change
+// since the previous sample. Does not allocate memory.
+// Returns 1 to indicate success and 0 for error.
+int sampleHomeGroup(HomeGroup* g, HomeUsage* usage);
+
+// Sample the groups of n homes, group i holding home i, once per step.
+// The CPU time of each home in the step goes to balancerRecord of b, if
+// not NULL, and the sample of home i to usage[i], if not NULL, e.g. for
+// publishMetrics. Homes that cannot be sampled get no record and
+// stepCpuSeconds -1.
+// Does not allocate memory. Returns the number of groups sampled.
+int sampleHomeGroups(HomeGroup* groups, int n, Balancer* b, HomeUsage* usage);
+
+// Close the files of the group and remove it. The group must not
+// contain processes any more. Returns 1 to indicate success and 0 for error.
+int removeHomeGroup(HomeGroup* g);
+
+#ifdef __cplusplus
+} // closing brace for extern "C"
+#endif
+#endif // HOME_GROUPS_H
@@ -0,0 +1,345 @@
+/* -------------------------------------------------------------------------
+ * metricsPage.c
+ * Live metrics in shared memory, published with a sequence lock.
+ * -------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#ifdef STANDALONE_XML_PARSER
+#define logThis(n, ...) printf(__VA_ARGS__);printf("\n")
+#else
+#include "GlobalIncludes.h"
+#include "logging.h" // logThis
+#endif // STANDALONE_XML_PARSER
+
+#ifdef _WIN32
+#include <windows.h>
+#define fenceRelease() MemoryBarrier()
+#define fenceAcquire() MemoryBarrier()
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#define fenceRelease() __atomic_thread_fence(__ATOMIC_RELEASE)
+#define fenceAcquire() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#endif
+
+#include "thread_support.h" // wallClock
+#include "exactSum.h"
+#include "metricsPage.h"
+
+// The part of the snapshot written under the sequence lock
+#define BODY_OFFSET offsetof(MetricsSnapshot, timestep)
+#define BODY_WORDS ((sizeof(MetricsSnapshot) - BODY_OFFSET) / sizeof(long long))
+
+#define METRICS_P99_EVERY 64
+
+// Copy the body to or from the shared page word by word through volatile
+// pointers, so that the compiler neither drops nor merges the accesses to
+// the page. The private snapshot is copied with memcpy, as its fields are
+// not long long and must not be accessed as such.
+static void writeBody(volatile MetricsSnapshot* page, const MetricsSnapshot* s) {
+    long long body[BODY_WORDS];
+    volatile long long* to = (volatile long long*)((volatile char*)page + BODY_OFFSET);
+    size_t i;
+    memcpy(body, (const char*)s + BODY_OFFSET, sizeof(body));
+    for (i=0; i<BODY_WORDS; i++) to[i] = body[i];
+}
+
+static void readBody(MetricsSnapshot* s, volatile const MetricsSnapshot* page) {
+    long long body[BODY_WORDS];
+    volatile const long long* from = (volatile const long long*)((volatile const char*)page + BODY_OFFSET);
+    size_t i;
+    for (i=0; i<BODY_WORDS; i++) body[i] = from[i];
+    memcpy((char*)s + BODY_OFFSET, body, sizeof(body));
+}
+
+static char* pageName(const char* name) {
+    char* s = (char*)malloc(strlen(name) + 7);
+    if (!s) return NULL;
+#ifdef _WIN32
+    sprintf(s, "Local\\%s", name);
+#else
+    sprintf(s, "/%s", name);
+#endif
+    return s;
+}
+
+// Returns 1 to indicate success and 0 for error
+static int mapPage(MetricsPage* m, int create) {
+#ifdef _WIN32
+    HANDLE h = create
+        ? CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(MetricsSnapshot), m->name)
+        : OpenFileMappingA(FILE_MAP_READ, FALSE, m->name);
+    if (!h) return 0; // error
+    m->snapshot = (MetricsSnapshot*)MapViewOfFile(h, create ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ,
+                                                  0, 0, sizeof(MetricsSnapshot));
+    if (!m->snapshot) {
+        CloseHandle(h);
+        return 0; // error
+    }
+    m->handle = h;
+#else
+    void* p;
+    int fd = create
+        ? shm_open(m->name, O_CREAT | O_RDWR, 0644)
+        : shm_open(m->name, O_RDONLY, 0);
+    if (fd < 0) return 0; // error
+    if (create && ftruncate(fd, sizeof(MetricsSnapshot))) {
+        close(fd);
+        shm_unlink(m->name);
+        return 0; // error
+    }
+    p = mmap(NULL, sizeof(MetricsSnapshot), create ? PROT_READ | PROT_WRITE : PROT_READ,
+             MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        if (create) shm_unlink(m->name);
+        return 0; // error
+    }
+    m->snapshot = (MetricsSnapshot*)p;
+#endif
+    return 1; // success
+}
+
+// Returns NULL to indicate failure
+static MetricsPage* newMetricsPage(const char* name, int create) {
+    MetricsPage* m = (MetricsPage*)calloc(1, sizeof(MetricsPage));
+    if (!m) return NULL;
+    m->owner = create;
+    m->name = pageName(name);
+    if (!m->name || !mapPage(m, create)) {
+        logThis(ERROR_ERROR, "Cannot %s metrics page '%s'", create ? "create" : "open", name);
+        free(m->name);
+        free(m);
+        return NULL;
+    }
+    return m;
+}
+
+MetricsPage* createMetricsPage(const char* name, int nHomes) {
+    MetricsPage* m = newMetricsPage(name, 1);
+    if (!m) return NULL;
+    memset(&m->next, 0, sizeof(MetricsSnapshot));
+    m->next.nHomes = nHomes;
+    m->next.timestep = -1;
+    m->next.rssMaxHome = -1;
+    m->rateStep = -1;
+    memset(m->snapshot, 0, sizeof(MetricsSnapshot));
+    m->snapshot->version = METRICS_VERSION;
+    m->snapshot->nHomes = nHomes;
+    writeBody(m->snapshot, &m->next);
+    // monitors check the magic number last
+    fenceRelease();
+    m->snapshot->magic = METRICS_MAGIC;
+    return m;
+}
+
+MetricsPage* openMetricsPage(const char* name) {
+    return newMetricsPage(name, 0);
+}
+
+void closeMetricsPage(MetricsPage* m) {
+    if (!m) return;
+#ifdef _WIN32
+    UnmapViewOfFile(m->snapshot);
+    CloseHandle((HANDLE)m->handle);
+#else
+    munmap(m->snapshot, sizeof(MetricsSnapshot));
+    if (m->owner) shm_unlink(m->name);
+#endif
+    free(m->name);
+    free(m);
+}
+
+// Returns the k-th smallest of the n values in x, reordering x
+static double selectKth(double* x, int n, int k) {
+    int left = 0, right = n - 1;
+    while (left < right) {
+        double pivot = x[(left + right) / 2];
+        int i = left, j = right;
+        while (i <= j) {
+            while (x[i] < pivot) i++;
+            while (x[j] > pivot) j--;
+            if (i <= j) {
+                double t = x[i];
+                x[i++] = x[j];
+                x[j--] = t;
+            }
+        }
+        if (k <= j) right = j;
+        else if (k >= i) left = i;
+        else break;
+    }
+    return x[k];
+}
+
+// Keep the METRICS_MAX_LAGGING slowest homes, slowest first
+static void addLagging(MetricsSnapshot* s, int home, double seconds) {
+    int i;
+    if (s->nLagging == METRICS_MAX_LAGGING) {
+        if (seconds <= s->laggingSeconds[METRICS_MAX_LAGGING-1]) return;
+        i = METRICS_MAX_LAGGING - 1;
+    } else {
+        i = s->nLagging++;
+    }
+    for (; i>0 && s->laggingSeconds[i-1] < seconds; i--) {
+        s->lagging[i] = s->lagging[i-1];
+        s->laggingSeconds[i] = s->laggingSeconds[i-1];
+    }
+    s->lagging[i] = home;
+    s->laggingSeconds[i] = seconds;
+}
+
+void publishMetrics(MetricsPage* m, long long timestep, double time, double stepSeconds,
+                    const double* netEnergy, const HomeUsage* usage) {
+    MetricsSnapshot* s = &m->next;
+    volatile MetricsSnapshot* page = m->snapshot;
+    double now = wallClock();
+    unsigned sequence;
+    int i, n;
+
+    s->timestep = timestep;
+    s->time = time;
+    s->lastStepLatency = stepSeconds;
+
+    // p99 of the latencies of the last METRICS_WINDOW steps,
+    // updated every METRICS_P99_EVERY steps to keep publishing cheap
+    m->latencies[m->nLatencies++ % METRICS_WINDOW] = stepSeconds;
+    if (m->nLatencies % METRICS_P99_EVERY == 1) {
+        n = m->nLatencies < METRICS_WINDOW ? m->nLatencies : METRICS_WINDOW;
+        memcpy(m->scratch, m->latencies, n * sizeof(double));
+        s->p99StepLatency = selectKth(m->scratch, n, (99 * n + 99) / 100 - 1);
+    }
+
+    // steps per second, updated once per second
+    if (m->rateStep < 0) {
+        m->rateStart = now;
+        m->rateStep = timestep;
+    } else if (now - m->rateStart >= 1) {
+        s->stepsPerSecond = (timestep - m->rateStep) / (now - m->rateStart);
+        m->rateStart = now;
+        m->rateStep = timestep;
+    }
+
+    if (netEnergy && s->nHomes > 0) {
+        s->netEnergySum = exactSumOf(netEnergy, s->nHomes);
+        s->netEnergyMin = s->netEnergyMax = netEnergy[0];
+        for (i=0; i<s->nHomes; i++) {
+            if (netEnergy[i] < s->netEnergyMin) s->netEnergyMin = netEnergy[i];
+            if (netEnergy[i] > s->netEnergyMax) s->netEnergyMax = netEnergy[i];
+        }
+    }
+    if (usage) {
+        s->nLagging = 0;
+        s->nMeasured = 0;
+        s->rssMaxHome = -1;
+        s->rssMax = s->rssSum = 0;
+        s->stepPageFaults = s->stepMajorFaults = 0;
+        for (i=0; i<s->nHomes; i++) {
+            const HomeUsage* u = &usage[i];
+            if (u->stepCpuSeconds < 0) continue;
+            addLagging(s, i, u->stepCpuSeconds);
+            s->nMeasured++;
+            s->rssSum += u->rss;
+            if (s->rssMaxHome < 0 || u->rss > s->rssMax) {
+                s->rssMax = u->rss;
+                s->rssMaxHome = i;
+            }
+            s->stepPageFaults += u->stepPageFaults;
+            s->stepMajorFaults += u->stepMajorFaults;
+        }
+    }
+
+    // the sequence is odd while the page is written
+    sequence = page->sequence;
+    page->sequence = sequence + 1;
+    fenceRelease();
+    writeBody(page, s);
+    fenceRelease();
+    page->sequence = sequence + 2;
+}
+
+int readMetrics(MetricsPage* m, MetricsSnapshot* snapshot) {
+    volatile MetricsSnapshot* page = m->snapshot;
+    int tries;
+    if (page->magic != METRICS_MAGIC || page->version != METRICS_VERSION) return 0; // error
+    fenceAcquire();
+    for (tries=0; tries<10000; tries++) {
+        unsigned before = page->sequence;
+        fenceAcquire();
+        if (before & 1) continue;
+        readBody(snapshot, page);
+        fenceAcquire();
+        if (page->sequence == before) {
+            snapshot->magic = page->magic;
+            snapshot->version = page->version;
+            snapshot->sequence = before;
+            snapshot->nHomes = page->nHomes;
+            return 1; // success
+        }
+    }
+    return 0; // error
+}
+
+// #define TEST
+#ifdef TEST
+// Monitor: metricsPage <name>
+// Demo publisher: metricsPage -publish <name>
+int main(int argc, char** argv) {
+    MetricsSnapshot s;
+    MetricsPage* m;
+    int i;
+    if (argc == 3 && !strcmp(argv[1], "-publish")) {
+        double netEnergy[100];
+        HomeUsage usage[100];
+        long long k;
+        m = createMetricsPage(argv[2], 100);
+        if (!m) return 1;
+        memset(usage, 0, sizeof(usage));
+        for (k=0; k<50000000; k++) {
+            for (i=0; i<100; i++) {
+                netEnergy[i] = (k + i) % 17 - 8;
+                usage[i].stepCpuSeconds = 1e-3 * ((k * 31 + i * 7) % 101);
+                usage[i].rss = (200 + (k + i) % 50) << 20;
+                usage[i].stepPageFaults = (k * 7 + i) % 13;
+                usage[i].stepMajorFaults = usage[i].stepPageFaults / 10;
+            }
+            publishMetrics(m, k, 60.0 * k, 1e-6 * (k % 1000), netEnergy, usage);
+        }
+        closeMetricsPage(m);
+        return 0;
+    }
+    if (argc != 2) {
+        printf("usage: metricsPage [-publish] <name>\n");
+        return 1;
+    }
+    m = openMetricsPage(argv[1]);
+    if (!m) return 1;
+    memset(&s, 0, sizeof(s));
+    for (;;) {
+        if (!readMetrics(m, &s)) {
+            printf("no snapshot\n");
+        } else {
+            printf("step %lld t=%.0f s, %.0f steps/s, p99 %.3f ms, net energy %.3f [%.3f, %.3f], slowest home %d (%.3f ms)\n",
+                   s.timestep, s.time, s.stepsPerSecond, 1000 * s.p99StepLatency, s.netEnergySum,
+                   s.netEnergyMin, s.netEnergyMax, s.nLagging ? s.lagging[0] : -1,
+                   s.nLagging ? 1000 * s.laggingSeconds[0] : 0.0);
+            printf("  %d homes measured, rss %.1f MB, largest home %d (%.1f MB), %lld page faults, %lld major\n",
+                   s.nMeasured, s.rssSum / 1048576.0, s.rssMaxHome, s.rssMax / 1048576.0,
+                   s.stepPageFaults, s.stepMajorFaults);
+        }
+        fflush(stdout);
+#ifdef _WIN32
+        Sleep(1000);
+#else
+        sleep(1);
+#endif
+    }
+    closeMetricsPage(m);
+    return 0;
+}
+#endif // TEST
@@ -0,0 +1,93 @@
+/* -------------------------------------------------------------------------
+ * metricsPage.h
+ * Live metrics of a running simulation in a page of shared memory. The
+ * simulation thread publishes a snapshot after each timestep, protected
+ * by a sequence lock: no lock is taken and no system call is made to
+ * publish. Monitors in other processes map the page read-only and retry
+ * a read until they get a consistent snapshot.
+ * The page is a POSIX shared memory object "/<name>", or a named file
+ * mapping "Local\<name>" on Windows. On older glibc, link with -lrt.
+ * -------------------------------------------------------------------------*/
+
+#ifndef METRICS_PAGE_H
+#define METRICS_PAGE_H
+
+#include "homeGroups.h" // HomeUsage
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define METRICS_MAGIC 0x5254454d     // "METR"
+#define METRICS_VERSION 2
+#define METRICS_MAX_LAGGING 8        // slowest homes reported per step
+#define METRICS_WINDOW 1024          // steps used for the latency percentile
+
+// Layout of the page. Only fixed-size members, so that monitors compiled
+// separately can read it. Members are 8-byte aligned.
+typedef struct {
+    unsigned magic;                  // METRICS_MAGIC
+    unsigned version;                // METRICS_VERSION
+    volatile unsigned sequence;      // odd while a snapshot is written
+    int nHomes;
+    long long timestep;              // last completed timestep
+    double time;                     // simulation time at the end of that step
+    double stepsPerSecond;           // mean over the last second of wall clock time
+    double p99StepLatency;           // seconds, over the last METRICS_WINDOW steps
+    double lastStepLatency;          // seconds
+    double netEnergySum;             // feeder aggregates of epSendNetEnergy, the sum exact, see exactSum.h
+    double netEnergyMin;
+    double netEnergyMax;
+    int nLagging;                    // entries used in lagging
+    int padding;
+    int lagging[METRICS_MAX_LAGGING];            // slowest homes of the last step
+    double laggingSeconds[METRICS_MAX_LAGGING];  // and their step times
+    int nMeasured;                   // homes with a usage sample in the last step
+    int rssMaxHome;                  // home with the most resident memory, -1 for none
+    long long rssMax;                // its resident memory, bytes
+    long long rssSum;                // resident memory of the measured homes, bytes
+    long long stepPageFaults;        // page faults of the measured homes in the last step
+    long long stepMajorFaults;       // of them page faults that needed I/O
+} MetricsSnapshot;
+
+typedef struct {
+    MetricsSnapshot* snapshot;       // the shared page
+    int owner;                       // 1 for the publisher
+    char* name;
+    void* handle;                    // file mapping on Windows
+    // publisher state, private to the simulation thread
+    MetricsSnapshot next;            // snapshot being built
+    double latencies[METRICS_WINDOW];
+    double scratch[METRICS_WINDOW];
+    int nLatencies;
+    double rateStart;                // wall clock time and step at the start
+    long long rateStep;              // of the current steps/s interval
+} MetricsPage;
+
+// Create and map the page for publishing. Returns NULL to indicate failure.
+MetricsPage* createMetricsPage(const char* name, int nHomes);
+
+// Map an existing page read-only, for monitors.
+// Returns NULL to indicate failure.
+MetricsPage* openMetricsPage(const char* name);
+
+// Unmap the page. The publisher also removes it.
+void closeMetricsPage(MetricsPage* m);
+
+// Publish the metrics of a completed timestep. netEnergy holds
+// epSendNetEnergy of each home, and usage the step CPU time, resident
+// memory and page faults of each home, e.g. from sampleHomeGroups, with
+// stepCpuSeconds negative if the home was not measured. Either may be
+// NULL. Does not allocate memory and makes no system call, apart from
+// the clock, which is a vDSO call on Linux.
+void publishMetrics(MetricsPage* m, long long timestep, double time, double stepSeconds,
+                    const double* netEnergy, const HomeUsage* usage);
+
+// Copy a consistent snapshot. Returns 1 to indicate success and 0 if
+// the page is not a metrics page or the publisher is writing too often.
+int readMetrics(MetricsPage* m, MetricsSnapshot* snapshot);
+
+#ifdef __cplusplus
+} // closing brace for extern "C"
+#endif
+#endif // METRICS_PAGE_H
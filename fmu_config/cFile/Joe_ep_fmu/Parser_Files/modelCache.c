@@ -0,0 +1,166 @@
+/* -------------------------------------------------------------------------
+ * modelCache.c
+ * Parsed model descriptions kept resident, keyed by path and file stamp.
+ * -------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "modelCache.h"
+
+ModelCache* newModelCache(int nBuckets) {
+    ModelCache* c = (ModelCache*)calloc(1, sizeof(ModelCache));
+    if (!c) return NULL;
+    c->nBuckets = nBuckets > 0 ? nBuckets : 1024;
+    c->buckets = (ModelCacheEntry**)calloc(c->nBuckets, sizeof(ModelCacheEntry*));
+    if (!c->buckets) {
+        free(c);
+        return NULL;
+    }
+    mutexInit(&c->lock);
+    return c;
+}
+
+static void freeEntry(ModelCacheEntry* e) {
+    free(e->xmlPath);
+    free(e->fmiVersion);
+    if (e->md) freeElement(e->md);
+    free(e);
+}
+
+void freeModelCache(ModelCache* c) {
+    int i;
+    if (!c) return;
+    for (i=0; i<c->nBuckets; i++) {
+        ModelCacheEntry* e = c->buckets[i];
+        while (e) {
+            ModelCacheEntry* next = e->next;
+            freeEntry(e);
+            e = next;
+        }
+    }
+    mutexDestroy(&c->lock);
+    free(c->buckets);
+    free(c);
+}
+
+int modelFileStamp(const char* path, long long* size, long long* mtime) {
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA a;
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &a)) return 0; // error
+    *size = ((long long)a.nFileSizeHigh << 32) | a.nFileSizeLow;
+    // 100 ns units since 1601, only compared for equality
+    *mtime = ((long long)a.ftLastWriteTime.dwHighDateTime << 32) | a.ftLastWriteTime.dwLowDateTime;
+#else
+    struct stat st;
+    if (stat(path, &st)) return 0; // error
+    *size = st.st_size;
+    *mtime = (long long)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+    return 1; // success
+}
+
+static unsigned int hashPath(const char* s) {
+    unsigned int h = 2166136261u;
+    while (*s) h = (h ^ (unsigned char)*s++) * 16777619u;
+    return h;
+}
+
+// Returns the entry of path that is not stale, or NULL
+static ModelCacheEntry* findEntry(ModelCache* c, const char* path) {
+    ModelCacheEntry* e = c->buckets[hashPath(path) % c->nBuckets];
+    for (; e; e = e->next)
+        if (!e->stale && !strcmp(e->xmlPath, path)) return e;
+    return NULL;
+}
+
+// Free the stale entries of the bucket of path that nobody uses.
+// Call with the lock held.
+static void removeStale(ModelCache* c, const char* path) {
+    ModelCacheEntry** link = &c->buckets[hashPath(path) % c->nBuckets];
+    while (*link) {
+        ModelCacheEntry* e = *link;
+        if (e->stale && !e->users) {
+            *link = e->next;
+            freeEntry(e);
+        } else {
+            link = &e->next;
+        }
+    }
+}
+
+ModelDescription* lookupModel(ModelCache* c, const char* xmlPath, const char** fmiVersion) {
+    ModelCacheEntry* e;
+    ModelDescription* md = NULL;
+    long long size, mtime;
+    int stamped = modelFileStamp(xmlPath, &size, &mtime);
+    mutexLock(&c->lock);
+    e = findEntry(c, xmlPath);
+    if (e && stamped && e->size == size && e->mtime == mtime) {
+        md = e->md;
+        if (fmiVersion) *fmiVersion = e->fmiVersion;
+        e->users++;
+        c->nHits++;
+    } else {
+        if (e) {
+            e->stale = 1;
+            c->nEntries--;
+            removeStale(c, xmlPath);
+        }
+        c->nMisses++;
+    }
+    mutexUnlock(&c->lock);
+    return md;
+}
+
+int insertModel(ModelCache* c, const char* xmlPath, char* fmiVersion, ModelDescription* md,
+                long long size, long long mtime) {
+    ModelCacheEntry* e;
+    ModelCacheEntry* old;
+    long long nowSize, nowMtime;
+    if (!modelFileStamp(xmlPath, &nowSize, &nowMtime)) return 0; // error
+    e = (ModelCacheEntry*)calloc(1, sizeof(ModelCacheEntry));
+    if (!e) return 0; // error
+    e->xmlPath = strdup(xmlPath);
+    if (!e->xmlPath) {
+        free(e);
+        return 0; // error
+    }
+    e->size = size;
+    e->mtime = mtime;
+    e->fmiVersion = fmiVersion;
+    e->md = md;
+    e->stale = nowSize != size || nowMtime != mtime;
+    e->users = 1;
+    mutexLock(&c->lock);
+    old = findEntry(c, xmlPath);
+    if (old && !e->stale) {
+        old->stale = 1;
+        c->nEntries--;
+    }
+    if (!e->stale) c->nEntries++;
+    removeStale(c, xmlPath);
+    e->next = c->buckets[hashPath(xmlPath) % c->nBuckets];
+    c->buckets[hashPath(xmlPath) % c->nBuckets] = e;
+    mutexUnlock(&c->lock);
+    return 1; // success
+}
+
+void releaseModel(ModelCache* c, const char* xmlPath, ModelDescription* md) {
+    ModelCacheEntry* e;
+    mutexLock(&c->lock);
+    for (e = c->buckets[hashPath(xmlPath) % c->nBuckets]; e; e = e->next) {
+        if (e->md == md && e->users > 0) {
+            e->users--;
+            if (e->stale && !e->users) removeStale(c, xmlPath);
+            break;
+        }
+    }
+    mutexUnlock(&c->lock);
+}
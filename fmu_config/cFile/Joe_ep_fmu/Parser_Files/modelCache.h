@@ -0,0 +1,74 @@
+/* -------------------------------------------------------------------------
+ * modelCache.h
+ * Keeps parsed model descriptions resident between runs of a long-running
+ * host process. An entry is keyed by the path of modelDescription.xml and
+ * is valid while the size and modification time of the file are unchanged,
+ * so a second run of the same fleet skips reading and parsing entirely.
+ * Each user of an entry holds a reference until releaseModel. Entries of
+ * changed files are replaced, and freed once their last user released
+ * them, since a running experiment may still use them.
+ * All functions may be called from several threads.
+ * -------------------------------------------------------------------------*/
+
+#ifndef modelCache_h
+#define modelCache_h
+
+#include "xml_parser.h"
+#include "thread_support.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ModelCacheEntry {
+    char* xmlPath;
+    long long size;            // of the file when it was parsed
+    long long mtime;           // modification time, ns (100 ns on Windows)
+    char* fmiVersion;
+    ModelDescription* md;
+    int stale;                 // 1 if the file changed after parsing
+    int users;                 // references not yet released
+    struct ModelCacheEntry* next;
+} ModelCacheEntry;
+
+typedef struct {
+    ModelCacheEntry** buckets;
+    int nBuckets;
+    int nEntries;              // entries that are not stale
+    long nHits;
+    long nMisses;
+    Mutex lock;
+} ModelCache;
+
+// Returns NULL if no memory is available
+ModelCache* newModelCache(int nBuckets);
+
+// Frees all entries, including their model descriptions
+void freeModelCache(ModelCache* c);
+
+// Returns the model description of xmlPath, and its fmi version in
+// fmiVersion if not NULL, or NULL if xmlPath is not cached or changed
+// since it was parsed. The cache owns the result; the caller holds a
+// reference and must release it with releaseModel.
+ModelDescription* lookupModel(ModelCache* c, const char* xmlPath, const char** fmiVersion);
+
+// Take ownership of md and fmiVersion, parsed from xmlPath, and mark an
+// older entry of xmlPath stale. If xmlPath changed while it was parsed,
+// the entry is stale at once. On success, the caller holds a reference as
+// after lookupModel. Returns 0 if xmlPath cannot be stat'ed or no memory
+// is available; the caller then still owns md and fmiVersion.
+int insertModel(ModelCache* c, const char* xmlPath, char* fmiVersion, ModelDescription* md,
+                long long size, long long mtime);
+
+// Release a reference to md of xmlPath, from lookupModel or insertModel.
+// A stale entry is freed with its last reference.
+void releaseModel(ModelCache* c, const char* xmlPath, ModelDescription* md);
+
+// Size and modification time of a file, as used for the key.
+// Returns 1 to indicate success and 0 for error.
+int modelFileStamp(const char* path, long long* size, long long* mtime);
+
+#ifdef __cplusplus
+} // closing brace for extern "C"
+#endif
+#endif // modelCache_h
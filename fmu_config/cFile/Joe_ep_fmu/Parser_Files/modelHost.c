@@ -0,0 +1,325 @@
+/* -------------------------------------------------------------------------
+ * modelHost.c
+ * Resident host of parsed model descriptions, with run submissions over
+ * a Unix domain socket.
+ * -------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef STANDALONE_XML_PARSER
+#define logThis(n, ...) printf(__VA_ARGS__);printf("\n")
+#else
+#include "GlobalIncludes.h"
+#include "logging.h" // logThis
+#endif // STANDALONE_XML_PARSER
+
+#include "modelHost.h"
+#include "thread_support.h" // wallClock
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#endif
+
+#define LINE_SIZE 4096
+
+// A client that goes away must not raise SIGPIPE, which ends the host
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SEND_FLAGS 0
+#endif
+
+#ifdef _WIN32
+
+ModelHost* openModelHost(const char* socketPath, int nWorkers) {
+    (void)nWorkers;
+    logThis(ERROR_ERROR, "Unix domain sockets are not supported, cannot open '%s'", socketPath);
+    return NULL;
+}
+
+int serveModelHost(ModelHost* h) {
+    (void)h;
+    return 0; // error
+}
+
+void closeModelHost(ModelHost* h) {
+    (void)h;
+}
+
+int submitToModelHost(const char* socketPath, const char* request, char* reply, int replySize) {
+    (void)socketPath;
+    (void)request;
+    (void)reply;
+    (void)replySize;
+    return 0; // error
+}
+
+#else
+
+// Returns 0 to indicate error, e.g. a path too long for sun_path
+static int socketAddress(const char* path, struct sockaddr_un* address) {
+    memset(address, 0, sizeof(struct sockaddr_un));
+    address->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address->sun_path)) return 0; // error
+    strcpy(address->sun_path, path);
+    return 1; // success
+}
+
+// Read one line, without the newline. Returns 0 if the connection
+// closed before a newline, or the line does not fit.
+static int readLine(int s, char* line, int size) {
+    int n = 0;
+    while (n < size - 1) {
+        char c;
+        if (recv(s, &c, 1, 0) != 1) return 0; // error
+        if (c == '\n') {
+            if (n > 0 && line[n-1] == '\r') n--;
+            line[n] = '\0';
+            return 1; // success
+        }
+        line[n++] = c;
+    }
+    return 0; // error
+}
+
+// Returns 0 to indicate error
+static int writeLine(int s, const char* line) {
+    int size = (int)strlen(line);
+    while (size > 0) {
+        int n = (int)send(s, line, size, SEND_FLAGS);
+        if (n <= 0) return 0; // error
+        line += n;
+        size -= n;
+    }
+    return send(s, "\n", 1, SEND_FLAGS) == 1;
+}
+
+// Prepare an accepted connection: recv fails after MODEL_HOST_TIMEOUT
+// seconds without data, so that a silent client cannot block the host,
+// and send does not raise SIGPIPE where MSG_NOSIGNAL is missing
+static void prepareConnection(int s) {
+    struct timeval tv;
+    tv.tv_sec = MODEL_HOST_TIMEOUT;
+    tv.tv_usec = 0;
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof(tv));
+#ifdef SO_NOSIGPIPE
+    {
+        int on = 1;
+        setsockopt(s, SOL_SOCKET, SO_NOSIGPIPE, (const char*)&on, sizeof(on));
+    }
+#endif
+}
+
+static void freeFleet(char** paths, int n) {
+    int i;
+    if (!paths) return;
+    for (i=0; i<n; i++) free(paths[i]);
+    free(paths);
+}
+
+// The paths listed in a fleet file, one per line, empty lines skipped.
+// Returns NULL to indicate failure.
+static char** readFleet(const char* path, int* n) {
+    char line[LINE_SIZE];
+    char** paths = NULL;
+    int size = 0;
+    FILE* file = fopen(path, "rb");
+    *n = 0;
+    if (!file) return NULL;
+    while (fgets(line, sizeof(line), file)) {
+        int length = (int)strcspn(line, "\r\n");
+        line[length] = '\0';
+        if (!length) continue;
+        if (*n == size) {
+            char** more = (char**)realloc(paths, (size ? 2 * size : 256) * sizeof(char*));
+            if (!more) break;
+            paths = more;
+            size = size ? 2 * size : 256;
+        }
+        paths[*n] = strdup(line);
+        if (!paths[*n]) break;
+        (*n)++;
+    }
+    if (!feof(file) || !paths) {
+        fclose(file);
+        freeFleet(paths, *n);
+        return NULL;
+    }
+    fclose(file);
+    return paths;
+}
+
+// Load the fleet listed in path and write the answer into reply
+static void runFleet(ModelHost* h, const char* path, char* reply, int size) {
+    ModelLoad* loads;
+    char** paths;
+    double start = wallClock();
+    int n, i, loaded;
+    paths = readFleet(path, &n);
+    if (!paths) {
+        snprintf(reply, size, "error cannot read fleet file '%.1024s'", path);
+        return;
+    }
+    loads = (ModelLoad*)calloc(n, sizeof(ModelLoad));
+    if (!loads) {
+        freeFleet(paths, n);
+        snprintf(reply, size, "error no memory for %d homes", n);
+        return;
+    }
+    for (i=0; i<n; i++) loads[i].xmlPath = paths[i];
+    loaded = loadModelDescriptions(&h->loader, loads, n);
+    h->lastRunSeconds = wallClock() - start;
+    h->nRuns++;
+    if (loaded < 0) {
+        snprintf(reply, size, "error cannot load fleet '%.1024s'", path);
+    } else {
+        snprintf(reply, size, "ok %d %d %.3f", loaded, h->loader.nCached, 1000 * h->lastRunSeconds);
+    }
+    // the cache keeps what it holds for the next run
+    releaseModelLoads(&h->loader, loads, n);
+    free(loads);
+    freeFleet(paths, n);
+}
+
+ModelHost* openModelHost(const char* socketPath, int nWorkers) {
+    struct sockaddr_un address;
+    ModelHost* h;
+    int probe, running;
+    if (!socketAddress(socketPath, &address)) {
+        logThis(ERROR_ERROR, "Socket path '%s' is too long", socketPath);
+        return NULL;
+    }
+    h = (ModelHost*)calloc(1, sizeof(ModelHost));
+    if (!h) return NULL;
+    initModelLoader(&h->loader, nWorkers);
+    h->loader.cache = newModelCache(0);
+    h->socketPath = strdup(socketPath);
+    h->listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (!h->loader.cache || !h->socketPath || h->listener < 0) {
+        if (h->listener >= 0) close(h->listener);
+        h->listener = -1;
+        closeModelHost(h);
+        return NULL;
+    }
+    // replace the socket file of a host that did not close, not a running one
+    probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    running = probe >= 0 && !connect(probe, (struct sockaddr*)&address, sizeof(address));
+    if (probe >= 0) close(probe);
+    if (running) {
+        logThis(ERROR_ERROR, "A model host is running on '%s'", socketPath);
+        close(h->listener);
+        h->listener = -1;
+        closeModelHost(h);
+        return NULL;
+    }
+    unlink(socketPath);
+    if (bind(h->listener, (struct sockaddr*)&address, sizeof(address)) || listen(h->listener, 16)) {
+        logThis(ERROR_ERROR, "Cannot listen on '%s'", socketPath);
+        close(h->listener);
+        h->listener = -1;
+        closeModelHost(h);
+        return NULL;
+    }
+    logThis(ERROR_INFO, "Model host listening on '%s'", socketPath);
+    return h;
+}
+
+int serveModelHost(ModelHost* h) {
+    char line[LINE_SIZE];
+    char reply[LINE_SIZE];
+    for (;;) {
+        int s = accept(h->listener, NULL, NULL);
+        if (s < 0) {
+            logThis(ERROR_ERROR, "Model host cannot accept on '%s'", h->socketPath);
+            return 0; // error
+        }
+        prepareConnection(s);
+        if (!readLine(s, line, sizeof(line))) {
+            close(s);
+            continue;
+        }
+        if (!strcmp(line, "quit")) {
+            writeLine(s, "ok");
+            close(s);
+            return 1; // success
+        }
+        if (!strncmp(line, "run ", 4)) {
+            runFleet(h, line + 4, reply, sizeof(reply));
+        } else {
+            snprintf(reply, sizeof(reply), "error unknown request");
+        }
+        writeLine(s, reply);
+        close(s);
+    }
+}
+
+void closeModelHost(ModelHost* h) {
+    if (!h) return;
+    if (h->listener >= 0) {
+        close(h->listener);
+        unlink(h->socketPath);
+    }
+    freeModelCache(h->loader.cache);
+    free(h->socketPath);
+    free(h);
+}
+
+int submitToModelHost(const char* socketPath, const char* request, char* reply, int replySize) {
+    struct sockaddr_un address;
+    int s, ok;
+    if (!socketAddress(socketPath, &address)) return 0; // error
+    s = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (s < 0) return 0; // error
+    ok = !connect(s, (struct sockaddr*)&address, sizeof(address))
+      && writeLine(s, request)
+      && readLine(s, reply, replySize);
+    close(s);
+    return ok;
+}
+
+#endif // _WIN32
+
+// #define TEST
+#ifdef TEST
+#ifndef _WIN32
+
+static void serve(void* arg) {
+    serveModelHost((ModelHost*)arg);
+}
+
+// modelHost <socket> <fleet file> [<runs>]: submit the same fleet a few
+// times to a host in this process and report the time of each run, as
+// seen by the client, including the socket round trip
+int main(int argc, char** argv) {
+    char request[LINE_SIZE];
+    char reply[LINE_SIZE];
+    int runs = argc > 3 ? atoi(argv[3]) : 3;
+    int r, ok = 1;
+    ModelHost* h;
+    Thread thread;
+    if (argc < 3) {
+        printf("usage: modelHost <socket> <fleet file> [<runs>]\n");
+        return 1;
+    }
+    h = openModelHost(argv[1], 4);
+    if (!h) return 1;
+    threadCreate(&thread, serve, h);
+    snprintf(request, sizeof(request), "run %s", argv[2]);
+    for (r=0; ok && r<runs; r++) {
+        double start = wallClock();
+        ok = submitToModelHost(argv[1], request, reply, sizeof(reply));
+        printf("run %d: '%s' after %.3f ms\n", r + 1, ok ? reply : "no answer", 1000 * (wallClock() - start));
+        ok = ok && !strncmp(reply, "ok", 2);
+    }
+    submitToModelHost(argv[1], "quit", reply, sizeof(reply));
+    threadJoin(thread);
+    closeModelHost(h);
+    return !ok;
+}
+#endif // _WIN32
+#endif // TEST
@@ -0,0 +1,60 @@
+/* -------------------------------------------------------------------------
+ * modelHost.h
+ * A long-running host process that keeps the parsed model descriptions
+ * of the fleets resident between runs, see modelCache.h, and accepts run
+ * submissions over a Unix domain socket. Each connection sends one line
+ *     run <fleet file>
+ * where the fleet file lists the path of modelDescription.xml of each
+ * home, one per line. The host loads them, through its cache, and
+ * answers one line
+ *     ok <homes loaded> <homes from the cache> <ms>
+ * or "error <message>". The line "quit" stops the host.
+ * The second and later runs of the same fleet skip reading and parsing.
+ * The FMU archives must be extracted before; the processes and sockets
+ * of the homes are still started by each run.
+ * A client that sends no line within MODEL_HOST_TIMEOUT seconds is
+ * dropped, as is the reply to a client that closed its connection.
+ * Not available on Windows.
+ * -------------------------------------------------------------------------*/
+
+#ifndef modelHost_h
+#define modelHost_h
+
+#include "modelLoader.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Seconds the host waits for the request line of a connection
+#define MODEL_HOST_TIMEOUT 10
+
+typedef struct {
+    char* socketPath;
+    int listener;
+    ModelLoader loader;        // with the cache, resident between runs
+    int nRuns;
+    double lastRunSeconds;     // load time of the last run
+} ModelHost;
+
+// Listen on a Unix domain socket at socketPath, replacing a stale socket
+// file. nWorkers threads per stage load the model descriptions.
+// Returns NULL to indicate failure.
+ModelHost* openModelHost(const char* socketPath, int nWorkers);
+
+// Serve submissions, one at a time, until a client sends quit.
+// Returns 1 after quit and 0 for error.
+int serveModelHost(ModelHost* h);
+
+// Close the socket, remove its file and free the cache
+void closeModelHost(ModelHost* h);
+
+// Client side: send the line request, e.g. "run fleet.txt", to the host
+// at socketPath and store its answer, without the newline, in reply.
+// Returns 1 to indicate success and 0 for error.
+int submitToModelHost(const char* socketPath, const char* request, char* reply, int replySize);
+
+#ifdef __cplusplus
+} // closing brace for extern "C"
+#endif
+#endif // modelHost_h
@@ -0,0 +1,207 @@
+/* -------------------------------------------------------------------------
+ * modelLoader.c
+ * Loads the model descriptions of many FMUs as a pipeline of stages.
+ * -------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef STANDALONE_XML_PARSER
+#define logThis(n, ...) printf(__VA_ARGS__);printf("\n")
+#else
+#include "GlobalIncludes.h"
+#include "logging.h" // logThis
+#endif // STANDALONE_XML_PARSER
+
+#include "xmlVersionParser.h"
+#include "modelLoader.h"
+
+// The parser supports FMI 1.0 only
+static int runVersionStage(void* item, void* arg) {
+    ModelLoad* load = (ModelLoad*)item;
+    (void)arg;
+    load->fmiVersion = load->xmlData
+        ? extractVersionFromBuffer(load->xmlPath, load->xmlData, load->xmlSize)
+        : extractVersion(load->xmlPath);
+    if (!load->fmiVersion) return 0; // error
+    if (strncmp(load->fmiVersion, "1.", 2)) {
+        logThis(ERROR_ERROR, "FMI version %s of '%s' is not supported",
+                load->fmiVersion, load->xmlPath);
+        return 0; // error
+    }
+    return 1; // success
+}
+
+static int runParseStage(void* item, void* arg) {
+    ModelLoad* load = (ModelLoad*)item;
+    (void)arg;
+    load->md = load->xmlData
+        ? parseBuffer(load->xmlPath, load->xmlData, load->xmlSize)
+        : parse(load->xmlPath);
+    return load->md != NULL;
+}
+
+// The batch read, as the source of the pipeline
+typedef struct {
+    ModelLoader* loader;
+    void** items;
+    FileRead* files;
+    int n;
+    void* feed;
+} BatchFeed;
+
+// Hand each home to the version stage as soon as its file is read. Homes
+// whose file could not be read in the batch read it in the stages.
+static void feedReadFile(int file, void* arg) {
+    BatchFeed* b = (BatchFeed*)arg;
+    ModelLoad* load = (ModelLoad*)b->items[file];
+    load->xmlData = b->files[file].data;
+    load->xmlSize = b->files[file].size;
+    pipelineFeed(b->feed, file);
+}
+
+static void readBatch(void* feed, void* arg) {
+    BatchFeed* b = (BatchFeed*)arg;
+    b->feed = feed;
+    b->loader->reader.fileDone = feedReadFile;
+    b->loader->reader.fileDoneArg = b;
+    readFileBatch(&b->loader->reader, b->files, b->n);
+    b->loader->reader.fileDone = NULL;
+    b->loader->reader.fileDoneArg = NULL;
+}
+
+void initModelLoader(ModelLoader* loader, int nWorkers) {
+    int s;
+    memset(loader, 0, sizeof(ModelLoader));
+    loader->nWorkers = nWorkers;
+    loader->queueSize = 4 * nWorkers;
+    loader->batchRead = 1;
+    initBatchReader(&loader->reader, read_uring, 64);
+    loader->stages[load_version].name = "version";
+    loader->stages[load_version].run = runVersionStage;
+    loader->stages[load_parse].name = "parse";
+    loader->stages[load_parse].run = runParseStage;
+    for (s=0; s<SIZEOF_LOAD_STAGE; s++)
+        loader->stages[s].arg = loader;
+}
+
+int loadModelDescriptions(ModelLoader* loader, ModelLoad* loads, int n) {
+    void** items;
+    FileRead* files = NULL;
+    BatchFeed batch;
+    long long* stamps = NULL;
+    int i, s, nItems = 0, result;
+    items = (void**)malloc((n > 0 ? n : 1) * sizeof(void*));
+    if (!items) return -1; // error
+    loader->nCached = 0;
+    for (i=0; i<n; i++) {
+        const char* version = NULL;
+        loads[i].xmlData = NULL;
+        loads[i].xmlSize = 0;
+        loads[i].fmiVersion = NULL;
+        loads[i].md = loader->cache ? lookupModel(loader->cache, loads[i].xmlPath, &version) : NULL;
+        loads[i].cached = loads[i].md != NULL;
+        if (loads[i].cached) {
+            loads[i].fmiVersion = (char*)version;
+            loader->nCached++;
+        } else {
+            items[nItems++] = &loads[i];
+        }
+    }
+    // stamp the files before they are read, so that a file changed
+    // while it is parsed does not enter the cache as valid
+    if (loader->cache && nItems > 0) {
+        stamps = (long long*)malloc(2 * nItems * sizeof(long long));
+        if (!stamps) {
+            free(items);
+            return -1; // error
+        }
+        for (i=0; i<nItems; i++) {
+            ModelLoad* load = (ModelLoad*)items[i];
+            if (!modelFileStamp(load->xmlPath, &stamps[2*i], &stamps[2*i+1]))
+                stamps[2*i] = -1;
+        }
+    }
+    if (loader->batchRead && nItems > 0) {
+        files = (FileRead*)calloc(nItems, sizeof(FileRead));
+        if (!files) {
+            free(items);
+            free(stamps);
+            return -1; // error
+        }
+        for (i=0; i<nItems; i++)
+            files[i].path = ((ModelLoad*)items[i])->xmlPath;
+    }
+    for (s=0; s<SIZEOF_LOAD_STAGE; s++)
+        loader->stages[s].nWorkers = loader->nWorkers;
+    if (files) {
+        // the stages parse the files read so far while the batch is read
+        batch.loader = loader;
+        batch.items = items;
+        batch.files = files;
+        batch.n = nItems;
+        result = runPipelineFed(loader->stages, SIZEOF_LOAD_STAGE, items, nItems, loader->queueSize,
+                                readBatch, &batch);
+    } else {
+        result = runPipeline(loader->stages, SIZEOF_LOAD_STAGE, items, nItems, loader->queueSize);
+    }
+    if (files) {
+        for (i=0; i<nItems; i++) {
+            ((ModelLoad*)items[i])->xmlData = NULL;
+            ((ModelLoad*)items[i])->xmlSize = 0;
+        }
+        freeFileBatch(files, nItems);
+        free(files);
+    }
+    if (stamps) {
+        for (i=0; i<nItems; i++) {
+            ModelLoad* load = (ModelLoad*)items[i];
+            if (load->md && stamps[2*i] >= 0
+                    && insertModel(loader->cache, load->xmlPath, load->fmiVersion, load->md,
+                                   stamps[2*i], stamps[2*i+1]))
+                load->cached = 1;
+        }
+        free(stamps);
+    }
+    free(items);
+    return result < 0 ? result : result + loader->nCached;
+}
+
+void releaseModelLoads(ModelLoader* loader, ModelLoad* loads, int n) {
+    int i;
+    for (i=0; i<n; i++) {
+        if (loads[i].cached) {
+            releaseModel(loader->cache, loads[i].xmlPath, loads[i].md);
+        } else {
+            if (loads[i].md) freeElement(loads[i].md);
+            free(loads[i].fmiVersion);
+        }
+        loads[i].md = NULL;
+        loads[i].fmiVersion = NULL;
+        loads[i].cached = 0;
+    }
+}
+
+void logLoaderStats(ModelLoader* loader) {
+    int s;
+    PipelineStage* last = &loader->stages[SIZEOF_LOAD_STAGE-1];
+    if (loader->batchRead) {
+        BatchReader* r = &loader->reader;
+        logThis(ERROR_INFO, "read %ld bytes with %s, %d failed, in %.3f s",
+                r->bytes, readBackendNames[r->used], r->nFailed, r->seconds);
+    }
+    if (loader->cache) {
+        logThis(ERROR_INFO, "%d model descriptions from the cache, %d entries",
+                loader->nCached, loader->cache->nEntries);
+    }
+    for (s=0; s<SIZEOF_LOAD_STAGE; s++) {
+        PipelineStage* st = &loader->stages[s];
+        int n = st->nDone + st->nFailed;
+        logThis(ERROR_INFO, "stage %-8s %5d done %3d failed, busy %.3f s, mean %.3f ms, max %.3f ms, finished after %.3f s",
+                st->name, st->nDone, st->nFailed, st->busyTime,
+                n ? 1000 * st->busyTime / n : 0.0, 1000 * st->maxTime, st->finishTime);
+    }
+    logThis(ERROR_INFO, "%d model descriptions ready after %.3f s",
+            last->nDone + loader->nCached, last->finishTime);
+}
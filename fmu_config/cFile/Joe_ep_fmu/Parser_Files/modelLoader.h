@@ -0,0 +1,67 @@
+/* -------------------------------------------------------------------------
+ * modelLoader.h
+ * Loads the model descriptions of many FMUs, e.g. one per home of a
+ * simulated neighbourhood. The stages of startup (extract fmi version,
+ * parse) run as a pipeline, so that the stages of different homes overlap.
+ * Optionally, all files are read in one batch, see batchRead.h, which
+ * hands each home to the stages as soon as its file is read, and parsed
+ * model descriptions are kept in a cache, see modelCache.h.
+ * -------------------------------------------------------------------------*/
+
+#ifndef modelLoader_h
+#define modelLoader_h
+
+#include "xml_parser.h"
+#include "pipeline.h"
+#include "batchRead.h"
+#include "modelCache.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Stages of loading one model description
+typedef enum {
+    load_version,      // extractVersion, check for FMI 1.0
+    load_parse,        // parse modelDescription.xml
+    SIZEOF_LOAD_STAGE
+} LoadStage;
+
+// One model description to load
+typedef struct {
+    const char* xmlPath;      // path of modelDescription.xml
+    const char* xmlData;      // NULL or contents of xmlPath, if read in a batch
+    long xmlSize;
+    char* fmiVersion;         // NULL or fmi version, the receiver must free it
+    ModelDescription* md;     // NULL or AST, the receiver must call freeElement(md)
+    int cached;               // 1 if the cache owns fmiVersion and md, see releaseModelLoads
+} ModelLoad;
+
+typedef struct {
+    int nWorkers;             // threads per stage
+    int queueSize;            // max number of homes waiting between two stages
+    int batchRead;            // 1 to read all files in one batch, while the stages run
+    BatchReader reader;       // backend and statistics of the batch read
+    ModelCache* cache;        // NULL or cache of parsed model descriptions, kept between loads
+    int nCached;              // homes of the last load found in the cache
+    PipelineStage stages[SIZEOF_LOAD_STAGE]; // statistics of the last load
+} ModelLoader;
+
+void initModelLoader(ModelLoader* loader, int nWorkers);
+
+// Loads all n model descriptions. On return, loads[i].md is NULL for
+// each home that failed in one of the stages.
+// Returns the number of model descriptions loaded, or -1 on error.
+int loadModelDescriptions(ModelLoader* loader, ModelLoad* loads, int n);
+
+// Free the model descriptions and fmi versions of all n loads, or release
+// them to the cache if it owns them
+void releaseModelLoads(ModelLoader* loader, ModelLoad* loads, int n);
+
+// Log per-stage timing of the last load
+void logLoaderStats(ModelLoader* loader);
+
+#ifdef __cplusplus
+} // closing brace for extern "C"
+#endif
+#endif // modelLoader_h
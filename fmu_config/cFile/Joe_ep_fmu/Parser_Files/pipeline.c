@@ -0,0 +1,224 @@
+/* -------------------------------------------------------------------------
+ * pipeline.c
+ * Runs a set of items through a sequence of stages connected by
+ * bounded queues.
+ * -------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "thread_support.h"
+#include "trace.h"
+#include "pipeline.h"
+
+// Bounded FIFO queue of item indices. The queue is closed when the last
+// worker of the stage that feeds it has finished.
+typedef struct {
+    int* slots;
+    int capacity;
+    int head;             // index of the next item to take
+    int count;            // number of items in the queue
+    int producers;        // workers that may still put items, 0 when closed
+    Mutex lock;
+    CondVar notEmpty;
+    CondVar notFull;
+} Queue;
+
+typedef struct {
+    PipelineStage* stages;
+    int nStages;
+    void** items;
+    Queue* queues;        // queues[s] holds the input of stage s
+    int aborted;          // 1 to make all workers stop early
+    double startTime;
+    Mutex statsLock;      // protects the statistics in stages
+} Pipeline;
+
+typedef struct {
+    Pipeline* p;
+    int stage;
+    int index;            // number of this worker within its stage
+} Worker;
+
+// Returns 0 to indicate error
+static int queueInit(Queue* q, int capacity, int producers) {
+    q->slots = (int*)malloc(capacity * sizeof(int));
+    if (!q->slots) return 0; // error
+    q->capacity = capacity;
+    q->head = 0;
+    q->count = 0;
+    q->producers = producers;
+    mutexInit(&q->lock);
+    condInit(&q->notEmpty);
+    condInit(&q->notFull);
+    return 1; // success
+}
+
+static void queueFree(Queue* q) {
+    free(q->slots);
+    mutexDestroy(&q->lock);
+    condDestroy(&q->notEmpty);
+    condDestroy(&q->notFull);
+}
+
+// Blocks while the queue is full
+static void queuePut(Pipeline* p, Queue* q, int item) {
+    mutexLock(&q->lock);
+    while (q->count == q->capacity && !p->aborted)
+        condWait(&q->notFull, &q->lock);
+    if (!p->aborted) {
+        q->slots[(q->head + q->count) % q->capacity] = item;
+        q->count++;
+        condSignal(&q->notEmpty);
+    }
+    mutexUnlock(&q->lock);
+}
+
+// Blocks while the queue is empty and not closed.
+// Returns -1 when the queue is closed and empty.
+static int queueTake(Pipeline* p, Queue* q) {
+    int item = -1;
+    mutexLock(&q->lock);
+    while (q->count == 0 && q->producers > 0 && !p->aborted)
+        condWait(&q->notEmpty, &q->lock);
+    if (q->count > 0 && !p->aborted) {
+        item = q->slots[q->head];
+        q->head = (q->head + 1) % q->capacity;
+        q->count--;
+        condSignal(&q->notFull);
+    }
+    mutexUnlock(&q->lock);
+    return item;
+}
+
+// Called by each worker of the feeding stage when it finishes
+static void queueRemoveProducer(Queue* q) {
+    mutexLock(&q->lock);
+    if (--q->producers == 0) condBroadcast(&q->notEmpty);
+    mutexUnlock(&q->lock);
+}
+
+static void abortPipeline(Pipeline* p) {
+    int s;
+    for (s=0; s<p->nStages; s++) {
+        Queue* q = &p->queues[s];
+        mutexLock(&q->lock);
+        p->aborted = 1;
+        condBroadcast(&q->notEmpty);
+        condBroadcast(&q->notFull);
+        mutexUnlock(&q->lock);
+    }
+}
+
+static void workerMain(void* arg) {
+    Worker* w = (Worker*)arg;
+    Pipeline* p = w->p;
+    PipelineStage* stage = &p->stages[w->stage];
+    Queue* in = &p->queues[w->stage];
+    Queue* out = w->stage+1 < p->nStages ? &p->queues[w->stage+1] : NULL;
+    int item;
+    if (traceSampled(0)) {
+        char name[64];
+        sprintf(name, "%.40s worker %d", stage->name, w->index);
+        traceThreadName(name);
+    }
+    while ((item = queueTake(p, in)) >= 0) {
+        double t0 = wallClock();
+        int ok = stage->run(p->items[item], stage->arg);
+        double t1 = wallClock();
+        if (traceSampled(item)) traceEvent(stage->name, item, t0, t1);
+        mutexLock(&p->statsLock);
+        if (ok) stage->nDone++; else stage->nFailed++;
+        stage->busyTime += t1 - t0;
+        if (t1 - t0 > stage->maxTime) stage->maxTime = t1 - t0;
+        stage->finishTime = t1 - p->startTime;
+        mutexUnlock(&p->statsLock);
+        if (ok && out) queuePut(p, out, item);
+    }
+    if (out) queueRemoveProducer(out);
+}
+
+int runPipeline(PipelineStage* stages, int nStages, void** items, int nItems, int queueSize) {
+    return runPipelineFed(stages, nStages, items, nItems, queueSize, NULL, NULL);
+}
+
+void pipelineFeed(void* feed, int item) {
+    Pipeline* p = (Pipeline*)feed;
+    // the input queue of the first stage has room for all items
+    queuePut(p, &p->queues[0], item);
+}
+
+int runPipelineFed(PipelineStage* stages, int nStages, void** items, int nItems, int queueSize,
+                   PipelineSource source, void* sourceArg) {
+    Pipeline p;
+    Worker* workers;
+    Thread* threads;
+    int nThreads = 0;
+    int nCreated = 0;
+    int result = -1;
+    int s, i;
+
+    if (nStages <= 0) return nItems;
+    if (queueSize < 1) queueSize = 1;
+    for (s=0; s<nStages; s++) {
+        if (stages[s].nWorkers < 1) stages[s].nWorkers = 1;
+        stages[s].nDone = 0;
+        stages[s].nFailed = 0;
+        stages[s].busyTime = 0;
+        stages[s].maxTime = 0;
+        stages[s].finishTime = 0;
+        nThreads += stages[s].nWorkers;
+    }
+
+    p.stages = stages;
+    p.nStages = nStages;
+    p.items = items;
+    p.aborted = 0;
+    p.queues = (Queue*)calloc(nStages, sizeof(Queue));
+    workers = (Worker*)calloc(nThreads, sizeof(Worker));
+    threads = (Thread*)calloc(nThreads, sizeof(Thread));
+    if (!p.queues || !workers || !threads) goto done;
+
+    // the input queue of the first stage holds all items and is closed,
+    // or, with a source, is filled and closed by the source
+    for (s=0; s<nStages; s++) {
+        if (!queueInit(&p.queues[s], s==0 ? (nItems > 0 ? nItems : 1) : queueSize,
+                       s==0 ? (source ? 1 : 0) : stages[s-1].nWorkers)) {
+            while (--s >= 0) queueFree(&p.queues[s]);
+            goto done;
+        }
+    }
+    if (!source) {
+        for (i=0; i<nItems; i++) p.queues[0].slots[i] = i;
+        p.queues[0].count = nItems;
+    }
+    mutexInit(&p.statsLock);
+
+    p.startTime = wallClock();
+    for (s=0; s<nStages; s++) {
+        for (i=0; i<stages[s].nWorkers; i++) {
+            workers[nCreated].p = &p;
+            workers[nCreated].stage = s;
+            workers[nCreated].index = i;
+            if (!threadCreate(&threads[nCreated], workerMain, &workers[nCreated])) {
+                abortPipeline(&p);
+                break;
+            }
+            nCreated++;
+        }
+        if (p.aborted) break;
+    }
+    if (source) {
+        if (!p.aborted) source(&p, sourceArg);
+        queueRemoveProducer(&p.queues[0]);
+    }
+    for (i=0; i<nCreated; i++) threadJoin(threads[i]);
+    if (!p.aborted) result = stages[nStages-1].nDone;
+
+    for (s=0; s<nStages; s++) queueFree(&p.queues[s]);
+    mutexDestroy(&p.statsLock);
+done:
+    free(p.queues);
+    free(workers);
+    free(threads);
+    return result;
+}
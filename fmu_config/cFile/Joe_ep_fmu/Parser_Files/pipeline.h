@@ -0,0 +1,57 @@
+/* -------------------------------------------------------------------------
+ * pipeline.h
+ * Runs a set of items through a sequence of stages. Each stage has its
+ * own worker threads, and stages are connected by bounded queues, so that
+ * different stages work on different items at the same time, e.g. item
+ * k+1 is parsed while item k is loaded.
+ * -------------------------------------------------------------------------*/
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Processes one item. Returns 1 to indicate success and 0 for error.
+// An item that fails a stage is not passed to the following stages.
+typedef int (*StageFunction)(void* item, void* arg);
+
+typedef struct {
+    const char* name;     // stage name used for reporting
+    StageFunction run;    // called once for each item
+    void* arg;            // passed to run
+    int nWorkers;         // number of threads running this stage, at least 1
+    // statistics of the last runPipeline
+    int nDone;            // items that passed this stage
+    int nFailed;          // items that failed in this stage
+    double busyTime;      // sum of the run times of all items, in seconds
+    double maxTime;       // longest run time of a single item, in seconds
+    double finishTime;    // time from pipeline start until the last item left this stage
+} PipelineStage;
+
+// Runs all items through the given stages in order.
+// At most queueSize items wait between two stages.
+// If tracing is on, each run of a stage is recorded as a trace event
+// named after the stage, with the index of the item as id.
+// Returns the number of items that passed all stages, or -1 if the
+// worker threads could not be started.
+int runPipeline(PipelineStage* stages, int nStages, void** items, int nItems, int queueSize);
+
+// Hands the items to the first stage as they become ready, e.g. as their
+// files are read, by calling pipelineFeed(feed, item) with the index of
+// each ready item, in any order
+typedef void (*PipelineSource)(void* feed, void* arg);
+
+// Like runPipeline, but the first stage gets only the items that source
+// feeds. source runs in the calling thread while the stages run, and
+// items it does not feed are skipped.
+int runPipelineFed(PipelineStage* stages, int nStages, void** items, int nItems, int queueSize,
+                   PipelineSource source, void* sourceArg);
+
+// Called by a source: item is ready for the first stage
+void pipelineFeed(void* feed, int item);
+
+#ifdef __cplusplus
+} // closing brace for extern "C"
+#endif
+#endif // PIPELINE_H
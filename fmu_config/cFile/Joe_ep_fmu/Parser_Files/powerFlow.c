@@ -0,0 +1,388 @@
+/* -------------------------------------------------------------------------
+ * powerFlow.c
+ * Backward/forward sweep power flow of radial feeders with warm start.
+ * -------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef STANDALONE_XML_PARSER
+#define logThis(n, ...) printf(__VA_ARGS__);printf("\n")
+#else
+#include "GlobalIncludes.h"
+#include "logging.h" // logThis
+#endif // STANDALONE_XML_PARSER
+
+#include "powerFlow.h"
+
+#define LINE_SIZE 512
+#define NAME_SIZE 128
+
+// A bus or home as read from the file, in file order
+typedef struct {
+    char* name;
+    int parent;             // in file order, -1 for the source
+    int level;
+    double r, x, rating;
+} BusRecord;
+
+typedef struct {
+    int home;
+    int bus;                // in file order
+    double powerFactor;
+} HomeRecord;
+
+static int findBus(BusRecord* buses, int n, const char* name) {
+    int i;
+    for (i=n-1; i>=0; i--) {
+        if (!strcmp(buses[i].name, name)) return i;
+    }
+    return -1;
+}
+
+// Allocate all arrays of f for nBuses buses and nHomes homes.
+// Returns 1 to indicate success and 0 if no memory is available.
+static int allocateFeeder(Feeder* f, int nBuses, int nHomes) {
+    f->nBuses = nBuses;
+    f->nHomes = nHomes;
+    f->names = (char**)calloc(nBuses, sizeof(char*));
+    f->parent = (int*)calloc(nBuses, sizeof(int));
+    f->levelStart = (int*)calloc(nBuses + 1, sizeof(int));
+    f->r = (double*)calloc(nBuses, sizeof(double));
+    f->x = (double*)calloc(nBuses, sizeof(double));
+    f->rating = (double*)calloc(nBuses, sizeof(double));
+    f->ratedBranch = (int*)calloc(nBuses, sizeof(int));
+    f->homeBus = (int*)calloc(nHomes + 1, sizeof(int));
+    f->homeTanPhi = (double*)calloc(nHomes + 1, sizeof(double));
+    f->p = (double*)calloc(nBuses, sizeof(double));
+    f->q = (double*)calloc(nBuses, sizeof(double));
+    f->vr = (double*)calloc(nBuses, sizeof(double));
+    f->vi = (double*)calloc(nBuses, sizeof(double));
+    f->ir = (double*)calloc(nBuses, sizeof(double));
+    f->ii = (double*)calloc(nBuses, sizeof(double));
+    f->loading = (double*)calloc(nBuses, sizeof(double));
+    return f->names && f->parent && f->levelStart && f->r && f->x && f->rating
+        && f->ratedBranch && f->homeBus && f->homeTanPhi && f->p && f->q
+        && f->vr && f->vi && f->ir && f->ii && f->loading;
+}
+
+// Number the buses level by level: bus 0 is the source, then its
+// children, then theirs, each level in file order
+static int numberBuses(Feeder* f, BusRecord* buses, int nRecords, HomeRecord* homes, int nHomeRecords) {
+    int* number = (int*)malloc((nRecords + 1) * sizeof(int));
+    int level, i, b = 1;
+    if (!number) return 0; // error
+    f->names[0] = strdup("source");
+    if (!f->names[0]) {
+        free(number);
+        return 0; // error
+    }
+    f->nLevels = 1;
+    f->levelStart[0] = 0;
+    f->levelStart[1] = 1;
+    for (level=1; b<f->nBuses; level++) {
+        for (i=0; i<nRecords; i++) {
+            if (buses[i].level != level) continue;
+            number[i] = b;
+            f->names[b] = buses[i].name;
+            buses[i].name = NULL;
+            f->parent[b] = buses[i].parent < 0 ? 0 : number[buses[i].parent];
+            f->r[b] = buses[i].r;
+            f->x[b] = buses[i].x;
+            f->rating[b] = 1000 * buses[i].rating;
+            f->ratedBranch[b] = f->rating[b] > 0 ? b : f->ratedBranch[f->parent[b]];
+            b++;
+        }
+        f->nLevels++;
+        f->levelStart[level + 1] = b;
+    }
+    for (i=0; i<f->nHomes; i++) f->homeBus[i] = -1;
+    for (i=0; i<nHomeRecords; i++) {
+        double pf = homes[i].powerFactor;
+        f->homeBus[homes[i].home] = number[homes[i].bus];
+        f->homeTanPhi[homes[i].home] = sqrt(1 - pf * pf) / pf;
+    }
+    free(number);
+    return 1; // success
+}
+
+Feeder* readFeeder(const char* path) {
+    char line[LINE_SIZE];
+    char name[NAME_SIZE];
+    char parent[NAME_SIZE];
+    BusRecord* buses = NULL;
+    HomeRecord* homes = NULL;
+    int nBuses = 0, busCapacity = 0, nHomes = 0, homeCapacity = 0, nHomeIds = 0;
+    int lineNumber = 0, ok = 1, i;
+    double sourceVoltage = 0;
+    Feeder* f = NULL;
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        logThis(ERROR_ERROR, "Cannot open file '%s'", path);
+        return NULL;
+    }
+    while (ok && fgets(line, sizeof(line), file)) {
+        char* hash = strchr(line, '#');
+        char keyword[16];
+        lineNumber++;
+        if (hash) *hash = '\0';
+        if (sscanf(line, "%15s", keyword) != 1) continue;
+        if (!strcmp(keyword, "source")) {
+            ok = sscanf(line, "%*s %lf", &sourceVoltage) == 1 && sourceVoltage > 0;
+        } else if (!strcmp(keyword, "bus")) {
+            BusRecord* bus;
+            if (nBuses == busCapacity) {
+                BusRecord* more;
+                busCapacity = busCapacity ? 2 * busCapacity : 64;
+                more = (BusRecord*)realloc(buses, busCapacity * sizeof(BusRecord));
+                if (!more) {
+                    ok = 0;
+                    break;
+                }
+                buses = more;
+            }
+            bus = &buses[nBuses];
+            bus->rating = 0;
+            ok = sscanf(line, "%*s %127s %127s %lf %lf %lf", name, parent, &bus->r, &bus->x, &bus->rating) >= 4
+              && strcmp(name, "source") && findBus(buses, nBuses, name) < 0
+              && bus->r >= 0 && bus->rating >= 0;
+            if (!ok) break;
+            bus->parent = strcmp(parent, "source") ? findBus(buses, nBuses, parent) : -1;
+            if (bus->parent < 0 && strcmp(parent, "source")) {
+                logThis(ERROR_ERROR, "Unknown parent '%s' in line %d of '%s'", parent, lineNumber, path);
+                ok = 0;
+                break;
+            }
+            bus->level = bus->parent < 0 ? 1 : buses[bus->parent].level + 1;
+            bus->name = strdup(name);
+            if (!bus->name) {
+                ok = 0;
+                break;
+            }
+            nBuses++;
+        } else if (!strcmp(keyword, "home")) {
+            HomeRecord* home;
+            if (nHomes == homeCapacity) {
+                HomeRecord* more;
+                homeCapacity = homeCapacity ? 2 * homeCapacity : 64;
+                more = (HomeRecord*)realloc(homes, homeCapacity * sizeof(HomeRecord));
+                if (!more) {
+                    ok = 0;
+                    break;
+                }
+                homes = more;
+            }
+            home = &homes[nHomes];
+            home->powerFactor = 1;
+            ok = sscanf(line, "%*s %d %127s %lf", &home->home, name, &home->powerFactor) >= 2
+              && home->home >= 0 && home->powerFactor > 0 && home->powerFactor <= 1
+              && (home->bus = findBus(buses, nBuses, name)) >= 0;
+            if (!ok) break;
+            if (home->home >= nHomeIds) nHomeIds = home->home + 1;
+            nHomes++;
+        } else {
+            ok = 0;
+        }
+    }
+    fclose(file);
+    if (ok && sourceVoltage <= 0) {
+        logThis(ERROR_ERROR, "No source voltage in '%s'", path);
+        ok = 0;
+    } else if (!ok) {
+        logThis(ERROR_ERROR, "Illegal line %d in '%s'", lineNumber, path);
+    }
+    if (ok) {
+        f = (Feeder*)calloc(1, sizeof(Feeder));
+        ok = f && allocateFeeder(f, nBuses + 1, nHomeIds)
+          && numberBuses(f, buses, nBuses, homes, nHomes);
+        if (!ok) {
+            logThis(ERROR_ERROR, "Out of memory reading '%s'", path);
+        }
+    }
+    if (ok) {
+        f->sourceVoltage = sourceVoltage;
+        f->tolerance = 1e-6;
+        f->maxIterations = 50;
+        // flat start
+        for (i=0; i<f->nBuses; i++) f->vr[i] = sourceVoltage;
+        logThis(ERROR_INFO, "Feeder '%s': %d buses in %d levels, %d homes",
+                path, nBuses, f->nLevels - 1, nHomes);
+    } else {
+        freeFeeder(f);
+        f = NULL;
+    }
+    for (i=0; i<nBuses; i++) free(buses[i].name);
+    free(buses);
+    free(homes);
+    return f;
+}
+
+void freeFeeder(Feeder* f) {
+    int i;
+    if (!f) return;
+    if (f->names) {
+        for (i=0; i<f->nBuses; i++) free(f->names[i]);
+    }
+    free(f->names);
+    free(f->parent);
+    free(f->levelStart);
+    free(f->r);
+    free(f->x);
+    free(f->rating);
+    free(f->ratedBranch);
+    free(f->homeBus);
+    free(f->homeTanPhi);
+    free(f->p);
+    free(f->q);
+    free(f->vr);
+    free(f->vi);
+    free(f->ir);
+    free(f->ii);
+    free(f->loading);
+    free(f);
+}
+
+int solveFeeder(Feeder* f, const double* homePower) {
+    const int n = f->nBuses;
+    const int* parent = f->parent;
+    const double* r = f->r;
+    const double* x = f->x;
+    const double* p = f->p;
+    const double* q = f->q;
+    double* vr = f->vr;
+    double* vi = f->vi;
+    double* ir = f->ir;
+    double* ii = f->ii;
+    double change = 0;
+    int i, b, l;
+    memset(f->p, 0, n * sizeof(double));
+    memset(f->q, 0, n * sizeof(double));
+    for (i=0; i<f->nHomes; i++) {
+        b = f->homeBus[i];
+        if (b < 0) continue;
+        if (!isfinite(homePower[i])) {
+            logThis(ERROR_ERROR, "Power flow: power %g of home %d is not finite", homePower[i], i);
+            return 0; // error
+        }
+        f->p[b] += homePower[i];
+        f->q[b] += homePower[i] * f->homeTanPhi[i];
+    }
+    vr[0] = f->sourceVoltage;
+    vi[0] = 0;
+    for (f->iterations=1; f->iterations<=f->maxIterations; f->iterations++) {
+        // load currents I = conj(S / V)
+        for (b=1; b<n; b++) {
+            double m = vr[b] * vr[b] + vi[b] * vi[b];
+            ir[b] = (p[b] * vr[b] + q[b] * vi[b]) / m;
+            ii[b] = (p[b] * vi[b] - q[b] * vr[b]) / m;
+        }
+        // backward sweep: children have higher numbers than their parent,
+        // and the top level buses add up the current of the source in bus 0
+        ir[0] = ii[0] = 0;
+        for (b=n-1; b>0; b--) {
+            ir[parent[b]] += ir[b];
+            ii[parent[b]] += ii[b];
+        }
+        // forward sweep, level by level: V = V(parent) - Z I
+        change = 0;
+        for (l=1; l<f->nLevels; l++) {
+            for (b=f->levelStart[l]; b<f->levelStart[l+1]; b++) {
+                double nr = vr[parent[b]] - (r[b] * ir[b] - x[b] * ii[b]);
+                double ni = vi[parent[b]] - (r[b] * ii[b] + x[b] * ir[b]);
+                double d = fabs(nr - vr[b]) + fabs(ni - vi[b]);
+                // a NaN makes change NaN, so the sweeps do not converge
+                if (!(d <= change)) change = d;
+                vr[b] = nr;
+                vi[b] = ni;
+            }
+        }
+        if (change <= f->tolerance * f->sourceVoltage) break;
+    }
+    if (!(change <= f->tolerance * f->sourceVoltage)) {
+        logThis(ERROR_WARNING, "Power flow did not converge in %d sweeps", f->maxIterations);
+        // do not warm start from a diverged solution
+        for (b=0; b<n; b++) {
+            vr[b] = f->sourceVoltage;
+            vi[b] = 0;
+        }
+        return 0; // error
+    }
+    // over the buses only, the source is 1 by definition
+    f->minVoltage = n > 1 ? HUGE_VAL : 1;
+    f->maxVoltage = n > 1 ? 0 : 1;
+    f->maxLoading = 0;
+    f->loading[0] = 0;
+    for (b=1; b<n; b++) {
+        double v = sqrt(vr[b] * vr[b] + vi[b] * vi[b]) / f->sourceVoltage;
+        double vParent = sqrt(vr[parent[b]] * vr[parent[b]] + vi[parent[b]] * vi[parent[b]]);
+        f->loading[b] = f->rating[b] > 0 ? vParent * sqrt(ir[b] * ir[b] + ii[b] * ii[b]) / f->rating[b] : 0;
+        if (v < f->minVoltage) f->minVoltage = v;
+        if (v > f->maxVoltage) f->maxVoltage = v;
+        if (f->loading[b] > f->maxLoading) f->maxLoading = f->loading[b];
+    }
+    return 1; // success
+}
+
+void feederHomeVoltages(Feeder* f, double* voltage) {
+    int i;
+    for (i=0; i<f->nHomes; i++) {
+        int b = f->homeBus[i];
+        voltage[i] = b < 0 ? 1 : sqrt(f->vr[b] * f->vr[b] + f->vi[b] * f->vi[b]) / f->sourceVoltage;
+    }
+}
+
+void feederHomeLoadings(Feeder* f, double* loading) {
+    int i;
+    for (i=0; i<f->nHomes; i++) {
+        int b = f->homeBus[i];
+        loading[i] = b < 0 ? 0 : f->loading[f->ratedBranch[b]];
+    }
+}
+
+// #define TEST
+#ifdef TEST
+
+// |V| of one bus behind r + jx with load P + jQ, from the quadratic in
+// |V|^2: |V|^4 + (2(rP + xQ) - Vs^2)|V|^2 + (r^2 + x^2)(P^2 + Q^2) = 0
+static double oneBusVoltage(double vs, double r, double x, double p, double q) {
+    double b = 2 * (r * p + x * q) - vs * vs;
+    double c = (r * r + x * x) * (p * p + q * q);
+    return sqrt((-b + sqrt(b * b - 4 * c)) / 2) / vs;
+}
+
+// powerFlow [<file>]: a single bus feeder written to file, solved for
+// loads and exports, against the closed form
+int main(int argc, char** argv) {
+    const char* path = argc > 1 ? argv[1] : "oneBus.txt";
+    double loads[] = { 5000, 20000, -8000, 0 };
+    double r = 0.1, x = 0.05, pf = 0.9, tanPhi = sqrt(1 - pf * pf) / pf;
+    double voltage, nan = 0;
+    int failed = 0, i;
+    Feeder* f;
+    FILE* file = fopen(path, "w");
+    if (!file) return 1;
+    fprintf(file, "source 240\nbus house source %g %g 25\nhome 0 house %g\n", r, x, pf);
+    fclose(file);
+    f = readFeeder(path);
+    if (!f) return 1;
+    for (i=0; i<4; i++) {
+        double expected = oneBusVoltage(240, r, x, loads[i], loads[i] * tanPhi);
+        int ok = solveFeeder(f, &loads[i]);
+        feederHomeVoltages(f, &voltage);
+        printf("%6.0f W: %.12f pu, expected %.12f, %d sweeps, voltage %.4f to %.4f pu, loading %.3f\n",
+               loads[i], voltage, expected, f->iterations, f->minVoltage, f->maxVoltage, f->maxLoading);
+        if (!ok || fabs(voltage - expected) > 1e-7 || f->minVoltage != voltage || f->maxVoltage != voltage)
+            failed = 1;
+    }
+    // a NaN power is rejected, and the next solve works again
+    nan = nan / nan;
+    if (solveFeeder(f, &nan)) failed = 1;
+    if (!solveFeeder(f, &loads[0])) failed = 1;
+    printf("%s\n", failed ? "failed" : "ok");
+    freeFeeder(f);
+    remove(path);
+    return failed;
+}
+#endif // TEST
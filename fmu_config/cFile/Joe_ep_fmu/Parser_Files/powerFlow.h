@@ -0,0 +1,83 @@
+/* -------------------------------------------------------------------------
+ * powerFlow.h
+ * Radial power flow of the distribution feeders, solved every timestep
+ * with the net loads of the homes, e.g. from epSendNetEnergy, so that the
+ * voltages and transformer loadings seen by the homes can feed back to
+ * the controller, see feederStep.h.
+ * Single phase equivalent, backward/forward sweep: loads are constant
+ * power; the backward sweep adds the load currents up towards the source,
+ * the forward sweep computes the voltage drops down from the source, until
+ * the voltages change by less than the tolerance. Each timestep starts
+ * from the voltages of the previous one, so a few sweeps usually suffice.
+ * Buses are numbered level by level from the source and all values are
+ * stored as arrays over the buses (real and imaginary parts separately):
+ * the load currents, the bulk of the arithmetic, are one vectorizable
+ * loop, and the buses of one level of the forward sweep are independent
+ * of each other; only the summation of currents is sequential.
+ * Topology file, one record per line, # starts a comment:
+ *     source <voltage V>
+ *     bus <name> <parent> <r ohm> <x ohm> [<rating kVA>]
+ *     home <home> <bus> [<power factor>]
+ * The parent of a bus is "source" or a bus defined before it. The rating
+ * is that of the branch from the parent to the bus, e.g. a distribution
+ * transformer. Homes are numbered from 0, power factor 1 by default.
+ * -------------------------------------------------------------------------*/
+
+#ifndef POWER_FLOW_H
+#define POWER_FLOW_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    int nBuses;             // including the source, which is bus 0
+    char** names;
+    int* parent;            // of each bus, 0 for the source itself
+    int nLevels;
+    int* levelStart;        // buses of level l are levelStart[l] to levelStart[l+1]-1
+    double* r;              // ohm, of the branch from the parent
+    double* x;
+    double* rating;         // VA of the branch from the parent, 0 if not rated
+    int* ratedBranch;       // nearest rated branch at or above each bus, 0 if none
+    double sourceVoltage;   // V
+    int nHomes;
+    int* homeBus;
+    double* homeTanPhi;     // reactive per active power of each home
+    double tolerance;       // largest voltage change relative to sourceVoltage, default 1e-6
+    int maxIterations;      // default 50
+    // state of the last solve, per bus
+    double* p;              // W, consumed by the homes at the bus
+    double* q;              // var
+    double* vr;             // V
+    double* vi;
+    double* ir;             // A, into the bus from its parent, for bus 0 from the source
+    double* ii;
+    double* loading;        // |S| of the branch from the parent / rating, 0 if not rated
+    int iterations;         // sweeps of the last solve
+    double minVoltage;      // per unit, over all buses but the source
+    double maxVoltage;      // e.g. above 1 where the homes export
+    double maxLoading;      // over all rated branches
+} Feeder;
+
+// Returns NULL to indicate failure, e.g. an unknown parent
+Feeder* readFeeder(const char* path);
+void freeFeeder(Feeder* f);
+
+// Solve the power flow for the given active power of each home, W,
+// positive if the home consumes, negative if it exports. The loads of
+// the homes at one bus are added in the order of the homes, so the
+// result depends only on the inputs. Does not allocate memory. Returns 1 if the sweeps converged and 0
+// otherwise, e.g. for a load beyond the capacity of the feeder or a
+// power that is not finite.
+int solveFeeder(Feeder* f, const double* homePower);
+
+// After solveFeeder: voltage magnitude in per unit of sourceVoltage at
+// the bus of each home, and loading of the nearest rated branch above it,
+// e.g. its transformer, 0 if there is none.
+void feederHomeVoltages(Feeder* f, double* voltage);
+void feederHomeLoadings(Feeder* f, double* loading);
+
+#ifdef __cplusplus
+} // closing brace for extern "C"
+#endif
+#endif // POWER_FLOW_H
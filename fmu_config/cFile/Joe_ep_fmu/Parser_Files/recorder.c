@@ -0,0 +1,241 @@
+/* -------------------------------------------------------------------------
+ * recorder.c
+ * Recording of the Real variables of one FMU instance, stored as CSV.
+ * -------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef STANDALONE_XML_PARSER
+#define logThis(n, ...) printf(__VA_ARGS__);printf("\n")
+#else
+#include "GlobalIncludes.h"
+#include "logging.h" // logThis
+#endif // STANDALONE_XML_PARSER
+
+#include "recorder.h"
+
+// Returns NULL if no memory is available
+static Recording* newEmptyRecording(int nColumns) {
+    Recording* r = (Recording*)calloc(1, sizeof(Recording));
+    int n = nColumns > 0 ? nColumns : 1;
+    if (!r) return NULL;
+    r->nColumns = nColumns;
+    r->names = (char**)calloc(n, sizeof(char*));
+    r->vars = (ScalarVariable**)calloc(n, sizeof(ScalarVariable*));
+    r->vrs = (fmiValueReference*)calloc(n, sizeof(fmiValueReference));
+    r->causality = (Enu*)calloc(n, sizeof(Enu));
+    if (!r->names || !r->vars || !r->vrs || !r->causality) {
+        freeRecording(r);
+        return NULL;
+    }
+    return r;
+}
+
+// Returns 0 to indicate error
+static int setColumn(Recording* r, int column, const char* name, ScalarVariable* sv) {
+    r->names[column] = strdup(name);
+    if (!r->names[column]) return 0; // error
+    r->vars[column] = sv;
+    r->vrs[column] = sv ? getValueReference(sv) : fmiUndefinedValueReference;
+    r->causality[column] = sv ? getCausality(sv) : enu_internal;
+    return 1; // success
+}
+
+Recording* newRecording(ModelDescription* md) {
+    Recording* r;
+    int i, n = 0;
+    if (md->modelVariables)
+        for (i=0; md->modelVariables[i]; i++)
+            if (md->modelVariables[i]->typeSpec->type == elm_Real) n++;
+    r = newEmptyRecording(n);
+    if (!r) return NULL;
+    n = 0;
+    if (md->modelVariables)
+    for (i=0; md->modelVariables[i]; i++) {
+        ScalarVariable* sv = md->modelVariables[i];
+        if (sv->typeSpec->type != elm_Real) continue;
+        if (!setColumn(r, n++, getName(sv), sv)) {
+            freeRecording(r);
+            return NULL;
+        }
+    }
+    return r;
+}
+
+Recording* newRecordingWithColumns(ModelDescription* md, char** names, int n) {
+    Recording* r = newEmptyRecording(n);
+    int i;
+    if (!r) return NULL;
+    for (i=0; i<n; i++) {
+        ScalarVariable* sv = NULL;
+        if (md) {
+            sv = getVariableByName(md, names[i]);
+            if (!sv || sv->typeSpec->type != elm_Real) {
+                logThis(ERROR_ERROR, "%s is not a Real variable of %s",
+                        names[i], getModelIdentifier(md));
+                freeRecording(r);
+                return NULL;
+            }
+        }
+        if (!setColumn(r, i, names[i], sv)) {
+            freeRecording(r);
+            return NULL;
+        }
+    }
+    return r;
+}
+
+int reserveRecording(Recording* r, int nSteps) {
+    double* t;
+    double* v;
+    if (nSteps <= r->capacity) return 1; // success
+    t = (double*)realloc(r->time, nSteps * sizeof(double));
+    if (!t) return 0; // error
+    r->time = t;
+    v = (double*)realloc(r->values, (size_t)nSteps * r->nColumns * sizeof(double) + 1);
+    if (!v) return 0; // error
+    r->values = v;
+    r->capacity = nSteps;
+    return 1; // success
+}
+
+int recordStep(Recording* r, double time, const double* values) {
+    if (r->nSteps == r->capacity
+            && !reserveRecording(r, r->capacity ? 2 * r->capacity : 1024))
+        return 0; // error
+    r->time[r->nSteps] = time;
+    memcpy(&recordedValue(r, r->nSteps, 0), values, r->nColumns * sizeof(double));
+    r->nSteps++;
+    return 1; // success
+}
+
+int getRecordingColumn(Recording* r, const char* name) {
+    int i;
+    for (i=0; i<r->nColumns; i++)
+        if (!strcmp(r->names[i], name)) return i;
+    return -1;
+}
+
+int writeRecording(Recording* r, const char* path) {
+    int i, k;
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        logThis(ERROR_ERROR, "Cannot open file '%s'", path);
+        return 0; // error
+    }
+    fprintf(file, "time");
+    for (i=0; i<r->nColumns; i++) fprintf(file, ",%s", r->names[i]);
+    fprintf(file, "\n");
+    for (k=0; k<r->nSteps; k++) {
+        fprintf(file, "%.17g", r->time[k]);
+        for (i=0; i<r->nColumns; i++) fprintf(file, ",%.17g", recordedValue(r, k, i));
+        fprintf(file, "\n");
+    }
+    return fclose(file) == 0;
+}
+
+// Returns NULL at end of file or if no memory is available.
+// The receiver must free the line.
+static char* readLine(FILE* file) {
+    int size = 256;
+    int n = 0;
+    char* line = (char*)malloc(size);
+    if (!line) return NULL;
+    while (fgets(line + n, size - n, file)) {
+        n += (int)strlen(line + n);
+        if (n > 0 && line[n-1] == '\n') {
+            line[--n] = '\0';
+            if (n > 0 && line[n-1] == '\r') line[--n] = '\0';
+            return line;
+        }
+        if (n == size - 1) {
+            char* longer = (char*)realloc(line, 2 * size);
+            if (!longer) break;
+            line = longer;
+            size *= 2;
+        }
+    }
+    if (n > 0) return line; // last line without newline
+    free(line);
+    return NULL;
+}
+
+Recording* readRecording(const char* path, ModelDescription* md) {
+    Recording* r = NULL;
+    double* row = NULL;
+    char** names = NULL;
+    char* line;
+    char* field;
+    int i, n, lineNumber = 1;
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        logThis(ERROR_ERROR, "Cannot open file '%s'", path);
+        return NULL;
+    }
+    line = readLine(file);
+    if (!line || strncmp(line, "time", 4) || (line[4] != ',' && line[4] != '\0')) {
+        logThis(ERROR_ERROR, "Missing header line 'time,...' in file '%s'", path);
+        goto error;
+    }
+    for (n=0, field=line; (field = strchr(field, ',')) != NULL; field++) n++;
+    names = (char**)malloc((n > 0 ? n : 1) * sizeof(char*));
+    row = (double*)malloc((n > 0 ? n : 1) * sizeof(double));
+    if (!names || !row) goto error;
+    field = line + 4;
+    for (i=0; i<n; i++) {
+        names[i] = field + 1;
+        field = strchr(names[i], ',');
+        if (field) *field = '\0';
+    }
+    r = newRecordingWithColumns(md, names, n);
+    if (!r) {
+        logThis(ERROR_ERROR, "Illegal header line in file '%s'", path);
+        goto error;
+    }
+    free(names);
+    names = NULL;
+    free(line);
+    while ((line = readLine(file)) != NULL) {
+        double time;
+        char* end;
+        lineNumber++;
+        if (!line[0]) {
+            free(line);
+            continue; // skip empty lines
+        }
+        time = strtod(line, &end);
+        for (i=0; i<n && *end == ','; i++) row[i] = strtod(end + 1, &end);
+        if (i < n || *end != '\0') {
+            logThis(ERROR_ERROR, "Illegal row at line %d of file '%s'", lineNumber, path);
+            goto error;
+        }
+        if (!recordStep(r, time, row)) goto error;
+        free(line);
+    }
+    free(row);
+    fclose(file);
+    return r;
+error:
+    free(line);
+    free(names);
+    free(row);
+    freeRecording(r);
+    fclose(file);
+    return NULL;
+}
+
+void freeRecording(Recording* r) {
+    int i;
+    if (!r) return;
+    if (r->names)
+        for (i=0; i<r->nColumns; i++) free(r->names[i]);
+    free(r->names);
+    free(r->vars);
+    free(r->vrs);
+    free(r->causality);
+    free(r->time);
+    free(r->values);
+    free(r);
+}
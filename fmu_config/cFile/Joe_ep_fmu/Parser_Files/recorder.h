@@ -0,0 +1,68 @@
+/* -------------------------------------------------------------------------
+ * recorder.h
+ * Recording of the Real variables of one FMU instance, one row per
+ * communication step. Row k holds the communication point time[k], the
+ * inputs set before the step from time[k], and the outputs read after it.
+ * Recordings are stored as CSV files with a header line
+ * "time,<variable name>,...", and numbers written with 17 significant
+ * digits, so that values survive a write and read unchanged.
+ * -------------------------------------------------------------------------*/
+
+#ifndef recorder_h
+#define recorder_h
+
+#include "xml_parser.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    int nColumns;              // number of variables, without time
+    char** names;              // name of each column
+    ScalarVariable** vars;     // variable of each column, NULL if not in the model description
+    fmiValueReference* vrs;    // value reference of each column
+    Enu* causality;            // causality of each column
+    int nSteps;                // number of recorded rows
+    int capacity;              // rows allocated
+    double* time;              // nSteps communication points
+    double* values;            // nSteps rows of nColumns values
+} Recording;
+
+// Returns a recording with one column for each Real variable of md,
+// or NULL if no memory is available.
+Recording* newRecording(ModelDescription* md);
+
+// Returns a recording with the given columns. If md is not NULL, each
+// name must be a Real variable of md. Returns NULL to indicate failure.
+Recording* newRecordingWithColumns(ModelDescription* md, char** names, int n);
+
+// Allocate memory for nSteps rows, so that recordStep does not
+// allocate memory until the recording has nSteps rows.
+// Returns 1 to indicate success and 0 for error.
+int reserveRecording(Recording* r, int nSteps);
+
+// Append one row of nColumns values.
+// Returns 1 to indicate success and 0 for error.
+int recordStep(Recording* r, double time, const double* values);
+
+// Returns the value of the given step and column
+#define recordedValue(r, step, column) ((r)->values[(size_t)(step) * (r)->nColumns + (column)])
+
+// Returns the column of the variable with the given name, or -1
+int getRecordingColumn(Recording* r, const char* name);
+
+// Returns 1 to indicate success and 0 for error
+int writeRecording(Recording* r, const char* path);
+
+// Read a recording, resolving the column names in md, if not NULL.
+// Returns NULL to indicate failure, e.g. for a column name that is
+// not a Real variable of md.
+Recording* readRecording(const char* path, ModelDescription* md);
+
+void freeRecording(Recording* r);
+
+#ifdef __cplusplus
+} // closing brace for extern "C"
+#endif
+#endif // recorder_h
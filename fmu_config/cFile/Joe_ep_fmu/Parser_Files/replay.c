@@ -0,0 +1,163 @@
+/* -------------------------------------------------------------------------
+ * replay.c
+ * Re-runs an FMU instance from a recording.
+ * -------------------------------------------------------------------------*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef STANDALONE_XML_PARSER
+#define logThis(n, ...) printf(__VA_ARGS__);printf("\n")
+#else
+#include "GlobalIncludes.h"
+#include "logging.h" // logThis
+#endif // STANDALONE_XML_PARSER
+
+#include "thread_support.h" // wallClock
+#include "allocCount.h"
+#include "arena.h"
+#include "trace.h"
+#include "replay.h"
+
+static void initResult(ReplayResult* result) {
+    memset(result, 0, sizeof(ReplayResult));
+    result->firstMismatchStep = -1;
+    result->firstMismatchColumn = -1;
+}
+
+// Compare the given outputs of one step with the recorded ones
+static void compareOutputs(Recording* expected, int step, const int* columns, int n,
+        const double* values, double tolerance, ReplayResult* result) {
+    int i;
+    for (i=0; i<n; i++) {
+        double error = fabs(values[i] - recordedValue(expected, step, columns[i]));
+        if (error > result->maxError) result->maxError = error;
+        if (error > tolerance || error != error) { // error != error for NaN
+            if (result->firstMismatchStep < 0) {
+                result->firstMismatchStep = step;
+                result->firstMismatchColumn = columns[i];
+                logThis(ERROR_WARNING, "Step %d at time %g: %s is %.17g, recorded %.17g",
+                        step, expected->time[step], expected->names[columns[i]],
+                        values[i], recordedValue(expected, step, columns[i]));
+            }
+            result->nMismatches++;
+        }
+    }
+}
+
+int replayRecording(Recording* r, ReplayTarget* target, double tolerance,
+                    Recording* actual, ReplayResult* result) {
+    // all buffers of the replay are taken from one arena
+    size_t n = r->nColumns + 1;
+    Arena* arena = newArena(7 * (n * sizeof(double) + 16));
+    fmiValueReference* inVrs = arena ? (fmiValueReference*)arenaAlloc(arena, n * sizeof(fmiValueReference)) : NULL;
+    fmiValueReference* outVrs = arena ? (fmiValueReference*)arenaAlloc(arena, n * sizeof(fmiValueReference)) : NULL;
+    int* inColumns = arena ? (int*)arenaAlloc(arena, n * sizeof(int)) : NULL;
+    int* outColumns = arena ? (int*)arenaAlloc(arena, n * sizeof(int)) : NULL;
+    double* inValues = arena ? (double*)arenaAlloc(arena, n * sizeof(double)) : NULL;
+    double* outValues = arena ? (double*)arenaAlloc(arena, n * sizeof(double)) : NULL;
+    double* row = arena ? (double*)arenaAlloc(arena, n * sizeof(double)) : NULL;
+    double start = wallClock();
+    long allocations = 0;
+    int nIn = 0, nOut = 0;
+    int ok = 0;
+    int i, k;
+
+    initResult(result);
+    result->nAllocations = -1;
+    if (!inVrs || !outVrs || !inColumns || !outColumns || !inValues || !outValues || !row) goto done;
+    if (actual && !reserveRecording(actual, actual->nSteps + r->nSteps)) goto done;
+    for (i=0; i<r->nColumns; i++) {
+        if (r->causality[i] == enu_input) {
+            inVrs[nIn] = r->vrs[i];
+            inColumns[nIn++] = i;
+        } else if (r->causality[i] == enu_output) {
+            outVrs[nOut] = r->vrs[i];
+            outColumns[nOut++] = i;
+        }
+    }
+
+    for (k=0; k<r->nSteps; k++) {
+        // the last step has the size of the one before
+        double h = k+1 < r->nSteps ? r->time[k+1] - r->time[k]
+                 : k > 0 ? r->time[k] - r->time[k-1] : 0;
+        int traced = traceSampled(k);
+        double stepStart = traced ? wallClock() : 0;
+        // the first step may allocate, e.g. in lazy initialization of the target
+        if (k == 1) allocations = allocationCount();
+        for (i=0; i<nIn; i++) inValues[i] = recordedValue(r, k, inColumns[i]);
+        if (nIn && !target->setReal(target->instance, inVrs, nIn, inValues)) {
+            logThis(ERROR_ERROR, "Could not set inputs at step %d", k);
+            goto done;
+        }
+        if (!target->doStep(target->instance, r->time[k], h)) {
+            logThis(ERROR_ERROR, "Could not do step %d at time %g", k, r->time[k]);
+            goto done;
+        }
+        if (nOut && !target->getReal(target->instance, outVrs, nOut, outValues)) {
+            logThis(ERROR_ERROR, "Could not get outputs at step %d", k);
+            goto done;
+        }
+        if (tolerance >= 0) compareOutputs(r, k, outColumns, nOut, outValues, tolerance, result);
+        if (actual) {
+            memcpy(row, &recordedValue(r, k, 0), r->nColumns * sizeof(double));
+            for (i=0; i<nOut; i++) row[outColumns[i]] = outValues[i];
+            if (!recordStep(actual, r->time[k], row)) goto done;
+        }
+        if (traced) traceEvent("replay step", k, stepStart, wallClock());
+        result->nSteps++;
+    }
+    if (allocations >= 0 && r->nSteps > 1) result->nAllocations = allocationCount() - allocations;
+    if (result->nAllocations > 0) {
+        logThis(ERROR_WARNING, "%ld memory allocations during steady-state steps", result->nAllocations);
+    }
+    ok = result->nMismatches == 0 && result->nAllocations <= 0;
+done:
+    result->seconds = wallClock() - start;
+    freeArena(arena);
+    return ok;
+}
+
+int compareRecordings(Recording* expected, Recording* actual, double tolerance, ReplayResult* result) {
+    int* outColumns;
+    double* outValues;
+    int nOut = 0;
+    int i, k;
+    double start = wallClock();
+    initResult(result);
+    if (expected->nColumns != actual->nColumns) {
+        logThis(ERROR_ERROR, "Recordings have %d and %d columns", expected->nColumns, actual->nColumns);
+        return 0;
+    }
+    for (i=0; i<expected->nColumns; i++) {
+        if (strcmp(expected->names[i], actual->names[i])) {
+            logThis(ERROR_ERROR, "Column %d is %s in one recording and %s in the other",
+                    i, expected->names[i], actual->names[i]);
+            return 0;
+        }
+    }
+    outColumns = (int*)malloc((expected->nColumns + 1) * sizeof(int));
+    outValues = (double*)malloc((expected->nColumns + 1) * sizeof(double));
+    if (!outColumns || !outValues) {
+        free(outColumns);
+        free(outValues);
+        return 0;
+    }
+    for (i=0; i<expected->nColumns; i++)
+        if (expected->causality[i] == enu_output) outColumns[nOut++] = i;
+    for (k=0; k<expected->nSteps && k<actual->nSteps; k++) {
+        for (i=0; i<nOut; i++) outValues[i] = recordedValue(actual, k, outColumns[i]);
+        compareOutputs(expected, k, outColumns, nOut, outValues, tolerance, result);
+        result->nSteps++;
+    }
+    free(outColumns);
+    free(outValues);
+    result->seconds = wallClock() - start;
+    if (expected->nSteps != actual->nSteps) {
+        logThis(ERROR_WARNING, "Recordings have %d and %d steps", expected->nSteps, actual->nSteps);
+        return 0;
+    }
+    return result->nMismatches == 0;
+}
@@ -0,0 +1,62 @@
+/* -------------------------------------------------------------------------
+ * replay.h
+ * Re-runs an FMU instance from a recording, without UCEF and without
+ * sockets. For each recorded step, the recorded inputs are set, the
+ * instance does one step, and its outputs are compared with the recorded
+ * outputs, e.g. the controller decisions epGetStartHeating/Cooling.
+ * Steps follow each other as fast as the instance can run them, and the
+ * result only depends on the recording and the instance. If tracing is
+ * on (see trace.h), each step is recorded as a trace event with the step
+ * as id.
+ * -------------------------------------------------------------------------*/
+
+#ifndef replay_h
+#define replay_h
+
+#include "recorder.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The FMU instance to drive. Each function returns 1 to indicate
+// success and 0 for error, like fmiSetReal etc. with status fmiOK.
+typedef struct {
+    void* instance;
+    int (*setReal)(void* instance, const fmiValueReference* vrs, int n, const double* values);
+    int (*doStep)(void* instance, double time, double stepSize);
+    int (*getReal)(void* instance, const fmiValueReference* vrs, int n, double* values);
+    // 1 if a forked copy of the instance can run on its own, see whatIf.h:
+    // it has no threads, child processes, sockets or files that the copy
+    // would share. Set only by the one who knows the instance.
+    int forkSafe;
+} ReplayTarget;
+
+typedef struct {
+    int nSteps;              // steps run
+    int nMismatches;         // output values that differ by more than the tolerance
+    int firstMismatchStep;   // -1 if all outputs matched
+    int firstMismatchColumn;
+    double maxError;         // largest absolute difference of an output
+    double seconds;          // wall clock time of the replay
+    long nAllocations;       // memory allocations after the first step, -1 if not counted
+} ReplayResult;
+
+// Replay recording r on target. Outputs are compared if tolerance >= 0.
+// If actual is not NULL, it must have the columns of r, and the inputs
+// and outputs of each step are appended to it.
+// After the first step, the replay itself does not allocate memory. If
+// allocations are counted, see allocCount.h, the replay fails when the
+// target allocates memory after the first step.
+// Returns 1 if all steps ran and all compared outputs matched, 0 otherwise.
+int replayRecording(Recording* r, ReplayTarget* target, double tolerance,
+                    Recording* actual, ReplayResult* result);
+
+// Compare the outputs of two recordings with the same columns step by step.
+// Returns 1 if all outputs match within tolerance, 0 otherwise.
+int compareRecordings(Recording* expected, Recording* actual, double tolerance, ReplayResult* result);
+
+#ifdef __cplusplus
+} // closing brace for extern "C"
+#endif
+#endif // replay_h
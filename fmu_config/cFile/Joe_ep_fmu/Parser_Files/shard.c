@@ -0,0 +1,506 @@
+/* -------------------------------------------------------------------------
+ * shard.c
+ * Distribution of homes over several nodes, with a coordinator that
+ * merges one short vector of exact sums per worker node and timestep.
+ * -------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef STANDALONE_XML_PARSER
+#define logThis(n, ...) printf(__VA_ARGS__);printf("\n")
+#else
+#include "GlobalIncludes.h"
+#include "logging.h" // logThis
+#endif // STANDALONE_XML_PARSER
+
+#include "shard.h"
+#include "exactSum.h"
+#include "thread_support.h" // wallClock
+#include "trace.h"
+
+#ifdef _WIN32
+#pragma comment(lib, "ws2_32.lib")
+#define closeSocket closesocket
+#define INVALID_SHARD_SOCKET INVALID_SOCKET
+#else
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#define closeSocket close
+#define INVALID_SHARD_SOCKET (-1)
+#endif
+
+// A peer that is gone must make send fail, not raise SIGPIPE, which
+// would end the process
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SEND_FLAGS 0
+#endif
+
+#define SHARD_MAGIC 0x44524853 // "SHRD"
+
+// First message of a worker
+typedef struct {
+    int magic;
+    int shard;
+    int nUp;
+    int nDown;
+} Hello;
+
+void shardRange(int nHomes, int nShards, int shard, int* first, int* count) {
+    int size = nHomes / nShards;
+    int rest = nHomes % nShards;
+    *first = shard * size + (shard < rest ? shard : rest);
+    *count = size + (shard < rest ? 1 : 0);
+}
+
+// -------------------------------------------------------------------------
+// ipconfig.txt, as read by Joe_ep_fmu: the value is placed between
+// the first two commas of line 2 (ip) and line 3 (port).
+
+int writeIpConfig(const char* path, const char* ip, int port) {
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        logThis(ERROR_ERROR, "Cannot open file '%s'", path);
+        return 0; // error
+    }
+    fprintf(file, "Put IP address and Port number in the line 2 and 3\r\n");
+    fprintf(file, "IP Address:  ,%s, //Input the IP address here\r\n", ip);
+    fprintf(file, "Port Number: ,%d, //Input the Port Number here", port);
+    return fclose(file) == 0;
+}
+
+// Copies the text between the first two commas of line into value.
+// Returns 0 to indicate error
+static int valueBetweenCommas(const char* line, char* value, int size) {
+    const char* begin = strchr(line, ',');
+    const char* end = begin ? strchr(begin + 1, ',') : NULL;
+    if (!end || end - begin - 1 >= size) return 0; // error
+    memcpy(value, begin + 1, end - begin - 1);
+    value[end - begin - 1] = '\0';
+    return 1; // success
+}
+
+int readIpConfig(const char* path, char* ip, int ipSize, int* port) {
+    char line[256];
+    char value[32];
+    int ok;
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        logThis(ERROR_ERROR, "Cannot open file '%s'", path);
+        return 0; // error
+    }
+    ok = fgets(line, sizeof(line), file) != NULL
+      && fgets(line, sizeof(line), file) != NULL
+      && valueBetweenCommas(line, ip, ipSize)
+      && fgets(line, sizeof(line), file) != NULL
+      && valueBetweenCommas(line, value, sizeof(value))
+      && sscanf(value, "%d", port) == 1;
+    fclose(file);
+    if (!ok) {
+        logThis(ERROR_ERROR, "Illegal format of file '%s'", path);
+    }
+    return ok;
+}
+
+// -------------------------------------------------------------------------
+// Socket helpers
+
+static int startSockets(void) {
+#ifdef _WIN32
+    static int started = 0;
+    WSADATA wsa;
+    if (!started) {
+        if (WSAStartup(MAKEWORD(2, 2), &wsa)) return 0; // error
+        started = 1;
+    }
+#endif
+    return 1; // success
+}
+
+// Returns 0 to indicate error
+static int sendAll(ShardSocket s, const void* buffer, int size) {
+    const char* p = (const char*)buffer;
+    while (size > 0) {
+        int n = send(s, p, size, SEND_FLAGS);
+        if (n <= 0) return 0; // error
+        p += n;
+        size -= n;
+    }
+    return 1; // success
+}
+
+// Returns 0 to indicate error, e.g. connection closed
+static int receiveAll(ShardSocket s, void* buffer, int size) {
+    char* p = (char*)buffer;
+    while (size > 0) {
+        int n = recv(s, p, size, 0);
+        if (n <= 0) return 0; // error
+        p += n;
+        size -= n;
+    }
+    return 1; // success
+}
+
+// Timesteps are short messages, send them without delay
+static void setNoDelay(ShardSocket s) {
+    int on = 1;
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(on));
+}
+
+// Where MSG_NOSIGNAL is missing, e.g. on macOS, the socket itself must
+// not raise SIGPIPE
+static void setNoSigPipe(ShardSocket s) {
+#ifdef SO_NOSIGPIPE
+    int on = 1;
+    setsockopt(s, SOL_SOCKET, SO_NOSIGPIPE, (const char*)&on, sizeof(on));
+#else
+    (void)s;
+#endif
+}
+
+// recv fails after the given seconds without data, never for 0
+static void setTimeout(ShardSocket s, double seconds) {
+#ifdef _WIN32
+    DWORD ms = (DWORD)(seconds * 1000);
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, (const char*)&ms, sizeof(ms));
+#else
+    struct timeval tv;
+    tv.tv_sec = (long)seconds;
+    tv.tv_usec = (long)((seconds - tv.tv_sec) * 1e6);
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof(tv));
+#endif
+}
+
+// -------------------------------------------------------------------------
+// Coordinator
+
+Coordinator* coordinatorOpen(int port, int nWorkers, int nUp, int nDown) {
+    return coordinatorOpenCaptured(port, nWorkers, nUp, nDown, NULL);
+}
+
+Coordinator* coordinatorOpenCaptured(int port, int nWorkers, int nUp, int nDown, Capture* capture) {
+    struct sockaddr_in address;
+    Coordinator* c;
+    int connected = 0;
+    int on = 1;
+    int i;
+    if (!startSockets()) return NULL;
+    c = (Coordinator*)calloc(1, sizeof(Coordinator));
+    if (!c) return NULL;
+    c->nWorkers = nWorkers;
+    c->nUp = nUp;
+    c->nDown = nDown;
+    c->workers = (ShardSocket*)malloc(nWorkers * sizeof(ShardSocket));
+    c->received = (ExactSum*)malloc((nUp > 0 ? nUp : 1) * sizeof(ExactSum));
+    c->sums = (ExactSum*)malloc((nUp > 0 ? nUp : 1) * sizeof(ExactSum));
+    c->frame = (char*)malloc(sizeof(int) + nUp * sizeof(ExactSum) + nDown * sizeof(double));
+    c->capture = capture;
+    c->listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (!c->workers || !c->received || !c->sums || !c->frame || c->listener == INVALID_SHARD_SOCKET) {
+        if (c->listener != INVALID_SHARD_SOCKET) closeSocket(c->listener);
+        free(c->workers);
+        free(c->received);
+        free(c->sums);
+        free(c->frame);
+        free(c);
+        return NULL;
+    }
+    for (i=0; i<nWorkers; i++) c->workers[i] = INVALID_SHARD_SOCKET;
+    setsockopt(c->listener, SOL_SOCKET, SO_REUSEADDR, (const char*)&on, sizeof(on));
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons((unsigned short)port);
+    if (bind(c->listener, (struct sockaddr*)&address, sizeof(address))
+            || listen(c->listener, nWorkers)) {
+        logThis(ERROR_ERROR, "Cannot listen on port %d", port);
+        coordinatorClose(c);
+        return NULL;
+    }
+    logThis(ERROR_INFO, "Coordinator waiting for %d workers on port %d", nWorkers, port);
+    while (connected < nWorkers) {
+        Hello hello;
+        ShardSocket s = accept(c->listener, NULL, NULL);
+        if (s == INVALID_SHARD_SOCKET) {
+            coordinatorClose(c);
+            return NULL;
+        }
+        setNoSigPipe(s);
+        setTimeout(s, SHARD_TIMEOUT);
+        if (!receiveAll(s, &hello, sizeof(hello)) || hello.magic != SHARD_MAGIC
+                || hello.shard < 0 || hello.shard >= nWorkers
+                || c->workers[hello.shard] != INVALID_SHARD_SOCKET
+                || hello.nUp != nUp || hello.nDown != nDown) {
+            logThis(ERROR_WARNING, "Rejected worker connection");
+            closeSocket(s);
+            continue;
+        }
+        setNoDelay(s);
+        if (capture) captureFrame(capture, hello.shard, CAPTURE_UP, &hello, sizeof(hello));
+        c->workers[hello.shard] = s;
+        connected++;
+    }
+    return c;
+}
+
+void coordinatorSetTimeout(Coordinator* c, double seconds) {
+    int i;
+    for (i=0; i<c->nWorkers; i++) setTimeout(c->workers[i], seconds);
+}
+
+int coordinatorGather(Coordinator* c, int step, double* up) {
+    int size = sizeof(int) + c->nUp * sizeof(ExactSum);
+    int traced = traceSampled(step);
+    double start = traced ? wallClock() : 0;
+    int i, k;
+    for (k=0; k<c->nUp; k++) exactSumInit(&c->sums[k]);
+    for (i=0; i<c->nWorkers; i++) {
+        int workerStep;
+        if (!receiveAll(c->workers[i], c->frame, size)) {
+            logThis(ERROR_ERROR, "Lost connection to shard %d, or no data for the timeout", i);
+            return 0; // error
+        }
+        if (c->capture) captureFrame(c->capture, i, CAPTURE_UP, c->frame, size);
+        memcpy(&workerStep, c->frame, sizeof(int));
+        memcpy(c->received, c->frame + sizeof(int), c->nUp * sizeof(ExactSum));
+        if (workerStep != step) {
+            logThis(ERROR_ERROR, "Shard %d sent step %d, expected %d", i, workerStep, step);
+            return 0; // error
+        }
+        for (k=0; k<c->nUp; k++) exactSumMerge(&c->sums[k], &c->received[k]);
+    }
+    for (k=0; k<c->nUp; k++) up[k] = exactSumValue(&c->sums[k]);
+    if (traced) traceEvent("shard gather", step, start, wallClock());
+    return 1; // success
+}
+
+int coordinatorScatter(Coordinator* c, int step, const double* down) {
+    int size = sizeof(int) + c->nDown * sizeof(double);
+    int traced = traceSampled(step);
+    double start = traced ? wallClock() : 0;
+    int i;
+    memcpy(c->frame, &step, sizeof(int));
+    memcpy(c->frame + sizeof(int), down, c->nDown * sizeof(double));
+    for (i=0; i<c->nWorkers; i++) {
+        if (!sendAll(c->workers[i], c->frame, size)) {
+            logThis(ERROR_ERROR, "Lost connection to shard %d", i);
+            return 0; // error
+        }
+        if (c->capture) captureFrame(c->capture, i, CAPTURE_DOWN, c->frame, size);
+    }
+    if (traced) traceEvent("shard scatter", step, start, wallClock());
+    return 1; // success
+}
+
+void coordinatorClose(Coordinator* c) {
+    int i;
+    if (!c) return;
+    for (i=0; i<c->nWorkers; i++)
+        if (c->workers[i] != INVALID_SHARD_SOCKET) closeSocket(c->workers[i]);
+    if (c->listener != INVALID_SHARD_SOCKET) closeSocket(c->listener);
+    free(c->workers);
+    free(c->received);
+    free(c->sums);
+    free(c->frame);
+    free(c);
+}
+
+// -------------------------------------------------------------------------
+// Worker
+
+ShardWorker* shardWorkerOpen(const char* ip, int port, int shard, int nUp, int nDown) {
+    struct sockaddr_in address;
+    Hello hello;
+    ShardWorker* w;
+    if (!startSockets()) return NULL;
+    w = (ShardWorker*)calloc(1, sizeof(ShardWorker));
+    if (!w) return NULL;
+    w->shard = shard;
+    w->nUp = nUp;
+    w->nDown = nDown;
+    w->frame = (char*)malloc(sizeof(int) + nUp * sizeof(ExactSum) + nDown * sizeof(double));
+    w->socket = socket(AF_INET, SOCK_STREAM, 0);
+    if (!w->frame || w->socket == INVALID_SHARD_SOCKET) {
+        if (w->socket != INVALID_SHARD_SOCKET) closeSocket(w->socket);
+        free(w->frame);
+        free(w);
+        return NULL;
+    }
+    setNoSigPipe(w->socket);
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = inet_addr(ip);
+    address.sin_port = htons((unsigned short)port);
+    hello.magic = SHARD_MAGIC;
+    hello.shard = shard;
+    hello.nUp = nUp;
+    hello.nDown = nDown;
+    if (connect(w->socket, (struct sockaddr*)&address, sizeof(address))
+            || !sendAll(w->socket, &hello, sizeof(hello))) {
+        logThis(ERROR_ERROR, "Cannot connect to coordinator %s:%d", ip, port);
+        shardWorkerClose(w);
+        return NULL;
+    }
+    setNoDelay(w->socket);
+    setTimeout(w->socket, SHARD_TIMEOUT);
+    return w;
+}
+
+void shardWorkerSetTimeout(ShardWorker* w, double seconds) {
+    setTimeout(w->socket, seconds);
+}
+
+int shardWorkerExchange(ShardWorker* w, int step, ExactSum* up, double* down) {
+    int traced = traceSampled(step);
+    double start = traced ? wallClock() : 0;
+    int coordinatorStep, k;
+    // the same exact sum in the same bytes, whatever was added
+    for (k=0; k<w->nUp; k++) exactSumNormalize(&up[k]);
+    memcpy(w->frame, &step, sizeof(int));
+    memcpy(w->frame + sizeof(int), up, w->nUp * sizeof(ExactSum));
+    if (!sendAll(w->socket, w->frame, sizeof(int) + w->nUp * sizeof(ExactSum))
+            || !receiveAll(w->socket, w->frame, sizeof(int) + w->nDown * sizeof(double))) {
+        logThis(ERROR_ERROR, "Lost connection to coordinator, or no data for the timeout");
+        return 0; // error
+    }
+    memcpy(&coordinatorStep, w->frame, sizeof(int));
+    memcpy(down, w->frame + sizeof(int), w->nDown * sizeof(double));
+    if (coordinatorStep != step) {
+        logThis(ERROR_ERROR, "Coordinator sent step %d, expected %d", coordinatorStep, step);
+        return 0; // error
+    }
+    if (traced) traceEvent("shard exchange", step, start, wallClock());
+    return 1; // success
+}
+
+void shardWorkerClose(ShardWorker* w) {
+    if (!w) return;
+    closeSocket(w->socket);
+    free(w->frame);
+    free(w);
+}
+
+// #define TEST
+#ifdef TEST
+#ifndef _WIN32
+#include <math.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+#define N_UP 2
+#define N_DOWN 2
+
+// Net energy of a home in a step, J: mostly small loads, some large
+// exports, so that the rounding of partial sums shows
+static double homeEnergy(int home, int step) {
+    double scale = home % 7 ? 3.6e3 : -3.6e7;
+    return scale * (1.5 + sin(0.37 * home + 0.11 * step));
+}
+
+// A worker process: connect, retrying until the coordinator listens,
+// then send the sums over its homes and check the answers
+static int runWorker(int port, int shard, int nWorkers, int nHomes, int nSteps) {
+    ShardWorker* w = NULL;
+    ExactSum up[N_UP];
+    double down[N_DOWN];
+    int first, count, step, k, tries;
+    shardRange(nHomes, nWorkers, shard, &first, &count);
+    for (tries=0; !w && tries<200; tries++) {
+        w = shardWorkerOpen("127.0.0.1", port, shard, N_UP, N_DOWN);
+        if (!w) usleep(20000);
+    }
+    if (!w) return 1;
+    for (step=0; step<nSteps; step++) {
+        exactSumInit(&up[0]);
+        exactSumInit(&up[1]);
+        for (k=first; k<first+count; k++) {
+            exactSumAdd(&up[0], homeEnergy(k, step));
+            exactSumAdd(&up[1], fabs(homeEnergy(k, step)));
+        }
+        if (!shardWorkerExchange(w, step, up, down) || down[1] != step) {
+            shardWorkerClose(w);
+            return 1;
+        }
+    }
+    shardWorkerClose(w);
+    return 0;
+}
+
+// Run nSteps with nWorkers forked workers and store the feeder total of
+// each step in total. Returns the mean time per step, or -1 for error.
+static double runShards(int port, int nWorkers, int nHomes, int nSteps, double* total) {
+    pid_t* pids = (pid_t*)malloc(nWorkers * sizeof(pid_t));
+    Coordinator* c;
+    double up[N_UP], down[N_DOWN], start = 0;
+    int i, step, ok = 1, status;
+    fflush(stdout);
+    for (i=0; i<nWorkers; i++) {
+        pids[i] = fork();
+        if (pids[i] == 0) _exit(runWorker(port, i, nWorkers, nHomes, nSteps));
+    }
+    c = coordinatorOpen(port, nWorkers, N_UP, N_DOWN);
+    if (!c) ok = 0;
+    else coordinatorSetTimeout(c, 10);
+    for (step=0; ok && step<nSteps; step++) {
+        if (step == 1) start = wallClock();
+        ok = coordinatorGather(c, step, up);
+        total[step] = up[0];
+        down[0] = up[0];
+        down[1] = step;
+        ok = ok && coordinatorScatter(c, step, down);
+    }
+    start = wallClock() - start;
+    coordinatorClose(c);
+    for (i=0; i<nWorkers; i++) {
+        if (!ok) kill(pids[i], SIGKILL);
+        if (waitpid(pids[i], &status, 0) != pids[i] || !WIFEXITED(status) || WEXITSTATUS(status)) ok = 0;
+    }
+    free(pids);
+    return ok ? start / (nSteps - 1) : -1;
+}
+
+// shard [<port> [<homes> [<steps>]]]: the same homes on 1, 8 and 32
+// worker processes against a coordinator on 127.0.0.1; all totals must
+// be bitwise those of one exact sum over all homes
+int main(int argc, char** argv) {
+    int port = argc > 1 ? atoi(argv[1]) : 47911;
+    int nHomes = argc > 2 ? atoi(argv[2]) : 3000;
+    int nSteps = argc > 3 ? atoi(argv[3]) : 300;
+    int counts[] = { 1, 8, 32 };
+    double* reference = (double*)malloc(nSteps * sizeof(double));
+    double* total = (double*)malloc(nSteps * sizeof(double));
+    double* x = (double*)malloc(nHomes * sizeof(double));
+    int n, step, k, failed = 0;
+    for (step=0; step<nSteps; step++) {
+        for (k=0; k<nHomes; k++) x[k] = homeEnergy(k, step);
+        reference[step] = exactSumOf(x, nHomes);
+    }
+    for (n=0; n<3; n++) {
+        double t;
+        int differ = 0;
+        t = runShards(port + n, counts[n], nHomes, nSteps, total);
+        if (t < 0) {
+            printf("%2d workers: failed\n", counts[n]);
+            failed = 1;
+            continue;
+        }
+        for (step=0; step<nSteps; step++)
+            if (memcmp(&total[step], &reference[step], sizeof(double))) differ++;
+        printf("%2d workers: %.1f us per step, %d of %d totals differ from the exact sum\n",
+               counts[n], 1e6 * t, differ, nSteps);
+        if (differ) failed = 1;
+    }
+    free(reference);
+    free(total);
+    free(x);
+    return failed;
+}
+#endif // _WIN32
+#endif // TEST
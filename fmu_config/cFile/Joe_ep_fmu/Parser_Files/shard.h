@@ -0,0 +1,115 @@
+/* -------------------------------------------------------------------------
+ * shard.h
+ * Distribution of homes over several nodes. The homes are split into
+ * contiguous shards, one per worker node. Each worker node runs its homes
+ * locally and, once per timestep, sends only a short vector of sums
+ * (e.g. per-feeder sums of epSendNetEnergy and controller inputs) to a
+ * coordinator. The sums are exact, see exactSum.h, and travel unrounded,
+ * so the totals of the coordinator are bitwise the same for any number
+ * of shards. The coordinator sends back one vector of doubles (e.g.
+ * prices or controller decisions) to all workers.
+ * Messages are exchanged over TCP in host byte order, so all nodes must
+ * share the same architecture. Each message is sent as one frame, the
+ * step followed by the values. A node that receives nothing for
+ * SHARD_TIMEOUT seconds, e.g. because its peer hangs, gives up, as does
+ * a node whose peer closed the connection or crashed.
+ * If tracing is on (see trace.h), each gather, scatter and exchange is
+ * recorded as a trace event with the step as id.
+ * -------------------------------------------------------------------------*/
+
+#ifndef SHARD_H
+#define SHARD_H
+
+#include "exactSum.h"
+#include "capture.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+typedef SOCKET ShardSocket;
+#else
+typedef int ShardSocket;
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Default receive timeout, seconds, see coordinatorSetTimeout
+#define SHARD_TIMEOUT 60
+
+// Homes first, ..., first+count-1 belong to the given shard.
+// Shard sizes differ by at most one home.
+void shardRange(int nHomes, int nShards, int shard, int* first, int* count);
+
+// Write or read the file ipconfig.txt that tells Joe_ep_fmu
+// the address of the socket to connect to.
+// Return 1 to indicate success and 0 for error.
+int writeIpConfig(const char* path, const char* ip, int port);
+int readIpConfig(const char* path, char* ip, int ipSize, int* port);
+
+typedef struct {
+    ShardSocket listener;
+    ShardSocket* workers;   // connection of each shard, indexed by shard number
+    int nWorkers;
+    int nUp;                // sums sent by each worker per step
+    int nDown;              // values sent to the workers per step
+    ExactSum* received;     // nUp sums received from one worker
+    ExactSum* sums;         // nUp sums over the workers
+    char* frame;            // step and sums or values of one message
+    Capture* capture;       // NULL, or frames of all workers, see capture.h
+} Coordinator;
+
+typedef struct {
+    ShardSocket socket;
+    int shard;
+    int nUp;
+    int nDown;
+    char* frame;            // step and sums or values of one message
+} ShardWorker;
+
+// Listen on the given port and wait until all nWorkers workers connected.
+// Returns NULL to indicate failure.
+Coordinator* coordinatorOpen(int port, int nWorkers, int nUp, int nDown);
+
+// Like coordinatorOpen, and if capture is not NULL, all frames received
+// from and sent to the workers, including their first message, are
+// captured with the shard number as connection, for replayCapture.
+// The capture stays owned by the caller and must outlive the coordinator.
+Coordinator* coordinatorOpenCaptured(int port, int nWorkers, int nUp, int nDown, Capture* capture);
+
+// Wait at most the given seconds, 0 for ever, for each message of a
+// worker, before coordinatorGather fails. SHARD_TIMEOUT by default.
+void coordinatorSetTimeout(Coordinator* c, double seconds);
+
+// Receive the sums of all workers for the given step, merge them
+// element-wise and store the totals, rounded once, in up. The totals
+// depend only on the values the workers added, not on how the homes
+// are split into shards nor on the order in which the workers report.
+// Returns 1 to indicate success and 0 for error.
+int coordinatorGather(Coordinator* c, int step, double* up);
+
+// Send the same nDown values to all workers.
+// Returns 1 to indicate success and 0 for error.
+int coordinatorScatter(Coordinator* c, int step, const double* down);
+
+void coordinatorClose(Coordinator* c);
+
+// Connect to the coordinator. Returns NULL to indicate failure.
+ShardWorker* shardWorkerOpen(const char* ip, int port, int shard, int nUp, int nDown);
+
+// Wait at most the given seconds, 0 for ever, for the answer of the
+// coordinator. SHARD_TIMEOUT by default.
+void shardWorkerSetTimeout(ShardWorker* w, double seconds);
+
+// Send the nUp exact sums of the given step over the homes of this
+// worker, then wait for the nDown values the coordinator sends back for
+// this step. The sums are normalized in place.
+// Returns 1 to indicate success and 0 for error.
+int shardWorkerExchange(ShardWorker* w, int step, ExactSum* up, double* down);
+
+void shardWorkerClose(ShardWorker* w);
+
+#ifdef __cplusplus
+} // closing brace for extern "C"
+#endif
+#endif // SHARD_H
@@ -0,0 +1,110 @@
+/* -------------------------------------------------------------------------
+ * sharedLib.c
+ * Loading and private copies of shared libraries.
+ * -------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef STANDALONE_XML_PARSER
+#define logThis(n, ...) printf(__VA_ARGS__);printf("\n")
+#else
+#include "GlobalIncludes.h"
+#include "logging.h" // logThis
+#endif // STANDALONE_XML_PARSER
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#include <unistd.h>
+#endif
+
+#include "sharedLib.h"
+
+#define PATH_SIZE 1024
+
+void* openSharedLib(const char* path) {
+    void* handle;
+#ifdef _WIN32
+    handle = (void*)LoadLibraryA(path);
+    if (!handle) {
+        logThis(ERROR_ERROR, "Cannot load '%s': error %lu", path, GetLastError());
+    }
+#else
+    handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        logThis(ERROR_ERROR, "Cannot load '%s': %s", path, dlerror());
+    }
+#endif
+    return handle;
+}
+
+void* sharedLibSymbol(void* handle, const char* name) {
+#ifdef _WIN32
+    return (void*)GetProcAddress((HMODULE)handle, name);
+#else
+    return dlsym(handle, name);
+#endif
+}
+
+void closeSharedLib(void* handle) {
+    if (!handle) return;
+#ifdef _WIN32
+    FreeLibrary((HMODULE)handle);
+#else
+    dlclose(handle);
+#endif
+}
+
+// Copy file from to file to. Returns 1 to indicate success and 0 for error.
+static int copyFile(const char* from, const char* to) {
+    char buffer[65536];
+    size_t n;
+    int ok = 1;
+    FILE* in = fopen(from, "rb");
+    FILE* out;
+    if (!in) return 0; // error
+    out = fopen(to, "wb");
+    if (!out) {
+        fclose(in);
+        return 0; // error
+    }
+    while (ok && (n = fread(buffer, 1, sizeof(buffer), in)) > 0)
+        ok = fwrite(buffer, 1, n, out) == n;
+    if (ferror(in)) ok = 0;
+    fclose(in);
+    if (fclose(out)) ok = 0;
+    return ok;
+}
+
+char* copySharedLib(const char* path, const char* copyDir, const char* prefix, const char* suffix) {
+    static volatile long nCopies = 0;
+    char copyPath[PATH_SIZE];
+    char* result;
+    long copy;
+#ifdef _WIN32
+    copy = InterlockedIncrement(&nCopies);
+    snprintf(copyPath, sizeof(copyPath), "%s/%s_%lu_%ld%s",
+             copyDir, prefix, GetCurrentProcessId(), copy, suffix);
+#else
+    copy = __sync_add_and_fetch(&nCopies, 1);
+    snprintf(copyPath, sizeof(copyPath), "%s/%s_%d_%ld%s",
+             copyDir, prefix, (int)getpid(), copy, suffix);
+#endif
+    if (!copyFile(path, copyPath)) {
+        logThis(ERROR_ERROR, "Cannot copy '%s' to '%s'", path, copyPath);
+        remove(copyPath);
+        return NULL;
+    }
+    result = strdup(copyPath);
+    if (!result) remove(copyPath);
+    return result;
+}
+
+void removeSharedLibCopy(char* copyPath) {
+    if (!copyPath) return;
+    remove(copyPath);
+    free(copyPath);
+}
@@ -0,0 +1,44 @@
+/* -------------------------------------------------------------------------
+ * sharedLib.h
+ * Loading of shared libraries, e.g. FMU binaries and controller plugins:
+ * dlopen on POSIX, LoadLibrary on Windows. A library may be loaded from
+ * a private copy, so that a process gets a fresh instance of its globals,
+ * or so that the original can be replaced while the copy is loaded.
+ * -------------------------------------------------------------------------*/
+
+#ifndef SHARED_LIB_H
+#define SHARED_LIB_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(_WIN32)
+#define SHARED_LIB_SUFFIX ".dll"
+#elif defined(__APPLE__)
+#define SHARED_LIB_SUFFIX ".dylib"
+#else
+#define SHARED_LIB_SUFFIX ".so"
+#endif
+
+// Load the library at path, resolving all symbols now and keeping them
+// local to the library. Returns NULL to indicate failure.
+void* openSharedLib(const char* path);
+
+// Address of the named symbol in the library, or NULL
+void* sharedLibSymbol(void* handle, const char* name);
+
+void closeSharedLib(void* handle);
+
+// Copy the library at path to copyDir/<prefix>_<process>_<n><suffix>,
+// with n counting the copies of this process.
+// Returns the path of the copy, which the receiver must free, e.g. with
+// removeSharedLibCopy, or NULL to indicate failure.
+char* copySharedLib(const char* path, const char* copyDir, const char* prefix, const char* suffix);
+
+// Delete the copy, after its library is closed, and free the path
+void removeSharedLibCopy(char* copyPath);
+
+#ifdef __cplusplus
+} // closing brace for extern "C"
+#endif
+#endif // SHARED_LIB_H
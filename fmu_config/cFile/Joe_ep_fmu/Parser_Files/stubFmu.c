@@ -0,0 +1,181 @@
+/* -------------------------------------------------------------------------
+ * stubFmu.c
+ * A stand-in for the shared library of Joe_ep_fmu, for the tests of
+ * fmuImport.c: FMI 1.0 co-simulation functions with the same model
+ * identifier and value references, without EnergyPlus and sockets.
+ * The zone temperature follows the heating and cooling decisions.
+ * Like Joe_ep_fmu, it can be instantiated only once per loaded library,
+ * and it keeps its model state in globals.
+ * Build, e.g. on Linux:
+ *     gcc -shared -fPIC -o Joe_ep_fmu.so stubFmu.c
+ *     gcc -shared -fPIC -DSTUB_NO_DO_STEP -o noDoStep.so stubFmu.c
+ * the second without fmiDoStep, which loadFmu must reject.
+ * -------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+
+#include "fmuImport.h"
+
+#ifdef _WIN32
+#define DLL_EXPORT __declspec(dllexport)
+#else
+#define DLL_EXPORT
+#endif
+
+// value references of modelDescription.xml of Joe_ep_fmu
+#define VR_NET_ENERGY       1
+#define VR_ZONE_TEMP        2
+#define VR_OUTDOOR_TEMP     3
+#define VR_HEATING_SETPOINT 9
+#define VR_COOLING_SETPOINT 10
+#define VR_START_HEATING    11
+#define VR_START_COOLING    12
+#define N_VR                13
+
+static int instantiated = 0;
+
+typedef struct {
+    double r[N_VR];
+    fmiCallbackFunctions functions;
+} Stub;
+
+DLL_EXPORT const char* Joe_ep_fmu_fmiGetTypesPlatform(void) {
+    return "standard32";
+}
+
+DLL_EXPORT const char* Joe_ep_fmu_fmiGetVersion(void) {
+    return "1.0";
+}
+
+DLL_EXPORT fmiStatus Joe_ep_fmu_fmiSetDebugLogging(fmiComponent c, fmiBoolean loggingOn) {
+    (void)c;
+    (void)loggingOn;
+    return fmiOK;
+}
+
+DLL_EXPORT fmiStatus Joe_ep_fmu_fmiSetReal(fmiComponent c, const fmiValueReference vr[], size_t nvr,
+                                           const fmiReal value[]) {
+    Stub* s = (Stub*)c;
+    size_t i;
+    for (i=0; i<nvr; i++) {
+        if (vr[i] >= N_VR) return fmiError;
+        s->r[vr[i]] = value[i];
+    }
+    return fmiOK;
+}
+
+DLL_EXPORT fmiStatus Joe_ep_fmu_fmiGetReal(fmiComponent c, const fmiValueReference vr[], size_t nvr,
+                                           fmiReal value[]) {
+    Stub* s = (Stub*)c;
+    size_t i;
+    for (i=0; i<nvr; i++) {
+        if (vr[i] >= N_VR) return fmiError;
+        value[i] = s->r[vr[i]];
+    }
+    return fmiOK;
+}
+
+// The model has no integer, boolean or string variables
+DLL_EXPORT fmiStatus Joe_ep_fmu_fmiSetInteger(fmiComponent c, const fmiValueReference vr[], size_t nvr,
+                                              const fmiInteger value[]) {
+    (void)c; (void)vr; (void)value;
+    return nvr ? fmiError : fmiOK;
+}
+
+DLL_EXPORT fmiStatus Joe_ep_fmu_fmiSetBoolean(fmiComponent c, const fmiValueReference vr[], size_t nvr,
+                                              const fmiBoolean value[]) {
+    (void)c; (void)vr; (void)value;
+    return nvr ? fmiError : fmiOK;
+}
+
+DLL_EXPORT fmiStatus Joe_ep_fmu_fmiSetString(fmiComponent c, const fmiValueReference vr[], size_t nvr,
+                                             const fmiString value[]) {
+    (void)c; (void)vr; (void)value;
+    return nvr ? fmiError : fmiOK;
+}
+
+DLL_EXPORT fmiStatus Joe_ep_fmu_fmiGetInteger(fmiComponent c, const fmiValueReference vr[], size_t nvr,
+                                              fmiInteger value[]) {
+    (void)c; (void)vr; (void)value;
+    return nvr ? fmiError : fmiOK;
+}
+
+DLL_EXPORT fmiStatus Joe_ep_fmu_fmiGetBoolean(fmiComponent c, const fmiValueReference vr[], size_t nvr,
+                                              fmiBoolean value[]) {
+    (void)c; (void)vr; (void)value;
+    return nvr ? fmiError : fmiOK;
+}
+
+DLL_EXPORT fmiStatus Joe_ep_fmu_fmiGetString(fmiComponent c, const fmiValueReference vr[], size_t nvr,
+                                             fmiString value[]) {
+    (void)c; (void)vr; (void)value;
+    return nvr ? fmiError : fmiOK;
+}
+
+DLL_EXPORT fmiComponent Joe_ep_fmu_fmiInstantiateSlave(fmiString instanceName, fmiString fmuGUID,
+        fmiString fmuLocation, fmiString mimeType, fmiReal timeout, fmiBoolean visible,
+        fmiBoolean interactive, fmiCallbackFunctions functions, fmiBoolean loggingOn) {
+    Stub* s;
+    (void)mimeType; (void)timeout; (void)visible; (void)interactive; (void)loggingOn;
+    if (instantiated) {
+        functions.logger(NULL, instanceName, fmiError, "error",
+                         "can be instantiated only once per process");
+        return NULL;
+    }
+    s = (Stub*)functions.allocateMemory(1, sizeof(Stub));
+    if (!s) return NULL;
+    s->functions = functions;
+    s->r[VR_ZONE_TEMP] = 20;
+    instantiated = 1;
+    functions.logger(s, instanceName, fmiOK, "log", "instantiated, guid %s, location %s",
+                     fmuGUID, fmuLocation);
+    return s;
+}
+
+DLL_EXPORT fmiStatus Joe_ep_fmu_fmiInitializeSlave(fmiComponent c, fmiReal tStart, fmiBoolean stopTimeDefined,
+                                                   fmiReal tStop) {
+    (void)c; (void)tStart; (void)stopTimeDefined; (void)tStop;
+    return fmiOK;
+}
+
+DLL_EXPORT fmiStatus Joe_ep_fmu_fmiTerminateSlave(fmiComponent c) {
+    (void)c;
+    return fmiOK;
+}
+
+DLL_EXPORT fmiStatus Joe_ep_fmu_fmiResetSlave(fmiComponent c) {
+    (void)c;
+    return fmiOK;
+}
+
+DLL_EXPORT void Joe_ep_fmu_fmiFreeSlaveInstance(fmiComponent c) {
+    Stub* s = (Stub*)c;
+    s->functions.freeMemory(s);
+    instantiated = 0;
+}
+
+#ifndef STUB_NO_DO_STEP
+// model state in globals, 512 KB like the tables of a building model
+#define MODEL_SIZE (1 << 16)
+static double model[MODEL_SIZE];
+
+// Decide on heating and cooling from the zone temperature, then let the
+// zone drift towards the outdoor temperature, and heat or cool it
+DLL_EXPORT fmiStatus Joe_ep_fmu_fmiDoStep(fmiComponent c, fmiReal currentCommunicationPoint,
+                                          fmiReal communicationStepSize, fmiBoolean newStep) {
+    Stub* s = (Stub*)c;
+    double* r = s->r;
+    double hours = communicationStepSize / 3600;
+    int i;
+    (void)currentCommunicationPoint;
+    (void)newStep;
+    r[VR_START_HEATING] = r[VR_ZONE_TEMP] < r[VR_HEATING_SETPOINT];
+    r[VR_START_COOLING] = r[VR_ZONE_TEMP] > r[VR_COOLING_SETPOINT];
+    r[VR_ZONE_TEMP] += 0.1 * hours * (r[VR_OUTDOOR_TEMP] - r[VR_ZONE_TEMP])
+                     + 2 * hours * (r[VR_START_HEATING] - r[VR_START_COOLING]);
+    r[VR_NET_ENERGY] = 3.6e6 * hours * (r[VR_START_HEATING] + r[VR_START_COOLING]);
+    // touch the model state, one cache line per page
+    for (i=0; i<MODEL_SIZE; i+=512) model[i] += communicationStepSize;
+    return fmiOK;
+}
+#endif // STUB_NO_DO_STEP
@@ -0,0 +1,340 @@
+/* -------------------------------------------------------------------------
+ * surrogate.c
+ * ARX surrogate models of homes, fitted by least squares.
+ * -------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef STANDALONE_XML_PARSER
+#define logThis(n, ...) printf(__VA_ARGS__);printf("\n")
+#else
+#include "GlobalIncludes.h"
+#include "logging.h" // logThis
+#endif // STANDALONE_XML_PARSER
+
+#include "surrogate.h"
+
+#define THETA(b, o, f, h) ((b)->theta[((size_t)(o) * (b)->nFeatures + (f)) * (b)->nHomes + (h)])
+
+SurrogateBank* newSurrogateBank(int nHomes, char** outputs, int nOutputs, char** inputs, int nInputs) {
+    SurrogateBank* b = (SurrogateBank*)calloc(1, sizeof(SurrogateBank));
+    int i;
+    if (!b) return NULL;
+    b->nHomes = nHomes;
+    b->nOutputs = nOutputs;
+    b->nInputs = nInputs;
+    b->nFeatures = nOutputs + nInputs + 1;
+    b->names = (char**)calloc(nOutputs + nInputs, sizeof(char*));
+    b->theta = (double*)calloc((size_t)nOutputs * b->nFeatures * nHomes, sizeof(double));
+    b->rmse = (double*)malloc((size_t)nOutputs * nHomes * sizeof(double));
+    if (!b->names || !b->theta || !b->rmse) {
+        freeSurrogateBank(b);
+        return NULL;
+    }
+    for (i=0; i<nOutputs + nInputs; i++) {
+        b->names[i] = strdup(i < nOutputs ? outputs[i] : inputs[i - nOutputs]);
+        if (!b->names[i]) {
+            freeSurrogateBank(b);
+            return NULL;
+        }
+    }
+    for (i=0; i<nOutputs * nHomes; i++) b->rmse[i] = -1;
+    return b;
+}
+
+void freeSurrogateBank(SurrogateBank* b) {
+    int i;
+    if (!b) return;
+    if (b->names)
+        for (i=0; i<b->nOutputs + b->nInputs; i++) free(b->names[i]);
+    free(b->names);
+    free(b->theta);
+    free(b->rmse);
+    free(b);
+}
+
+// Returns 0 if a variable of the bank is not a column of r
+static int findColumns(SurrogateBank* b, Recording* r, int* columns) {
+    int i;
+    for (i=0; i<b->nOutputs + b->nInputs; i++) {
+        columns[i] = getRecordingColumn(r, b->names[i]);
+        if (columns[i] < 0) {
+            logThis(ERROR_ERROR, "Variable %s is not recorded", b->names[i]);
+            return 0; // error
+        }
+    }
+    return 1; // success
+}
+
+// Features that predict the outputs of row k+1: the outputs of row k,
+// the inputs of row k+1, which were set before that step, and 1
+static void features(Recording* r, int k, const int* columns, int nO, int nF, double* phi) {
+    int i;
+    for (i=0; i<nO; i++) phi[i] = recordedValue(r, k, columns[i]);
+    for (i=nO; i<nF-1; i++) phi[i] = recordedValue(r, k+1, columns[i]);
+    phi[nF-1] = 1;
+}
+
+// Cholesky factorization of the symmetric n x n matrix a, in place.
+// Returns 0 if a is not positive definite.
+static int cholesky(double* a, int n) {
+    int i, j, k;
+    for (j=0; j<n; j++) {
+        double d = a[j*n+j];
+        for (k=0; k<j; k++) d -= a[j*n+k] * a[j*n+k];
+        if (d <= 0) return 0; // error
+        a[j*n+j] = sqrt(d);
+        for (i=j+1; i<n; i++) {
+            double s = a[i*n+j];
+            for (k=0; k<j; k++) s -= a[i*n+k] * a[j*n+k];
+            a[i*n+j] = s / a[j*n+j];
+        }
+    }
+    return 1; // success
+}
+
+// Solve L L' x = y for x, in place
+static void choleskySolve(const double* l, int n, double* x) {
+    int i, k;
+    for (i=0; i<n; i++) {
+        for (k=0; k<i; k++) x[i] -= l[i*n+k] * x[k];
+        x[i] /= l[i*n+i];
+    }
+    for (i=n-1; i>=0; i--) {
+        for (k=i+1; k<n; k++) x[i] -= l[k*n+i] * x[k];
+        x[i] /= l[i*n+i];
+    }
+}
+
+int fitSurrogate(SurrogateBank* b, int home, Recording* r, double ridge) {
+    int nF = b->nFeatures, nO = b->nOutputs;
+    int* columns = (int*)malloc((nO + b->nInputs) * sizeof(int));
+    double* xtx = (double*)calloc(nF * nF, sizeof(double));
+    double* xty = (double*)calloc(nF * nO, sizeof(double));
+    double* scale = (double*)calloc(nF, sizeof(double));
+    double* phi = (double*)malloc(nF * sizeof(double));
+    double* x = (double*)malloc(nF * sizeof(double));
+    double trace = 0;
+    int i, j, o, k, ok = 0;
+
+    if (!columns || !xtx || !xty || !scale || !phi || !x) goto done;
+    if (!findColumns(b, r, columns)) goto done;
+    if (r->nSteps - 1 < nF) {
+        logThis(ERROR_ERROR, "Recording of home %d has %d steps, too few to fit %d coefficients",
+                home, r->nSteps, nF);
+        goto done;
+    }
+
+    // scale the features to a root mean square of 1, so that the normal
+    // equations stay well conditioned, e.g. for energies in J and temperatures
+    for (k=0; k<r->nSteps-1; k++) {
+        features(r, k, columns, nO, nF, phi);
+        for (i=0; i<nF; i++) scale[i] += phi[i] * phi[i];
+    }
+    for (i=0; i<nF; i++) {
+        scale[i] = sqrt(scale[i] / (r->nSteps - 1));
+        if (scale[i] == 0) scale[i] = 1;
+    }
+
+    // normal equations X'X theta = X'Y in one pass over the recording
+    for (k=0; k<r->nSteps-1; k++) {
+        features(r, k, columns, nO, nF, phi);
+        for (i=0; i<nF; i++) phi[i] /= scale[i];
+        for (i=0; i<nF; i++) {
+            for (j=0; j<=i; j++) xtx[i*nF+j] += phi[i] * phi[j];
+            for (o=0; o<nO; o++) xty[o*nF+i] += phi[i] * recordedValue(r, k+1, columns[o]);
+        }
+    }
+    for (i=0; i<nF; i++) {
+        for (j=0; j<i; j++) xtx[j*nF+i] = xtx[i*nF+j];
+        trace += xtx[i*nF+i];
+    }
+    for (i=0; i<nF; i++) xtx[i*nF+i] += ridge * trace / nF;
+    if (!cholesky(xtx, nF)) {
+        logThis(ERROR_ERROR, "Cannot fit surrogate of home %d, increase ridge", home);
+        goto done;
+    }
+    for (o=0; o<nO; o++) {
+        memcpy(x, &xty[o*nF], nF * sizeof(double));
+        choleskySolve(xtx, nF, x);
+        for (i=0; i<nF; i++) THETA(b, o, i, home) = x[i] / scale[i];
+    }
+
+    // one step training error
+    for (o=0; o<nO; o++) {
+        double sum = 0;
+        for (k=0; k<r->nSteps-1; k++) {
+            double y = 0;
+            features(r, k, columns, nO, nF, phi);
+            for (i=0; i<nF; i++) y += THETA(b, o, i, home) * phi[i];
+            y -= recordedValue(r, k+1, columns[o]);
+            sum += y * y;
+        }
+        b->rmse[o * b->nHomes + home] = sqrt(sum / (r->nSteps - 1));
+    }
+    ok = 1;
+done:
+    free(columns);
+    free(xtx);
+    free(xty);
+    free(scale);
+    free(phi);
+    free(x);
+    return ok;
+}
+
+void predictSurrogates(SurrogateBank* b, int nCandidates, int horizon,
+                       const double* state, const double* inputs, double* outputs) {
+    int nO = b->nOutputs, nI = b->nInputs, nH = b->nHomes;
+    size_t lanes = (size_t)nH * nCandidates;
+    int step, o, h, i, c;
+    for (step=0; step<horizon; step++) {
+        const double* prev = outputs + (size_t)(step-1) * nO * lanes;
+        const double* u = inputs + (size_t)step * nI * lanes;
+        for (o=0; o<nO; o++) {
+            double* y = outputs + ((size_t)step * nO + o) * lanes;
+            for (h=0; h<nH; h++) {
+                double* yh = y + (size_t)h * nCandidates;
+                double bias = THETA(b, o, nO + nI, h);
+                for (c=0; c<nCandidates; c++) yh[c] = bias;
+                for (i=0; i<nO; i++) {
+                    double a = THETA(b, o, i, h);
+                    if (step == 0) {
+                        double y0 = a * state[(size_t)i * nH + h];
+                        for (c=0; c<nCandidates; c++) yh[c] += y0;
+                    } else {
+                        const double* yp = prev + i * lanes + (size_t)h * nCandidates;
+                        for (c=0; c<nCandidates; c++) yh[c] += a * yp[c];
+                    }
+                }
+                for (i=0; i<nI; i++) {
+                    double a = THETA(b, o, nO + i, h);
+                    const double* ui = u + i * lanes + (size_t)h * nCandidates;
+                    for (c=0; c<nCandidates; c++) yh[c] += a * ui[c];
+                }
+            }
+        }
+    }
+}
+
+SurrogateHome* newSurrogateHome(SurrogateBank* b, int home, const double* state) {
+    SurrogateHome* h = (SurrogateHome*)calloc(1, sizeof(SurrogateHome));
+    if (!h) return NULL;
+    h->bank = b;
+    h->home = home;
+    h->y = (double*)malloc((b->nOutputs + 1) * sizeof(double));
+    h->u = (double*)calloc(b->nInputs + 1, sizeof(double));
+    h->next = (double*)malloc((b->nOutputs + 1) * sizeof(double));
+    if (!h->y || !h->u || !h->next) {
+        freeSurrogateHome(h);
+        return NULL;
+    }
+    memcpy(h->y, state, b->nOutputs * sizeof(double));
+    return h;
+}
+
+void freeSurrogateHome(SurrogateHome* h) {
+    if (!h) return;
+    free(h->y);
+    free(h->u);
+    free(h->next);
+    free(h);
+}
+
+// Only inputs can be set
+static int setSurrogateReal(void* instance, const fmiValueReference* vrs, int n, const double* values) {
+    SurrogateHome* h = (SurrogateHome*)instance;
+    int i, nO = h->bank->nOutputs;
+    for (i=0; i<n; i++) {
+        if (vrs[i] < (fmiValueReference)nO || vrs[i] >= (fmiValueReference)(nO + h->bank->nInputs))
+            return 0; // error
+        h->u[vrs[i] - nO] = values[i];
+    }
+    return 1; // success
+}
+
+// One step, summed in the order of predictSurrogates, so that both give
+// the same values
+static int doSurrogateStep(void* instance, double time, double stepSize) {
+    SurrogateHome* h = (SurrogateHome*)instance;
+    SurrogateBank* b = h->bank;
+    int nO = b->nOutputs, nI = b->nInputs;
+    double* y = h->next;
+    int o, i;
+    (void)time;
+    (void)stepSize;
+    for (o=0; o<nO; o++) {
+        y[o] = THETA(b, o, nO + nI, h->home);
+        for (i=0; i<nO; i++) y[o] += THETA(b, o, i, h->home) * h->y[i];
+        for (i=0; i<nI; i++) y[o] += THETA(b, o, nO + i, h->home) * h->u[i];
+    }
+    memcpy(h->y, y, nO * sizeof(double));
+    return 1; // success
+}
+
+static int getSurrogateReal(void* instance, const fmiValueReference* vrs, int n, double* values) {
+    SurrogateHome* h = (SurrogateHome*)instance;
+    int i, nO = h->bank->nOutputs;
+    for (i=0; i<n; i++) {
+        if (vrs[i] >= (fmiValueReference)(nO + h->bank->nInputs)) return 0; // error
+        values[i] = vrs[i] < (fmiValueReference)nO ? h->y[vrs[i]] : h->u[vrs[i] - nO];
+    }
+    return 1; // success
+}
+
+void initSurrogateReplayTarget(ReplayTarget* target, SurrogateHome* h) {
+    target->instance = h;
+    target->setReal = setSurrogateReal;
+    target->doStep = doSurrogateStep;
+    target->getReal = getSurrogateReal;
+    target->forkSafe = 1;
+}
+
+int checkSurrogate(SurrogateBank* b, int home, Recording* r, int horizon, double* rmse) {
+    int nF = b->nFeatures, nO = b->nOutputs;
+    int* columns;
+    double* phi;
+    double* y;
+    int i, o, k, s, n = 0, ok = 0;
+
+    // without a predicted step, y would be compared uninitialized
+    if (horizon < 1) {
+        logThis(ERROR_ERROR, "Cannot check surrogate of home %d with horizon %d, need at least 1", home, horizon);
+        return 0; // error
+    }
+    columns = (int*)malloc((nO + b->nInputs) * sizeof(int));
+    phi = (double*)malloc(nF * sizeof(double));
+    y = (double*)malloc(nO * sizeof(double));
+    if (!columns || !phi || !y) goto done;
+    if (!findColumns(b, r, columns)) goto done;
+    for (o=0; o<nO; o++) rmse[o] = 0;
+    for (k=0; k+horizon<r->nSteps; k++) {
+        features(r, k, columns, nO, nF, phi);
+        for (s=0; s<horizon; s++) {
+            for (o=0; o<nO; o++) {
+                y[o] = 0;
+                for (i=0; i<nF; i++) y[o] += THETA(b, o, i, home) * phi[i];
+            }
+            // next step: predicted outputs, recorded inputs
+            if (s + 1 < horizon) {
+                features(r, k+s+1, columns, nO, nF, phi);
+                memcpy(phi, y, nO * sizeof(double));
+            }
+        }
+        for (o=0; o<nO; o++) {
+            double e = y[o] - recordedValue(r, k+horizon, columns[o]);
+            rmse[o] += e * e;
+        }
+        n++;
+    }
+    for (o=0; o<nO; o++) rmse[o] = n ? sqrt(rmse[o] / n) : 0;
+    ok = n > 0;
+done:
+    free(columns);
+    free(phi);
+    free(y);
+    return ok;
+}
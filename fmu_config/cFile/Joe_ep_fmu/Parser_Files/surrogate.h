@@ -0,0 +1,85 @@
+/* -------------------------------------------------------------------------
+ * surrogate.h
+ * Fast surrogate models of homes for lookahead control, e.g. to predict
+ * epSendZoneMeanAirTemp and epSendNetEnergy under candidate setpoints.
+ * Each home gets a first order ARX model fitted by least squares on its
+ * recording:
+ *     y(k+1) = A y(k) + B u(k+1) + c
+ * with outputs y (e.g. zone temperature, net energy) and inputs u (e.g.
+ * outdoor temperature, solar radiation, heating and cooling setpoints).
+ * As in the recording, u(k+1) is set before the step that yields y(k+1),
+ * so a setpoint acts on the step it is set for.
+ * A first order ARX model in the zone temperature is the discrete form
+ * of a lumped RC model. The models of all homes share one column layout,
+ * and their coefficients are stored home by home, so that all homes and
+ * candidates are predicted together in vectorizable loops.
+ * -------------------------------------------------------------------------*/
+
+#ifndef SURROGATE_H
+#define SURROGATE_H
+
+#include "recorder.h"
+#include "replay.h" // ReplayTarget
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    int nHomes;
+    int nOutputs;
+    int nInputs;
+    int nFeatures;          // nOutputs + nInputs + 1
+    char** names;           // nOutputs output names, then nInputs input names
+    double* theta;          // coefficients [output][feature][home]; features are y, u, 1
+    double* rmse;           // one step training error [output][home], negative if not fitted
+} SurrogateBank;
+
+// Returns a bank of nHomes models with the given output and input
+// variables, or NULL if no memory is available.
+SurrogateBank* newSurrogateBank(int nHomes, char** outputs, int nOutputs, char** inputs, int nInputs);
+void freeSurrogateBank(SurrogateBank* b);
+
+// Fit the model of the given home to recording r by least squares, with
+// a ridge term of relative size ridge, e.g. 1e-8, for badly excited inputs.
+// Returns 1 to indicate success and 0 for error, e.g. a missing column.
+int fitSurrogate(SurrogateBank* b, int home, Recording* r, double ridge);
+
+// Predict horizon steps for all homes and nCandidates input sequences each.
+// A lane is one candidate of one home, lane = home * nCandidates + candidate.
+//   state    [output][home]            y at the start
+//   inputs   [step][input][lane]       u set before each step
+//   outputs  [step][output][lane]      y after each step
+void predictSurrogates(SurrogateBank* b, int nCandidates, int horizon,
+                       const double* state, const double* inputs, double* outputs);
+
+// Check the model of the given home against recording r, e.g. recorded
+// while replaying the real FMU: from each step, predict horizon steps
+// with the recorded inputs. rmse receives the root mean square error of
+// the horizon step prediction of each output.
+// Returns 1 to indicate success and 0 for error, e.g. horizon < 1.
+int checkSurrogate(SurrogateBank* b, int home, Recording* r, int horizon, double* rmse);
+
+// One home of a bank, stepped like an FMU instance. The value reference
+// of a variable is its index in names: outputs first, then inputs.
+typedef struct {
+    SurrogateBank* bank;
+    int home;
+    double* y;              // nOutputs outputs after the last step
+    double* u;              // nInputs inputs for the next step
+    double* next;           // scratch space of a step, so that steps do not allocate
+} SurrogateHome;
+
+// Returns the given home of b with the outputs state, e.g. measured, and
+// all inputs 0, or NULL if no memory is available. b must outlive it.
+SurrogateHome* newSurrogateHome(SurrogateBank* b, int home, const double* state);
+void freeSurrogateHome(SurrogateHome* h);
+
+// Drive h through target, e.g. for replay or runWhatIf. The target is
+// forkSafe: h is plain memory of this process.
+void initSurrogateReplayTarget(ReplayTarget* target, SurrogateHome* h);
+
+#ifdef __cplusplus
+} // closing brace for extern "C"
+#endif
+#endif // SURROGATE_H
@@ -0,0 +1,442 @@
+/* -------------------------------------------------------------------------
+ * tariff.c
+ * Compilation of price schedules into a time-indexed binary table, and
+ * O(1) lookup in the table mapped read-only.
+ * -------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef STANDALONE_XML_PARSER
+#define logThis(n, ...) printf(__VA_ARGS__);printf("\n")
+#else
+#include "GlobalIncludes.h"
+#include "logging.h" // logThis
+#endif // STANDALONE_XML_PARSER
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "tariff.h"
+
+#define TARIFF_MAX_RULES 32
+#define PRICES_ALIGNMENT 64
+
+// -------------------------------------------------------------------------
+// Compilation
+
+// Price on days fromDay to toDay, 1 = Monday, from fromSecond to
+// toSecond of the day; if toSecond < fromSecond, to toSecond of the
+// next day
+typedef struct {
+    int fromDay;
+    int toDay;
+    int fromSecond;
+    int toSecond;
+    double price;
+} TouRule;
+
+typedef struct {
+    TariffInfo info;
+    double price;
+    int nRules;
+    TouRule rules[TARIFF_MAX_RULES];
+    char pricesPath[256];
+} TariffSource;
+
+typedef struct {
+    double slotSeconds;
+    double startTime;
+    int weekday;
+    int nSlots;
+    int periodic;
+    int nTariffs;
+    TariffSource* tariffs;
+} TariffSchedule;
+
+static char* trim(char* s) {
+    char* end;
+    while (*s == ' ' || *s == '\t') s++;
+    end = s + strlen(s);
+    while (end > s && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r' || end[-1] == '\n')) end--;
+    *end = '\0';
+    return s;
+}
+
+// Returns 1 if day is in fromDay..toDay, which may wrap, e.g. 6-1
+static int dayInRange(int day, int fromDay, int toDay) {
+    if (fromDay <= toDay) return day >= fromDay && day <= toDay;
+    return day >= fromDay || day <= toDay;
+}
+
+// Returns 1 if the rule sets the price at the given second of the weekday
+static int ruleMatches(const TouRule* r, int weekday, int second) {
+    int yesterday = (weekday + 5) % 7 + 1;
+    if (r->fromSecond < r->toSecond)
+        return dayInRange(weekday, r->fromDay, r->toDay) && second >= r->fromSecond && second < r->toSecond;
+    // past midnight: the evening of a day in range, or the morning after
+    return (dayInRange(weekday, r->fromDay, r->toDay) && second >= r->fromSecond)
+        || (dayInRange(yesterday, r->fromDay, r->toDay) && second < r->toSecond);
+}
+
+// Returns 1 for a time of day from 0:00 to 24:00
+static int validTime(int h, int m) {
+    return h >= 0 && m >= 0 && m < 60 && (h < 24 || (h == 24 && m == 0));
+}
+
+// Returns 1 to indicate success and 0 for error
+static int parseStatement(TariffSchedule* s, char* line) {
+    TariffSource* t = s->nTariffs ? &s->tariffs[s->nTariffs-1] : NULL;
+    char word[16];
+    char name[TARIFF_NAME_SIZE];
+    int n;
+    if (sscanf(line, "%15s%n", word, &n) != 1) return 0; // error
+    line += n;
+    if (!strcmp(word, "slot")) return sscanf(line, "%lf", &s->slotSeconds) == 1;
+    if (!strcmp(word, "start")) return sscanf(line, "%lf", &s->startTime) == 1;
+    if (!strcmp(word, "weekday")) return sscanf(line, "%d", &s->weekday) == 1;
+    if (!strcmp(word, "slots")) return sscanf(line, "%d", &s->nSlots) == 1;
+    if (!strcmp(word, "periodic")) return sscanf(line, "%d", &s->periodic) == 1;
+    if (!strcmp(word, "tariff")) {
+        TariffSource* more;
+        if (sscanf(line, "%31s", name) != 1) return 0; // error
+        more = (TariffSource*)realloc(s->tariffs, (s->nTariffs + 1) * sizeof(TariffSource));
+        if (!more) return 0; // error
+        s->tariffs = more;
+        t = &s->tariffs[s->nTariffs++];
+        memset(t, 0, sizeof(TariffSource));
+        strcpy(t->info.name, name);
+        return 1; // success
+    }
+    if (!t) {
+        logThis(ERROR_ERROR, "'%s' outside of a tariff", word);
+        return 0; // error
+    }
+    if (!strcmp(word, "price")) return sscanf(line, "%lf", &t->price) == 1;
+    if (!strcmp(word, "prices")) return sscanf(line, "%255s", t->pricesPath) == 1;
+    if (!strcmp(word, "tou")) {
+        TouRule* r = &t->rules[t->nRules];
+        int h0, m0, h1, m1;
+        if (t->nRules == TARIFF_MAX_RULES) {
+            logThis(ERROR_ERROR, "More than %d tou rules", TARIFF_MAX_RULES);
+            return 0; // error
+        }
+        if (sscanf(line, "%d-%d %d:%d %d:%d %lf", &r->fromDay, &r->toDay,
+                   &h0, &m0, &h1, &m1, &r->price) != 7)
+            return 0; // error
+        if (r->fromDay < 1 || r->fromDay > 7 || r->toDay < 1 || r->toDay > 7
+                || !validTime(h0, m0) || !validTime(h1, m1)) {
+            logThis(ERROR_ERROR, "tou needs days 1..7 and times 0:00..24:00");
+            return 0; // error
+        }
+        r->fromSecond = 3600 * h0 + 60 * m0;
+        r->toSecond = 3600 * h1 + 60 * m1;
+        if (r->fromSecond == 86400) {
+            logThis(ERROR_ERROR, "tou cannot start at 24:00, start at 0:00");
+            return 0; // error
+        }
+        if (r->fromSecond == r->toSecond) {
+            logThis(ERROR_ERROR, "tou from %02d:%02d to %02d:%02d is empty", h0, m0, h1, m1);
+            return 0; // error
+        }
+        if (r->toSecond == 0) r->toSecond = 86400; // to midnight
+        t->nRules++;
+        return 1; // success
+    }
+    if (!strcmp(word, "tier")) {
+        TariffInfo* info = &t->info;
+        if (info->nTiers == TARIFF_MAX_TIERS) {
+            logThis(ERROR_ERROR, "More than %d tiers", TARIFF_MAX_TIERS);
+            return 0; // error
+        }
+        if (sscanf(line, "%lf %lf", &info->tierStart[info->nTiers], &info->tierAdder[info->nTiers]) != 2)
+            return 0; // error
+        if (info->nTiers > 0 && info->tierStart[info->nTiers] <= info->tierStart[info->nTiers-1]) {
+            logThis(ERROR_ERROR, "Tiers must start at increasing usage");
+            return 0; // error
+        }
+        info->nTiers++;
+        return 1; // success
+    }
+    logThis(ERROR_ERROR, "Unknown statement '%s'", word);
+    return 0; // error
+}
+
+// Path relative to the directory of the source
+static void relativePath(const char* sourcePath, const char* path, char* result, int size) {
+    const char* slash = strrchr(sourcePath, '/');
+    const char* backslash = strrchr(sourcePath, '\\');
+    int n;
+    if (backslash > slash) slash = backslash;
+    if (path[0] == '/' || path[0] == '\\' || (path[0] && path[1] == ':') || !slash) {
+        snprintf(result, size, "%s", path);
+        return;
+    }
+    n = (int)(slash - sourcePath) + 1;
+    snprintf(result, size, "%.*s%s", n, sourcePath, path);
+}
+
+// Set the prices of tariff k from a file of lines "time,price".
+// Returns 1 to indicate success and 0 for error
+static int readRealTimePrices(TariffSchedule* s, int k, const char* path, double* prices) {
+    char line[256];
+    double time, price, previous = 0;
+    int slot = 0, lineNumber = 0, first = 1;
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        logThis(ERROR_ERROR, "Cannot open file '%s'", path);
+        return 0; // error
+    }
+    while (fgets(line, sizeof(line), file)) {
+        char* l = trim(line);
+        lineNumber++;
+        if (!*l || *l == '#') continue;
+        if (sscanf(l, "%lf,%lf", &time, &price) != 2) {
+            if (first) continue; // header line
+            logThis(ERROR_ERROR, "Expected time,price at line %d of file '%s'", lineNumber, path);
+            fclose(file);
+            return 0; // error
+        }
+        // slots that start before time get the previous price
+        for (; slot < s->nSlots && s->startTime + slot * s->slotSeconds < time; slot++)
+            if (!first) prices[(size_t)slot * s->nTariffs + k] = previous;
+        // before the first time, the first price holds
+        if (first) {
+            int i;
+            for (i=0; i<slot; i++) prices[(size_t)i * s->nTariffs + k] = price;
+        }
+        previous = price;
+        first = 0;
+    }
+    fclose(file);
+    for (; !first && slot < s->nSlots; slot++)
+        prices[(size_t)slot * s->nTariffs + k] = previous;
+    return 1; // success
+}
+
+static void applyRules(TariffSchedule* s, int k, double* prices) {
+    TariffSource* t = &s->tariffs[k];
+    int slot, i;
+    for (slot=0; slot<s->nSlots; slot++) {
+        double seconds = slot * s->slotSeconds;
+        int day = (int)floor(seconds / 86400);
+        int second = (int)(seconds - 86400.0 * day);
+        int weekday = (s->weekday - 1 + day) % 7 + 1;
+        for (i=0; i<t->nRules; i++) {
+            const TouRule* r = &t->rules[i];
+            if (ruleMatches(r, weekday, second))
+                prices[(size_t)slot * s->nTariffs + k] = r->price;
+        }
+    }
+}
+
+// Returns 1 to indicate success and 0 for error
+static int writeTable(TariffSchedule* s, const double* prices, const char* path) {
+    static const char zeros[PRICES_ALIGNMENT] = {0};
+    TariffHeader h;
+    int k, ok;
+    int infoEnd = sizeof(TariffHeader) + s->nTariffs * sizeof(TariffInfo);
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        logThis(ERROR_ERROR, "Cannot open file '%s'", path);
+        return 0; // error
+    }
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, TARIFF_MAGIC, 4);
+    h.version = TARIFF_VERSION;
+    h.nTariffs = s->nTariffs;
+    h.nSlots = s->nSlots;
+    h.slotSeconds = s->slotSeconds;
+    h.startTime = s->startTime;
+    h.periodic = s->periodic;
+    h.pricesOffset = (infoEnd + PRICES_ALIGNMENT - 1) / PRICES_ALIGNMENT * PRICES_ALIGNMENT;
+    ok = fwrite(&h, sizeof(h), 1, file) == 1;
+    for (k=0; ok && k<s->nTariffs; k++)
+        ok = fwrite(&s->tariffs[k].info, sizeof(TariffInfo), 1, file) == 1;
+    if (ok) ok = fwrite(zeros, 1, h.pricesOffset - infoEnd, file) == (size_t)(h.pricesOffset - infoEnd);
+    if (ok) ok = fwrite(prices, sizeof(double), (size_t)s->nSlots * s->nTariffs, file)
+                 == (size_t)s->nSlots * s->nTariffs;
+    if (fclose(file)) ok = 0;
+    if (!ok) {
+        logThis(ERROR_ERROR, "Cannot write file '%s'", path);
+    }
+    return ok;
+}
+
+int compileTariffs(const char* sourcePath, const char* tablePath) {
+    TariffSchedule s;
+    double* prices = NULL;
+    char line[512];
+    char path[512];
+    int lineNumber = 0, k, i, ok = 0;
+    FILE* file = fopen(sourcePath, "r");
+    if (!file) {
+        logThis(ERROR_ERROR, "Cannot open file '%s'", sourcePath);
+        return 0; // error
+    }
+    memset(&s, 0, sizeof(s));
+    s.slotSeconds = 900;
+    s.weekday = 1;
+    while (fgets(line, sizeof(line), file)) {
+        char* comment = strchr(line, '#');
+        char* l;
+        lineNumber++;
+        if (comment) *comment = '\0';
+        l = trim(line);
+        if (!*l) continue;
+        if (!parseStatement(&s, l)) {
+            logThis(ERROR_ERROR, "Syntax error at line %d of file '%s'", lineNumber, sourcePath);
+            fclose(file);
+            free(s.tariffs);
+            return 0; // error
+        }
+    }
+    fclose(file);
+    if (s.slotSeconds <= 0 || s.nSlots <= 0 || s.nTariffs == 0 || s.weekday < 1 || s.weekday > 7) {
+        logThis(ERROR_ERROR, "File '%s' needs slot > 0, slots > 0, weekday 1..7 and a tariff", sourcePath);
+        free(s.tariffs);
+        return 0; // error
+    }
+
+    prices = (double*)malloc((size_t)s.nSlots * s.nTariffs * sizeof(double));
+    if (!prices) goto done;
+    for (k=0; k<s.nTariffs; k++) {
+        TariffSource* t = &s.tariffs[k];
+        for (i=0; i<s.nSlots; i++) prices[(size_t)i * s.nTariffs + k] = t->price;
+        if (t->pricesPath[0]) {
+            relativePath(sourcePath, t->pricesPath, path, sizeof(path));
+            if (!readRealTimePrices(&s, k, path, prices)) goto done;
+        }
+        applyRules(&s, k, prices);
+    }
+    ok = writeTable(&s, prices, tablePath);
+done:
+    free(prices);
+    free(s.tariffs);
+    return ok;
+}
+
+// -------------------------------------------------------------------------
+// Lookup
+
+TariffTable* openTariffTable(const char* tablePath) {
+    TariffTable* t = (TariffTable*)calloc(1, sizeof(TariffTable));
+    const TariffHeader* h;
+    if (!t) return NULL;
+#ifdef _WIN32
+    {
+        HANDLE file = CreateFileA(tablePath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+        LARGE_INTEGER size;
+        if (file == INVALID_HANDLE_VALUE) goto error;
+        if (!GetFileSizeEx(file, &size)) {
+            CloseHandle(file);
+            goto error;
+        }
+        t->size = (size_t)size.QuadPart;
+        t->handle = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        CloseHandle(file);
+        if (!t->handle) goto error;
+        t->base = MapViewOfFile(t->handle, FILE_MAP_READ, 0, 0, 0);
+        if (!t->base) {
+            CloseHandle(t->handle);
+            goto error;
+        }
+    }
+#else
+    {
+        struct stat st;
+        void* p;
+        int fd = open(tablePath, O_RDONLY);
+        if (fd < 0) goto error;
+        if (fstat(fd, &st) || st.st_size < (off_t)sizeof(TariffHeader)) {
+            close(fd);
+            goto error;
+        }
+        t->size = st.st_size;
+        p = mmap(NULL, t->size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED) goto error;
+        t->base = p;
+    }
+#endif
+    h = (const TariffHeader*)t->base;
+    t->header = h;
+    if (t->size < sizeof(TariffHeader) || memcmp(h->magic, TARIFF_MAGIC, 4) || h->version != TARIFF_VERSION
+            || h->nTariffs <= 0 || h->nSlots <= 0 || h->slotSeconds <= 0
+            || h->pricesOffset < (int)(sizeof(TariffHeader) + h->nTariffs * sizeof(TariffInfo))
+            || t->size < h->pricesOffset + (size_t)h->nSlots * h->nTariffs * sizeof(double)) {
+        logThis(ERROR_ERROR, "File '%s' is not a tariff table", tablePath);
+        closeTariffTable(t);
+        return NULL;
+    }
+    t->tariffs = (const TariffInfo*)(h + 1);
+    t->prices = (const double*)((const char*)t->base + h->pricesOffset);
+    return t;
+error:
+    logThis(ERROR_ERROR, "Cannot map file '%s'", tablePath);
+    free(t);
+    return NULL;
+}
+
+void closeTariffTable(TariffTable* t) {
+    if (!t) return;
+#ifdef _WIN32
+    UnmapViewOfFile(t->base);
+    CloseHandle((HANDLE)t->handle);
+#else
+    munmap((void*)t->base, t->size);
+#endif
+    free(t);
+}
+
+int findTariff(TariffTable* t, const char* name) {
+    int k;
+    for (k=0; k<t->header->nTariffs; k++)
+        if (!strncmp(t->tariffs[k].name, name, TARIFF_NAME_SIZE)) return k;
+    return -1;
+}
+
+int tariffSlot(TariffTable* t, double time) {
+    const TariffHeader* h = t->header;
+    double slot = floor((time - h->startTime) / h->slotSeconds);
+    if (h->periodic) {
+        slot = fmod(slot, h->nSlots);
+        if (slot < 0) slot += h->nSlots;
+    } else if (slot < 0) {
+        slot = 0;
+    } else if (slot >= h->nSlots) {
+        slot = h->nSlots - 1;
+    }
+    return (int)slot;
+}
+
+static double tierAdder(const TariffInfo* info, double usage) {
+    double adder = 0;
+    int i;
+    for (i=0; i<info->nTiers && usage >= info->tierStart[i]; i++)
+        adder = info->tierAdder[i];
+    return adder;
+}
+
+double tariffPrice(TariffTable* t, int tariff, double time, double usage) {
+    const double* row = t->prices + (size_t)tariffSlot(t, time) * t->header->nTariffs;
+    return row[tariff] + tierAdder(&t->tariffs[tariff], usage);
+}
+
+void tariffPrices(TariffTable* t, const int* tariffOf, const double* usage, int n,
+                  double time, double* prices) {
+    const double* row = t->prices + (size_t)tariffSlot(t, time) * t->header->nTariffs;
+    int i;
+    for (i=0; i<n; i++) prices[i] = row[tariffOf[i]];
+    if (usage)
+        for (i=0; i<n; i++)
+            if (t->tariffs[tariffOf[i]].nTiers) prices[i] += tierAdder(&t->tariffs[tariffOf[i]], usage[i]);
+}
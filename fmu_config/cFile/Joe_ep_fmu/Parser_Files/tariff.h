@@ -0,0 +1,98 @@
+/* -------------------------------------------------------------------------
+ * tariff.h
+ * Price schedules of the homes. A text source with time-of-use,
+ * real-time and tiered tariffs is compiled once into a binary table that
+ * holds the price of each tariff in each time slot. Worker processes map
+ * the table read-only, so all of them share one copy, and look up the
+ * price of a home in O(1): slot = (time - startTime) / slotSeconds.
+ * The table is written in host byte order.
+ *
+ * Source format, one statement per line, # starts a comment:
+ *     slot 900              seconds per slot
+ *     start 0               simulation time of slot 0, a midnight
+ *     weekday 1             day of week of slot 0, 1 = Monday ... 7 = Sunday
+ *     slots 35040           number of slots, e.g. one year of 15 minutes
+ *     periodic 0            1 to repeat the table after the last slot
+ *     tariff <name>         starts a tariff, the statements below belong to it
+ *     price 0.12            default price
+ *     tou 1-5 16:00 21:00 0.35   price on days 1 to 5 from 16:00 to 21:00,
+ *                                later rules take precedence; days 1..7,
+ *                                times 0:00..24:00
+ *     tou 1-5 22:00 06:00 0.08   a rule that ends before it starts runs
+ *                                past midnight: from 22:00 of days 1 to 5
+ *                                to 06:00 of the day after
+ *     prices rtp.csv        real-time prices, lines "time,price", sorted by
+ *                           time; a price holds until the next time
+ *     tier 500 0.02         from a cumulative usage of 500, add 0.02 to the price
+ * -------------------------------------------------------------------------*/
+
+#ifndef TARIFF_H
+#define TARIFF_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TARIFF_MAGIC "TRF1"
+#define TARIFF_VERSION 1
+#define TARIFF_NAME_SIZE 32
+#define TARIFF_MAX_TIERS 4
+
+// Layout of the binary table: header, tariff infos, prices [slot][tariff]
+typedef struct {
+    char magic[4];                     // TARIFF_MAGIC
+    int version;                       // TARIFF_VERSION
+    int nTariffs;
+    int nSlots;
+    double slotSeconds;
+    double startTime;
+    int periodic;                      // 1 if the table repeats after the last slot
+    int pricesOffset;                  // offset of the prices from the start of the table, in bytes
+} TariffHeader;
+
+typedef struct {
+    char name[TARIFF_NAME_SIZE];
+    int nTiers;
+    int padding;
+    double tierStart[TARIFF_MAX_TIERS]; // cumulative usage where a tier starts, increasing
+    double tierAdder[TARIFF_MAX_TIERS]; // added to the price within the tier
+} TariffInfo;
+
+typedef struct {
+    const TariffHeader* header;
+    const TariffInfo* tariffs;
+    const double* prices;              // [slot][tariff]
+    const void* base;                  // the mapped table
+    size_t size;
+    void* handle;                      // file mapping on Windows
+} TariffTable;
+
+// Compile the source into a binary table.
+// Returns 1 to indicate success and 0 for error.
+int compileTariffs(const char* sourcePath, const char* tablePath);
+
+// Map a compiled table read-only. Returns NULL to indicate failure.
+TariffTable* openTariffTable(const char* tablePath);
+void closeTariffTable(TariffTable* t);
+
+// Returns the index of the named tariff, or -1
+int findTariff(TariffTable* t, const char* name);
+
+// Returns the slot of the given simulation time
+int tariffSlot(TariffTable* t, double time);
+
+// Returns the price of the given tariff at the given time, for a home
+// with the given cumulative usage, 0 for tariffs without tiers.
+double tariffPrice(TariffTable* t, int tariff, double time, double usage);
+
+// Prices of n homes at the given time. Home i has tariff tariffOf[i] and
+// cumulative usage usage[i]; usage may be NULL if no tariff has tiers.
+void tariffPrices(TariffTable* t, const int* tariffOf, const double* usage, int n,
+                  double time, double* prices);
+
+#ifdef __cplusplus
+} // closing brace for extern "C"
+#endif
+#endif // TARIFF_H
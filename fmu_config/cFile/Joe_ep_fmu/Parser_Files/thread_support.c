@@ -0,0 +1,97 @@
+/* -------------------------------------------------------------------------
+ * thread_support.c
+ * Minimal portable wrapper for threads, mutexes, condition variables
+ * and a monotonic wall clock.
+ * -------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#ifndef _WIN32
+#include <time.h>
+#endif
+#include "thread_support.h"
+
+// The thread entry points of Win32 and pthreads have different
+// signatures. The start record carries the user function to a trampoline.
+typedef struct {
+    ThreadFunction f;
+    void* arg;
+} ThreadStart;
+
+#ifdef _WIN32
+static DWORD WINAPI threadMain(LPVOID p) {
+#else
+static void* threadMain(void* p) {
+#endif
+    ThreadStart start = *(ThreadStart*)p;
+    free(p);
+    start.f(start.arg);
+    return 0;
+}
+
+int threadCreate(Thread* t, ThreadFunction f, void* arg) {
+    ThreadStart* start = (ThreadStart*)malloc(sizeof(ThreadStart));
+    if (!start) return 0; // error
+    start->f = f;
+    start->arg = arg;
+#ifdef _WIN32
+    *t = CreateThread(NULL, 0, threadMain, start, 0, NULL);
+    if (*t == NULL) {
+#else
+    if (pthread_create(t, NULL, threadMain, start)) {
+#endif
+        free(start);
+        return 0; // error
+    }
+    return 1; // success
+}
+
+#ifdef _WIN32
+
+void threadJoin(Thread t) {
+    WaitForSingleObject(t, INFINITE);
+    CloseHandle(t);
+}
+
+void mutexInit(Mutex* m)    { InitializeCriticalSection(m); }
+void mutexLock(Mutex* m)    { EnterCriticalSection(m); }
+void mutexUnlock(Mutex* m)  { LeaveCriticalSection(m); }
+void mutexDestroy(Mutex* m) { DeleteCriticalSection(m); }
+
+void condInit(CondVar* c)             { InitializeConditionVariable(c); }
+void condWait(CondVar* c, Mutex* m)   { SleepConditionVariableCS(c, m, INFINITE); }
+void condSignal(CondVar* c)           { WakeConditionVariable(c); }
+void condBroadcast(CondVar* c)        { WakeAllConditionVariable(c); }
+void condDestroy(CondVar* c)          { (void)c; }
+
+double wallClock(void) {
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER now;
+    if (!frequency.QuadPart) QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&now);
+    return (double)now.QuadPart / (double)frequency.QuadPart;
+}
+
+#else
+
+void threadJoin(Thread t) {
+    pthread_join(t, NULL);
+}
+
+void mutexInit(Mutex* m)    { pthread_mutex_init(m, NULL); }
+void mutexLock(Mutex* m)    { pthread_mutex_lock(m); }
+void mutexUnlock(Mutex* m)  { pthread_mutex_unlock(m); }
+void mutexDestroy(Mutex* m) { pthread_mutex_destroy(m); }
+
+void condInit(CondVar* c)             { pthread_cond_init(c, NULL); }
+void condWait(CondVar* c, Mutex* m)   { pthread_cond_wait(c, m); }
+void condSignal(CondVar* c)           { pthread_cond_signal(c); }
+void condBroadcast(CondVar* c)        { pthread_cond_broadcast(c); }
+void condDestroy(CondVar* c)          { pthread_cond_destroy(c); }
+
+double wallClock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+#endif // _WIN32
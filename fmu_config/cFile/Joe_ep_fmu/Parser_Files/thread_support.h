@@ -0,0 +1,61 @@
+/* -------------------------------------------------------------------------
+ * thread_support.h
+ * Minimal portable wrapper for threads, mutexes, condition variables
+ * and a monotonic wall clock. Uses the Win32 API on Windows and
+ * pthreads elsewhere.
+ * -------------------------------------------------------------------------*/
+
+#ifndef THREAD_SUPPORT_H
+#define THREAD_SUPPORT_H
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// storage class for variables with one instance per thread
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+#ifdef _WIN32
+typedef HANDLE Thread;
+typedef CRITICAL_SECTION Mutex;
+typedef CONDITION_VARIABLE CondVar;
+#else
+typedef pthread_t Thread;
+typedef pthread_mutex_t Mutex;
+typedef pthread_cond_t CondVar;
+#endif
+
+typedef void (*ThreadFunction)(void* arg);
+
+// Returns 1 to indicate success and 0 for error
+int threadCreate(Thread* t, ThreadFunction f, void* arg);
+void threadJoin(Thread t);
+
+void mutexInit(Mutex* m);
+void mutexLock(Mutex* m);
+void mutexUnlock(Mutex* m);
+void mutexDestroy(Mutex* m);
+
+void condInit(CondVar* c);
+void condWait(CondVar* c, Mutex* m);
+void condSignal(CondVar* c);
+void condBroadcast(CondVar* c);
+void condDestroy(CondVar* c);
+
+// seconds since an arbitrary fixed point, monotonic
+double wallClock(void);
+
+#ifdef __cplusplus
+} // closing brace for extern "C"
+#endif
+#endif // THREAD_SUPPORT_H
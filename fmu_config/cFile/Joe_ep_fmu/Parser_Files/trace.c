@@ -0,0 +1,169 @@
+/* -------------------------------------------------------------------------
+ * trace.c
+ * Low-overhead timeline tracing into per-thread buffers,
+ * exported in Chrome trace-event JSON format.
+ * -------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "thread_support.h"
+#include "trace.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#define atomicLoad(p) InterlockedCompareExchange((volatile LONG*)(p), 0, 0)
+#define atomicStore(p, v) InterlockedExchange((volatile LONG*)(p), (v))
+#else
+// a thread that sees a new generation or sampling also sees what was
+// written before it
+#define atomicLoad(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define atomicStore(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#endif
+
+typedef struct {
+    const char* name;
+    int id;
+    double start;         // wallClock() seconds
+    double end;
+} TraceEvent;
+
+// One buffer per thread that recorded an event. All buffers are kept
+// in a list, so that they outlive the threads until traceFree.
+typedef struct TraceBuffer {
+    struct TraceBuffer* next;
+    int tid;
+    char name[64];
+    int n;                // number of recorded events
+    int dropped;          // events lost because the buffer was full
+    TraceEvent events[TRACE_BUFFER_SIZE];
+} TraceBuffer;
+
+static volatile int sampling = 0; // 0 when tracing is off, read by all threads
+static double origin = 0;         // time of traceEnable, the zero of the timeline
+static int initialized = 0;
+static Mutex listLock;            // protects buffers and nextTid
+static TraceBuffer* buffers = NULL;
+static int nextTid = 1;
+static volatile int generation = 0; // incremented by traceFree
+static THREAD_LOCAL TraceBuffer* current = NULL;
+static THREAD_LOCAL int currentGeneration = 0; // current is valid if equal to generation
+
+void traceEnable(int sampleEvery) {
+    if (!initialized) {
+        mutexInit(&listLock);
+        initialized = 1;
+    }
+    if (sampleEvery > 0 && !atomicLoad(&sampling)) origin = wallClock();
+    atomicStore(&sampling, sampleEvery > 0 ? sampleEvery : 0);
+}
+
+int traceSampled(int id) {
+    // read once: tracing may be switched off between two reads
+    int every = atomicLoad(&sampling);
+    return every && id % every == 0;
+}
+
+// Returns NULL if no memory is available
+static TraceBuffer* getBuffer(void) {
+    TraceBuffer* b = current;
+    if (b && currentGeneration == atomicLoad(&generation)) return b;
+    b = (TraceBuffer*)malloc(sizeof(TraceBuffer));
+    if (!b) return NULL;
+    b->n = 0;
+    b->dropped = 0;
+    b->name[0] = '\0';
+    mutexLock(&listLock);
+    b->tid = nextTid++;
+    b->next = buffers;
+    buffers = b;
+    mutexUnlock(&listLock);
+    current = b;
+    currentGeneration = atomicLoad(&generation);
+    return b;
+}
+
+void traceEvent(const char* name, int id, double start, double end) {
+    TraceBuffer* b;
+    if (!atomicLoad(&sampling)) return;
+    b = getBuffer();
+    if (!b) return;
+    if (b->n == TRACE_BUFFER_SIZE) {
+        b->dropped++;
+        return;
+    }
+    b->events[b->n].name = name;
+    b->events[b->n].id = id;
+    b->events[b->n].start = start;
+    b->events[b->n].end = end;
+    b->n++;
+}
+
+void traceThreadName(const char* name) {
+    TraceBuffer* b;
+    if (!atomicLoad(&sampling)) return;
+    b = getBuffer();
+    if (!b) return;
+    strncpy(b->name, name, sizeof(b->name) - 1);
+    b->name[sizeof(b->name) - 1] = '\0';
+}
+
+// Write s as the contents of a JSON string, escaping quotes, backslashes
+// and control characters
+static void writeJsonString(FILE* file, const char* s) {
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') fprintf(file, "\\%c", c);
+        else if (c < 0x20) fprintf(file, "\\u%04x", c);
+        else fputc(c, file);
+    }
+}
+
+int traceExportChrome(const char* path) {
+    TraceBuffer* b;
+    int i;
+    int first = 1;
+    FILE* file = fopen(path, "w");
+    if (!file) return 0; // error
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    if (initialized) mutexLock(&listLock);
+    for (b=buffers; b; b=b->next) {
+        if (b->name[0]) {
+            fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"",
+                    first ? "" : ",", b->tid);
+            writeJsonString(file, b->name);
+            fprintf(file, "\"}}");
+            first = 0;
+        }
+        for (i=0; i<b->n; i++) {
+            TraceEvent* e = &b->events[i];
+            fprintf(file, "%s\n{\"name\":\"", first ? "" : ",");
+            writeJsonString(file, e->name);
+            fprintf(file, "\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"home\":%d}}",
+                    b->tid, 1e6 * (e->start - origin), 1e6 * (e->end - e->start), e->id);
+            first = 0;
+        }
+        if (b->dropped) {
+            fprintf(file, "%s\n{\"name\":\"dropped events\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%d,\"ts\":0,\"args\":{\"count\":%d}}",
+                    first ? "" : ",", b->tid, b->dropped);
+            first = 0;
+        }
+    }
+    if (initialized) mutexUnlock(&listLock);
+    fprintf(file, "\n]}\n");
+    return fclose(file) == 0;
+}
+
+void traceFree(void) {
+    TraceBuffer* b;
+    if (!initialized) return;
+    mutexLock(&listLock);
+    while (buffers) {
+        b = buffers;
+        buffers = b->next;
+        free(b);
+    }
+    nextTid = 1;
+    atomicStore(&generation, generation + 1); // invalidates the buffer pointers of all threads
+    mutexUnlock(&listLock);
+}
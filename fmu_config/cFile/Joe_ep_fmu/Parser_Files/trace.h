@@ -0,0 +1,46 @@
+/* -------------------------------------------------------------------------
+ * trace.h
+ * Low-overhead timeline tracing. Each thread records complete events
+ * (name, home, start, duration) into its own fixed-size buffer without
+ * locking. The buffers are exported in Chrome trace-event JSON format,
+ * which is read by chrome://tracing and by the Perfetto UI.
+ * Only every n-th home (or step) is recorded, so tracing can stay on
+ * during long runs.
+ * -------------------------------------------------------------------------*/
+
+#ifndef TRACE_H
+#define TRACE_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// number of events each thread can record, later events are dropped
+#define TRACE_BUFFER_SIZE 16384
+
+// Start recording. Records events whose id is a multiple of sampleEvery,
+// i.e. 1 records all events. 0 stops recording.
+void traceEnable(int sampleEvery);
+
+// Returns 1 if events with the given id are recorded
+int traceSampled(int id);
+
+// Record a complete event of the calling thread. The times are
+// wallClock() values in seconds. name must be a string literal or
+// otherwise outlive the trace.
+void traceEvent(const char* name, int id, double start, double end);
+
+// Name shown for the calling thread, the string is copied
+void traceThreadName(const char* name);
+
+// Write all recorded events to the given file.
+// Returns 1 to indicate success and 0 for error.
+int traceExportChrome(const char* path);
+
+// Discard all recorded events and release the buffers.
+// No other thread may record events during this call.
+void traceFree(void);
+
+#ifdef __cplusplus
+} // closing brace for extern "C"
+#endif
+#endif // TRACE_H
@@ -0,0 +1,237 @@
+/* -------------------------------------------------------------------------
+ * whatIf.c
+ * What-if evaluation of candidate control sequences in forked children.
+ * -------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef STANDALONE_XML_PARSER
+#define logThis(n, ...) printf(__VA_ARGS__);printf("\n")
+#else
+#include "GlobalIncludes.h"
+#include "logging.h" // logThis
+#endif // STANDALONE_XML_PARSER
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#endif
+
+#include "whatIf.h"
+
+void summarizeWhatIf(WhatIfSpec* spec, const double* candidates, const double* observed, int k,
+                     int energyColumn, int temperatureColumn, int heatingControl, int coolingControl,
+                     double* energy, double* discomfort) {
+    const double* controls = candidates + (size_t)k * spec->nSteps * spec->nControls;
+    const double* values = observed + (size_t)k * spec->nSteps * spec->nObserved;
+    int s;
+    *energy = 0;
+    *discomfort = 0;
+    for (s=0; s<spec->nSteps; s++) {
+        const double* c = controls + (size_t)s * spec->nControls;
+        const double* v = values + (size_t)s * spec->nObserved;
+        double t = v[temperatureColumn];
+        *energy += v[energyColumn];
+        if (t < c[heatingControl]) *discomfort += (c[heatingControl] - t) * spec->stepSize / 3600;
+        if (t > c[coolingControl]) *discomfort += (t - c[coolingControl]) * spec->stepSize / 3600;
+    }
+}
+
+#ifdef _WIN32
+
+int runWhatIf(ReplayTarget* target, WhatIfSpec* spec, const double* candidates,
+              int nCandidates, double* observed, int* ok) {
+    logThis(ERROR_ERROR, "What-if evaluation needs fork, which is not available on Windows");
+    return -1; // error
+}
+
+#else
+
+// Runs in the child, never returns
+static void runCandidate(ReplayTarget* target, WhatIfSpec* spec, const double* controls,
+                         double* observed, volatile int* done) {
+    int s;
+    for (s=0; s<spec->nSteps; s++) {
+        double time = spec->time + s * spec->stepSize;
+        if (spec->nControls && !target->setReal(target->instance, spec->controlVrs, spec->nControls,
+                                                controls + (size_t)s * spec->nControls))
+            _exit(1);
+        if (!target->doStep(target->instance, time, spec->stepSize))
+            _exit(1);
+        if (spec->nObserved && !target->getReal(target->instance, spec->observedVrs, spec->nObserved,
+                                                observed + (size_t)s * spec->nObserved))
+            _exit(1);
+    }
+    *done = 1;
+    // _exit skips atexit handlers and stdio buffers copied from the parent
+    _exit(0);
+}
+
+// Returns 1 if the child exited normally after running all steps
+static int waitCandidate(pid_t pid, volatile int* done, int k) {
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) return 0; // error
+    }
+    if (WIFSIGNALED(status)) {
+        logThis(ERROR_WARNING, "What-if candidate %d terminated by signal %d", k, WTERMSIG(status));
+        return 0; // error
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 && *done;
+}
+
+int runWhatIf(ReplayTarget* target, WhatIfSpec* spec, const double* candidates,
+              int nCandidates, double* observed, int* ok) {
+    size_t rows = (size_t)spec->nSteps * spec->nObserved;
+    size_t size = nCandidates * (rows * sizeof(double) + sizeof(int));
+    int maxParallel = spec->maxParallel > 0 ? spec->maxParallel : 1;
+    int next = 0, oldest = 0, nOk = 0;
+    double* shared;
+    volatile int* done;
+    pid_t* pids;
+
+    if (!target->forkSafe) {
+        logThis(ERROR_ERROR, "What-if target is not marked fork safe, cannot run it in forked children");
+        if (nCandidates > 0) memset(ok, 0, nCandidates * sizeof(int));
+        return -1; // error
+    }
+    if (nCandidates <= 0) return 0;
+    pids = (pid_t*)malloc(nCandidates * sizeof(pid_t));
+    // the results of all children, shared with the parent
+    shared = (double*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (!pids || shared == MAP_FAILED) {
+        logThis(ERROR_ERROR, "Cannot allocate memory for %d what-if candidates", nCandidates);
+        free(pids);
+        if (shared != MAP_FAILED) munmap(shared, size);
+        return -1; // error
+    }
+    done = (volatile int*)(shared + nCandidates * rows);
+
+    // at most maxParallel children at once; they take about the same
+    // time, so the oldest one is waited for first
+    while (oldest < nCandidates) {
+        while (next < nCandidates && next - oldest < maxParallel) {
+            pid_t pid = fork();
+            if (pid == 0) {
+                runCandidate(target, spec, candidates + (size_t)next * spec->nSteps * spec->nControls,
+                             shared + next * rows, &done[next]);
+            }
+            if (pid < 0) {
+                logThis(ERROR_ERROR, "Cannot fork what-if candidate %d: %s", next, strerror(errno));
+            }
+            pids[next++] = pid;
+        }
+        ok[oldest] = pids[oldest] > 0 && waitCandidate(pids[oldest], &done[oldest], oldest);
+        nOk += ok[oldest];
+        oldest++;
+    }
+
+    memcpy(observed, shared, nCandidates * rows * sizeof(double));
+    munmap(shared, size);
+    free(pids);
+    return nOk;
+}
+
+#endif // _WIN32
+
+// #define TEST
+#ifdef TEST
+#ifndef _WIN32
+#include <math.h>
+#include "surrogate.h"
+
+#define N_STEPS 12
+#define N_CANDIDATES 8
+
+// whatIf: fit the surrogate of a home to a synthetic recording, evaluate
+// heating setpoints from 17 to 24 degrees for the next N_STEPS steps in
+// forked children, and check the results against predictSurrogates
+int main(void) {
+    char* names[5] = { "zoneTemp", "netEnergy", "outdoorTemp", "heatingSetpoint", "coolingSetpoint" };
+    fmiValueReference controlVrs[3] = { 2, 3, 4 };
+    fmiValueReference observedVrs[2] = { 1, 0 };  // net energy, zone temperature
+    double state[2] = { 19, 0 };
+    double candidates[N_CANDIDATES * N_STEPS * 3];
+    double observed[N_CANDIDATES * N_STEPS * 2];
+    double inputs[N_STEPS * 3 * N_CANDIDATES];
+    double outputs[N_STEPS * 2 * N_CANDIDATES];
+    int ok[N_CANDIDATES];
+    Recording* r = newRecordingWithColumns(NULL, names, 5);
+    SurrogateBank* b = newSurrogateBank(1, names, 2, names + 2, 3);
+    SurrogateHome* home;
+    ReplayTarget target;
+    WhatIfSpec spec;
+    double t = 20, row[5];
+    int i, k, s, n, mismatches = 0;
+
+    if (!r || !b) return 1;
+    // row k: inputs set before step k, outputs after it
+    for (k=0; k<2000; k++) {
+        double outdoor = 5 + 8 * sin(k / 40.0);
+        double heating = 18 + 3 * ((k / 30) % 2);
+        double energy = 4e5 * (heating - t) + 2e4 * (20 - outdoor);
+        t = 0.85 * t + 0.05 * outdoor + 0.1 * heating;
+        row[0] = t;
+        row[1] = energy;
+        row[2] = outdoor;
+        row[3] = heating;
+        row[4] = 26;
+        recordStep(r, 900.0 * k, row);
+    }
+    if (!fitSurrogate(b, 0, r, 1e-10)) return 1;
+    printf("fitted, one step error %g K, %g J\n", b->rmse[0], b->rmse[1]);
+
+    home = newSurrogateHome(b, 0, state);
+    if (!home) return 1;
+    initSurrogateReplayTarget(&target, home);
+    for (k=0; k<N_CANDIDATES; k++) {
+        for (s=0; s<N_STEPS; s++) {
+            double* c = candidates + ((size_t)k * N_STEPS + s) * 3;
+            c[0] = 5;
+            c[1] = 17 + k;
+            c[2] = 26;
+            for (i=0; i<3; i++) inputs[(s * 3 + i) * N_CANDIDATES + k] = c[i];
+        }
+    }
+    spec.nControls = 3;
+    spec.controlVrs = controlVrs;
+    spec.nObserved = 2;
+    spec.observedVrs = observedVrs;
+    spec.nSteps = N_STEPS;
+    spec.time = 0;
+    spec.stepSize = 900;
+    spec.maxParallel = 4;
+
+    n = runWhatIf(&target, &spec, candidates, N_CANDIDATES, observed, ok);
+    predictSurrogates(b, N_CANDIDATES, N_STEPS, state, inputs, outputs);
+    for (k=0; k<N_CANDIDATES; k++) {
+        double energy, discomfort;
+        for (s=0; s<N_STEPS; s++) {
+            const double* v = observed + ((size_t)k * N_STEPS + s) * 2;
+            if (v[0] != outputs[(s * 2 + 1) * N_CANDIDATES + k]) mismatches++;
+            if (v[1] != outputs[(s * 2 + 0) * N_CANDIDATES + k]) mismatches++;
+        }
+        summarizeWhatIf(&spec, candidates, observed, k, 0, 1, 1, 2, &energy, &discomfort);
+        printf("heating %2.0f: %s, energy %8.3f MJ, discomfort %6.3f Kh\n",
+               candidates[(size_t)k * N_STEPS * 3 + 1], ok[k] ? "ok" : "failed", energy / 1e6, discomfort);
+    }
+    printf("%d of %d candidates ran, %d values differ from predictSurrogates\n", n, N_CANDIDATES, mismatches);
+    printf("state of the home after the what-if: %g, %g\n", home->y[0], home->y[1]);
+
+    // the state of the home is unchanged, and targets that are not fork
+    // safe are refused
+    k = n == N_CANDIDATES && mismatches == 0 && home->y[0] == state[0] && home->y[1] == state[1];
+    target.forkSafe = 0;
+    k = k && runWhatIf(&target, &spec, candidates, N_CANDIDATES, observed, ok) == -1;
+    freeSurrogateHome(home);
+    freeSurrogateBank(b);
+    freeRecording(r);
+    printf("%s\n", k ? "ok" : "FAILED");
+    return !k;
+}
+#endif // _WIN32
+#endif // TEST
@@ -0,0 +1,59 @@
+/* -------------------------------------------------------------------------
+ * whatIf.h
+ * What-if evaluation of candidate control sequences, e.g. heating and
+ * cooling setpoints for the next hour, from the current state of a home.
+ * FMI 1.0 co-simulation has no state save and restore, so the worker
+ * process forks one child per candidate: each child starts from a
+ * copy-on-write snapshot of the current state, runs its candidate, writes
+ * the observed values into memory shared with the parent and exits. The
+ * state of the worker itself is not changed.
+ * Needs fork, so it is not available on Windows.
+ * The target must not talk to other processes while a candidate runs,
+ * since the children share its sockets and files, and must not use
+ * threads, which fork does not copy. So runWhatIf only runs targets
+ * marked forkSafe, e.g. a surrogate of the home, see SurrogateHome in
+ * surrogate.h. A slave of a real FMU is not: Joe_ep_fmu talks to UCEF
+ * and EnergyPlus over sockets.
+ * -------------------------------------------------------------------------*/
+
+#ifndef WHAT_IF_H
+#define WHAT_IF_H
+
+#include "replay.h" // ReplayTarget
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    int nControls;
+    const fmiValueReference* controlVrs;   // set before each step, e.g. setpoints
+    int nObserved;
+    const fmiValueReference* observedVrs;  // read after each step, e.g. net energy, zone temperature
+    int nSteps;                            // steps of the horizon
+    double time;                           // current communication point
+    double stepSize;
+    int maxParallel;                       // max children running at once, at least 1
+} WhatIfSpec;
+
+// Runs nCandidates candidates from the current state of target.
+// candidates holds for each candidate nSteps rows of nControls values.
+// On return, observed holds for each candidate nSteps rows of nObserved
+// values, and ok[k] is 1 if candidate k ran all steps, 0 otherwise.
+// Returns the number of candidates that ran all steps, or -1 on error,
+// e.g. if target is not marked forkSafe.
+int runWhatIf(ReplayTarget* target, WhatIfSpec* spec, const double* candidates,
+              int nCandidates, double* observed, int* ok);
+
+// Summary of candidate k: the sum of observed column energyColumn, and
+// the discomfort in degree hours, i.e. how far observed column
+// temperatureColumn was below the control heatingControl or above the
+// control coolingControl, integrated over the horizon.
+void summarizeWhatIf(WhatIfSpec* spec, const double* candidates, const double* observed, int k,
+                     int energyColumn, int temperatureColumn, int heatingControl, int coolingControl,
+                     double* energy, double* discomfort);
+
+#ifdef __cplusplus
+} // closing brace for extern "C"
+#endif
+#endif // WHAT_IF_H
@@ -0,0 +1,221 @@
+/* -------------------------------------------------------------------------
+ * windowStats.c
+ * Rolling statistics over a sliding window of steps, for all homes.
+ * -------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include "windowStats.h"
+
+#define VALUE(w, step, home) ((w)->values[(size_t)((step) % (w)->window) * (w)->nHomes + (home)])
+
+WindowStats* newWindowStats(int nHomes, int window) {
+    WindowStats* w = (WindowStats*)calloc(1, sizeof(WindowStats));
+    size_t n = nHomes > 0 ? nHomes : 1;
+    if (!w) return NULL;
+    w->nHomes = nHomes;
+    w->window = window > 0 ? window : 1;
+    w->values = (double*)calloc(n * w->window, sizeof(double));
+    w->mean = (double*)calloc(n, sizeof(double));
+    w->m2 = (double*)calloc(n, sizeof(double));
+    w->minQueue = (int*)calloc(n * w->window, sizeof(int));
+    w->maxQueue = (int*)calloc(n * w->window, sizeof(int));
+    w->minHead = (int*)calloc(n, sizeof(int));
+    w->minSize = (int*)calloc(n, sizeof(int));
+    w->maxHead = (int*)calloc(n, sizeof(int));
+    w->maxSize = (int*)calloc(n, sizeof(int));
+    if (!w->values || !w->mean || !w->m2 || !w->minQueue || !w->maxQueue
+            || !w->minHead || !w->minSize || !w->maxHead || !w->maxSize) {
+        freeWindowStats(w);
+        return NULL;
+    }
+    return w;
+}
+
+void freeWindowStats(WindowStats* w) {
+    if (!w) return;
+    free(w->values);
+    free(w->mean);
+    free(w->m2);
+    free(w->minQueue);
+    free(w->maxQueue);
+    free(w->minHead);
+    free(w->minSize);
+    free(w->maxHead);
+    free(w->maxSize);
+    free(w);
+}
+
+// Monotonic queue of the steps in the window, for the minimum if
+// sign is 1, for the maximum if sign is -1. The front is the step of
+// the minimum (maximum); a step leaves the queue at the back when a
+// smaller (larger) value arrives, or at the front when it leaves the window.
+static void pushQueue(WindowStats* w, int* queue, int* head, int* size, int home,
+                      int step, double value, double sign) {
+    int* q = queue + (size_t)home * w->window;
+    int h = head[home], n = size[home];
+    if (n > 0 && q[h] <= step - w->window) {
+        h = (h + 1) % w->window;
+        n--;
+    }
+    while (n > 0 && sign * VALUE(w, q[(h + n - 1) % w->window], home) >= sign * value)
+        n--;
+    q[(h + n) % w->window] = step;
+    head[home] = h;
+    size[home] = n + 1;
+}
+
+// Recompute mean and m2 from the values in the window,
+// to remove the rounding errors of the sliding updates
+static void resync(WindowStats* w) {
+    int h, s;
+    for (h=0; h<w->nHomes; h++) {
+        w->mean[h] = 0;
+        w->m2[h] = 0;
+    }
+    for (s=0; s<w->window; s++) {
+        const double* v = &w->values[(size_t)s * w->nHomes];
+        for (h=0; h<w->nHomes; h++) w->mean[h] += v[h];
+    }
+    for (h=0; h<w->nHomes; h++) w->mean[h] /= w->window;
+    for (s=0; s<w->window; s++) {
+        const double* v = &w->values[(size_t)s * w->nHomes];
+        for (h=0; h<w->nHomes; h++) w->m2[h] += (v[h] - w->mean[h]) * (v[h] - w->mean[h]);
+    }
+}
+
+void addWindowStep(WindowStats* w, const double* values) {
+    int step = w->nSteps;
+    double* slot = &w->values[(size_t)(step % w->window) * w->nHomes];
+    int h;
+    if (step < w->window) {
+        // window not full yet: Welford's update
+        double n = step + 1;
+        for (h=0; h<w->nHomes; h++) {
+            double delta = values[h] - w->mean[h];
+            w->mean[h] += delta / n;
+            w->m2[h] += delta * (values[h] - w->mean[h]);
+        }
+    } else {
+        // replace the oldest value
+        for (h=0; h<w->nHomes; h++) {
+            double old = slot[h];
+            double oldMean = w->mean[h];
+            w->mean[h] += (values[h] - old) / w->window;
+            w->m2[h] += (values[h] - old) * (values[h] - w->mean[h] + old - oldMean);
+        }
+    }
+    // the slot of the oldest step is overwritten; the queues drop that
+    // step before they compare values
+    for (h=0; h<w->nHomes; h++) slot[h] = values[h];
+    for (h=0; h<w->nHomes; h++) {
+        pushQueue(w, w->minQueue, w->minHead, w->minSize, h, step, values[h], 1);
+        pushQueue(w, w->maxQueue, w->maxHead, w->maxSize, h, step, values[h], -1);
+    }
+    w->nSteps++;
+    if (w->nSteps % w->window == 0) resync(w);
+}
+
+double windowMean(WindowStats* w, int home) {
+    return w->mean[home];
+}
+
+double windowVariance(WindowStats* w, int home) {
+    int n = windowCount(w);
+    double v = n > 1 ? w->m2[home] / (n - 1) : 0;
+    return v > 0 ? v : 0;
+}
+
+double windowMin(WindowStats* w, int home) {
+    if (w->nSteps == 0) return 0;
+    return VALUE(w, w->minQueue[(size_t)home * w->window + w->minHead[home]], home);
+}
+
+double windowMax(WindowStats* w, int home) {
+    if (w->nSteps == 0) return 0;
+    return VALUE(w, w->maxQueue[(size_t)home * w->window + w->maxHead[home]], home);
+}
+
+// #define TEST
+#ifdef TEST
+#include <math.h>
+#include <stdio.h>
+#include "thread_support.h" // wallClock
+
+#define TEST_HOMES 7
+#define TEST_STEPS 20000
+
+// Value of a home at a step: noise around a slow wave, a large offset,
+// a constant and repeated values, the cases that break sliding updates
+static double testValue(int home, int step) {
+    switch (home) {
+        case 0: return (rand() % 1000) / 10.0 - 50 + 1e3 * sin(step / 500.0);
+        case 1: return 1e6 + rand() % 100;
+        case 2: return 5;
+        case 3: return rand() % 3;
+        case 4: return -1e-3 * step;
+        default: return (rand() % 2000 - 1000) * 1e-9 * (home + 1);
+    }
+}
+
+// Compares each statistic of each step with the brute-force recomputation
+// over the window. Returns the number of mismatches.
+static int checkWindow(int window) {
+    WindowStats* w = newWindowStats(TEST_HOMES, window);
+    double* history = (double*)malloc((size_t)TEST_STEPS * TEST_HOMES * sizeof(double));
+    double values[TEST_HOMES], worst = 0;
+    int nBad = 0, h, k, j;
+    if (!w || !history) return 1;
+    for (k=0; k<TEST_STEPS; k++) {
+        for (h=0; h<TEST_HOMES; h++) values[h] = history[(size_t)k * TEST_HOMES + h] = testValue(h, k);
+        addWindowStep(w, values);
+        for (h=0; h<TEST_HOMES; h++) {
+            int n = k + 1 < window ? k + 1 : window;
+            double min = values[h], max = values[h], sum = 0, squares = 0, mean, variance, scale, error;
+            for (j=k-n+1; j<=k; j++) {
+                double x = history[(size_t)j * TEST_HOMES + h];
+                if (x < min) min = x;
+                if (x > max) max = x;
+                sum += x;
+            }
+            mean = sum / n;
+            for (j=k-n+1; j<=k; j++) {
+                double d = history[(size_t)j * TEST_HOMES + h] - mean;
+                squares += d * d;
+            }
+            variance = n > 1 ? squares / (n - 1) : 0;
+            // errors relative to the magnitude of the values in the window
+            scale = mean * mean + (max - min) * (max - min) + 1e-300;
+            error = fabs(windowMean(w, h) - mean) / (fabs(mean) + max - min + 1e-300);
+            if (fabs(windowVariance(w, h) - variance) / scale > error) error = fabs(windowVariance(w, h) - variance) / scale;
+            if (error > worst) worst = error;
+            if (windowMin(w, h) != min || windowMax(w, h) != max || error > 1e-9
+                    || windowCount(w) != n) nBad++;
+        }
+    }
+    printf("window %4d: %d steps, %d mismatches, largest relative error %.2g\n", window, TEST_STEPS, nBad, worst);
+    freeWindowStats(w);
+    free(history);
+    return nBad;
+}
+
+// windowStats: all statistics against the brute-force recomputation,
+// then the time per home update of 1000 homes over a day of minutes
+int main(void) {
+    int windows[] = { 1, 2, 60, 1440 };
+    int nBad = 0, i, k;
+    WindowStats* w = newWindowStats(1000, 1440);
+    double x[1000], start;
+    srand(1);
+    for (i=0; i<4; i++) nBad += checkWindow(windows[i]);
+    if (!w) return 1;
+    start = wallClock();
+    for (k=0; k<100000; k++) {
+        for (i=0; i<1000; i++) x[i] = i * k % 977;
+        addWindowStep(w, x);
+    }
+    printf("%.1f ns per home update\n", 1e9 * (wallClock() - start) / (100000.0 * 1000));
+    freeWindowStats(w);
+    printf("%s\n", nBad ? "failed" : "ok");
+    return nBad != 0;
+}
+#endif // TEST
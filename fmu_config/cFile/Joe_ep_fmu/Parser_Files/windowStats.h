@@ -0,0 +1,55 @@
+/* -------------------------------------------------------------------------
+ * windowStats.h
+ * Rolling mean, variance, minimum and maximum of one exchanged channel,
+ * e.g. epSendNetEnergy or the price, over the last window steps of every
+ * home. Each step adds one value per home in amortized O(1) per home:
+ * the mean and variance are updated with Welford's method for a sliding
+ * window, minimum and maximum with monotonic queues. Values are stored
+ * structure-of-arrays, home by home, so that one step touches
+ * contiguous memory. Use one WindowStats per channel and window length,
+ * e.g. 60 and 1440 steps for an hour and a day of one-minute steps.
+ * -------------------------------------------------------------------------*/
+
+#ifndef WINDOW_STATS_H
+#define WINDOW_STATS_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    int nHomes;
+    int window;             // steps in the window
+    int nSteps;             // steps added so far
+    double* values;         // last window values [slot][home], slot = step % window
+    double* mean;           // [home]
+    double* m2;             // sum of squared deviations from the mean [home]
+    int* minQueue;          // steps with increasing values [home][window]
+    int* maxQueue;          // steps with decreasing values [home][window]
+    int* minHead;           // first entry of the queue of each home
+    int* minSize;           // entries in the queue of each home
+    int* maxHead;
+    int* maxSize;
+} WindowStats;
+
+// Returns NULL if no memory is available
+WindowStats* newWindowStats(int nHomes, int window);
+void freeWindowStats(WindowStats* w);
+
+// Add the values of one step, one per home. Values must not be NaN.
+// Does not allocate memory.
+void addWindowStep(WindowStats* w, const double* values);
+
+// Number of steps in the window, at most window
+#define windowCount(w) ((w)->nSteps < (w)->window ? (w)->nSteps : (w)->window)
+
+// Statistics of the values of the given home in the window.
+// Mean, minimum and maximum are 0 before the first step.
+double windowMean(WindowStats* w, int home);
+double windowVariance(WindowStats* w, int home);  // sample variance, 0 for less than 2 values
+double windowMin(WindowStats* w, int home);
+double windowMax(WindowStats* w, int home);
+
+#ifdef __cplusplus
+} // closing brace for extern "C"
+#endif
+#endif // WINDOW_STATS_H
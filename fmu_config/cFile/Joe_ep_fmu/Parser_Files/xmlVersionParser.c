@@ -46,10 +46,9 @@ static char *extractFmiVersionAttribute(xmlTextReaderPtr xmlReader) {
 }
 
 // The receiver must free the return.
-static char *streamFile(const char *xmlPath) {
-    xmlTextReaderPtr xmlReader;
+// Frees xmlReader.
+static char *streamReader(xmlTextReaderPtr xmlReader, const char *xmlPath) {
     char *fmiVersion = NULL;
-    xmlReader = xmlReaderForFile(xmlPath, NULL, 0);
     if (xmlReader != NULL) {
         if (readNextInXml(xmlReader)) {
             // I expect that first element is fmiModelDescription.
@@ -69,14 +68,31 @@ static char *streamFile(const char *xmlPath) {
     return fmiVersion;
 }
 
+// The receiver must free the return.
+static char *streamFile(const char *xmlPath) {
+    return streamReader(xmlReaderForFile(xmlPath, NULL, 0), xmlPath);
+}
+
 // Returns NULL to indicate failure
 // Otherwise, return the version of this FMU.
 // The receiver must free the returned string.
+// Safe to call from several threads at once: xmlInitParser may be called
+// repeatedly, but xmlCleanupParser would release global libxml2 state still
+// used by other threads, see cleanupVersionParser.
 char *extractVersion(const char *xmlDescriptionPath) {
-    char *fmiVersion;
+    xmlInitParser();
+    return streamFile(xmlDescriptionPath);
+}
 
+// Same as extractVersion, for a model description already in memory.
+// name is used in messages only.
+char *extractVersionFromBuffer(const char *name, const char *buffer, long size) {
     xmlInitParser();
-    fmiVersion = streamFile(xmlDescriptionPath);
+    return streamReader(xmlReaderForMemory(buffer, (int)size, name, NULL, 0), name);
+}
+
+// Release global memory of libxml2.
+// Call once, after the last call of extractVersion.
+void cleanupVersionParser(void) {
     xmlCleanupParser();
-    return fmiVersion;
 }
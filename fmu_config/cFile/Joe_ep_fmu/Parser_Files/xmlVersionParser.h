@@ -20,6 +20,8 @@ extern "C" {
 #pragma comment(lib, "wsock32.lib")
 
 char *extractVersion(const char *xmlDescriptionPath);
+char *extractVersionFromBuffer(const char *name, const char *buffer, long size);
+void cleanupVersionParser(void);
 
 #ifdef __cplusplus
 } // closing brace for extern "C"
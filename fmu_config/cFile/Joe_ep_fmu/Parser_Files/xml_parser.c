@@ -34,6 +34,7 @@
 #endif // STANDALONE_XML_PARSER
 
 #include "xml_parser.h"
+#include "thread_support.h" // THREAD_LOCAL
 
 const char *elmNames[SIZEOF_ELM] = {
     "fmiModelDescription","UnitDefinitions","BaseUnit","DisplayUnitDefinition","TypeDefinitions",
@@ -59,12 +60,15 @@ const char *enuNames[SIZEOF_ENU] = {
     "input","output", "internal","none","noAlias","alias","negatedAlias"
 };
 
-#define XMLBUFSIZE 1024
-char text[XMLBUFSIZE];       // XML file is parsed in chunks of length XMLBUFZIZE
-XML_Parser parser = NULL;    // non-NULL during parsing
-Stack* stack = NULL;         // the parser stack
-char* data = NULL;           // buffer that holds element content, see handleData
-int skipData=0;              // 1 to ignore element content, 0 when recording content
+// The parser state is thread local, so that several threads
+// can parse model descriptions of different FMUs at the same time.
+// A suspended parse keeps this state in its ParseSession.
+#define XMLBUFSIZE 1024                       // XML file is parsed in chunks of length XMLBUFZIZE
+static THREAD_LOCAL XML_Parser parser = NULL; // non-NULL during parsing
+static THREAD_LOCAL Stack* stack = NULL;      // the parser stack
+static THREAD_LOCAL char* data = NULL;        // buffer that holds element content, see handleData
+static THREAD_LOCAL int skipData=0;           // 1 to ignore element content, 0 when recording content
+static THREAD_LOCAL int elementBudget=0;      // elements until the parser suspends, 0 for no limit
 
 // -------------------------------------------------------------------------
 // Low-level functions for inspecting the model description 
@@ -692,7 +696,9 @@ static void XMLCALL endElement(void *context, const char *elm) {
     }
     // All children of el removed from the stack.
     // The top element must be of type el now.
-    checkPeek(el);
+    if (!checkPeek(el)) return;
+    // suspend the parser if this parse step has used up its budget
+    if (elementBudget > 0 && --elementBudget == 0) XML_StopParser(parser, XML_TRUE);
 }
 
 // Called to handle element data, e.g. "xy" in <Name>xy</Name>
@@ -863,55 +869,205 @@ ModelDescription* validate(ModelDescription* md) {
 }
 
 // -------------------------------------------------------------------------
-// Entry function parse() of the XML parser 
+// Entry functions of the XML parser: parse() and the resumable
+// parseBegin(), parseStep(), parseEnd()
+
+struct ParseSession {
+    char* xmlPath;
+    FILE* file;           // input of parseBegin
+    const char* buffer;   // input of parseBuffer
+    long size;
+    long position;        // bytes of buffer parsed
+    XML_Parser parser;
+    Stack* stack;
+    char* data;
+    int skipData;
+    int final;            // 1 after the last chunk of the file was read
+    int suspended;        // 1 if the parser was suspended by the element budget
+    ParseStatus status;
+    ModelDescription* md; // the result, when status is parseDone
+};
+
+// Make the state of session s the parser state of this thread,
+// and keep the previous state in saved.
+static void bindSession(ParseSession* s, ParseSession* saved) {
+    saved->parser = parser;
+    saved->stack = stack;
+    saved->data = data;
+    saved->skipData = skipData;
+    parser = s->parser;
+    stack = s->stack;
+    data = s->data;
+    skipData = s->skipData;
+}
 
-static void cleanup(FILE *file) {
-    stackFree(stack);
-    stack = NULL;
-    XML_ParserFree(parser);
-    parser = NULL;
-    fclose(file);
+// Store the parser state of this thread in session s,
+// and restore the state kept in saved.
+static void unbindSession(ParseSession* s, ParseSession* saved) {
+    s->parser = parser;
+    s->stack = stack;
+    s->data = data;
+    s->skipData = skipData;
+    parser = saved->parser;
+    stack = saved->stack;
+    data = saved->data;
+    skipData = saved->skipData;
+}
+
+// Release everything but the session itself and the result s->md
+static void cleanup(ParseSession* s) {
+    if (s->stack) {
+        while (!stackIsEmpty(s->stack)) freeElement(stackPop(s->stack));
+        stackFree(s->stack);
+        s->stack = NULL;
+    }
+    if (s->parser) {
+        XML_ParserFree(s->parser);
+        s->parser = NULL;
+    }
+    if (s->file) {
+        fclose(s->file);
+        s->file = NULL;
+    }
+    free(s->data);
+    s->data = NULL;
 }
 
 // Returns NULL to indicate failure
-// Otherwise, return the root node md of the AST.
-// The receiver must call freeElement(md) to release AST memory.
-ModelDescription* parse(const char* xmlPath) {
-    ModelDescription* md = NULL;
-    FILE *file;
-    int done = 0;
-    stack = stackNew(100, 10);
-    if (!checkPointer(stack)) return NULL; // failure
-    parser = XML_ParserCreate(NULL);
-    if (!checkPointer(parser)) return NULL; // failure
-    XML_SetElementHandler(parser, startElement, endElement);
-    XML_SetCharacterDataHandler(parser, handleData);
-    file = fopen(xmlPath, "rb");
-    if (file == NULL) {
+static ParseSession* newSession(const char* xmlPath) {
+    ParseSession* s = (ParseSession*)calloc(1, sizeof(ParseSession));
+    if (!checkPointer(s)) return NULL; // failure
+    s->status = parseInProgress;
+    s->xmlPath = strdup(xmlPath);
+    s->stack = stackNew(100, 10);
+    s->parser = XML_ParserCreate(NULL);
+    if (!checkPointer(s->xmlPath) || !checkPointer(s->stack) || !checkPointer(s->parser)) {
+        cleanup(s);
+        free(s->xmlPath);
+        free(s);
+        return NULL; // failure
+    }
+    XML_SetElementHandler(s->parser, startElement, endElement);
+    XML_SetCharacterDataHandler(s->parser, handleData);
+    return s;
+}
+
+// Returns NULL to indicate failure.
+// Otherwise, returns a session for use with parseStep and parseEnd.
+ParseSession* parseBegin(const char* xmlPath) {
+    ParseSession* s = newSession(xmlPath);
+    if (!s) return NULL; // failure
+    s->file = fopen(xmlPath, "rb");
+    if (s->file == NULL) {
         logThis(ERROR_ERROR, "Cannot open file '%s'", xmlPath);
-        XML_ParserFree(parser);
+        cleanup(s);
+        free(s->xmlPath);
+        free(s);
         return NULL; // failure
     }
     logThis(ERROR_INFO, "parse %s", xmlPath);
-    while (!done) {
-        int n = fread(text, sizeof(char), XMLBUFSIZE, file);
-        if (n != XMLBUFSIZE) done = 1;
-        if (!XML_Parse(parser, text, n, done)){
+    return s;
+}
+
+// Continue the parse of session s. Returns after about maxBytes of input
+// or after maxElements elements were processed, or when the parse is
+// complete. 0 means no limit. A parse in progress can be continued in
+// any thread, but not by two threads at once.
+// Returns parseInProgress, or the final state parseDone or parseFailed.
+ParseStatus parseStep(ParseSession* s, int maxBytes, int maxElements) {
+    ParseSession saved;
+    enum XML_Status status;
+    int nBytes = 0;
+    if (s->status != parseInProgress) return s->status;
+    bindSession(s, &saved);
+    elementBudget = maxElements > 0 ? maxElements : 0;
+    for (;;) {
+        if (s->suspended) {
+            s->suspended = 0;
+            status = XML_ResumeParser(parser);
+        } else if (s->buffer) {
+            // the whole buffer in one call, the element budget suspends the parser
+            int n = s->size - s->position;
+            s->final = 1;
+            nBytes += n;
+            status = XML_Parse(parser, s->buffer + s->position, n, s->final);
+            s->position += n;
+        } else {
+            int n;
+            void* buffer = XML_GetBuffer(parser, XMLBUFSIZE);
+            if (!checkPointer(buffer)) {
+                s->status = parseFailed;
+                break;
+            }
+            n = fread(buffer, sizeof(char), XMLBUFSIZE, s->file);
+            if (n != XMLBUFSIZE) s->final = 1;
+            nBytes += n;
+            status = XML_ParseBuffer(parser, n, s->final);
+        }
+        if (status == XML_STATUS_ERROR) {
             logThis(ERROR_ERROR, "Parse error in file %s at line %d:\n%s\n",
-                    xmlPath,
+                    s->xmlPath,
                     XML_GetCurrentLineNumber(parser),
                     XML_ErrorString(XML_GetErrorCode(parser)));
-            while (!stackIsEmpty(stack)) md = (ModelDescription *)stackPop(stack);
-            if (md) freeElement(md);
-            cleanup(file);
-            return NULL; // failure
+            s->status = parseFailed;
+            break;
+        }
+        if (status == XML_STATUS_SUSPENDED) {
+            s->suspended = 1;
+            break;
         }
+        if (s->final) {
+            ModelDescription* md = (ModelDescription *)stackPop(stack);
+            assert(stackIsEmpty(stack));
+            //printElement(1, md); // debug
+            s->md = validate(md); // success if all refs are valid
+            if (!s->md) freeElement(md);
+            s->status = s->md ? parseDone : parseFailed;
+            break;
+        }
+        if (maxBytes > 0 && nBytes >= maxBytes) break;
     }
-    md = (ModelDescription *)stackPop(stack);
-    assert(stackIsEmpty(stack));
-    cleanup(file);
-    //printElement(1, md); // debug
-    return validate(md); // success if all refs are valid
+    elementBudget = 0;
+    unbindSession(s, &saved);
+    if (s->status != parseInProgress) cleanup(s);
+    return s->status;
+}
+
+// Returns NULL to indicate failure, or if the parse is still in progress
+// Otherwise, return the root node md of the AST.
+// The receiver must call freeElement(md) to release AST memory.
+// Releases session s.
+ModelDescription* parseEnd(ParseSession* s) {
+    ModelDescription* md = s->md;
+    cleanup(s);
+    free(s->xmlPath);
+    free(s);
+    return md;
+}
+
+// Returns NULL to indicate failure
+// Otherwise, return the root node md of the AST.
+// The receiver must call freeElement(md) to release AST memory.
+// Parses size bytes of modelDescription.xml already in memory, e.g. read
+// by readFileBatch. name is used in messages only.
+ModelDescription* parseBuffer(const char* name, const char* buffer, long size) {
+    ParseSession* s = newSession(name);
+    if (!s) return NULL; // failure
+    s->buffer = buffer;
+    s->size = size;
+    logThis(ERROR_INFO, "parse %s", name);
+    parseStep(s, 0, 0);
+    return parseEnd(s);
+}
+
+// Returns NULL to indicate failure
+// Otherwise, return the root node md of the AST.
+// The receiver must call freeElement(md) to release AST memory.
+ModelDescription* parse(const char* xmlPath) {
+    ParseSession* s = parseBegin(xmlPath);
+    if (!s) return NULL; // failure
+    parseStep(s, 0, 0);
+    return parseEnd(s);
 }
 
 // #define TEST
@@ -144,8 +144,21 @@ typedef enum {
     valueIllegal
 } ValueStatus;
 
+// State of a parse that processes the input in several steps
+typedef struct ParseSession ParseSession;
+
+typedef enum {
+    parseInProgress,
+    parseDone,
+    parseFailed
+} ParseStatus;
+
 // Public methods: Parsing and low-level AST access
 ModelDescription* parse(const char* xmlPath);
+ModelDescription* parseBuffer(const char* name, const char* buffer, long size);
+ParseSession* parseBegin(const char* xmlPath);
+ParseStatus parseStep(ParseSession* s, int maxBytes, int maxElements);
+ModelDescription* parseEnd(ParseSession* s);
 const char* getString(void* element, Att a);
 double getDouble     (void* element, Att a, ValueStatus* vs);
 int getInt           (void* element, Att a, ValueStatus* vs);